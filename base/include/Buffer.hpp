@@ -21,6 +21,7 @@ public:
     vk::DeviceSize size;
     vk::BufferUsageFlags usage;
     vk::MemoryPropertyFlags mem_prop_flags;
+    vk::SharingMode sharing_mode;
     vk::Buffer buf;
     vk::MemoryRequirements mem_reqs{VK_NULL_HANDLE};
     vk::DeviceSize allocation_size{0};
@@ -40,7 +41,8 @@ public:
         p_dev_(p_dev),
         size(size),
         usage(usage),
-        mem_prop_flags(mem_prop_flags)
+        mem_prop_flags(mem_prop_flags),
+        sharing_mode(sharing_mode)
     {
         buf = p_dev->dev.createBuffer(vk::BufferCreateInfo({},
                                                            size,
@@ -154,12 +156,36 @@ inline void allocate_and_bind_buffer_memory(Physical_device* p_phy_dev,
     // this function does not unmap memory 
 }
 
+// a buffer written on one of the graphics and compute queues and read on the other,
+// concurrent when the queue families differ, in its own memory
+inline Buffer* create_shared_buffer(Physical_device* p_phy_dev,
+                                    Device* p_dev,
+                                    vk::DeviceMemory& mem,
+                                    const vk::DeviceSize& size,
+                                    const vk::BufferUsageFlags& usage,
+                                    const vk::MemoryPropertyFlags& mem_prop_flags)
+{
+    uint32_t queue_families[2] = {p_phy_dev->graphics_queue_family_idx, p_phy_dev->compute_queue_family_idx};
+    bool concurrent = queue_families[0] != queue_families[1];
+
+    auto* p_buf = new Buffer(p_dev,
+                             size,
+                             usage,
+                             mem_prop_flags,
+                             concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                             concurrent ? 2 : 0,
+                             queue_families);
+    p_buf->update_descriptor();
+    allocate_and_bind_buffer_memory(p_phy_dev, p_dev, mem, 1, &p_buf);
+    return p_buf;
+}
+
 static void update_host_visible_buffer_memory(
     Device* p_dev,
     Buffer* p_buffer,
     vk::DeviceMemory& mem, // mapped
     vk::DeviceSize data_size,
-    void* data,
+    const void* data,
     bool unmap = false)
 {
 
@@ -170,100 +196,8 @@ static void update_host_visible_buffer_memory(
     }
 
     assert(p_buffer->mapped);
-    memcpy(p_buffer->mapped, reinterpret_cast<uint8_t*>(data), data_size);
+    memcpy(p_buffer->mapped, reinterpret_cast<const uint8_t*>(data), data_size);
     if (unmap) p_dev->dev.unmapMemory(mem);
 }
-
-static void update_device_local_buffer_memory(
-    Physical_device* p_phy_dev,
-    Device* p_dev,
-    Buffer* p_buffer,
-    vk::DeviceMemory& mem,
-    vk::DeviceSize data_size,
-    void* data,
-    const vk::DeviceSize offset = 0,
-    const vk::PipelineStageFlags generating_stages = vk::PipelineStageFlags(),
-    const vk::PipelineStageFlags consuming_stages = vk::PipelineStageFlags(),
-    const vk::AccessFlags curr_access = vk::AccessFlags(),
-    const vk::AccessFlags new_access = vk::AccessFlags(),
-    const vk::CommandBuffer& cmd_buf = nullptr)
-{
-    assert((p_buffer->mem_prop_flags & vk::MemoryPropertyFlagBits::eDeviceLocal) == vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    // use staging buffer
-    auto p_staging_buf = new Buffer(p_dev,
-                                    data_size,
-                                    vk::BufferUsageFlagBits::eTransferSrc,
-                                    vk::MemoryPropertyFlagBits::eHostVisible |
-                                    vk::MemoryPropertyFlagBits::eHostCoherent );
-
-    // allocate and bind memory
-    vk::DeviceMemory staging_mem;
-    allocate_and_bind_buffer_memory(p_phy_dev,
-                                    p_dev,
-                                    staging_mem,
-                                    1, &p_staging_buf);
-
-    // write staging buffer with data
-    update_host_visible_buffer_memory(p_dev,
-                                      p_staging_buf,
-                                      staging_mem,
-                                      data_size, data);
-
-    // begin copy cmd buf
-    cmd_buf.begin(vk::CommandBufferBeginInfo(
-        vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
-
-    // change buf layout to transfer write
-    vk::BufferMemoryBarrier barrier(curr_access,
-                                    vk::AccessFlagBits::eTransferWrite,
-                                    0, 0,
-                                    p_buffer->buf,
-                                    0, VK_WHOLE_SIZE);
-    cmd_buf.pipelineBarrier(generating_stages,
-                            vk::PipelineStageFlagBits::eTransfer,
-                            vk::DependencyFlags(),
-                            0, nullptr,
-                            1, &barrier,
-                            0, nullptr);
-
-    // copy data from staging buf to buf
-    vk::BufferCopy region(0, offset, p_buffer->size);
-    cmd_buf.copyBuffer(p_staging_buf->buf, p_buffer->buf, 1, &region);
-
-    // change buf layout to final
-    barrier = vk::BufferMemoryBarrier(
-        vk::AccessFlagBits::eTransferWrite,
-        new_access,
-        0, 0,
-        p_buffer->buf,
-        0, VK_WHOLE_SIZE);
-    cmd_buf.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        consuming_stages,
-        vk::DependencyFlags(),
-        0, nullptr,
-        1, &barrier,
-        0, nullptr);
-
-    cmd_buf.end();
-
-    // submit and wait until done
-    const auto fence = p_dev->dev.createFence(
-        vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
-    assert_success(p_dev->dev.resetFences(1, &fence));
-    p_dev->graphics_queue.submit(
-        vk::SubmitInfo(0, nullptr,
-                       nullptr,
-                       1, &cmd_buf,
-                       0, nullptr),
-        fence);
-    assert_success(p_dev->dev.waitForFences(1, &fence, VK_TRUE, UINT64_MAX));
-
-    // cleanup
-    p_dev->dev.destroyFence(fence);
-    delete p_staging_buf;
-    p_dev->dev.freeMemory(staging_mem);
-}
 } // namespace base
 #undef MSG_PREFIX
\ No newline at end of file
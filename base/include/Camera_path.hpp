@@ -0,0 +1,114 @@
+#pragma once
+#include "Camera.hpp"
+#include <glm/glm.hpp>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iostream>
+#define MSG_PREFIX "-- CAMERA_PATH: "
+
+namespace base
+{
+// scripted camera keyframes for unattended runs
+// file format, one keyframe per line, '#' starts a comment:
+//   time eye_x eye_y eye_z target_x target_y target_z
+// keyframes are sorted by time, the path loops after the last one
+class Camera_path
+{
+public:
+    struct Keyframe
+    {
+        float time;
+        glm::vec3 eye_pos;
+        glm::vec3 target;
+    };
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << MSG_PREFIX << "cannot open " << path << std::endl;
+            return false;
+        }
+        keyframes_.clear();
+        std::string line;
+        while (std::getline(file, line)) {
+            auto comment = line.find('#');
+            if (comment != std::string::npos) line.erase(comment);
+            std::istringstream ss(line);
+            Keyframe key;
+            if (ss >> key.time >>
+                key.eye_pos.x >> key.eye_pos.y >> key.eye_pos.z >>
+                key.target.x >> key.target.y >> key.target.z) {
+                if (!keyframes_.empty() && key.time <= keyframes_.back().time) {
+                    std::cout << MSG_PREFIX << "keyframe times must increase, skipping t = " << key.time << std::endl;
+                    continue;
+                }
+                keyframes_.push_back(key);
+            }
+        }
+        std::cout << MSG_PREFIX << "loaded " << keyframes_.size() << " keyframes from " << path << std::endl;
+        return !keyframes_.empty();
+    }
+
+    // one revolution around target in duration seconds, keeping the eye height
+    void make_orbit(const glm::vec3 &eye_pos,
+                    const glm::vec3 &target,
+                    float duration,
+                    uint32_t keyframe_count = 32)
+    {
+        keyframes_.clear();
+        glm::vec3 offset = eye_pos - target;
+        float radius = glm::length(glm::vec2(offset.x, offset.z));
+        float angle = atan2f(offset.z, offset.x);
+        for (uint32_t i = 0; i <= keyframe_count; i++) {
+            float t = static_cast<float>(i) / static_cast<float>(keyframe_count);
+            float a = angle + t * 6.2831853f;
+            keyframes_.push_back({t * duration,
+                                 target + glm::vec3(radius * cosf(a), offset.y, radius * sinf(a)),
+                                 target});
+        }
+    }
+
+    bool empty() const
+    {
+        return keyframes_.empty();
+    }
+
+    float duration() const
+    {
+        return keyframes_.empty() ? 0.f : keyframes_.back().time;
+    }
+
+    // linear interpolation between the enclosing keyframes
+    void apply(float time, Camera *p_camera) const
+    {
+        if (keyframes_.empty()) return;
+        if (keyframes_.size() > 1 && duration() > 0.f) {
+            time = fmodf(time, duration());
+        }
+
+        size_t next = 0;
+        while (next < keyframes_.size() && keyframes_[next].time <= time) next++;
+        if (next == 0 || next == keyframes_.size()) {
+            const auto &key = next == 0 ? keyframes_.front() : keyframes_.back();
+            p_camera->eye_pos = key.eye_pos;
+            p_camera->target = key.target;
+        } else {
+            const auto &k0 = keyframes_[next - 1];
+            const auto &k1 = keyframes_[next];
+            float s = (time - k0.time) / (k1.time - k0.time);
+            p_camera->eye_pos = glm::mix(k0.eye_pos, k1.eye_pos, s);
+            p_camera->target = glm::mix(k0.target, k1.target, s);
+        }
+        p_camera->update();
+    }
+
+private:
+    std::vector<Keyframe> keyframes_;
+};
+} // namespace base
+
+#undef MSG_PREFIX
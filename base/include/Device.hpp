@@ -1,6 +1,7 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include "Physical_device.hpp"
+#include <set>
 
 namespace base
 {
@@ -11,35 +12,28 @@ public:
     vk::Queue graphics_queue;
     vk::Queue compute_queue;
     vk::Queue present_queue;
+    vk::Queue transfer_queue;
 
     explicit Device(Physical_device* p_phy_dev) :
         p_phy_dev_(p_phy_dev)
     {
-        uint32_t queue_count = 1;
-        const std::vector<float> queue_priorities(queue_count, 0.f);
+        // graphics, compute, present and transfer queues may or may not be the same,
+        // one queue of each distinct family
+        const std::set<uint32_t> queue_families{p_phy_dev->graphics_queue_family_idx,
+                                                p_phy_dev->compute_queue_family_idx,
+                                                p_phy_dev->present_queue_family_idx,
+                                                p_phy_dev->transfer_queue_family_idx};
+        const float queue_priority = 0.f;
         std::vector<vk::DeviceQueueCreateInfo> dev_queue_infos;
-        // graphics queue
-        dev_queue_infos.push_back({{},
-                                  p_phy_dev->graphics_queue_family_idx,
-                                  1,
-                                  queue_priorities.data()});
-        // graphics, compute, presant queues may or may not be the same
-        if (p_phy_dev->graphics_queue_family_idx != p_phy_dev->compute_queue_family_idx) {
+        for (auto family : queue_families) {
             dev_queue_infos.push_back({{},
-                                      p_phy_dev->compute_queue_family_idx,
+                                      family,
                                       1,
-                                      queue_priorities.data()});
-        }
-        if (p_phy_dev->graphics_queue_family_idx != p_phy_dev->present_queue_family_idx) {
-            dev_queue_infos.push_back({{},
-                                      p_phy_dev->present_queue_family_idx,
-                                      1,
-                                      queue_priorities.data()});
-            queue_count++;
+                                      &queue_priority});
         }
 
         dev = p_phy_dev->phy_dev.createDevice(vk::DeviceCreateInfo({},
-                                                                   queue_count,
+                                                                   static_cast<uint32_t>(dev_queue_infos.size()),
                                                                    dev_queue_infos.data(),
                                                                    0,
                                                                    nullptr,
@@ -49,6 +43,7 @@ public:
         graphics_queue = dev.getQueue(p_phy_dev->graphics_queue_family_idx, 0);
         compute_queue = dev.getQueue(p_phy_dev->compute_queue_family_idx, 0);
         present_queue = dev.getQueue(p_phy_dev->present_queue_family_idx, 0);
+        transfer_queue = dev.getQueue(p_phy_dev->transfer_queue_family_idx, 0);
     }
 
     ~Device()
@@ -56,6 +51,7 @@ public:
         graphics_queue = nullptr;
         compute_queue = nullptr;
         present_queue = nullptr;
+        transfer_queue = nullptr;
         dev.waitIdle();
         dev.destroy();
     }
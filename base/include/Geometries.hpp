@@ -1,75 +1,18 @@
 #pragma once
 #include "Aabb.hpp"
+#include "Mesh_packer.hpp"
 #include "Physical_device.hpp"
 #include "Device.hpp"
 #include "Buffer.hpp"
+#include "Upload_manager.hpp"
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <vector>
+#include <cfloat>
+#define MSG_PREFIX "-- GEOMETRIES: "
 
 namespace base
 {
-typedef enum Vertex_component
-{
-    VERT_COMP_VEC4,
-    VERT_COMP_COLOR3,
-    VERT_COMP_POSITION,
-    VERT_COMP_NORMAL,
-    VERT_COMP_TANGENT,
-    VERT_COMP_BITANGENT,
-    VERT_COMP_UV,
-    VERT_COMP_FLOAT
-} Vertex_component;
-
-struct Vertex_layout
-{
-    std::vector<Vertex_component> comps;
-
-    Vertex_layout() = default;
-
-    explicit Vertex_layout(const std::vector<Vertex_component> &comps) :
-        comps(comps)
-    {}
-
-    explicit Vertex_layout(Vertex_component comp) {
-        comps.emplace_back(comp);
-    }
-
-    uint32_t get_stride()
-    {
-        uint32_t res = 0;
-        for (auto &comp : comps) {
-            switch (comp) {
-                case VERT_COMP_VEC4:res += 4 * sizeof(float);
-                    break;
-                case VERT_COMP_POSITION:
-                case VERT_COMP_NORMAL:
-                case VERT_COMP_TANGENT:
-                case VERT_COMP_BITANGENT:
-                case VERT_COMP_COLOR3:res += 3 * sizeof(float);
-                    break;
-                case VERT_COMP_UV:res += 2 * sizeof(float);
-                    break;
-                case VERT_COMP_FLOAT:res += sizeof(float);
-                    break;
-                default:
-                    break;
-            }
-        }
-        return res;
-    }
-};
-
-struct Mesh
-{
-    uint32_t material_idx;
-    uint32_t idx_base;
-    uint32_t idx_count;
-    int32_t vert_offset;
-    glm::vec4 min;
-    glm::vec4 max;
-};
-
 class Geometries
 {
 public:
@@ -87,6 +30,39 @@ public:
     uint32_t vi_bind_id{0};
 
     std::vector<Mesh> meshes{};
+    // scene mesh index to its index in meshes after init from a scene,
+    // meshes with the same vertices and indices share one
+    std::vector<uint32_t> mesh_remap{};
+
+    // the packed vertices and indices stay in host_vertices and host_indices
+    // after init from a scene when set, e.g. to write them to a cache
+    bool keep_host_data{false};
+    std::vector<float> host_vertices{};
+    std::vector<uint32_t> host_indices{};
+
+    // init from a scene reorders the triangles of every mesh for the vertex
+    // cache and overdraw, then its vertices for fetch locality, see Mesh_optimizer
+    bool optimize_meshes{false};
+    std::vector<Mesh_cache_stats> mesh_cache_stats{};
+
+    // init from a scene adds up to lod_count simplified levels to every mesh,
+    // in the index buffer after the full meshes, see Mesh_simplifier
+    uint32_t lod_count{0};
+    // MAX_MESH_LODS per mesh, filled in by the caller after init_packed
+    std::vector<Mesh_lod> mesh_lods{};
+
+    // the clusters of every mesh after init from a scene, those of mesh m
+    // are cluster_offsets[m] to cluster_offsets[m + 1], see Mesh_clusters
+    std::vector<Mesh_cluster> clusters{};
+    std::vector<uint32_t> cluster_offsets{};
+
+    // init_packed uploads the positions once more, tightly packed in
+    // p_pos_buffer, for passes reading nothing else
+    bool position_stream{false};
+    Buffer *p_pos_buffer{nullptr};
+    vk::DeviceMemory pos_buffer_mem;
+    vk::VertexInputBindingDescription pos_vi_binding;
+    std::vector<vk::VertexInputAttributeDescription> pos_vi_attribs;
 
     Geometries(Physical_device *p_phy_dev,
                Device *p_dev,
@@ -102,147 +78,70 @@ public:
     {
         p_dev_->dev.freeMemory(vert_buffer_mem);
         p_dev_->dev.freeMemory(idx_buffer_mem);
+        p_dev_->dev.freeMemory(pos_buffer_mem);
         delete p_vert_buffer;
         delete p_idx_buffer;
+        delete p_pos_buffer;
     }
 
+    // meshes are packed concurrently by p_jobs when given, see pack_meshes
     void init(const aiScene *p_scene,
-              vk::CommandBuffer cmd_buffer)
+              Upload_manager &uploads,
+              Job_system *p_jobs = nullptr)
     {
+        Packed_meshes packed;
+        pack_meshes(p_scene, vertex_layout, optimize_meshes, lod_count, p_jobs, packed);
+        init_(packed, uploads);
+    }
 
-        std::vector<float> vdata;
-        std::vector<uint32_t> idata;
-
-        uint32_t idx_base = 0;
-        int32_t vert_offset = 0;
-
-        for (uint32_t m = 0; m < p_scene->mNumMeshes; m++) {
-            auto p_mesh = p_scene->mMeshes[m];
-
-            glm::vec3 min{FLT_MAX};
-            glm::vec3 max(FLT_MIN);
-
-            bool has_color = p_mesh->HasVertexColors(0);
-            bool has_normal = p_mesh->HasNormals();
-            bool has_uv = p_mesh->HasTextureCoords(0);
-            bool has_tangent = p_mesh->HasTangentsAndBitangents();
-
-            for (uint32_t v = 0; v < p_mesh->mNumVertices; v++) {
-                for (auto &comp : vertex_layout.comps) {
-                    switch (comp) {
-                        case VERT_COMP_POSITION:
-                        {
-                            float x = (p_mesh->mVertices[v].x);
-                            float y = (p_mesh->mVertices[v].y);
-                            float z = (p_mesh->mVertices[v].z);
-                            vdata.push_back(x);
-                            vdata.push_back(y);
-                            vdata.push_back(z);
-                            min.x = std::min(x, min.x);
-                            min.y = std::min(y, min.y);
-                            min.z = std::min(z, min.z);
-                            max.x = std::max(x, max.x);
-                            max.y = std::max(y, max.y);
-                            max.z = std::max(z, max.z);
-                        }
-                        break;
-                        case VERT_COMP_NORMAL:
-                        {
-                            assert(has_normal);
-                            vdata.push_back(p_mesh->mNormals[v].x);
-                            vdata.push_back(p_mesh->mNormals[v].y);
-                            vdata.push_back(p_mesh->mNormals[v].z);
-                        }
-                        break;
-                        case VERT_COMP_UV:
-                        {
-                            assert(has_uv);
-                            aiVector3D pTexCoord = p_mesh->mTextureCoords[0][v];
-                            vdata.push_back(pTexCoord.x);
-                            vdata.push_back(pTexCoord.y);
-                        }
-                        break;
-                        case VERT_COMP_COLOR3:
-                            if (has_color) {
-                                vdata.push_back(p_mesh->mColors[v]->r);
-                                vdata.push_back(p_mesh->mColors[v]->g);
-                                vdata.push_back(p_mesh->mColors[v]->b);
-                            } else {
-                                vdata.push_back(1.f);
-                                vdata.push_back(1.f);
-                                vdata.push_back(1.f);
-                            }
-                            break;
-                        case VERT_COMP_TANGENT:
-                        {
-                            assert(has_tangent);
-                            vdata.push_back(p_mesh->mTangents[v].x);
-                            vdata.push_back(p_mesh->mTangents[v].y);
-                            vdata.push_back(p_mesh->mTangents[v].z);
-                        }
-                        break;
-                        case VERT_COMP_BITANGENT:
-                        {
-                            assert(has_tangent);
-                            vdata.push_back(p_mesh->mBitangents[v].x);
-                            vdata.push_back(p_mesh->mBitangents[v].y);
-                            vdata.push_back(p_mesh->mBitangents[v].z);
-                        }
-                        break;
-                        case VERT_COMP_VEC4:
-                        {
-                            // to be implemented in child class
-                            vdata.push_back(0.f);
-                            vdata.push_back(0.f);
-                            vdata.push_back(0.f);
-                            vdata.push_back(0.f);
-                        }
-                        break;
-                        case VERT_COMP_FLOAT:
-                        {
-                            // to be implemented in child class
-                            vdata.push_back(0.f);
-                        }
-                        break;
-                        default:throw std::runtime_error("Invalid vertex component.");
-                    } // switch component
-                } // loop components
-            } // loop vertices 
-
-            for (uint32_t f = 0; f < p_mesh->mNumFaces; f++) {
-                for (uint32_t j = 0; j < 3; j++) { // triangulated
-                    idata.emplace_back(p_mesh->mFaces[f].mIndices[j]);
-                }
-            }
-            uint32_t idx_count = 3 * p_mesh->mNumFaces;// triangulated
-            meshes.push_back({p_mesh->mMaterialIndex,
-                             idx_base,
-                             idx_count,
-                             vert_offset,
-                             glm::vec4(min, 1.f),
-                             glm::vec4(max, 1.f)});
-            vert_offset += p_mesh->mNumVertices;
-            idx_base += idx_count;
-        } // loop meshes
-
-        indices = static_cast<uint32_t>(idata.size());
+    // the same from meshes loaded without assimp, e.g. a Gltf_scene
+    void init(const std::vector<Mesh_source> &sources,
+              Upload_manager &uploads,
+              Job_system *p_jobs = nullptr)
+    {
+        Packed_meshes packed;
+        pack_meshes(sources, vertex_layout, optimize_meshes, lod_count, p_jobs, packed);
+        init_(packed, uploads);
+    }
+
+    // uploads vertices packed as vertex_layout and their indices, the
+    // data is staged before returning, meshes are filled in by the caller
+    void init_packed(const void *p_vert_data,
+                     vk::DeviceSize vert_buf_size,
+                     const uint32_t *p_idx_data,
+                     uint32_t idx_count,
+                     Upload_manager &uploads)
+    {
+        indices = idx_count;
+
+        if (vertex_layout.unquantized().get_stride() != stride) {
+            vk::DeviceSize unquantized_size = vert_buf_size / stride * vertex_layout.unquantized().get_stride();
+            std::cout << MSG_PREFIX << "quantized vertices " << vert_buf_size << " bytes, saved " <<
+                unquantized_size - vert_buf_size << " of " << unquantized_size << " bytes" << std::endl;
+        }
 
         // attribute buffers
 
-        const vk::DeviceSize vert_buf_size = vdata.size() * sizeof(vdata[0]);
-        const vk::DeviceSize idx_buf_size = idata.size() * sizeof(idata[0]);
+        const vk::DeviceSize idx_buf_size = idx_count * sizeof(uint32_t);
 
-        // create device local buffers
+        // create device local buffers, storage buffers too for the
+        // compute passes reading triangles
         p_vert_buffer = new Buffer(p_dev_,
                                    vert_buf_size,
-                                   vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                   vk::BufferUsageFlagBits::eVertexBuffer |
+                                   vk::BufferUsageFlagBits::eStorageBuffer |
+                                   vk::BufferUsageFlagBits::eTransferDst,
                                    vk::MemoryPropertyFlagBits::eDeviceLocal,
                                    vk::SharingMode::eExclusive);
         p_idx_buffer = new Buffer(p_dev_,
                                   idx_buf_size,
-                                  vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                  vk::BufferUsageFlagBits::eIndexBuffer |
+                                  vk::BufferUsageFlagBits::eStorageBuffer |
+                                  vk::BufferUsageFlagBits::eTransferDst,
                                   vk::MemoryPropertyFlagBits::eDeviceLocal,
                                   vk::SharingMode::eExclusive);
+        p_vert_buffer->update_descriptor();
+        p_idx_buffer->update_descriptor();
 
         allocate_and_bind_buffer_memory(p_phy_dev_,
                                         p_dev_,
@@ -252,29 +151,20 @@ public:
                                         p_dev_,
                                         idx_buffer_mem, 1, &p_idx_buffer);
 
-        update_device_local_buffer_memory(
-            p_phy_dev_,
-            p_dev_,
-            p_vert_buffer,
-            vert_buffer_mem,
-            vert_buf_size,
-            vdata.data(), 0,
-            vk::PipelineStageFlagBits::eTopOfPipe,
-            vk::PipelineStageFlagBits::eVertexInput,
-            vk::AccessFlags(), vk::AccessFlagBits::eVertexAttributeRead,
-            cmd_buffer);
-
-        update_device_local_buffer_memory(
-            p_phy_dev_,
-            p_dev_,
-            p_idx_buffer,
-            idx_buffer_mem,
-            idx_buf_size,
-            idata.data(), 0,
-            vk::PipelineStageFlagBits::eTopOfPipe,
-            vk::PipelineStageFlagBits::eVertexInput,
-            vk::AccessFlags(), vk::AccessFlagBits::eIndexRead,
-            cmd_buffer);
+        uploads.upload_buffer(p_vert_buffer,
+                              vert_buf_size,
+                              p_vert_data, 0,
+                              vk::PipelineStageFlagBits::eVertexInput |
+                              vk::PipelineStageFlagBits::eComputeShader,
+                              vk::AccessFlagBits::eVertexAttributeRead |
+                              vk::AccessFlagBits::eShaderRead);
+        uploads.upload_buffer(p_idx_buffer,
+                              idx_buf_size,
+                              p_idx_data, 0,
+                              vk::PipelineStageFlagBits::eVertexInput |
+                              vk::PipelineStageFlagBits::eComputeShader,
+                              vk::AccessFlagBits::eIndexRead |
+                              vk::AccessFlagBits::eShaderRead);
 
         // vi bindings
         vi_binding = vk::VertexInputBindingDescription(0, stride, vk::VertexInputRate::eVertex);
@@ -316,12 +206,153 @@ public:
                                             offset);
                     offset += sizeof(float) * 4;
                     break;
+                case VERT_COMP_POSITION_UNORM16:
+                    vi_attribs.emplace_back(idx++,
+                                            vi_bind_id,
+                                            vk::Format::eR16G16B16A16Unorm,
+                                            offset);
+                    offset += sizeof(uint16_t) * 4;
+                    break;
+                case VERT_COMP_NORMAL_OCT16:
+                    vi_attribs.emplace_back(idx++,
+                                            vi_bind_id,
+                                            vk::Format::eR16G16Snorm,
+                                            offset);
+                    offset += sizeof(uint16_t) * 2;
+                    break;
+                case VERT_COMP_UV_HALF:
+                    vi_attribs.emplace_back(idx++,
+                                            vi_bind_id,
+                                            vk::Format::eR16G16Sfloat,
+                                            offset);
+                    offset += sizeof(uint16_t) * 2;
+                    break;
             }
         }
+
+        if (position_stream) init_position_stream_(p_vert_data, vert_buf_size / stride, uploads);
+    }
+
+    // byte offset of the positions in a vertex, false without them
+    bool position_offset(uint32_t &offset) const
+    {
+        for (size_t i = 0; i < vertex_layout.comps.size(); i++) {
+            if (vertex_layout.comps[i] == VERT_COMP_POSITION || vertex_layout.comps[i] == VERT_COMP_POSITION_UNORM16) {
+                offset = vi_attribs[i].offset;
+                return true;
+            }
+        }
+        return false;
     }
 
 private:
     Physical_device * p_phy_dev_;
     Device *p_dev_;
+
+    void init_(Packed_meshes &packed,
+               Upload_manager &uploads)
+    {
+        meshes = std::move(packed.meshes);
+        mesh_remap = std::move(packed.mesh_remap);
+        mesh_lods = std::move(packed.lods);
+        clusters = std::move(packed.clusters);
+        cluster_offsets = std::move(packed.cluster_offsets);
+        std::vector<float> &vdata = packed.vertices;
+        std::vector<uint32_t> &idata = packed.indices;
+        if (meshes.size() < mesh_remap.size()) {
+            std::cout << MSG_PREFIX << mesh_remap.size() - meshes.size() << " of " << mesh_remap.size() <<
+                " meshes share the geometry of another" << std::endl;
+        }
+        if (optimize_meshes) {
+            mesh_cache_stats = std::move(packed.cache_stats);
+            print_cache_stats_();
+        }
+        if (lod_count > 0) print_lods_();
+        std::cout << MSG_PREFIX << clusters.size() << " clusters of at most " << MAX_CLUSTER_TRIANGLES <<
+            " triangles" << std::endl;
+
+        init_packed(vdata.data(), vdata.size() * sizeof(vdata[0]),
+                    idata.data(), static_cast<uint32_t>(idata.size()),
+                    uploads);
+        if (keep_host_data) {
+            host_vertices = std::move(vdata);
+            host_indices = std::move(idata);
+        }
+    }
+
+    void init_position_stream_(const void *p_vert_data,
+                               vk::DeviceSize vert_count,
+                               Upload_manager &uploads)
+    {
+        auto &comps = vertex_layout.comps;
+        auto it = std::find_if(comps.begin(), comps.end(), [](Vertex_component comp) {
+            return comp == VERT_COMP_POSITION || comp == VERT_COMP_POSITION_UNORM16;
+        });
+        if (it == comps.end() || vert_count == 0) {
+            std::cout << MSG_PREFIX << "no positions, position stream disabled" << std::endl;
+            return;
+        }
+        const vk::VertexInputAttributeDescription &attrib = vi_attribs[it - comps.begin()];
+        const uint32_t pos_size = Vertex_layout(*it).get_stride();
+
+        std::vector<uint8_t> pdata(vert_count * pos_size);
+        auto p_src = static_cast<const uint8_t *>(p_vert_data) + attrib.offset;
+        for (vk::DeviceSize v = 0; v < vert_count; v++) {
+            memcpy(pdata.data() + v * pos_size, p_src + v * stride, pos_size);
+        }
+
+        p_pos_buffer = new Buffer(p_dev_,
+                                  pdata.size(),
+                                  vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                  vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                  vk::SharingMode::eExclusive);
+        allocate_and_bind_buffer_memory(p_phy_dev_,
+                                        p_dev_,
+                                        pos_buffer_mem, 1, &p_pos_buffer);
+        uploads.upload_buffer(p_pos_buffer,
+                              pdata.size(),
+                              pdata.data(), 0,
+                              vk::PipelineStageFlagBits::eVertexInput,
+                              vk::AccessFlagBits::eVertexAttributeRead);
+
+        pos_vi_binding = vk::VertexInputBindingDescription(vi_bind_id, pos_size, vk::VertexInputRate::eVertex);
+        pos_vi_attribs.emplace_back(0, vi_bind_id, attrib.format, 0);
+        std::cout << MSG_PREFIX << "position stream " << pdata.size() << " bytes, " <<
+            pos_size << " of " << stride << " bytes per vertex" << std::endl;
+    }
+
+    void print_lods_() const
+    {
+        uint64_t tri_counts[MAX_MESH_LODS] = {};
+        uint32_t simplified_meshes = 0;
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const Mesh_lod *p_lods = mesh_lods.data() + m * MAX_MESH_LODS;
+            for (uint32_t level = 0; level < MAX_MESH_LODS; level++) tri_counts[level] += p_lods[level].idx_count / 3;
+            if (p_lods[1].error > 0.f) simplified_meshes++;
+        }
+        std::cout << MSG_PREFIX << simplified_meshes << " of " << meshes.size() << " meshes simplified, triangles per level";
+        for (uint32_t level = 0; level < MAX_MESH_LODS; level++) std::cout << " " << tri_counts[level];
+        std::cout << std::endl;
+    }
+
+    void print_cache_stats_() const
+    {
+        auto add = [](Vertex_cache_stats &sum, const Vertex_cache_stats &stats) {
+            sum.misses += stats.misses;
+            sum.tri_count += stats.tri_count;
+            sum.vert_count += stats.vert_count;
+        };
+        Vertex_cache_stats total_before, total_after;
+        for (size_t m = 0; m < mesh_cache_stats.size(); m++) {
+            const Mesh_cache_stats &stats = mesh_cache_stats[m];
+            std::cout << MSG_PREFIX << "mesh " << m << " acmr " << stats.before.acmr() << " -> " <<
+                stats.after.acmr() << ", atvr " << stats.before.atvr() << " -> " << stats.after.atvr() << std::endl;
+            add(total_before, stats.before);
+            add(total_after, stats.after);
+        }
+        std::cout << MSG_PREFIX << "all meshes acmr " << total_before.acmr() << " -> " << total_after.acmr() <<
+            ", atvr " << total_before.atvr() << " -> " << total_after.atvr() << std::endl;
+    }
 };
 } // namespace base
+#undef MSG_PREFIX
@@ -0,0 +1,836 @@
+#pragma once
+#include "Json.hpp"
+#include "Meshopt_decoder.hpp"
+#include "Mesh_packer.hpp"
+#include "Job_system.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// loads glTF 2.0 (.gltf and .glb) scenes without assimp, triangle list
+// primitives become the meshes, in mesh and primitive order, and every node
+// with a mesh an instance of each of its primitives
+//
+// supported extensions:
+//   EXT_meshopt_compression  buffer views decoded on the worker threads
+//   KHR_mesh_quantization    integer attributes, normalized or not
+//   KHR_texture_transform    offset and scale of the base color uvs
+//   EXT_mesh_gpu_instancing  translation, rotation and scale per instance
+// sparse accessors and other required extensions fail the load
+//
+// the attributes are converted to the float arrays of Vertex_source, uvs
+// flipped to the lower left origin of the assimp import, missing normals
+// are generated from the triangles and missing uvs are 0
+
+namespace base
+{
+// one primitive, 3 floats per vertex for each attribute
+struct Gltf_mesh
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> uvs;
+    std::vector<uint32_t> indices;
+    uint32_t material_idx{0};
+};
+
+struct Gltf_instance
+{
+    glm::mat4 transform;
+    uint32_t mesh_idx;
+};
+
+// metallic roughness material, image uris relative to the scene file
+struct Gltf_material
+{
+    glm::vec4 base_color{1.f};
+    glm::vec3 emissive{0.f};
+    float metallic{1.f};
+    float roughness{1.f};
+    bool opaque{true};
+    std::string base_color_image{};
+    std::string normal_image{};
+    // KHR_texture_transform of the base color texture
+    glm::vec2 uv_offset{0.f};
+    glm::vec2 uv_scale{1.f};
+};
+
+class Gltf_scene
+{
+public:
+    std::vector<Gltf_mesh> meshes{};
+    std::vector<Gltf_instance> instances{};
+    std::vector<Gltf_material> materials{};
+    // triangle lists only, the other primitives are skipped
+    uint32_t skipped_primitives{0};
+    std::string error{};
+
+    static bool is_gltf_path(const std::string &path)
+    {
+        auto dot = path.find_last_of('.');
+        if (dot == std::string::npos) return false;
+        std::string ext = path.substr(dot + 1);
+        for (auto &c : ext) c = static_cast<char>(tolower(c));
+        return ext == "gltf" || ext == "glb";
+    }
+
+    // false and the error otherwise, the buffer views and the primitives
+    // are decoded concurrently by p_jobs when given
+    bool load(const std::string &path,
+              Job_system *p_jobs = nullptr)
+    {
+        auto slash = path.find_last_of("/\\");
+        dir_ = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        if (!read_file_(path, file_)) return fail_("cannot read " + path);
+        if (!parse_document_()) return false;
+        if (!check_uints_(doc_, "", false)) return false;
+        if (!check_extensions_()) return false;
+        if (!load_buffers_()) return false;
+        if (!load_views_(p_jobs)) return false;
+        if (!read_materials_()) return false;
+        if (!read_meshes_(p_jobs)) return false;
+        return read_nodes_();
+    }
+
+    // the meshes as sources of pack_meshes, valid while the scene is
+    std::vector<Mesh_source> mesh_sources() const
+    {
+        std::vector<Mesh_source> res(meshes.size());
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const Gltf_mesh &mesh = meshes[m];
+            res[m].vertices.vert_count = static_cast<uint32_t>(mesh.positions.size() / 3);
+            res[m].vertices.positions = mesh.positions.data();
+            res[m].vertices.normals = mesh.normals.data();
+            res[m].vertices.uvs = mesh.uvs.data();
+            res[m].indices = mesh.indices.data();
+            res[m].idx_count = static_cast<uint32_t>(mesh.indices.size());
+            res[m].material_idx = mesh.material_idx;
+        }
+        return res;
+    }
+
+private:
+    struct Span
+    {
+        const uint8_t *p_data;
+        size_t size;
+        size_t stride; // 0 for tightly packed
+    };
+
+    std::string dir_{};
+    std::vector<uint8_t> file_{};
+    Json doc_{};
+    Span bin_chunk_{nullptr, 0, 0};
+    // loaded buffers and decoded views, reserved up front, the views point into them
+    std::vector<std::vector<uint8_t>> owned_{};
+    std::vector<Span> buffers_{};
+    std::vector<Span> views_{};
+    // first mesh of every gltf mesh
+    std::vector<uint32_t> mesh_bases_{};
+
+    static const uint32_t GLB_MAGIC = 0x46546c67; // glTF
+    static const uint32_t GLB_CHUNK_JSON = 0x4e4f534a;
+    static const uint32_t GLB_CHUNK_BIN = 0x004e4942;
+    static const int MODE_TRIANGLES = 4;
+
+    bool fail_(const std::string &msg)
+    {
+        if (error.empty()) error = msg;
+        return false;
+    }
+
+    static bool read_file_(const std::string &path,
+                           std::vector<uint8_t> &res)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+        std::streamsize size = file.tellg();
+        file.seekg(0);
+        res.resize(static_cast<size_t>(size));
+        return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char *>(res.data()), size));
+    }
+
+    static uint32_t read_u32_(const uint8_t *p)
+    {
+        uint32_t res;
+        memcpy(&res, p, sizeof(res));
+        return res;
+    }
+
+    bool parse_document_()
+    {
+        const char *p_json = reinterpret_cast<const char *>(file_.data());
+        size_t json_size = file_.size();
+        if (file_.size() >= 12 && read_u32_(file_.data()) == GLB_MAGIC) {
+            if (read_u32_(file_.data() + 4) != 2) return fail_("unsupported glb version");
+            size_t length = std::min<size_t>(read_u32_(file_.data() + 8), file_.size());
+            json_size = 0;
+            for (size_t offset = 12; offset + 8 <= length;) {
+                size_t chunk_size = read_u32_(file_.data() + offset);
+                uint32_t chunk_type = read_u32_(file_.data() + offset + 4);
+                offset += 8;
+                if (chunk_size > length - offset) return fail_("glb chunk out of range");
+                if (chunk_type == GLB_CHUNK_JSON && json_size == 0) {
+                    p_json = reinterpret_cast<const char *>(file_.data() + offset);
+                    json_size = chunk_size;
+                } else if (chunk_type == GLB_CHUNK_BIN && !bin_chunk_.p_data) {
+                    bin_chunk_ = {file_.data() + offset, chunk_size, 0};
+                }
+                offset += (chunk_size + 3) & ~size_t(3);
+            }
+            if (json_size == 0) return fail_("glb without json chunk");
+        }
+        std::string json_error;
+        if (!Json::parse(p_json, json_size, doc_, json_error)) return fail_("invalid json, " + json_error);
+        if (doc_["asset"]["version"].as_string().compare(0, 2, "2.") != 0) return fail_("not a glTF 2.0 file");
+        return true;
+    }
+
+    // the indices, counts and offsets read with as_uint are non-negative
+    // integers, the numbers under these keys or in attributes objects
+    bool check_uints_(const Json &value, const std::string &key, bool is_uint)
+    {
+        static const char *uint_keys[] = {
+            "buffer", "bufferView", "byteLength", "byteOffset", "byteStride",
+            "children", "componentType", "count", "index", "indices",
+            "material", "mesh", "mode", "nodes", "scene", "source"
+        };
+        switch (value.type) {
+            case Json::TYPE_NUMBER:
+                if (is_uint && !value.is_uint()) return fail_("invalid " + key + ", not a non-negative integer");
+                return true;
+            case Json::TYPE_ARRAY:
+                for (auto &item : value.items) {
+                    if (!check_uints_(item, key, is_uint)) return false;
+                }
+                return true;
+            case Json::TYPE_OBJECT:
+                for (auto &member : value.members) {
+                    if (member.first == "extras") continue;
+                    bool member_uint = key == "attributes";
+                    for (auto p_key : uint_keys) member_uint |= member.first == p_key;
+                    if (!check_uints_(member.second, member.first, member_uint)) return false;
+                }
+                return true;
+            default:
+                return true;
+        }
+    }
+
+    bool check_extensions_()
+    {
+        const char *supported[] = {
+            "EXT_meshopt_compression",
+            "KHR_mesh_quantization",
+            "KHR_texture_transform",
+            "EXT_mesh_gpu_instancing",
+            "KHR_materials_emissive_strength"
+        };
+        for (auto &ext : doc_["extensionsRequired"].items) {
+            bool found = false;
+            for (auto p_name : supported) found |= ext.as_string() == p_name;
+            if (!found) return fail_("unsupported required extension " + ext.as_string());
+        }
+        return true;
+    }
+
+    static int hex_digit_(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // false for a % not followed by two hex digits
+    static bool percent_decode_(const std::string &uri, std::string &res)
+    {
+        res.clear();
+        for (size_t i = 0; i < uri.size(); i++) {
+            if (uri[i] != '%') {
+                res.push_back(uri[i]);
+                continue;
+            }
+            int hi = i + 2 < uri.size() ? hex_digit_(uri[i + 1]) : -1;
+            int lo = i + 2 < uri.size() ? hex_digit_(uri[i + 2]) : -1;
+            if (hi < 0 || lo < 0) return false;
+            res.push_back(static_cast<char>(hi * 16 + lo));
+            i += 2;
+        }
+        return true;
+    }
+
+    static bool decode_base64_(const std::string &text,
+                               size_t offset,
+                               std::vector<uint8_t> &res)
+    {
+        uint32_t bits = 0;
+        int bit_count = 0;
+        for (size_t i = offset; i < text.size() && text[i] != '='; i++) {
+            char c = text[i];
+            int v;
+            if (c >= 'A' && c <= 'Z') v = c - 'A';
+            else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') v = c - '0' + 52;
+            else if (c == '+') v = 62;
+            else if (c == '/') v = 63;
+            else return false;
+            bits = (bits << 6) | static_cast<uint32_t>(v);
+            bit_count += 6;
+            if (bit_count >= 8) {
+                bit_count -= 8;
+                res.push_back(static_cast<uint8_t>(bits >> bit_count));
+            }
+        }
+        return true;
+    }
+
+    bool load_buffers_()
+    {
+        const Json &buffers = doc_["buffers"];
+        owned_.reserve(buffers.size() + doc_["bufferViews"].size());
+        for (size_t b = 0; b < buffers.size(); b++) {
+            const Json &buffer = buffers.at(b);
+            const size_t byte_length = buffer["byteLength"].as_uint();
+            const std::string &uri = buffer["uri"].as_string();
+            if (!buffer.has("uri")) {
+                // the glb chunk, or the fallback of compressed views
+                if (b == 0 && bin_chunk_.p_data) {
+                    if (bin_chunk_.size < byte_length) return fail_("glb buffer out of range");
+                    buffers_.push_back(bin_chunk_);
+                } else {
+                    buffers_.push_back({nullptr, 0, 0});
+                }
+                continue;
+            }
+            if (buffer["extensions"]["EXT_meshopt_compression"]["fallback"].as_bool()) {
+                buffers_.push_back({nullptr, 0, 0});
+                continue;
+            }
+            owned_.emplace_back();
+            std::vector<uint8_t> &data = owned_.back();
+            std::string path;
+            if (uri.compare(0, 5, "data:") == 0) {
+                auto comma = uri.find(";base64,");
+                if (comma == std::string::npos || !decode_base64_(uri, comma + 8, data))
+                    return fail_("unsupported data uri of buffer " + std::to_string(b));
+            } else if (!percent_decode_(uri, path)) {
+                return fail_("invalid uri of buffer " + std::to_string(b));
+            } else if (!read_file_(dir_ + path, data)) {
+                return fail_("cannot read buffer " + dir_ + uri);
+            }
+            if (data.size() < byte_length) return fail_("buffer " + uri + " shorter than its byte length");
+            buffers_.push_back({data.data(), byte_length, 0});
+        }
+        return true;
+    }
+
+    // the views referenced by the accessors of the triangle lists and the
+    // instancing attributes, the others are not decoded
+    std::vector<bool> used_views_() const
+    {
+        std::vector<bool> res(doc_["bufferViews"].size(), false);
+        auto use = [&](const Json &accessor_idx) {
+            const Json &accessor = doc_["accessors"].at(accessor_idx.as_uint(UINT32_MAX));
+            uint32_t view = accessor["bufferView"].as_uint(UINT32_MAX);
+            if (view < res.size()) res[view] = true;
+        };
+        for (auto &mesh : doc_["meshes"].items) {
+            for (auto &prim : mesh["primitives"].items) {
+                if (prim["mode"].as_int(MODE_TRIANGLES) != MODE_TRIANGLES) continue;
+                use(prim["indices"]);
+                use(prim["attributes"]["POSITION"]);
+                use(prim["attributes"]["NORMAL"]);
+                use(prim["attributes"]["TEXCOORD_0"]);
+            }
+        }
+        for (auto &node : doc_["nodes"].items) {
+            for (auto &attrib : node["extensions"]["EXT_mesh_gpu_instancing"]["attributes"].members) {
+                use(attrib.second);
+            }
+        }
+        return res;
+    }
+
+    bool load_views_(Job_system *p_jobs)
+    {
+        const Json &views = doc_["bufferViews"];
+        const uint32_t view_count = static_cast<uint32_t>(views.size());
+        views_.assign(view_count, {nullptr, 0, 0});
+        std::vector<bool> used = used_views_();
+
+        // storage of the compressed views, allocated before decoding in parallel
+        std::vector<uint32_t> compressed;
+        std::vector<std::vector<uint8_t> *> decoded(view_count, nullptr);
+        for (uint32_t v = 0; v < view_count; v++) {
+            const Json &view = views.at(v);
+            const Json &ext = view["extensions"]["EXT_meshopt_compression"];
+            if (ext.type == Json::TYPE_OBJECT) {
+                if (!used[v]) continue;
+                owned_.emplace_back(static_cast<size_t>(ext["count"].as_uint()) * ext["byteStride"].as_uint());
+                decoded[v] = &owned_.back();
+                compressed.push_back(v);
+                continue;
+            }
+            uint32_t buffer = view["buffer"].as_uint(UINT32_MAX);
+            size_t offset = view["byteOffset"].as_uint();
+            size_t length = view["byteLength"].as_uint();
+            if (buffer >= buffers_.size()) return fail_("invalid buffer of view " + std::to_string(v));
+            const Span &src = buffers_[buffer];
+            if (!src.p_data) {
+                if (used[v]) return fail_("view " + std::to_string(v) + " of a fallback buffer");
+                continue;
+            }
+            if (offset > src.size || length > src.size - offset)
+                return fail_("view " + std::to_string(v) + " out of range");
+            views_[v] = {src.p_data + offset, length, view["byteStride"].as_uint()};
+        }
+
+        std::vector<uint8_t> failed(compressed.size(), 0);
+        parallel_for(p_jobs, static_cast<uint32_t>(compressed.size()), [&](uint32_t i) {
+            failed[i] = !decode_view_(compressed[i], *decoded[compressed[i]]);
+        });
+        for (size_t i = 0; i < compressed.size(); i++) {
+            if (failed[i]) return fail_("cannot decode compressed view " + std::to_string(compressed[i]));
+            const Json &ext = views.at(compressed[i])["extensions"]["EXT_meshopt_compression"];
+            const std::vector<uint8_t> &data = *decoded[compressed[i]];
+            views_[compressed[i]] = {data.data(), data.size(), ext["byteStride"].as_uint()};
+        }
+        return true;
+    }
+
+    bool decode_view_(uint32_t v,
+                      std::vector<uint8_t> &res) const
+    {
+        const Json &ext = doc_["bufferViews"].at(v)["extensions"]["EXT_meshopt_compression"];
+        uint32_t buffer = ext["buffer"].as_uint(UINT32_MAX);
+        size_t offset = ext["byteOffset"].as_uint();
+        size_t length = ext["byteLength"].as_uint();
+        size_t stride = ext["byteStride"].as_uint();
+        size_t count = ext["count"].as_uint();
+        if (buffer >= buffers_.size() || !buffers_[buffer].p_data) return false;
+        const Span &src = buffers_[buffer];
+        if (offset > src.size || length > src.size - offset) return false;
+        const uint8_t *p_src = src.p_data + offset;
+
+        const std::string &mode = ext["mode"].as_string();
+        bool ok;
+        if (mode == "ATTRIBUTES") ok = meshopt::decode_vertex_buffer(res.data(), count, stride, p_src, length);
+        else if (mode == "TRIANGLES") ok = meshopt::decode_index_buffer(res.data(), count, stride, p_src, length);
+        else if (mode == "INDICES") ok = meshopt::decode_index_sequence(res.data(), count, stride, p_src, length);
+        else ok = false;
+        if (!ok) return false;
+
+        const std::string &filter = ext["filter"].as_string();
+        if (filter.empty() || filter == "NONE") return true;
+        if (filter == "OCTAHEDRAL") {
+            if (stride == 4) meshopt::filter_octahedral(reinterpret_cast<int8_t *>(res.data()), count);
+            else if (stride == 8) meshopt::filter_octahedral(reinterpret_cast<int16_t *>(res.data()), count);
+            else return false;
+            return true;
+        }
+        if (filter == "EXPONENTIAL" && stride % 4 == 0) {
+            meshopt::filter_exponential(reinterpret_cast<uint32_t *>(res.data()), count * stride / 4);
+            return true;
+        }
+        return false; // QUATERNION is used by animations only
+    }
+
+    static uint32_t component_count_(const std::string &type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    static size_t component_size_(uint32_t component_type)
+    {
+        switch (component_type) {
+            case 5120: // byte
+            case 5121:return 1; // unsigned byte
+            case 5122: // short
+            case 5123:return 2; // unsigned short
+            case 5125: // unsigned int
+            case 5126:return 4; // float
+            default:return 0;
+        }
+    }
+
+    static float read_component_(const uint8_t *p,
+                                 uint32_t component_type,
+                                 bool normalized)
+    {
+        switch (component_type) {
+            case 5120: {
+                float v = static_cast<float>(static_cast<int8_t>(*p));
+                return normalized ? std::max(v / 127.f, -1.f) : v;
+            }
+            case 5121:return normalized ? *p / 255.f : *p;
+            case 5122: {
+                int16_t i;
+                memcpy(&i, p, sizeof(i));
+                return normalized ? std::max(i / 32767.f, -1.f) : i;
+            }
+            case 5123: {
+                uint16_t u;
+                memcpy(&u, p, sizeof(u));
+                return normalized ? u / 65535.f : u;
+            }
+            case 5125: {
+                uint32_t u;
+                memcpy(&u, p, sizeof(u));
+                return static_cast<float>(u);
+            }
+            default: {
+                float f;
+                memcpy(&f, p, sizeof(f));
+                return f;
+            }
+        }
+    }
+
+    // the elements of an accessor, checked against its view
+    bool accessor_span_(uint32_t accessor_idx,
+                        const uint8_t *&p_data,
+                        size_t &stride,
+                        size_t &count,
+                        uint32_t &comps) const
+    {
+        const Json &accessor = doc_["accessors"].at(accessor_idx);
+        if (accessor.type != Json::TYPE_OBJECT || accessor.has("sparse")) return false;
+        const uint32_t component_type = accessor["componentType"].as_uint();
+        comps = component_count_(accessor["type"].as_string());
+        const size_t elem_size = comps * component_size_(component_type);
+        count = accessor["count"].as_uint();
+        if (elem_size == 0) return false;
+        const uint32_t view = accessor["bufferView"].as_uint(UINT32_MAX);
+        if (view == UINT32_MAX) {
+            p_data = nullptr; // all zeros
+            stride = 0;
+            return true;
+        }
+        if (view >= views_.size() || !views_[view].p_data) return false;
+        const Span &span = views_[view];
+        const size_t offset = accessor["byteOffset"].as_uint();
+        stride = span.stride ? span.stride : elem_size;
+        if (count > 0 && (offset > span.size || (count - 1) * stride + elem_size > span.size - offset)) return false;
+        p_data = span.p_data + offset;
+        return true;
+    }
+
+    // dst_comps floats per element, the missing components 0
+    bool read_floats_(uint32_t accessor_idx,
+                      uint32_t dst_comps,
+                      std::vector<float> &res) const
+    {
+        const uint8_t *p_data;
+        size_t stride, count;
+        uint32_t comps;
+        if (!accessor_span_(accessor_idx, p_data, stride, count, comps)) return false;
+        const Json &accessor = doc_["accessors"].at(accessor_idx);
+        const uint32_t component_type = accessor["componentType"].as_uint();
+        const bool normalized = accessor["normalized"].as_bool();
+        const size_t component_size = component_size_(component_type);
+        res.assign(count * dst_comps, 0.f);
+        if (!p_data) return true;
+        const uint32_t read_comps = std::min(comps, dst_comps);
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t *p_elem = p_data + i * stride;
+            for (uint32_t c = 0; c < read_comps; c++) {
+                res[i * dst_comps + c] = read_component_(p_elem + c * component_size, component_type, normalized);
+            }
+        }
+        return true;
+    }
+
+    bool read_indices_(uint32_t accessor_idx,
+                       std::vector<uint32_t> &res) const
+    {
+        const uint8_t *p_data;
+        size_t stride, count;
+        uint32_t comps;
+        if (!accessor_span_(accessor_idx, p_data, stride, count, comps) || comps != 1) return false;
+        const uint32_t component_type = doc_["accessors"].at(accessor_idx)["componentType"].as_uint();
+        res.assign(count, 0);
+        if (!p_data) return true;
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t *p = p_data + i * stride;
+            switch (component_type) {
+                case 5121:res[i] = *p;
+                    break;
+                case 5123: {
+                    uint16_t u;
+                    memcpy(&u, p, sizeof(u));
+                    res[i] = u;
+                    break;
+                }
+                case 5125:memcpy(&res[i], p, sizeof(uint32_t));
+                    break;
+                default:return false;
+            }
+        }
+        return true;
+    }
+
+    // the uri is empty for embedded images
+    bool image_uri_(const Json &texture_info, std::string &res)
+    {
+        const Json &texture = doc_["textures"].at(texture_info["index"].as_uint(UINT32_MAX));
+        const Json &image = doc_["images"].at(texture["source"].as_uint(UINT32_MAX));
+        if (!percent_decode_(image["uri"].as_string(), res)) {
+            return fail_("invalid uri of image " + std::to_string(texture["source"].as_uint(UINT32_MAX)));
+        }
+        return true;
+    }
+
+    bool read_materials_()
+    {
+        for (auto &json_mtl : doc_["materials"].items) {
+            Gltf_material mtl;
+            const Json &pbr = json_mtl["pbrMetallicRoughness"];
+            for (uint32_t c = 0; c < 4 && c < pbr["baseColorFactor"].size(); c++) {
+                mtl.base_color[c] = static_cast<float>(pbr["baseColorFactor"].at(c).as_number());
+            }
+            for (uint32_t c = 0; c < 3 && c < json_mtl["emissiveFactor"].size(); c++) {
+                mtl.emissive[c] = static_cast<float>(json_mtl["emissiveFactor"].at(c).as_number());
+            }
+            mtl.emissive *= static_cast<float>(
+                json_mtl["extensions"]["KHR_materials_emissive_strength"]["emissiveStrength"].as_number(1.));
+            mtl.metallic = static_cast<float>(pbr["metallicFactor"].as_number(1.));
+            mtl.roughness = static_cast<float>(pbr["roughnessFactor"].as_number(1.));
+            mtl.opaque = json_mtl["alphaMode"].as_string().empty() || json_mtl["alphaMode"].as_string() == "OPAQUE";
+            if (pbr.has("baseColorTexture")) {
+                const Json &info = pbr["baseColorTexture"];
+                if (!image_uri_(info, mtl.base_color_image)) return false;
+                const Json &transform = info["extensions"]["KHR_texture_transform"];
+                for (uint32_t c = 0; c < 2; c++) {
+                    mtl.uv_offset[c] = static_cast<float>(transform["offset"].at(c).as_number(0.));
+                    mtl.uv_scale[c] = static_cast<float>(transform["scale"].at(c).as_number(1.));
+                }
+            }
+            if (json_mtl.has("normalTexture") && !image_uri_(json_mtl["normalTexture"], mtl.normal_image)) return false;
+            materials.push_back(mtl);
+        }
+        return true;
+    }
+
+    // area weighted vertex normals of the triangles
+    static void generate_normals_(Gltf_mesh &mesh)
+    {
+        const size_t vert_count = mesh.positions.size() / 3;
+        std::vector<glm::vec3> normals(vert_count, glm::vec3(0.f));
+        auto position = [&mesh](uint32_t v) {
+            return glm::vec3(mesh.positions[3 * v], mesh.positions[3 * v + 1], mesh.positions[3 * v + 2]);
+        };
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+            glm::vec3 n = glm::cross(position(b) - position(a), position(c) - position(a));
+            normals[a] += n;
+            normals[b] += n;
+            normals[c] += n;
+        }
+        mesh.normals.resize(3 * vert_count);
+        for (size_t v = 0; v < vert_count; v++) {
+            float l = glm::length(normals[v]);
+            glm::vec3 n = l > 0.f ? normals[v] / l : glm::vec3(0.f, 0.f, 1.f);
+            mesh.normals[3 * v] = n.x;
+            mesh.normals[3 * v + 1] = n.y;
+            mesh.normals[3 * v + 2] = n.z;
+        }
+    }
+
+    bool read_primitive_(const Json &prim,
+                         Gltf_mesh &mesh) const
+    {
+        const Json &attribs = prim["attributes"];
+        if (!read_floats_(attribs["POSITION"].as_uint(UINT32_MAX), 3, mesh.positions)) return false;
+        const size_t vert_count = mesh.positions.size() / 3;
+
+        if (prim.has("indices")) {
+            if (!read_indices_(prim["indices"].as_uint(UINT32_MAX), mesh.indices)) return false;
+            mesh.indices.resize(mesh.indices.size() / 3 * 3);
+            for (auto idx : mesh.indices) {
+                if (idx >= vert_count) return false;
+            }
+        } else {
+            mesh.indices.resize(vert_count / 3 * 3);
+            for (uint32_t i = 0; i < mesh.indices.size(); i++) mesh.indices[i] = i;
+        }
+
+        if (attribs.has("NORMAL")) {
+            if (!read_floats_(attribs["NORMAL"].as_uint(UINT32_MAX), 3, mesh.normals)) return false;
+            if (mesh.normals.size() != mesh.positions.size()) return false;
+        } else {
+            generate_normals_(mesh);
+        }
+
+        if (attribs.has("TEXCOORD_0")) {
+            if (!read_floats_(attribs["TEXCOORD_0"].as_uint(UINT32_MAX), 3, mesh.uvs)) return false;
+            if (mesh.uvs.size() != mesh.positions.size()) return false;
+            glm::vec2 offset(0.f), scale(1.f);
+            if (mesh.material_idx < materials.size()) {
+                offset = materials[mesh.material_idx].uv_offset;
+                scale = materials[mesh.material_idx].uv_scale;
+            }
+            for (size_t v = 0; v < vert_count; v++) {
+                mesh.uvs[3 * v] = mesh.uvs[3 * v] * scale.x + offset.x;
+                mesh.uvs[3 * v + 1] = 1.f - (mesh.uvs[3 * v + 1] * scale.y + offset.y);
+            }
+        } else {
+            mesh.uvs.assign(mesh.positions.size(), 0.f);
+        }
+        return true;
+    }
+
+    bool read_meshes_(Job_system *p_jobs)
+    {
+        // primitives without a material use the default one, after the others
+        const uint32_t default_material = static_cast<uint32_t>(materials.size());
+        bool use_default_material = false;
+        std::vector<const Json *> prims;
+        for (auto &json_mesh : doc_["meshes"].items) {
+            mesh_bases_.push_back(static_cast<uint32_t>(prims.size()));
+            for (auto &prim : json_mesh["primitives"].items) {
+                prims.push_back(&prim);
+            }
+        }
+        meshes.assign(prims.size(), Gltf_mesh());
+        for (size_t p = 0; p < prims.size(); p++) {
+            uint32_t material = (*prims[p])["material"].as_uint(UINT32_MAX);
+            if (material >= default_material) {
+                material = default_material;
+                use_default_material = true;
+            }
+            meshes[p].material_idx = material;
+            if ((*prims[p])["mode"].as_int(MODE_TRIANGLES) != MODE_TRIANGLES) skipped_primitives++;
+        }
+        if (use_default_material) materials.push_back(Gltf_material());
+
+        std::vector<uint8_t> failed(prims.size(), 0);
+        parallel_for(p_jobs, static_cast<uint32_t>(prims.size()), [&](uint32_t p) {
+            if ((*prims[p])["mode"].as_int(MODE_TRIANGLES) != MODE_TRIANGLES) return;
+            failed[p] = !read_primitive_(*prims[p], meshes[p]);
+        });
+        for (size_t p = 0; p < prims.size(); p++) {
+            if (failed[p]) return fail_("invalid primitive " + std::to_string(p));
+        }
+        return true;
+    }
+
+    static glm::mat4 trs_(const glm::vec3 &t,
+                          const glm::vec4 &r,
+                          const glm::vec3 &s)
+    {
+        const float x = r.x, y = r.y, z = r.z, w = r.w;
+        glm::mat4 res(1.f);
+        res[0] = glm::vec4(1.f - 2.f * (y * y + z * z), 2.f * (x * y + w * z), 2.f * (x * z - w * y), 0.f) * s.x;
+        res[1] = glm::vec4(2.f * (x * y - w * z), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + w * x), 0.f) * s.y;
+        res[2] = glm::vec4(2.f * (x * z + w * y), 2.f * (y * z - w * x), 1.f - 2.f * (x * x + y * y), 0.f) * s.z;
+        res[3] = glm::vec4(t, 1.f);
+        return res;
+    }
+
+    static glm::mat4 node_transform_(const Json &node)
+    {
+        if (node["matrix"].size() == 16) {
+            glm::mat4 res;
+            for (uint32_t c = 0; c < 4; c++) {
+                for (uint32_t r = 0; r < 4; r++) {
+                    res[c][r] = static_cast<float>(node["matrix"].at(4 * c + r).as_number());
+                }
+            }
+            return res;
+        }
+        glm::vec3 t(0.f), s(1.f);
+        glm::vec4 r(0.f, 0.f, 0.f, 1.f);
+        for (uint32_t c = 0; c < 3; c++) {
+            t[c] = static_cast<float>(node["translation"].at(c).as_number(0.));
+            s[c] = static_cast<float>(node["scale"].at(c).as_number(1.));
+        }
+        for (uint32_t c = 0; c < 4; c++) {
+            r[c] = static_cast<float>(node["rotation"].at(c).as_number(c == 3 ? 1. : 0.));
+        }
+        return trs_(t, r, s);
+    }
+
+    void add_instances_(uint32_t json_mesh,
+                        const glm::mat4 &transform)
+    {
+        const size_t prim_count = doc_["meshes"].at(json_mesh)["primitives"].size();
+        for (uint32_t p = 0; p < prim_count; p++) {
+            uint32_t mesh_idx = mesh_bases_[json_mesh] + p;
+            if (!meshes[mesh_idx].indices.empty()) instances.push_back({transform, mesh_idx});
+        }
+    }
+
+    bool traverse_(uint32_t node_idx,
+                   const glm::mat4 &parent,
+                   uint32_t depth)
+    {
+        const Json &nodes = doc_["nodes"];
+        if (node_idx >= nodes.size()) return fail_("invalid node " + std::to_string(node_idx));
+        if (depth > nodes.size()) return fail_("node hierarchy with a cycle");
+        const Json &node = nodes.at(node_idx);
+        const glm::mat4 transform = parent * node_transform_(node);
+
+        const uint32_t json_mesh = node["mesh"].as_uint(UINT32_MAX);
+        if (json_mesh < mesh_bases_.size()) {
+            const Json &attribs = node["extensions"]["EXT_mesh_gpu_instancing"]["attributes"];
+            if (attribs.type == Json::TYPE_OBJECT) {
+                std::vector<float> t, r, s;
+                if ((attribs.has("TRANSLATION") && !read_floats_(attribs["TRANSLATION"].as_uint(UINT32_MAX), 3, t)) ||
+                    (attribs.has("ROTATION") && !read_floats_(attribs["ROTATION"].as_uint(UINT32_MAX), 4, r)) ||
+                    (attribs.has("SCALE") && !read_floats_(attribs["SCALE"].as_uint(UINT32_MAX), 3, s)))
+                    return fail_("invalid instancing attributes of node " + std::to_string(node_idx));
+                const size_t count = std::max(t.size() / 3, std::max(r.size() / 4, s.size() / 3));
+                for (size_t i = 0; i < count; i++) {
+                    glm::vec3 ti = i < t.size() / 3 ? glm::vec3(t[3 * i], t[3 * i + 1], t[3 * i + 2]) : glm::vec3(0.f);
+                    glm::vec4 ri = i < r.size() / 4 ? glm::vec4(r[4 * i], r[4 * i + 1], r[4 * i + 2], r[4 * i + 3]) :
+                        glm::vec4(0.f, 0.f, 0.f, 1.f);
+                    glm::vec3 si = i < s.size() / 3 ? glm::vec3(s[3 * i], s[3 * i + 1], s[3 * i + 2]) : glm::vec3(1.f);
+                    add_instances_(json_mesh, transform * trs_(ti, ri, si));
+                }
+            } else {
+                add_instances_(json_mesh, transform);
+            }
+        }
+        for (auto &child : node["children"].items) {
+            if (!traverse_(child.as_uint(UINT32_MAX), transform, depth + 1)) return false;
+        }
+        return true;
+    }
+
+    bool read_nodes_()
+    {
+        const Json &scenes = doc_["scenes"];
+        if (scenes.size() == 0) {
+            // no scene, every root node
+            std::vector<bool> is_child(doc_["nodes"].size(), false);
+            for (auto &node : doc_["nodes"].items) {
+                for (auto &child : node["children"].items) {
+                    uint32_t c = child.as_uint(UINT32_MAX);
+                    if (c < is_child.size()) is_child[c] = true;
+                }
+            }
+            for (uint32_t n = 0; n < is_child.size(); n++) {
+                if (!is_child[n] && !traverse_(n, glm::mat4(1.f), 0)) return false;
+            }
+            return true;
+        }
+        const Json &scene = scenes.at(doc_["scene"].as_uint(0));
+        for (auto &root : scene["nodes"].items) {
+            if (!traverse_(root.as_uint(UINT32_MAX), glm::mat4(1.f), 0)) return false;
+        }
+        return true;
+    }
+};
+} // namespace base
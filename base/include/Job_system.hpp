@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace base
+{
+// fixed pool of worker threads running one parallel_for at a time,
+// the calling thread takes indices as well
+class Job_system
+{
+public:
+    // 0 uses one thread per hardware thread
+    explicit Job_system(uint32_t thread_count = 0)
+    {
+        if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+        for (uint32_t i = 1; i < thread_count; i++) {
+            workers_.emplace_back([this]() { work_(); });
+        }
+    }
+
+    ~Job_system()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        start_cv_.notify_all();
+        for (auto &worker : workers_) worker.join();
+    }
+
+    Job_system(const Job_system &) = delete;
+    Job_system &operator=(const Job_system &) = delete;
+
+    uint32_t thread_count() const
+    {
+        return static_cast<uint32_t>(workers_.size()) + 1;
+    }
+
+    // calls fn(i) for every i in [0, count) and returns when all are done,
+    // the first exception thrown by fn is rethrown here
+    void parallel_for(uint32_t count,
+                      const std::function<void(uint32_t)> &fn)
+    {
+        if (count == 0) return;
+        if (workers_.empty() || count == 1) {
+            for (uint32_t i = 0; i < count; i++) fn(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            p_fn_ = &fn;
+            count_ = count;
+            next_ = 0;
+            busy_ = static_cast<uint32_t>(workers_.size());
+            error_ = nullptr;
+            generation_++;
+        }
+        start_cv_.notify_all();
+
+        run_();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return busy_ == 0; });
+        p_fn_ = nullptr;
+        if (error_) std::rethrow_exception(error_);
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(uint32_t)> *p_fn_{nullptr};
+    uint32_t count_{0};
+    std::atomic<uint32_t> next_{0};
+    uint32_t busy_{0}; // workers still in the current parallel_for
+    uint64_t generation_{0};
+    std::exception_ptr error_{nullptr};
+    bool quit_{false};
+
+    void run_()
+    {
+        for (uint32_t i = next_++; i < count_; i = next_++) {
+            try {
+                (*p_fn_)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) error_ = std::current_exception();
+                next_ = count_;
+            }
+        }
+    }
+
+    void work_()
+    {
+        uint64_t generation = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_cv_.wait(lock, [&]() { return quit_ || generation_ != generation; });
+                if (quit_) return;
+                generation = generation_;
+            }
+            run_();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                busy_--;
+            }
+            done_cv_.notify_one();
+        }
+    }
+};
+
+// Job_system::parallel_for, on the calling thread without p_jobs
+inline void parallel_for(Job_system *p_jobs,
+                         uint32_t count,
+                         const std::function<void(uint32_t)> &fn)
+{
+    if (p_jobs) {
+        p_jobs->parallel_for(count, fn);
+    } else {
+        for (uint32_t i = 0; i < count; i++) fn(i);
+    }
+}
+} // namespace base
@@ -0,0 +1,315 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// minimal json document reader for scene formats, numbers are doubles,
+// objects keep their members in file order
+namespace base
+{
+class Json
+{
+public:
+    enum Type
+    {
+        TYPE_NULL,
+        TYPE_BOOL,
+        TYPE_NUMBER,
+        TYPE_STRING,
+        TYPE_ARRAY,
+        TYPE_OBJECT
+    };
+
+    Type type{TYPE_NULL};
+    bool boolean{false};
+    double number{0.};
+    std::string string{};
+    std::vector<Json> items{};
+    std::vector<std::pair<std::string, Json>> members{};
+
+    // parses the document, false and the error with its offset otherwise
+    static bool parse(const char *p_text,
+                      size_t length,
+                      Json &res,
+                      std::string &error)
+    {
+        Parser parser{p_text, p_text + length, p_text, ""};
+        parser.skip_space();
+        if (!parser.value(res, 0)) {
+            error = parser.error;
+            return false;
+        }
+        parser.skip_space();
+        if (parser.p != parser.p_end) {
+            parser.fail("trailing characters");
+            error = parser.error;
+            return false;
+        }
+        return true;
+    }
+
+    // the member of an object, a null value when it has none
+    const Json &operator[](const char *key) const
+    {
+        for (auto &member : members) {
+            if (member.first == key) return member.second;
+        }
+        return null_();
+    }
+
+    // the item of an array, a null value when out of range
+    const Json &at(size_t idx) const
+    {
+        return idx < items.size() ? items[idx] : null_();
+    }
+
+    bool has(const char *key) const
+    {
+        return &(*this)[key] != &null_();
+    }
+
+    size_t size() const
+    {
+        return type == TYPE_ARRAY ? items.size() : members.size();
+    }
+
+    double as_number(double fallback = 0.) const
+    {
+        return type == TYPE_NUMBER ? number : fallback;
+    }
+
+    // a non-negative integer number that fits in 32 bits
+    bool is_uint() const
+    {
+        return type == TYPE_NUMBER && number >= 0. && number <= UINT32_MAX &&
+            static_cast<double>(static_cast<uint32_t>(number)) == number;
+    }
+
+    // the fallback for other values too, see is_uint
+    uint32_t as_uint(uint32_t fallback = 0) const
+    {
+        return is_uint() ? static_cast<uint32_t>(number) : fallback;
+    }
+
+    int as_int(int fallback = -1) const
+    {
+        return type == TYPE_NUMBER ? static_cast<int>(number) : fallback;
+    }
+
+    bool as_bool(bool fallback = false) const
+    {
+        return type == TYPE_BOOL ? boolean : fallback;
+    }
+
+    const std::string &as_string() const
+    {
+        return string;
+    }
+
+private:
+    static const Json &null_()
+    {
+        static const Json res;
+        return res;
+    }
+
+    struct Parser
+    {
+        const char *p;
+        const char *p_end;
+        const char *p_begin;
+        std::string error;
+
+        static const int MAX_DEPTH = 128;
+
+        bool fail(const char *msg)
+        {
+            if (error.empty()) error = std::string(msg) + " at offset " + std::to_string(p - p_begin);
+            return false;
+        }
+
+        void skip_space()
+        {
+            while (p != p_end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+        }
+
+        bool literal(const char *word)
+        {
+            for (; *word; word++, p++) {
+                if (p == p_end || *p != *word) return fail("invalid literal");
+            }
+            return true;
+        }
+
+        bool value(Json &res, int depth)
+        {
+            if (depth > MAX_DEPTH) return fail("nested too deep");
+            if (p == p_end) return fail("unexpected end");
+            switch (*p) {
+                case '{':return object(res, depth);
+                case '[':return array(res, depth);
+                case '"':res.type = TYPE_STRING;
+                    return string(res.string);
+                case 't':res.type = TYPE_BOOL;
+                    res.boolean = true;
+                    return literal("true");
+                case 'f':res.type = TYPE_BOOL;
+                    res.boolean = false;
+                    return literal("false");
+                case 'n':res.type = TYPE_NULL;
+                    return literal("null");
+                default:return number(res);
+            }
+        }
+
+        bool number(Json &res)
+        {
+            // strtod needs a terminated copy, numbers are short
+            const char *p_start = p;
+            while (p != p_end && (isdigit_(*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')) p++;
+            if (p == p_start) return fail("unexpected character");
+            std::string text(p_start, p);
+            char *p_parsed = nullptr;
+            res.type = TYPE_NUMBER;
+            res.number = strtod(text.c_str(), &p_parsed);
+            if (p_parsed != text.c_str() + text.size()) return fail("invalid number");
+            return true;
+        }
+
+        static bool isdigit_(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        bool hex4(uint32_t &res)
+        {
+            res = 0;
+            for (int i = 0; i < 4; i++, p++) {
+                if (p == p_end) return fail("unexpected end");
+                char c = *p;
+                res <<= 4;
+                if (c >= '0' && c <= '9') res |= c - '0';
+                else if (c >= 'a' && c <= 'f') res |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') res |= c - 'A' + 10;
+                else return fail("invalid escape");
+            }
+            return true;
+        }
+
+        static void append_utf8_(uint32_t cp, std::string &res)
+        {
+            if (cp < 0x80) {
+                res.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                res.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+                res.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else if (cp < 0x10000) {
+                res.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+                res.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                res.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            } else {
+                res.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+                res.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+                res.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+                res.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+            }
+        }
+
+        bool string(std::string &res)
+        {
+            p++; // opening quote
+            while (p != p_end && *p != '"') {
+                if (*p != '\\') {
+                    res.push_back(*p++);
+                    continue;
+                }
+                if (++p == p_end) return fail("unexpected end");
+                char c = *p++;
+                switch (c) {
+                    case 'b':res.push_back('\b');
+                        break;
+                    case 'f':res.push_back('\f');
+                        break;
+                    case 'n':res.push_back('\n');
+                        break;
+                    case 'r':res.push_back('\r');
+                        break;
+                    case 't':res.push_back('\t');
+                        break;
+                    case 'u': {
+                        uint32_t cp;
+                        if (!hex4(cp)) return false;
+                        // surrogate pair
+                        if (cp >= 0xd800 && cp < 0xdc00 && p_end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                            p += 2;
+                            uint32_t low;
+                            if (!hex4(low)) return false;
+                            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                        }
+                        append_utf8_(cp, res);
+                        break;
+                    }
+                    default:res.push_back(c); // quote, backslash and slash
+                        break;
+                }
+            }
+            if (p == p_end) return fail("unterminated string");
+            p++; // closing quote
+            return true;
+        }
+
+        bool array(Json &res, int depth)
+        {
+            res.type = TYPE_ARRAY;
+            p++;
+            skip_space();
+            if (p != p_end && *p == ']') {
+                p++;
+                return true;
+            }
+            while (true) {
+                res.items.emplace_back();
+                skip_space();
+                if (!value(res.items.back(), depth + 1)) return false;
+                skip_space();
+                if (p == p_end) return fail("unexpected end");
+                if (*p == ']') {
+                    p++;
+                    return true;
+                }
+                if (*p++ != ',') return fail("expected , or ]");
+            }
+        }
+
+        bool object(Json &res, int depth)
+        {
+            res.type = TYPE_OBJECT;
+            p++;
+            skip_space();
+            if (p != p_end && *p == '}') {
+                p++;
+                return true;
+            }
+            while (true) {
+                skip_space();
+                if (p == p_end || *p != '"') return fail("expected a key");
+                res.members.emplace_back();
+                if (!string(res.members.back().first)) return false;
+                skip_space();
+                if (p == p_end || *p++ != ':') return fail("expected :");
+                skip_space();
+                if (!value(res.members.back().second, depth + 1)) return false;
+                skip_space();
+                if (p == p_end) return fail("unexpected end");
+                if (*p == '}') {
+                    p++;
+                    return true;
+                }
+                if (*p++ != ',') return fail("expected , or }");
+            }
+        }
+    };
+};
+} // namespace base
@@ -0,0 +1,130 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// splits the triangle order of a mesh into clusters of consecutive
+// triangles, each a range of the index buffer drawn on its own, with an aabb
+// and a normal cone for culling, layout matches cluster_cull.comp
+//
+// a cluster is backfacing for every eye in the cone opening away from
+// cone_apex along -cone_axis: dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff
+// (as in meshoptimizer's cluster bounds), cone_cutoff is 1 when the normals
+// spread too far for the cone to cull anything
+
+namespace base
+{
+const uint32_t MAX_CLUSTER_VERTICES = 64;
+const uint32_t MAX_CLUSTER_TRIANGLES = 124;
+
+struct Mesh_cluster
+{
+    glm::vec3 min;
+    uint32_t idx_base;
+    glm::vec3 max;
+    uint32_t idx_count;
+    glm::vec3 cone_apex;
+    float cone_cutoff;
+    glm::vec3 cone_axis;
+    int32_t vert_offset;
+};
+
+// p_positions holds 3 floats per vertex, p_indices the idx_count indices
+// starting at idx_base of the index buffer, the clusters are appended to res
+inline void build_clusters(const uint32_t *p_indices,
+                           uint32_t idx_count,
+                           const float *p_positions,
+                           uint32_t vert_count,
+                           uint32_t idx_base,
+                           int32_t vert_offset,
+                           std::vector<Mesh_cluster> &res)
+{
+    auto position = [p_positions](uint32_t v) {
+        return glm::vec3(p_positions[3 * v], p_positions[3 * v + 1], p_positions[3 * v + 2]);
+    };
+
+    auto add_cluster = [&](uint32_t first_tri, uint32_t tri_count) {
+        const uint32_t *p_tris = p_indices + 3 * first_tri;
+        Mesh_cluster cluster;
+        cluster.idx_base = idx_base + 3 * first_tri;
+        cluster.idx_count = 3 * tri_count;
+        cluster.vert_offset = vert_offset;
+        cluster.min = glm::vec3(FLT_MAX);
+        cluster.max = glm::vec3(-FLT_MAX);
+        for (uint32_t i = 0; i < 3 * tri_count; i++) {
+            cluster.min = glm::min(cluster.min, position(p_tris[i]));
+            cluster.max = glm::max(cluster.max, position(p_tris[i]));
+        }
+        glm::vec3 center = (cluster.min + cluster.max) * .5f;
+
+        // unit normals of the triangles with an area
+        std::vector<glm::vec3> normals(tri_count, glm::vec3(0.f));
+        glm::vec3 axis(0.f);
+        for (uint32_t t = 0; t < tri_count; t++) {
+            glm::vec3 p0 = position(p_tris[3 * t]);
+            glm::vec3 n = glm::cross(position(p_tris[3 * t + 1]) - p0, position(p_tris[3 * t + 2]) - p0);
+            float area = glm::length(n);
+            if (!(area > 0.f)) continue;
+            normals[t] = n / area;
+            axis += normals[t];
+        }
+        float axis_length = glm::length(axis);
+        float min_dot = 1.f;
+        if (axis_length > 0.f) {
+            axis /= axis_length;
+            for (auto &n : normals) {
+                if (n != glm::vec3(0.f)) min_dot = std::min(min_dot, glm::dot(n, axis));
+            }
+        }
+
+        cluster.cone_apex = center;
+        cluster.cone_axis = glm::vec3(0.f, 0.f, 1.f);
+        cluster.cone_cutoff = 1.f;
+        if (axis_length > 0.f && min_dot > .1f) {
+            // the apex is moved back along the axis until every triangle plane
+            // is in front of it
+            float max_t = 0.f;
+            for (uint32_t t = 0; t < tri_count; t++) {
+                const glm::vec3 &n = normals[t];
+                if (n == glm::vec3(0.f)) continue;
+                float dc = glm::dot(center - position(p_tris[3 * t]), n);
+                float dn = glm::dot(axis, n);
+                max_t = std::max(max_t, dc / dn);
+            }
+            cluster.cone_apex = center - axis * max_t;
+            cluster.cone_axis = axis;
+            cluster.cone_cutoff = std::sqrt(1.f - min_dot * min_dot);
+        }
+        res.push_back(cluster);
+    };
+
+    // greedy over the triangle order, a cluster ends when the next triangle
+    // would exceed either limit
+    const uint32_t tri_count = idx_count / 3;
+    std::vector<uint32_t> cluster_of(vert_count, ~0u); // last cluster using the vertex
+    uint32_t cluster_idx = 0;
+    uint32_t first_tri = 0;
+    uint32_t cluster_verts = 0;
+    for (uint32_t t = 0; t < tri_count; t++) {
+        uint32_t new_verts = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = p_indices[3 * t + k];
+            bool repeated = (k > 0 && p_indices[3 * t] == v) || (k > 1 && p_indices[3 * t + 1] == v);
+            if (cluster_of[v] != cluster_idx && !repeated) new_verts++;
+        }
+        if (cluster_verts + new_verts > MAX_CLUSTER_VERTICES || t - first_tri == MAX_CLUSTER_TRIANGLES) {
+            add_cluster(first_tri, t - first_tri);
+            cluster_idx++;
+            first_tri = t;
+            cluster_verts = 0;
+            new_verts = 3;
+        }
+        for (int k = 0; k < 3; k++) cluster_of[p_indices[3 * t + k]] = cluster_idx;
+        cluster_verts += new_verts;
+    }
+    if (tri_count > first_tri) add_cluster(first_tri, tri_count - first_tri);
+}
+} // namespace base
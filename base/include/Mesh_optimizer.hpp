@@ -0,0 +1,280 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// triangle and vertex orders of an indexed triangle mesh, all indices are
+// relative to the first vertex of the mesh
+//
+// optimize_vertex_cache() orders the triangles for post transform cache
+// locality (Forsyth, linear speed vertex cache optimisation), optimize_overdraw()
+// then sorts clusters of that order so that triangles facing outwards from the
+// mesh center come first, splitting only where the cache starts over,
+// optimize_vertex_fetch() renumbers the vertices in order of first use.
+
+namespace base
+{
+struct Vertex_cache_stats
+{
+    uint32_t misses{0};
+    uint32_t tri_count{0};
+    uint32_t vert_count{0}; // referenced vertices
+
+    // average cache miss ratio, misses per triangle, 0.5 - 3
+    float acmr() const
+    {
+        return tri_count ? static_cast<float>(misses) / tri_count : 0.f;
+    }
+
+    // average transform to vertex ratio, misses per vertex, 1 at best
+    float atvr() const
+    {
+        return vert_count ? static_cast<float>(misses) / vert_count : 0.f;
+    }
+};
+
+// fifo cache of cache_size entries, as found in hardware
+inline Vertex_cache_stats analyze_vertex_cache(const uint32_t *p_indices,
+                                               uint32_t idx_count,
+                                               uint32_t vert_count,
+                                               uint32_t cache_size = 16)
+{
+    Vertex_cache_stats res;
+    res.tri_count = idx_count / 3;
+    std::vector<uint32_t> timestamps(vert_count, 0);
+    std::vector<bool> used(vert_count, false);
+    uint32_t time = cache_size + 1;
+    for (uint32_t i = 0; i < idx_count; i++) {
+        uint32_t v = p_indices[i];
+        if (!used[v]) {
+            used[v] = true;
+            res.vert_count++;
+        }
+        if (time - timestamps[v] > cache_size) {
+            timestamps[v] = time++;
+            res.misses++;
+        }
+    }
+    return res;
+}
+
+inline void optimize_vertex_cache(uint32_t *p_indices,
+                                  uint32_t idx_count,
+                                  uint32_t vert_count)
+{
+    const int CACHE_SIZE = 32;
+    const uint32_t tri_count = idx_count / 3;
+    if (tri_count == 0) return;
+
+    auto vertex_score = [](int cache_pos, uint32_t remaining) {
+        if (remaining == 0) return -1.f;
+        float score = 0.f;
+        if (cache_pos >= 0) {
+            if (cache_pos < 3) {
+                // the last triangle, fixed score to not favour any of its edges
+                score = .75f;
+            } else {
+                score = std::pow(1.f - static_cast<float>(cache_pos - 3) / (CACHE_SIZE - 3), 1.5f);
+            }
+        }
+        // valence boost, favours vertices with few triangles left
+        return score + 2.f / std::sqrt(static_cast<float>(remaining));
+    };
+
+    // triangles per vertex
+    std::vector<uint32_t> remaining(vert_count, 0);
+    for (uint32_t i = 0; i < idx_count; i++) remaining[p_indices[i]]++;
+    std::vector<uint32_t> adj_offsets(vert_count + 1, 0);
+    for (uint32_t v = 0; v < vert_count; v++) adj_offsets[v + 1] = adj_offsets[v] + remaining[v];
+    std::vector<uint32_t> adj(idx_count);
+    {
+        std::vector<uint32_t> fill(adj_offsets.begin(), adj_offsets.end() - 1);
+        for (uint32_t t = 0; t < tri_count; t++) {
+            for (int k = 0; k < 3; k++) adj[fill[p_indices[3 * t + k]]++] = t;
+        }
+    }
+
+    std::vector<int> cache_pos(vert_count, -1);
+    std::vector<float> vert_scores(vert_count);
+    for (uint32_t v = 0; v < vert_count; v++) vert_scores[v] = vertex_score(-1, remaining[v]);
+    std::vector<bool> emitted(tri_count, false);
+    std::vector<uint32_t> res(idx_count);
+
+    uint32_t cache[CACHE_SIZE + 3];
+    uint32_t cache_count = 0;
+    uint32_t cursor = 0; // triangles before it are emitted
+    int64_t best = -1;
+    for (uint32_t out = 0; out < tri_count; out++) {
+        if (best < 0) {
+            // dead end, continue with the first triangle left
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+        uint32_t tri = static_cast<uint32_t>(best);
+        emitted[tri] = true;
+        const uint32_t *p_tri = p_indices + 3 * tri;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = p_tri[k];
+            res[3 * out + k] = v;
+
+            // remove the triangle from the vertex
+            uint32_t *p_adj = adj.data() + adj_offsets[v];
+            uint32_t n = remaining[v];
+            for (uint32_t i = 0; i < n; i++) {
+                if (p_adj[i] == tri) {
+                    p_adj[i] = p_adj[n - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the triangle moves to the front of the lru cache
+        uint32_t new_cache[CACHE_SIZE + 3];
+        uint32_t new_count = 0;
+        for (int k = 0; k < 3; k++) {
+            if (std::find(new_cache, new_cache + new_count, p_tri[k]) == new_cache + new_count)
+                new_cache[new_count++] = p_tri[k];
+        }
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != p_tri[0] && v != p_tri[1] && v != p_tri[2]) new_cache[new_count++] = v;
+        }
+        for (uint32_t i = CACHE_SIZE; i < new_count; i++) {
+            cache_pos[new_cache[i]] = -1;
+            vert_scores[new_cache[i]] = vertex_score(-1, remaining[new_cache[i]]);
+        }
+        cache_count = std::min(new_count, static_cast<uint32_t>(CACHE_SIZE));
+        std::copy(new_cache, new_cache + cache_count, cache);
+        for (uint32_t i = 0; i < cache_count; i++) {
+            cache_pos[cache[i]] = static_cast<int>(i);
+            vert_scores[cache[i]] = vertex_score(static_cast<int>(i), remaining[cache[i]]);
+        }
+
+        // the next triangle is the best scored one with a vertex in the cache
+        best = -1;
+        float best_score = -1.f;
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            const uint32_t *p_adj = adj.data() + adj_offsets[v];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                uint32_t t = p_adj[j];
+                const uint32_t *p_t = p_indices + 3 * t;
+                float score = vert_scores[p_t[0]] + vert_scores[p_t[1]] + vert_scores[p_t[2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+    }
+    std::copy(res.begin(), res.end(), p_indices);
+}
+
+// p_positions holds 3 floats per vertex, keeps the cache efficiency of
+// the order by only moving whole clusters that start with a full cache miss
+inline void optimize_overdraw(uint32_t *p_indices,
+                              uint32_t idx_count,
+                              const float *p_positions,
+                              uint32_t vert_count,
+                              uint32_t cache_size = 16)
+{
+    const uint32_t tri_count = idx_count / 3;
+    if (tri_count < 2) return;
+
+    // clusters start where all three vertices miss the fifo cache
+    std::vector<uint32_t> cluster_starts;
+    {
+        std::vector<uint32_t> timestamps(vert_count, 0);
+        uint32_t time = cache_size + 1;
+        for (uint32_t t = 0; t < tri_count; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = p_indices[3 * t + k];
+                if (time - timestamps[v] > cache_size) {
+                    timestamps[v] = time++;
+                    misses++;
+                }
+            }
+            if (t == 0 || misses == 3) cluster_starts.push_back(t);
+        }
+    }
+    const uint32_t cluster_count = static_cast<uint32_t>(cluster_starts.size());
+    if (cluster_count < 2) return;
+    cluster_starts.push_back(tri_count);
+
+    auto position = [p_positions](uint32_t v) {
+        return glm::vec3(p_positions[3 * v], p_positions[3 * v + 1], p_positions[3 * v + 2]);
+    };
+
+    // area weighted centers and normals
+    glm::vec3 mesh_center(0.f);
+    float mesh_area = 0.f;
+    std::vector<glm::vec3> centers(cluster_count, glm::vec3(0.f));
+    std::vector<glm::vec3> normals(cluster_count, glm::vec3(0.f));
+    std::vector<float> areas(cluster_count, 0.f);
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        for (uint32_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++) {
+            glm::vec3 p0 = position(p_indices[3 * t]);
+            glm::vec3 p1 = position(p_indices[3 * t + 1]);
+            glm::vec3 p2 = position(p_indices[3 * t + 2]);
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            centers[c] += (p0 + p1 + p2) * (area / 3.f);
+            normals[c] += n;
+            areas[c] += area;
+        }
+        mesh_center += centers[c];
+        mesh_area += areas[c];
+        if (areas[c] > 0.f) centers[c] /= areas[c];
+    }
+    if (mesh_area > 0.f) mesh_center /= mesh_area;
+
+    std::vector<float> keys(cluster_count);
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        float len = glm::length(normals[c]);
+        keys[c] = len > 0.f ? glm::dot(centers[c] - mesh_center, normals[c] / len) : 0.f;
+    }
+    std::vector<uint32_t> order(cluster_count);
+    for (uint32_t c = 0; c < cluster_count; c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+    std::vector<uint32_t> res;
+    res.reserve(idx_count);
+    for (uint32_t c : order) {
+        res.insert(res.end(), p_indices + 3 * cluster_starts[c], p_indices + 3 * cluster_starts[c + 1]);
+    }
+    std::copy(res.begin(), res.end(), p_indices);
+}
+
+// p_vertices holds vert_floats floats per vertex, vertices no triangle uses
+// are kept at the end in their order
+inline void optimize_vertex_fetch(uint32_t *p_indices,
+                                  uint32_t idx_count,
+                                  float *p_vertices,
+                                  uint32_t vert_count,
+                                  uint32_t vert_floats)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vert_count, unused);
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < idx_count; i++) {
+        uint32_t &r = remap[p_indices[i]];
+        if (r == unused) r = next++;
+        p_indices[i] = r;
+    }
+    for (uint32_t v = 0; v < vert_count; v++) {
+        if (remap[v] == unused) remap[v] = next++;
+    }
+
+    std::vector<float> res(static_cast<size_t>(vert_count) * vert_floats);
+    for (uint32_t v = 0; v < vert_count; v++) {
+        std::copy(p_vertices + static_cast<size_t>(v) * vert_floats,
+                  p_vertices + static_cast<size_t>(v + 1) * vert_floats,
+                  res.begin() + static_cast<size_t>(remap[v]) * vert_floats);
+    }
+    std::copy(res.begin(), res.end(), p_vertices);
+}
+} // namespace base
@@ -0,0 +1,317 @@
+#pragma once
+#include "Vertex_packer.hpp"
+#include "Job_system.hpp"
+#include "Mesh_clusters.hpp"
+#include "Mesh_optimizer.hpp"
+#include "Mesh_simplifier.hpp"
+#include <assimp/scene.h>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// packs the meshes of an imported or loaded scene on the host, without a
+// device, for base::Geometries and for offline baking
+
+namespace base
+{
+// post transform cache efficiency of a mesh before and after optimization
+struct Mesh_cache_stats
+{
+    Vertex_cache_stats before;
+    Vertex_cache_stats after;
+};
+
+struct Mesh
+{
+    uint32_t material_idx;
+    uint32_t idx_base;
+    uint32_t idx_count;
+    int32_t vert_offset;
+    glm::vec4 min;
+    glm::vec4 max;
+};
+
+// levels of detail per mesh, the full mesh and up to 3 simplified ones
+const uint32_t MAX_MESH_LODS = 4;
+// cells along the longest side of a mesh for its first simplified level,
+// halved for every further level
+const uint32_t LOD_GRID_SIZE = 64;
+
+// an index range of a mesh, the simplified ones use the vertices of the full
+// mesh, error is the simplification error over the longest side of its aabb
+struct Mesh_lod
+{
+    uint32_t idx_count;
+    uint32_t idx_base;
+    int32_t vert_offset;
+    float error;
+};
+
+struct Packed_meshes
+{
+    std::vector<Mesh> meshes;
+    // scene mesh index to its index in meshes, meshes with the same
+    // vertices and indices share one
+    std::vector<uint32_t> mesh_remap;
+    std::vector<float> vertices; // packed as the vertex layout
+    std::vector<uint32_t> indices;
+    std::vector<Mesh_cache_stats> cache_stats; // per mesh when optimized
+    // MAX_MESH_LODS per mesh from the full one, the levels past the last
+    // simplified one repeat it, the simplified indices follow the full ones
+    std::vector<Mesh_lod> lods;
+    // the clusters of the full meshes, those of mesh m are
+    // cluster_offsets[m] to cluster_offsets[m + 1], see Mesh_clusters
+    std::vector<Mesh_cluster> clusters;
+    std::vector<uint32_t> cluster_offsets;
+};
+
+// a triangle list to pack, its indices are relative to its first vertex
+struct Mesh_source
+{
+    Vertex_source vertices;
+    const uint32_t *indices{nullptr};
+    uint32_t idx_count{0};
+    uint32_t material_idx{0};
+};
+
+inline Vertex_source mesh_vertex_source(const aiMesh *p_mesh)
+{
+    static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "single precision assimp expected");
+    static_assert(sizeof(aiColor4D) == 4 * sizeof(float), "single precision assimp expected");
+    Vertex_source src;
+    src.vert_count = p_mesh->mNumVertices;
+    src.positions = reinterpret_cast<const float *>(p_mesh->mVertices);
+    if (p_mesh->HasNormals())
+        src.normals = reinterpret_cast<const float *>(p_mesh->mNormals);
+    if (p_mesh->HasTextureCoords(0))
+        src.uvs = reinterpret_cast<const float *>(p_mesh->mTextureCoords[0]);
+    if (p_mesh->HasTangentsAndBitangents()) {
+        src.tangents = reinterpret_cast<const float *>(p_mesh->mTangents);
+        src.bitangents = reinterpret_cast<const float *>(p_mesh->mBitangents);
+    }
+    if (p_mesh->HasVertexColors(0))
+        src.colors = reinterpret_cast<const float *>(p_mesh->mColors[0]);
+    return src;
+}
+
+// the meshes of an imported scene, the triangulated faces are flattened
+// into indices, one array per mesh
+inline void ai_mesh_sources(const aiScene *p_scene,
+                            Job_system *p_jobs,
+                            std::vector<std::vector<uint32_t>> &indices,
+                            std::vector<Mesh_source> &res)
+{
+    indices.assign(p_scene->mNumMeshes, std::vector<uint32_t>());
+    res.assign(p_scene->mNumMeshes, Mesh_source());
+    parallel_for(p_jobs, p_scene->mNumMeshes, [&](uint32_t m) {
+        auto p_mesh = p_scene->mMeshes[m];
+        std::vector<uint32_t> &mesh_indices = indices[m];
+        mesh_indices.resize(3 * p_mesh->mNumFaces); // triangulated
+        for (uint32_t f = 0; f < p_mesh->mNumFaces; f++) {
+            memcpy(&mesh_indices[3 * f], p_mesh->mFaces[f].mIndices, 3 * sizeof(uint32_t));
+        }
+        res[m].vertices = mesh_vertex_source(p_mesh);
+        res[m].indices = mesh_indices.data();
+        res[m].idx_count = static_cast<uint32_t>(mesh_indices.size());
+        res[m].material_idx = p_mesh->mMaterialIndex;
+    });
+}
+
+// the vertex attributes and the indices
+inline uint64_t mesh_hash(const Mesh_source &mesh)
+{
+    uint64_t res = 14695981039346656037ull;
+    auto mix = [&res](const void *p_data, size_t bytes) {
+        auto p_words = reinterpret_cast<const uint32_t *>(p_data);
+        for (size_t i = 0; i < bytes / sizeof(uint32_t); i++) {
+            res = (res ^ p_words[i]) * 1099511628211ull;
+        }
+    };
+    const Vertex_source &src = mesh.vertices;
+    mix(&src.vert_count, sizeof(src.vert_count));
+    mix(&mesh.idx_count, sizeof(mesh.idx_count));
+    const float *attribs[5] = {src.positions, src.normals, src.uvs, src.tangents, src.bitangents};
+    for (auto p_attrib : attribs) {
+        if (p_attrib) mix(p_attrib, src.vert_count * 3 * sizeof(float));
+    }
+    if (src.colors) mix(src.colors, src.vert_count * 4 * sizeof(float));
+    mix(mesh.indices, mesh.idx_count * sizeof(uint32_t));
+    return res;
+}
+
+inline bool same_mesh(const Mesh_source &mesh_a,
+                      const Mesh_source &mesh_b)
+{
+    const Vertex_source &a = mesh_a.vertices;
+    const Vertex_source &b = mesh_b.vertices;
+    if (a.vert_count != b.vert_count || mesh_a.idx_count != mesh_b.idx_count) return false;
+    auto same = [](const void *p_x, const void *p_y, size_t bytes) {
+        if (!p_x || !p_y) return p_x == p_y;
+        return memcmp(p_x, p_y, bytes) == 0;
+    };
+    const size_t vec3_bytes = a.vert_count * 3 * sizeof(float);
+    return same(a.positions, b.positions, vec3_bytes) &&
+        same(a.normals, b.normals, vec3_bytes) &&
+        same(a.uvs, b.uvs, vec3_bytes) &&
+        same(a.tangents, b.tangents, vec3_bytes) &&
+        same(a.bitangents, b.bitangents, vec3_bytes) &&
+        same(a.colors, b.colors, a.vert_count * 4 * sizeof(float)) &&
+        same(mesh_a.indices, mesh_b.indices, mesh_a.idx_count * sizeof(uint32_t));
+}
+
+// meshes are packed concurrently by p_jobs when given, each into its own
+// range of the vertex and index arrays, optimize reorders the triangles of
+// every mesh for the vertex cache and overdraw, then its vertices for fetch
+// locality, see Mesh_optimizer, lod_count simplified levels are added to
+// every mesh that they reduce by a quarter at least, see Mesh_simplifier,
+// the full meshes are split into clusters in their final triangle order
+inline void pack_meshes(const std::vector<Mesh_source> &sources,
+                        const Vertex_layout &layout,
+                        bool optimize,
+                        uint32_t lod_count,
+                        Job_system *p_jobs,
+                        Packed_meshes &res)
+{
+    // only the first of the meshes with the same content is packed
+    const uint32_t scene_mesh_count = static_cast<uint32_t>(sources.size());
+    std::vector<uint64_t> hashes(scene_mesh_count);
+    parallel_for(p_jobs, scene_mesh_count, [&](uint32_t m) {
+        hashes[m] = mesh_hash(sources[m]);
+    });
+    std::vector<uint32_t> unique_meshes; // scene mesh indices
+    std::unordered_multimap<uint64_t, uint32_t> by_hash;
+    res.mesh_remap.assign(scene_mesh_count, 0);
+    for (uint32_t m = 0; m < scene_mesh_count; m++) {
+        auto range = by_hash.equal_range(hashes[m]);
+        auto it = range.first;
+        while (it != range.second && !same_mesh(sources[it->second], sources[m])) ++it;
+        if (it != range.second) {
+            res.mesh_remap[m] = res.mesh_remap[it->second];
+            continue;
+        }
+        res.mesh_remap[m] = static_cast<uint32_t>(unique_meshes.size());
+        unique_meshes.push_back(m);
+        by_hash.emplace(hashes[m], m);
+    }
+    const uint32_t mesh_count = static_cast<uint32_t>(unique_meshes.size());
+
+    // prefix sums of the vertex and index counts, every mesh is packed in place
+    uint32_t idx_base = 0;
+    int32_t vert_offset = 0;
+    res.meshes.clear();
+    res.meshes.reserve(mesh_count);
+    for (uint32_t m = 0; m < mesh_count; m++) {
+        const Mesh_source &src = sources[unique_meshes[m]];
+        res.meshes.push_back({src.material_idx,
+                             idx_base,
+                             src.idx_count,
+                             vert_offset,
+                             glm::vec4(0.f),
+                             glm::vec4(0.f)});
+        vert_offset += src.vertices.vert_count;
+        idx_base += src.idx_count;
+    }
+    const uint32_t vert_floats = layout.get_stride() / sizeof(float);
+    res.vertices.assign(static_cast<size_t>(vert_offset) * vert_floats, 0.f);
+    res.indices.assign(idx_base, 0);
+    res.cache_stats.assign(optimize ? mesh_count : 0, Mesh_cache_stats());
+    lod_count = std::min(lod_count, MAX_MESH_LODS - 1);
+    std::vector<std::vector<uint32_t>> lod_indices(mesh_count); // the simplified levels of a mesh
+    std::vector<uint32_t> simplified_counts(mesh_count, 0);
+    res.lods.assign(static_cast<size_t>(mesh_count) * MAX_MESH_LODS, Mesh_lod());
+    std::vector<std::vector<Mesh_cluster>> mesh_clusters(mesh_count);
+
+    parallel_for(p_jobs, mesh_count, [&](uint32_t m) {
+        const Mesh_source &mesh_src = sources[unique_meshes[m]];
+        Mesh &mesh = res.meshes[m];
+        float *p_verts = res.vertices.data() + static_cast<size_t>(mesh.vert_offset) * vert_floats;
+
+        Vertex_source src = mesh_src.vertices;
+        glm::vec3 min, max;
+        position_bounds(src.positions, src.vert_count, min, max);
+        mesh.min = glm::vec4(min, 1.f);
+        mesh.max = glm::vec4(max, 1.f);
+        src.bounds_min = min;
+        src.bounds_extent = quantization_extent(min, max);
+
+        pack_vertices(layout, src, p_verts);
+
+        uint32_t *p_idx = res.indices.data() + mesh.idx_base;
+        if (mesh.idx_count > 0) memcpy(p_idx, mesh_src.indices, mesh.idx_count * sizeof(uint32_t));
+
+        // every level is simplified from the full mesh, in the source vertex order
+        Mesh_lod *p_lods = res.lods.data() + static_cast<size_t>(m) * MAX_MESH_LODS;
+        p_lods[0] = {mesh.idx_count, 0, mesh.vert_offset, 0.f};
+        std::vector<uint32_t> &simplified = lod_indices[m];
+        for (uint32_t level = 1; level <= lod_count; level++) {
+            std::vector<uint32_t> lod;
+            float error = simplify_clustered(p_idx, mesh.idx_count, src.positions, src.vert_count,
+                                             min, max, LOD_GRID_SIZE >> (level - 1), lod);
+            const uint32_t lod_idx_count = static_cast<uint32_t>(lod.size());
+            if (lod_idx_count == 0 || lod_idx_count > p_lods[level - 1].idx_count / 4 * 3) break;
+            if (optimize) optimize_vertex_cache(lod.data(), lod_idx_count, src.vert_count);
+            p_lods[level] = {lod_idx_count, static_cast<uint32_t>(simplified.size()), mesh.vert_offset, error};
+            simplified.insert(simplified.end(), lod.begin(), lod.end());
+            simplified_counts[m] = level;
+        }
+
+        if (optimize) {
+            Mesh_cache_stats &stats = res.cache_stats[m];
+            stats.before = analyze_vertex_cache(p_idx, mesh.idx_count, src.vert_count);
+            optimize_vertex_cache(p_idx, mesh.idx_count, src.vert_count);
+            optimize_overdraw(p_idx, mesh.idx_count, src.positions, src.vert_count);
+        }
+        // the source positions match the indices until the vertices are reordered
+        build_clusters(p_idx, mesh.idx_count, src.positions, src.vert_count,
+                       mesh.idx_base, mesh.vert_offset, mesh_clusters[m]);
+        if (optimize) {
+            Mesh_cache_stats &stats = res.cache_stats[m];
+            if (simplified.empty()) {
+                optimize_vertex_fetch(p_idx, mesh.idx_count, p_verts, src.vert_count, vert_floats);
+            } else {
+                // the simplified levels use vertices of the full one, they are renumbered
+                // with it, in the order of the full one
+                std::vector<uint32_t> all(p_idx, p_idx + mesh.idx_count);
+                all.insert(all.end(), simplified.begin(), simplified.end());
+                optimize_vertex_fetch(all.data(), static_cast<uint32_t>(all.size()), p_verts, src.vert_count, vert_floats);
+                std::copy(all.begin(), all.begin() + mesh.idx_count, p_idx);
+                std::copy(all.begin() + mesh.idx_count, all.end(), simplified.begin());
+            }
+            stats.after = analyze_vertex_cache(p_idx, mesh.idx_count, src.vert_count);
+        }
+    });
+
+    // the simplified levels follow the full meshes, their idx_base was
+    // relative to the simplified indices of the mesh
+    for (uint32_t m = 0; m < mesh_count; m++) {
+        Mesh_lod *p_lods = res.lods.data() + static_cast<size_t>(m) * MAX_MESH_LODS;
+        const uint32_t lod_base = static_cast<uint32_t>(res.indices.size());
+        p_lods[0].idx_base = res.meshes[m].idx_base;
+        for (uint32_t level = 1; level < MAX_MESH_LODS; level++) {
+            if (level <= simplified_counts[m]) p_lods[level].idx_base += lod_base;
+            else p_lods[level] = p_lods[level - 1];
+        }
+        res.indices.insert(res.indices.end(), lod_indices[m].begin(), lod_indices[m].end());
+    }
+
+    res.clusters.clear();
+    res.cluster_offsets.assign(1, 0);
+    for (auto &clusters : mesh_clusters) {
+        res.clusters.insert(res.clusters.end(), clusters.begin(), clusters.end());
+        res.cluster_offsets.push_back(static_cast<uint32_t>(res.clusters.size()));
+    }
+}
+
+inline void pack_meshes(const aiScene *p_scene,
+                        const Vertex_layout &layout,
+                        bool optimize,
+                        uint32_t lod_count,
+                        Job_system *p_jobs,
+                        Packed_meshes &res)
+{
+    std::vector<std::vector<uint32_t>> indices;
+    std::vector<Mesh_source> sources;
+    ai_mesh_sources(p_scene, p_jobs, indices, sources);
+    pack_meshes(sources, layout, optimize, lod_count, p_jobs, res);
+}
+} // namespace base
@@ -0,0 +1,132 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// simplified index lists of an indexed triangle mesh over its own vertices,
+// all indices are relative to the first vertex of the mesh
+//
+// simplify_clustered() collapses the vertices of every cell of a uniform grid
+// into one of them (Rossignac and Borrel, vertex clustering), the one with the
+// least quadric error of the cell's triangle planes (Lindstrom, out-of-core
+// simplification), triangles left with less than three cells are dropped
+
+namespace base
+{
+// p_positions holds 3 floats per vertex, grid_size cells span the longest side
+// of the min - max box, returns the largest distance of a vertex to the one it
+// was collapsed into over that side, 0 when nothing is collapsed
+inline float simplify_clustered(const uint32_t *p_indices,
+                                uint32_t idx_count,
+                                const float *p_positions,
+                                uint32_t vert_count,
+                                const glm::vec3 &min,
+                                const glm::vec3 &max,
+                                uint32_t grid_size,
+                                std::vector<uint32_t> &res)
+{
+    res.clear();
+    const glm::vec3 extent = max - min;
+    const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    if (!(longest > 0.f) || grid_size == 0) {
+        res.assign(p_indices, p_indices + idx_count);
+        return 0.f;
+    }
+
+    auto position = [p_positions](uint32_t v) {
+        return glm::vec3(p_positions[3 * v], p_positions[3 * v + 1], p_positions[3 * v + 2]);
+    };
+
+    // cell of every vertex
+    const float cell_size = longest / grid_size;
+    uint32_t dims[3];
+    for (int i = 0; i < 3; i++) {
+        dims[i] = std::min(grid_size, std::max(1u, static_cast<uint32_t>(std::ceil(extent[i] / cell_size))));
+    }
+    std::vector<uint32_t> vert_cells(vert_count);
+    for (uint32_t v = 0; v < vert_count; v++) {
+        glm::vec3 p = (position(v) - min) / cell_size;
+        uint32_t c[3];
+        for (int i = 0; i < 3; i++) {
+            c[i] = std::min(dims[i] - 1, static_cast<uint32_t>(std::max(0.f, p[i])));
+        }
+        vert_cells[v] = (c[0] * dims[1] + c[1]) * dims[2] + c[2];
+    }
+
+    // area weighted plane quadrics per cell, the symmetric 4x4 matrix as
+    // xx, xy, xz, xd, yy, yz, yd, zz, zd, dd
+    typedef std::array<double, 10> Quadric;
+    std::vector<Quadric> quadrics(static_cast<size_t>(dims[0]) * dims[1] * dims[2]);
+    for (auto &q : quadrics) q.fill(0.);
+    const uint32_t tri_count = idx_count / 3;
+    for (uint32_t t = 0; t < tri_count; t++) {
+        const uint32_t *p_tri = p_indices + 3 * t;
+        glm::vec3 p0 = position(p_tri[0]);
+        glm::vec3 n = glm::cross(position(p_tri[1]) - p0, position(p_tri[2]) - p0);
+        float area = glm::length(n);
+        if (!(area > 0.f)) continue;
+        n /= area;
+        double plane[4] = {n.x, n.y, n.z, -glm::dot(n, p0)};
+        Quadric q;
+        int k = 0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = i; j < 4; j++) q[k++] = area * plane[i] * plane[j];
+        }
+        for (int i = 0; i < 3; i++) {
+            Quadric &cell = quadrics[vert_cells[p_tri[i]]];
+            for (int j = 0; j < 10; j++) cell[j] += q[j];
+        }
+    }
+
+    // the vertex of every cell with the least error
+    const uint32_t none = ~0u;
+    std::vector<uint32_t> cell_verts(quadrics.size(), none);
+    std::vector<double> cell_errors(quadrics.size(), 0.);
+    for (uint32_t i = 0; i < idx_count; i++) {
+        uint32_t v = p_indices[i];
+        uint32_t cell = vert_cells[v];
+        const Quadric &q = quadrics[cell];
+        glm::vec3 p = position(v);
+        double x = p.x, y = p.y, z = p.z;
+        double error = q[0] * x * x + 2. * q[1] * x * y + 2. * q[2] * x * z + 2. * q[3] * x +
+            q[4] * y * y + 2. * q[5] * y * z + 2. * q[6] * y +
+            q[7] * z * z + 2. * q[8] * z + q[9];
+        if (cell_verts[cell] == none || error < cell_errors[cell]) {
+            cell_verts[cell] = v;
+            cell_errors[cell] = error;
+        }
+    }
+
+    // collapsed triangles in their order, without degenerate and duplicate ones
+    std::vector<std::array<uint32_t, 4>> tris; // collapsed vertices and the triangle
+    tris.reserve(tri_count);
+    float max_dist = 0.f;
+    for (uint32_t t = 0; t < tri_count; t++) {
+        std::array<uint32_t, 4> tri;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = p_indices[3 * t + k];
+            tri[k] = cell_verts[vert_cells[v]];
+            max_dist = std::max(max_dist, glm::length(position(v) - position(tri[k])));
+        }
+        tri[3] = t;
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) continue;
+        // the same rotation for the same triangle, the winding is kept
+        while (tri[0] > tri[1] || tri[0] > tri[2]) std::rotate(tri.begin(), tri.begin() + 1, tri.begin() + 3);
+        tris.push_back(tri);
+    }
+    std::sort(tris.begin(), tris.end());
+    tris.erase(std::unique(tris.begin(), tris.end(), [](const std::array<uint32_t, 4> &a, const std::array<uint32_t, 4> &b) {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+    }), tris.end());
+    std::sort(tris.begin(), tris.end(), [](const std::array<uint32_t, 4> &a, const std::array<uint32_t, 4> &b) {
+        return a[3] < b[3];
+    });
+
+    res.reserve(tris.size() * 3);
+    for (auto &tri : tris) res.insert(res.end(), tri.begin(), tri.begin() + 3);
+    return max_dist / longest;
+}
+} // namespace base
@@ -0,0 +1,352 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// decoders of the meshoptimizer buffer codecs of EXT_meshopt_compression,
+// the vertex codec (ATTRIBUTES, version 0), the triangle index codec
+// (TRIANGLES, versions 0 and 1) and the index sequence codec (INDICES), and
+// the octahedral and exponential filters applied after them
+//
+// all decoders check the bounds of the encoded data and return false on
+// malformed input instead of reading past it
+
+namespace base
+{
+namespace meshopt
+{
+const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+const size_t BYTE_GROUP_SIZE = 16;
+const size_t TAIL_MIN_SIZE = 32;
+
+inline size_t vertex_block_size_(size_t vertex_size)
+{
+    size_t res = VERTEX_BLOCK_SIZE_BYTES / vertex_size;
+    res &= ~(BYTE_GROUP_SIZE - 1);
+    return res < VERTEX_BLOCK_MAX_SIZE ? res : VERTEX_BLOCK_MAX_SIZE;
+}
+
+inline uint8_t unzigzag8_(uint8_t v)
+{
+    return static_cast<uint8_t>((0 - (v & 1)) ^ (v >> 1));
+}
+
+// 16 bytes of 0, 2, 4 or 8 bits each, 2 and 4 bit values of all ones
+// are followed by the byte in full
+inline const uint8_t *decode_bytes_group_(const uint8_t *p_data,
+                                          const uint8_t *p_end,
+                                          uint8_t *p_dst,
+                                          int bitslog2)
+{
+    if (bitslog2 == 0) {
+        memset(p_dst, 0, BYTE_GROUP_SIZE);
+        return p_data;
+    }
+    if (bitslog2 == 3) {
+        if (static_cast<size_t>(p_end - p_data) < BYTE_GROUP_SIZE) return nullptr;
+        memcpy(p_dst, p_data, BYTE_GROUP_SIZE);
+        return p_data + BYTE_GROUP_SIZE;
+    }
+    const int bits = bitslog2 == 1 ? 2 : 4;
+    const size_t packed_bytes = BYTE_GROUP_SIZE * bits / 8;
+    if (static_cast<size_t>(p_end - p_data) < packed_bytes) return nullptr;
+    const uint8_t sentinel = static_cast<uint8_t>((1 << bits) - 1);
+    const uint8_t *p_extra = p_data + packed_bytes;
+    for (size_t i = 0; i < BYTE_GROUP_SIZE; i++) {
+        // most significant bits first
+        const int shift = 8 - bits - static_cast<int>(i * bits % 8);
+        uint8_t v = static_cast<uint8_t>((p_data[i * bits / 8] >> shift) & sentinel);
+        if (v == sentinel) {
+            if (p_extra == p_end) return nullptr;
+            v = *p_extra++;
+        }
+        p_dst[i] = v;
+    }
+    return p_extra;
+}
+
+inline const uint8_t *decode_bytes_(const uint8_t *p_data,
+                                    const uint8_t *p_end,
+                                    uint8_t *p_dst,
+                                    size_t count)
+{
+    // 2 bits per group of the group sizes
+    const size_t group_count = count / BYTE_GROUP_SIZE;
+    const size_t header_size = (group_count + 3) / 4;
+    if (static_cast<size_t>(p_end - p_data) < header_size) return nullptr;
+    const uint8_t *p_header = p_data;
+    p_data += header_size;
+    for (size_t g = 0; g < group_count; g++) {
+        int bitslog2 = (p_header[g / 4] >> ((g % 4) * 2)) & 3;
+        p_data = decode_bytes_group_(p_data, p_end, p_dst + g * BYTE_GROUP_SIZE, bitslog2);
+        if (!p_data) return nullptr;
+    }
+    return p_data;
+}
+
+// the vertices of a block are stored byte by byte, each byte as the
+// zigzag delta to the same byte of the previous vertex
+inline const uint8_t *decode_vertex_block_(const uint8_t *p_data,
+                                           const uint8_t *p_end,
+                                           uint8_t *p_dst,
+                                           size_t vertex_count,
+                                           size_t vertex_size,
+                                           uint8_t *p_last_vertex)
+{
+    uint8_t deltas[VERTEX_BLOCK_MAX_SIZE];
+    const size_t count_aligned = (vertex_count + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+    for (size_t k = 0; k < vertex_size; k++) {
+        p_data = decode_bytes_(p_data, p_end, deltas, count_aligned);
+        if (!p_data) return nullptr;
+        uint8_t p = p_last_vertex[k];
+        for (size_t i = 0; i < vertex_count; i++) {
+            p = static_cast<uint8_t>(p + unzigzag8_(deltas[i]));
+            p_dst[i * vertex_size + k] = p;
+        }
+    }
+    memcpy(p_last_vertex, p_dst + (vertex_count - 1) * vertex_size, vertex_size);
+    return p_data;
+}
+
+// vertex_count vertices of vertex_size bytes, a multiple of 4 up to 256
+inline bool decode_vertex_buffer(void *p_dst,
+                                 size_t vertex_count,
+                                 size_t vertex_size,
+                                 const uint8_t *p_src,
+                                 size_t src_size)
+{
+    if (vertex_size == 0 || vertex_size > 256 || vertex_size % 4 != 0) return false;
+    const uint8_t *p_data = p_src;
+    const uint8_t *p_end = p_src + src_size;
+    if (src_size < 1 + vertex_size) return false;
+    if (*p_data++ != 0xa0) return false; // version 0
+    // the first vertex is stored in full at the end, the deltas start from it
+    uint8_t last_vertex[256];
+    memcpy(last_vertex, p_end - vertex_size, vertex_size);
+
+    const size_t block_size = vertex_block_size_(vertex_size);
+    auto p_vertices = static_cast<uint8_t *>(p_dst);
+    for (size_t offset = 0; offset < vertex_count; offset += block_size) {
+        size_t count = offset + block_size < vertex_count ? block_size : vertex_count - offset;
+        p_data = decode_vertex_block_(p_data, p_end, p_vertices + offset * vertex_size,
+                                      count, vertex_size, last_vertex);
+        if (!p_data) return false;
+    }
+    const size_t tail_size = vertex_size < TAIL_MIN_SIZE ? TAIL_MIN_SIZE : vertex_size;
+    return static_cast<size_t>(p_end - p_data) == tail_size;
+}
+
+inline bool decode_vbyte_(const uint8_t *&p_data,
+                          const uint8_t *p_end,
+                          uint32_t &res)
+{
+    res = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (p_data == p_end) return false;
+        uint8_t group = *p_data++;
+        res |= static_cast<uint32_t>(group & 127) << shift;
+        if (group < 128) return true;
+    }
+    return false;
+}
+
+// free indices are zigzag deltas to the last free index
+inline bool decode_index_(const uint8_t *&p_data,
+                          const uint8_t *p_end,
+                          uint32_t &last)
+{
+    uint32_t v;
+    if (!decode_vbyte_(p_data, p_end, v)) return false;
+    last += (v >> 1) ^ (0u - (v & 1));
+    return true;
+}
+
+// index_count 16 or 32 bit indices of a triangle list, the triangles are
+// coded against a fifo of 16 recent edges and one of 16 recent vertices
+inline bool decode_index_buffer(void *p_dst,
+                                size_t index_count,
+                                size_t index_size,
+                                const uint8_t *p_src,
+                                size_t src_size)
+{
+    if (index_count % 3 != 0 || (index_size != 2 && index_size != 4)) return false;
+    // header, a code per triangle and the 16 byte table of the aux codes
+    if (src_size < 1 + index_count / 3 + 16) return false;
+    if ((p_src[0] & 0xf0) != 0xe0) return false;
+    const int version = p_src[0] & 0x0f;
+    if (version > 1) return false;
+
+    uint32_t edge_fifo[16][2];
+    uint32_t vertex_fifo[16];
+    memset(edge_fifo, -1, sizeof(edge_fifo));
+    memset(vertex_fifo, -1, sizeof(vertex_fifo));
+    size_t edge_offset = 0, vertex_offset = 0;
+    auto push_vertex = [&](uint32_t v, bool cond) {
+        vertex_fifo[vertex_offset] = v;
+        vertex_offset = (vertex_offset + (cond ? 1 : 0)) & 15;
+    };
+    auto push_edge = [&](uint32_t a, uint32_t b) {
+        edge_fifo[edge_offset][0] = a;
+        edge_fifo[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    };
+    auto write = [&](size_t i, uint32_t a, uint32_t b, uint32_t c) {
+        if (index_size == 2) {
+            auto p = static_cast<uint16_t *>(p_dst) + i;
+            p[0] = static_cast<uint16_t>(a);
+            p[1] = static_cast<uint16_t>(b);
+            p[2] = static_cast<uint16_t>(c);
+        } else {
+            auto p = static_cast<uint32_t *>(p_dst) + i;
+            p[0] = a;
+            p[1] = b;
+            p[2] = c;
+        }
+    };
+
+    uint32_t next = 0, last = 0;
+    // version 1 codes the free index deltas -1 and 1 as 13 and 14
+    const int fec_max = version >= 1 ? 13 : 15;
+    const uint8_t *p_code = p_src + 1;
+    const uint8_t *p_data = p_code + index_count / 3;
+    const uint8_t *p_data_end = p_src + src_size - 16;
+    const uint8_t *p_aux_table = p_data_end;
+    for (size_t i = 0; i < index_count; i += 3) {
+        if (p_data > p_data_end) return false;
+        uint8_t code = *p_code++;
+        if (code < 0xf0) {
+            // an edge of the fifo and a new, recent or free vertex
+            const int fe = code >> 4;
+            uint32_t a = edge_fifo[(edge_offset - 1 - fe) & 15][0];
+            uint32_t b = edge_fifo[(edge_offset - 1 - fe) & 15][1];
+            const int fec = code & 15;
+            uint32_t c;
+            if (fec < fec_max) {
+                c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - 1 - fec) & 15];
+                push_vertex(c, fec == 0);
+            } else {
+                if (fec != 15) last += fec - (fec ^ 3);
+                else if (!decode_index_(p_data, p_data_end, last)) return false;
+                c = last;
+                push_vertex(c, true);
+            }
+            write(i, a, b, c);
+            push_edge(c, b);
+            push_edge(a, c);
+        } else if (code < 0xfe) {
+            // a new vertex and two new or recent ones, coded in the aux table
+            uint8_t aux = p_aux_table[code & 15];
+            const int feb = aux >> 4;
+            const int fec = aux & 15;
+            uint32_t a = next++;
+            uint32_t b = feb == 0 ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+            uint32_t c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+            write(i, a, b, c);
+            push_vertex(a, true);
+            push_vertex(b, feb == 0);
+            push_vertex(c, fec == 0);
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        } else {
+            // the same with the aux code in full and free vertices
+            if (p_data == p_data_end) return false;
+            uint8_t aux = *p_data++;
+            const int fea = code == 0xfe ? 0 : 15;
+            const int feb = aux >> 4;
+            const int fec = aux & 15;
+            if (aux == 0) next = 0; // restart
+            uint32_t a = fea == 0 ? next++ : 0;
+            uint32_t b = feb == 0 ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+            uint32_t c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+            if (fea == 15) {
+                if (!decode_index_(p_data, p_data_end, last)) return false;
+                a = last;
+            }
+            if (feb == 15) {
+                if (!decode_index_(p_data, p_data_end, last)) return false;
+                b = last;
+            }
+            if (fec == 15) {
+                if (!decode_index_(p_data, p_data_end, last)) return false;
+                c = last;
+            }
+            write(i, a, b, c);
+            push_vertex(a, true);
+            push_vertex(b, feb == 0 || feb == 15);
+            push_vertex(c, fec == 0 || fec == 15);
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+    }
+    return p_data == p_data_end;
+}
+
+// index_count 16 or 32 bit indices of any topology, each a zigzag delta
+// to one of the last two indices
+inline bool decode_index_sequence(void *p_dst,
+                                  size_t index_count,
+                                  size_t index_size,
+                                  const uint8_t *p_src,
+                                  size_t src_size)
+{
+    if (index_size != 2 && index_size != 4) return false;
+    // header, a byte per index at least and a 4 byte tail
+    if (src_size < 1 + index_count + 4) return false;
+    if ((p_src[0] & 0xf0) != 0xd0 || (p_src[0] & 0x0f) > 1) return false;
+    const uint8_t *p_data = p_src + 1;
+    const uint8_t *p_data_end = p_src + src_size - 4;
+    uint32_t last[2] = {0, 0};
+    for (size_t i = 0; i < index_count; i++) {
+        uint32_t v;
+        if (!decode_vbyte_(p_data, p_data_end, v)) return false;
+        uint32_t &base = last[v & 1];
+        v >>= 1;
+        base += (v >> 1) ^ (0u - (v & 1));
+        if (index_size == 2) static_cast<uint16_t *>(p_dst)[i] = static_cast<uint16_t>(base);
+        else static_cast<uint32_t *>(p_dst)[i] = base;
+    }
+    return p_data == p_data_end;
+}
+
+// snorm8 or snorm16 x 4 octahedral unit vectors with the scale in z,
+// to snorm unit vectors in place, the w component is kept
+template<typename T>
+inline void filter_octahedral(T *p_data,
+                              size_t count)
+{
+    const float max = static_cast<float>((1 << (sizeof(T) * 8 - 1)) - 1);
+    for (size_t i = 0; i < count; i++) {
+        T *p = p_data + 4 * i;
+        float x = static_cast<float>(p[0]);
+        float y = static_cast<float>(p[1]);
+        float z = static_cast<float>(p[2]) - std::fabs(x) - std::fabs(y);
+        // the lower hemisphere is folded
+        float t = z < 0.f ? z : 0.f;
+        x += x >= 0.f ? t : -t;
+        y += y >= 0.f ? t : -t;
+        float l = std::sqrt(x * x + y * y + z * z);
+        float s = l > 0.f ? max / l : 0.f;
+        p[0] = static_cast<T>(static_cast<int>(x * s + (x >= 0.f ? .5f : -.5f)));
+        p[1] = static_cast<T>(static_cast<int>(y * s + (y >= 0.f ? .5f : -.5f)));
+        p[2] = static_cast<T>(static_cast<int>(z * s + (z >= 0.f ? .5f : -.5f)));
+    }
+}
+
+// 24 bit mantissas with 8 bit exponents to floats in place
+inline void filter_exponential(uint32_t *p_data,
+                               size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint32_t v = p_data[i];
+        int32_t m = static_cast<int32_t>(v << 8) >> 8;
+        int32_t e = static_cast<int32_t>(v) >> 24;
+        float res = std::ldexp(static_cast<float>(m), e);
+        memcpy(&p_data[i], &res, sizeof(res));
+    }
+}
+} // namespace meshopt
+} // namespace base
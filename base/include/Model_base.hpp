@@ -1,6 +1,8 @@
 #pragma once
 #include "tools.hpp"
 #include "Geometries.hpp"
+#include "Gltf_loader.hpp"
+#include "Timer.hpp"
 #include <assimp/postprocess.h>
 #define MSG_PREFIX "-- MODEL: "
 
@@ -15,12 +17,22 @@ public:
 
     Geometries *p_geometries{nullptr}; 
 
+    // threads packing the meshes of an imported scene, 0 for one per hardware thread
+    uint32_t load_thread_count{0};
+    // vertex cache, overdraw and vertex fetch order of the imported meshes,
+    // see Geometries::optimize_meshes
+    bool optimize_meshes{false};
+    // a tightly packed copy of the positions, see Geometries::position_stream
+    bool position_stream{false};
+    // simplified levels of the imported meshes, see Geometries::lod_count
+    uint32_t lod_count{0};
+
     Model_base(Physical_device *p_phy_dev,
           Device *p_dev,
-          vk::CommandPool graphics_cmd_pool) :
+          Upload_manager *p_uploads) :
         p_phy_dev_(p_phy_dev),
         p_dev_(p_dev),
-        graphics_cmd_pool_(graphics_cmd_pool)
+        p_uploads_(p_uploads)
     {}
 
     virtual ~Model_base()
@@ -32,38 +44,82 @@ public:
               const Vertex_layout &layout,
               const int ai_flags = 0 )
     {
-        assert(file_exists(model_path));
         model_path_ = model_path;
+        ai_flags_ = ai_flags;
         std::cout << MSG_PREFIX << "loading file " << model_path << std::endl;
 
-        Assimp::Importer importer;
-        const aiScene *p_scene = importer.ReadFile(model_path_.c_str(),
-                                                   aiProcess_Triangulate | aiProcess_RemoveRedundantMaterials | ai_flags);
-        assert(p_scene);
+        p_geometries = new Geometries(p_phy_dev_, p_dev_, layout);
+        p_geometries->keep_host_data = keep_host_geometry_;
+        p_geometries->optimize_meshes = optimize_meshes;
+        p_geometries->position_stream = position_stream;
+        p_geometries->lod_count = lod_count;
 
-        std::vector<vk::CommandBuffer> cmd_buffers = p_dev_->dev.allocateCommandBuffers(
-            vk::CommandBufferAllocateInfo(
-                graphics_cmd_pool_,
-                vk::CommandBufferLevel::ePrimary,
-                1));
+        if (!load_cached_()) {
+            assert(file_exists(model_path));
+            Job_system jobs(load_thread_count);
+            Timer timer;
+            double import_time, geometries_time;
+            if (Gltf_scene::is_gltf_path(model_path_)) {
+                // without assimp, ai_flags do not apply
+                Gltf_scene scene;
+                if (!scene.load(model_path_, &jobs))
+                    std::cout << MSG_PREFIX << "cannot load " << model_path_ << ", " << scene.error << std::endl;
+                assert(scene.error.empty());
+                if (scene.skipped_primitives > 0)
+                    std::cout << MSG_PREFIX << scene.skipped_primitives << " primitives are not triangle lists, skipped" << std::endl;
+                import_time = timer.get();
 
-        p_geometries = new Geometries(p_phy_dev_, p_dev_, layout);
-        p_geometries->init(p_scene, cmd_buffers[0]);
-        post_process_(p_scene, cmd_buffers[0]);
+                p_geometries->init(scene.mesh_sources(), *p_uploads_, &jobs);
+                geometries_time = timer.get();
+                post_process_(scene);
+            } else {
+                Assimp::Importer importer;
+                const aiScene *p_scene = importer.ReadFile(model_path_.c_str(),
+                                                           aiProcess_Triangulate | aiProcess_RemoveRedundantMaterials | ai_flags);
+                assert(p_scene);
+                import_time = timer.get();
+
+                p_geometries->init(p_scene, *p_uploads_, &jobs);
+                geometries_time = timer.get();
+                post_process_(p_scene);
+                // scene is freed when the Importer is destroyed
+            }
+            double post_process_time = timer.get();
+
+            std::cout << MSG_PREFIX << "import " << import_time * 1000. << " ms, geometries " <<
+                (geometries_time - import_time) * 1000. << " ms, post process " <<
+                (post_process_time - geometries_time) * 1000. << " ms, " <<
+                jobs.thread_count() << " threads" << std::endl;
+        }
 
-        p_dev_->dev.freeCommandBuffers(graphics_cmd_pool_, cmd_buffers);
-        cmd_buffers.clear();
-        // scene is freed when the Importer is destroyed
+        // the last copies are submitted, the caller waits for them before
+        // the first frame
+        p_uploads_->flush();
     }
 
 protected:
     base::Physical_device *p_phy_dev_;
     base::Device *p_dev_;
-    vk::CommandPool graphics_cmd_pool_;
+    // the copies of the geometries, materials and instances, waited for by
+    // the owner
+    Upload_manager *p_uploads_;
     std::string model_path_;
+    int ai_flags_{0};
+    // the geometries keep their packed host data, see load_cached_
+    bool keep_host_geometry_{false};
+
+    // loads everything the import would from elsewhere, e.g. a cache of an
+    // earlier import, returns false to import the model file instead
+    virtual bool load_cached_()
+    {
+        return false;
+    }
+
+    virtual void post_process_(const aiScene *p_scene)
+    {};
 
-    virtual void post_process_(const aiScene *p_scene,
-                                 vk::CommandBuffer cmd_buffer)
+    // the same for a glTF scene loaded without assimp
+    virtual void post_process_(const Gltf_scene &scene)
     {};
 };
 } // namespace base
@@ -0,0 +1,96 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include "Swapchain.hpp"
+#include "Render_target.hpp"
+#define MSG_PREFIX "-- OFFSCREEN_TARGET: "
+
+namespace base
+{
+// stands in for the swapchain when there is no surface,
+// each back buffer renders into its own color image
+class Offscreen_target : public Swapchain
+{
+public:
+    Offscreen_target(Physical_device* p_phy_dev,
+                     Device* p_dev,
+                     vk::SurfaceFormatKHR surface_format,
+                     vk::Format depth_format,
+                     uint32_t image_count,
+                     Render_pass* p_onscreen_rp) :
+        Swapchain(p_phy_dev,
+                  p_dev,
+                  vk::SurfaceKHR(),
+                  surface_format,
+                  depth_format,
+                  image_count,
+                  p_onscreen_rp)
+    {}
+
+    ~Offscreen_target() override
+    {
+        // need to call detach() in the program before deconstruction
+        assert(p_color_targets_.empty());
+    }
+
+    bool resize(uint32_t width_hint, uint32_t height_hint, bool force = false) override
+    {
+        vk::Extent2D new_extent{std::max(1u, width_hint), std::max(1u, height_hint)};
+        if (curr_extent_.width == new_extent.width && curr_extent_.height == new_extent.height && !force)
+            return false;
+
+        if (!framebuffers.empty()) {
+            p_dev_->dev.waitIdle();
+            detach();
+        }
+
+        curr_extent_ = new_extent;
+        attach();
+
+        std::cout << MSG_PREFIX << "offscreen target resized to " << curr_extent_.width << " x " << curr_extent_.height
+            << std::endl;
+        return true;
+    }
+
+    void attach() override
+    {
+        update_render_area_();
+
+        std::vector<vk::Image> images;
+        for (uint32_t i = 0; i < image_count_; i++) {
+            p_color_targets_.push_back(new Render_target(p_phy_dev_,
+                                                         p_dev_,
+                                                         surface_format_.format,
+                                                         curr_extent_,
+                                                         vk::ImageUsageFlagBits::eColorAttachment |
+                                                         vk::ImageUsageFlagBits::eTransferSrc,
+                                                         vk::ImageAspectFlagBits::eColor));
+            images.push_back(p_color_targets_.back()->image);
+        }
+
+        if (depth_format_ != vk::Format::eUndefined) {
+            create_depth_attachment_();
+        }
+        create_color_attachments_(images);
+        create_framebuffers_();
+    }
+
+    void detach() override
+    {
+        Swapchain::detach();
+        for (auto p_target : p_color_targets_) {
+            delete p_target;
+        }
+        p_color_targets_.clear();
+    }
+
+    vk::Image image(uint32_t idx) const
+    {
+        return p_color_targets_[idx]->image;
+    }
+
+private:
+    std::vector<Render_target*> p_color_targets_;
+};
+} // namespace base
+
+#undef MSG_PREFIX
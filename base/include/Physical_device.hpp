@@ -18,14 +18,21 @@ public:
     uint32_t graphics_queue_family_idx;
     uint32_t compute_queue_family_idx;
     uint32_t present_queue_family_idx;
+    // a family with transfer but neither graphics nor compute, the copy
+    // engines of discrete gpus, the graphics family otherwise
+    uint32_t transfer_queue_family_idx;
 
     vk::PhysicalDeviceMemoryProperties mem_props;
     vk::PhysicalDeviceProperties props;
 
+    // optional extensions supported by the chosen device are appended to req_extensions,
+    // optional features it supports are enabled in req_features
     Physical_device(vk::Instance* p_instance,
                     base::Shell_base* p_shell,
                     vk::PhysicalDeviceFeatures& req_features,
-                    std::vector<const char*>& req_extensions) :
+                    std::vector<const char*>& req_extensions,
+                    const std::vector<const char*>& opt_extensions = {},
+                    const vk::PhysicalDeviceFeatures& opt_features = {}) :
         p_instance_(p_instance),
         req_features(req_features),
         req_extensions(req_extensions)
@@ -63,8 +70,11 @@ public:
                 if (cqf < 0 &&
                     (props.queueFlags & compute_queue_flags) == compute_queue_flags)
                     cqf = i;
-                // present queue
-                if (pqf < 0 && static_cast<bool>(p_shell->can_present(pd, i)))
+                // present queue, a headless shell presents nothing
+                // and the graphics queue stands in
+                if (p_shell->headless())
+                    pqf = gqf;
+                else if (pqf < 0 && static_cast<bool>(p_shell->can_present(pd, i)))
                     pqf = i;
                 if (gqf >= 0 && cqf >= 0 && pqf >= 0) break;
             }
@@ -73,6 +83,15 @@ public:
                 graphics_queue_family_idx = static_cast<uint32_t>(gqf);
                 compute_queue_family_idx = static_cast<uint32_t>(cqf);
                 present_queue_family_idx = static_cast<uint32_t>(pqf);
+                transfer_queue_family_idx = graphics_queue_family_idx;
+                for (uint32_t i = 0; i < queue_family_props.size(); i++) {
+                    const vk::QueueFlags flags = queue_family_props[i].queueFlags;
+                    if ((flags & vk::QueueFlagBits::eTransfer) &&
+                        !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+                        transfer_queue_family_idx = i;
+                        break;
+                    }
+                }
                 break;
             }
         }
@@ -83,6 +102,21 @@ public:
         mem_props = phy_dev.getMemoryProperties();
         props = phy_dev.getProperties();
 
+        if (!opt_extensions.empty()) {
+            std::set<std::string> ext_names;
+            for (const auto& ext_prop : phy_dev.enumerateDeviceExtensionProperties()) {
+                ext_names.insert(static_cast<std::string>(ext_prop.extensionName));
+            }
+            for (const auto& ext_name : opt_extensions) {
+                bool supported = ext_names.find(ext_name) != ext_names.end();
+                if (supported) this->req_extensions.push_back(ext_name);
+                std::cout << MSG_PREFIX << "optional extension " << ext_name
+                    << (supported ? " enabled" : " not supported") << std::endl;
+            }
+        }
+
+        enable_opt_features_(opt_features);
+
         if (!check_req_features_support_()) {
             throw std::runtime_error("missing physical device features support");
         }
@@ -90,6 +124,14 @@ public:
 
     ~Physical_device() = default;
 
+    bool extension_enabled(const std::string& ext_name) const
+    {
+        for (const auto& ext : req_extensions) {
+            if (ext_name == ext) return true;
+        }
+        return false;
+    }
+
     uint32_t get_memory_type_index(uint32_t type_bits,
                                    const vk::MemoryPropertyFlags& property_flags)
     {
@@ -141,6 +183,24 @@ public:
 private:
     vk::Instance* p_instance_;
 
+    void enable_opt_features_(const vk::PhysicalDeviceFeatures& opt_features)
+    {
+        auto opt = static_cast<VkPhysicalDeviceFeatures>(opt_features);
+        auto opt_ptr = reinterpret_cast<VkBool32*>(&opt);
+        auto req = static_cast<VkPhysicalDeviceFeatures>(req_features);
+        auto req_ptr = reinterpret_cast<VkBool32*>(&req);
+        auto available_features = static_cast<VkPhysicalDeviceFeatures>(phy_dev.getFeatures());
+        auto avail_ptr = reinterpret_cast<VkBool32*>(&available_features);
+        auto len = sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32);
+        for (size_t i = 0; i < len; i++) {
+            if (opt_ptr[i] != VK_TRUE || req_ptr[i] == VK_TRUE) continue;
+            req_ptr[i] = avail_ptr[i];
+            std::cout << MSG_PREFIX << "optional physical device feature #" << i
+                << (avail_ptr[i] == VK_TRUE ? " enabled" : " not supported") << std::endl;
+        }
+        req_features = vk::PhysicalDeviceFeatures(req);
+    }
+
     bool check_req_features_support_()
     {
         auto req = static_cast<VkPhysicalDeviceFeatures>(req_features);
@@ -5,6 +5,7 @@
 #include "FPS_counter.hpp"
 #include "Physical_device.hpp"
 #include "Device.hpp"
+#include <cstring>
 #include <iostream>
 #define DEBUG_REPORT_VERBOSE false
 #define MSG_PREFIX "-- PROGRAM_BASE: "
@@ -69,7 +70,7 @@ public:
         delete p_dev_;
         delete p_phy_dev_;
 
-        instance_.destroySurfaceKHR(surface_);
+        if (surface_) instance_.destroySurfaceKHR(surface_);
         p_shell_->destroy_window();
 
         if (enable_validation_) destroy_debug_report_callback_();
@@ -78,9 +79,12 @@ public:
 
     void init_base(vk::Format format = vk::Format::eR8G8B8A8Unorm)
     {
-        req_inst_extensions_.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-        req_inst_extensions_.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-        req_device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        for (auto ext : p_shell_->required_instance_extensions()) {
+            req_inst_extensions_.push_back(ext);
+        }
+        if (!headless()) {
+            req_device_extensions_.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
 
         if (enable_validation_) {
             req_inst_layers_.push_back("VK_LAYER_LUNARG_standard_validation");
@@ -99,10 +103,22 @@ public:
         p_phy_dev_ = new Physical_device(&instance_,
                                          p_shell_,
                                          req_phy_dev_features_,
-                                         req_device_extensions_);
+                                         req_device_extensions_,
+                                         opt_device_extensions_,
+                                         opt_phy_dev_features_);
         p_dev_ = new Device(p_phy_dev_);
-        p_shell_->init_window();
-        init_surface_(format);
+        if (headless()) {
+            surface_format_ = {format, vk::ColorSpaceKHR::eSrgbNonlinear};
+        } else {
+            p_shell_->init_window();
+            init_surface_(format);
+        }
+    }
+
+    // no window, no surface, nothing is presented
+    bool headless() const
+    {
+        return p_shell_->headless();
     }
 
     void run()
@@ -110,19 +126,7 @@ public:
         Timer timer;
         double prev_time = timer.get();
 
-        while (true) {
-            bool quit = false;
-            MSG msg{};
-            while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
-                if (msg.message == WM_QUIT) {
-                    quit = true;
-                    break;
-                }
-                TranslateMessage(&msg);
-                DispatchMessage(&msg);
-            }
-            if (quit) break;
-
+        while (p_shell_->poll_events()) {
             acquire_back_buffer_();
 
             double curr_time = timer.get();
@@ -134,6 +138,19 @@ public:
         }
     }
 
+    // runs frame_count frames with a fixed time step
+    void run_headless(uint32_t frame_count, float frame_time = 1.f / 60.f)
+    {
+        Timer timer;
+        for (uint32_t i = 0; i < frame_count; i++) {
+            acquire_back_buffer_();
+            fps_counter_.update(frame_time);
+            present_back_buffer_(static_cast<float>(i) * frame_time, frame_time);
+        }
+        p_dev_->dev.waitIdle();
+        std::cout << MSG_PREFIX << frame_count << " frames in " << timer.get() << " s" << std::endl;
+    }
+
 protected:
     bool enable_validation_;
     Prog_info_base * p_info_;
@@ -143,7 +160,11 @@ protected:
     std::vector<const char *> req_inst_layers_{};
     std::vector<const char *> req_inst_extensions_{};
     vk::PhysicalDeviceFeatures req_phy_dev_features_{};
+    // enabled when the device supports them, see Physical_device::req_features
+    vk::PhysicalDeviceFeatures opt_phy_dev_features_{};
     std::vector<const char *> req_device_extensions_{};
+    // enabled when the device supports them, see Physical_device::extension_enabled
+    std::vector<const char *> opt_device_extensions_{};
 
     vk::Instance instance_;
     VkDebugReportCallbackEXT debug_report_ = VK_NULL_HANDLE;
@@ -232,8 +253,7 @@ protected:
 
     void init_surface_(vk::Format format)
     {
-        vk::Win32SurfaceCreateInfoKHR surface_info({}, p_shell_->hinstance, p_shell_->hwnd);
-        surface_ = instance_.createWin32SurfaceKHR(surface_info);
+        surface_ = p_shell_->create_surface(instance_);
         VkBool32 supported;
         p_phy_dev_->phy_dev.getSurfaceSupportKHR(p_phy_dev_->present_queue_family_idx, surface_, &supported);
         assert(supported);
@@ -0,0 +1,166 @@
+#pragma once
+#include "Shell_base.hpp"
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <stdexcept>
+#define MSG_PREFIX "-- SHELL_GLFW: "
+
+namespace base
+{
+class Shell_glfw : public Shell_base
+{
+public:
+    GLFWwindow *window{nullptr};
+
+    explicit Shell_glfw(Prog_info_base* p_info)
+        :Shell_base(p_info)
+    {
+        if (!glfwInit()) {
+            std::string errstr = MSG_PREFIX;
+            errstr.append("failed to initialize glfw");
+            throw std::runtime_error(errstr);
+        }
+    }
+
+    ~Shell_glfw() override
+    {
+        glfwTerminate();
+    }
+
+    std::vector<const char*> required_instance_extensions() const override
+    {
+        uint32_t count = 0;
+        const char **names = glfwGetRequiredInstanceExtensions(&count);
+        return std::vector<const char*>(names, names + count);
+    }
+
+    VkBool32 can_present(vk::PhysicalDevice phy_dev, uint32_t queue_family) override
+    {
+        return glfwGetPhysicalDevicePresentationSupport(nullptr,
+                                                        static_cast<VkPhysicalDevice>(phy_dev),
+                                                        queue_family) == GLFW_TRUE;
+    }
+
+    void init_window() override
+    {
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(static_cast<int>(p_info_base_->width()),
+                                  static_cast<int>(p_info_base_->height()),
+                                  p_info_base_->prog_name().c_str(),
+                                  nullptr,
+                                  nullptr);
+        if (!window) {
+            std::string errstr = MSG_PREFIX;
+            errstr.append("failed to create window");
+            throw std::runtime_error(errstr);
+        }
+        glfwSetWindowSizeLimits(window,
+                                GLFW_DONT_CARE, GLFW_DONT_CARE,
+                                max_width_ > 0 ? static_cast<int>(max_width_) : GLFW_DONT_CARE,
+                                max_height_ > 0 ? static_cast<int>(max_height_) : GLFW_DONT_CARE);
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback_);
+        glfwSetKeyCallback(window, key_callback_);
+        glfwSetScrollCallback(window, scroll_callback_);
+        glfwSetWindowCloseCallback(window, close_callback_);
+    }
+
+    void destroy_window() override
+    {
+        if (window) glfwDestroyWindow(window);
+        window = nullptr;
+    }
+
+    vk::SurfaceKHR create_surface(vk::Instance instance) override
+    {
+        VkSurfaceKHR surface;
+        if (glfwCreateWindowSurface(static_cast<VkInstance>(instance), window, nullptr, &surface) != VK_SUCCESS) {
+            std::string errstr = MSG_PREFIX;
+            errstr.append("failed to create window surface");
+            throw std::runtime_error(errstr);
+        }
+        return vk::SurfaceKHR(surface);
+    }
+
+    bool poll_events() override
+    {
+        glfwPollEvents();
+        return !glfwWindowShouldClose(window);
+    }
+
+    void post_quit_msg() override
+    {
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+
+private:
+    static Shell_glfw *get_shell_(GLFWwindow *window)
+    {
+        return reinterpret_cast<Shell_glfw*>(glfwGetWindowUserPointer(window));
+    }
+
+    static void framebuffer_size_callback_(GLFWwindow *window, int width, int height)
+    {
+        get_shell_(window)->window_resize_(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    }
+
+    static void scroll_callback_(GLFWwindow *window, double x_offset, double y_offset)
+    {
+        get_shell_(window)->on_key(y_offset > 0. ? KEY_WHEEL_UP : KEY_WHEEL_DOWN);
+    }
+
+    static void close_callback_(GLFWwindow *window)
+    {
+        // the shell decides, KEY_SHUTDOWN posts quit by default
+        glfwSetWindowShouldClose(window, GLFW_FALSE);
+        get_shell_(window)->on_key(KEY_SHUTDOWN);
+    }
+
+    static void key_callback_(GLFWwindow *window, int glfw_key, int scancode, int action, int mods)
+    {
+        if (action == GLFW_RELEASE) return;
+        Key key;
+        switch (glfw_key) {
+            case GLFW_KEY_ESCAPE:key = KEY_ESC; break;
+            case GLFW_KEY_UP:key = KEY_UP; break;
+            case GLFW_KEY_DOWN:key = KEY_DOWN; break;
+            case GLFW_KEY_LEFT:key = KEY_LEFT; break;
+            case GLFW_KEY_RIGHT:key = KEY_RIGHT; break;
+            case GLFW_KEY_SPACE:key = KEY_SPACE; break;
+            case GLFW_KEY_F1:key = KEY_F1; break;
+            case GLFW_KEY_F2:key = KEY_F2; break;
+            case GLFW_KEY_F3:key = KEY_F3; break;
+            case GLFW_KEY_F4:key = KEY_F4; break;
+            case GLFW_KEY_F5:key = KEY_F5; break;
+            case GLFW_KEY_F6:key = KEY_F6; break;
+            case GLFW_KEY_F7:key = KEY_F7; break;
+            case GLFW_KEY_F8:key = KEY_F8; break;
+            case GLFW_KEY_F9:key = KEY_F9; break;
+            case GLFW_KEY_F10:key = KEY_F10; break;
+            case GLFW_KEY_F11:key = KEY_F11; break;
+            case GLFW_KEY_F12:key = KEY_F12; break;
+            case GLFW_KEY_1:key = KEY_NUM_1; break;
+            case GLFW_KEY_2:key = KEY_NUM_2; break;
+            case GLFW_KEY_3:key = KEY_NUM_3; break;
+            case GLFW_KEY_4:key = KEY_NUM_4; break;
+            case GLFW_KEY_5:key = KEY_NUM_5; break;
+            case GLFW_KEY_6:key = KEY_NUM_6; break;
+            case GLFW_KEY_7:key = KEY_NUM_7; break;
+            case GLFW_KEY_8:key = KEY_NUM_8; break;
+            case GLFW_KEY_9:key = KEY_NUM_9; break;
+            case GLFW_KEY_0:key = KEY_NUM_0; break;
+            case GLFW_KEY_A:key = KEY_A; break;
+            case GLFW_KEY_W:key = KEY_W; break;
+            case GLFW_KEY_S:key = KEY_S; break;
+            case GLFW_KEY_D:key = KEY_D; break;
+            case GLFW_KEY_R:key = KEY_R; break;
+            case GLFW_KEY_F:key = KEY_F; break;
+            default:key = KEY_UNKNOWN; break;
+        }
+        get_shell_(window)->on_key(key);
+    }
+};
+} // namespace base
+
+#undef MSG_PREFIX
@@ -0,0 +1,59 @@
+#pragma once
+#include "Shell_base.hpp"
+
+namespace base
+{
+// shell for headless runs, no window and no surface
+class Shell_null : public Shell_base
+{
+public:
+    explicit Shell_null(Prog_info_base* p_info)
+        :Shell_base(p_info)
+    {}
+
+    bool headless() const override
+    {
+        return true;
+    }
+
+    std::vector<const char*> required_instance_extensions() const override
+    {
+        return {};
+    }
+
+    VkBool32 can_present(vk::PhysicalDevice phy_dev, uint32_t queue_family) override
+    {
+        return VK_FALSE;
+    }
+
+    void init_window() override
+    {}
+
+    void destroy_window() override
+    {}
+
+    vk::SurfaceKHR create_surface(vk::Instance instance) override
+    {
+        return vk::SurfaceKHR();
+    }
+
+    bool poll_events() override
+    {
+        return !quit_;
+    }
+
+    void post_quit_msg() override
+    {
+        quit_ = true;
+    }
+
+protected:
+    void window_resize_(uint32_t width, uint32_t height) override
+    {
+        p_info_base_->on_resize(width, height);
+    }
+
+private:
+    bool quit_{false};
+};
+} // namespace base
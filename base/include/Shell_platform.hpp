@@ -0,0 +1,24 @@
+#pragma once
+// windowed shell of the current platform,
+// BASE_USE_GLFW selects the portable glfw shell (set by the cmake build)
+#if defined(BASE_USE_GLFW)
+#include "Shell_glfw.hpp"
+namespace base
+{
+using Shell_platform = Shell_glfw;
+}
+#elif defined(_WIN32)
+#include "Shell_win32.hpp"
+namespace base
+{
+using Shell_platform = Shell_win32;
+}
+#else
+// no window system, only headless runs are possible
+#include "Shell_null.hpp"
+namespace base
+{
+using Shell_platform = Shell_null;
+}
+#endif
+#include "Shell_null.hpp"
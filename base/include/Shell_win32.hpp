@@ -0,0 +1,179 @@
+#pragma once
+#include "Shell_base.hpp"
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#ifndef WH_NCHITTEST
+#define WM_NCHITTEST 0x0084
+#endif
+
+namespace base
+{
+class Shell_win32 : public Shell_base
+{
+public:
+    HINSTANCE hinstance{nullptr};
+    HWND hwnd{nullptr};
+
+    explicit Shell_win32(Prog_info_base* p_info)
+        :Shell_base(p_info)
+    {}
+
+    std::vector<const char*> required_instance_extensions() const override
+    {
+        return {VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME};
+    }
+
+    void destroy_window() override
+    {
+        DestroyWindow(hwnd);
+    }
+
+    VkBool32 can_present(vk::PhysicalDevice phy_dev, uint32_t queue_family) override
+    {
+        return phy_dev.getWin32PresentationSupportKHR(queue_family);
+    }
+
+    vk::SurfaceKHR create_surface(vk::Instance instance) override
+    {
+        vk::Win32SurfaceCreateInfoKHR surface_info({}, hinstance, hwnd);
+        return instance.createWin32SurfaceKHR(surface_info);
+    }
+
+    void init_window() override
+    {
+        const std::string class_name("VulkanProgramWindowClass");
+        hinstance = GetModuleHandle(nullptr);
+        WNDCLASSEXA win_class = {};
+        win_class.cbSize = sizeof(WNDCLASSEX);
+        win_class.style = CS_HREDRAW | CS_VREDRAW;
+        win_class.lpfnWndProc = window_proc_;
+        win_class.hInstance = hinstance;
+        win_class.hCursor = LoadCursor(nullptr, IDC_ARROW);
+        win_class.lpszClassName = class_name.c_str();
+        RegisterClassExA(&win_class);
+
+        const DWORD win_style = WS_CLIPSIBLINGS | WS_CLIPCHILDREN | WS_VISIBLE | WS_OVERLAPPEDWINDOW;
+        long width = static_cast<long>(p_info_base_->width());
+        long height = static_cast<long>(p_info_base_->height());
+        long left = (GetSystemMetrics(SM_CXSCREEN) - width) / 2;
+        long top = (GetSystemMetrics(SM_CYSCREEN) - height) / 2;
+        RECT win_rect = {left, top, left + width, top + height};
+        AdjustWindowRect(&win_rect, win_style, false);
+
+        hwnd = CreateWindowExA(
+            WS_EX_APPWINDOW,
+            class_name.c_str(),
+            p_info_base_->prog_name().c_str(),
+            win_style,
+            left, top,
+            width, height,
+            nullptr,
+            nullptr,
+            hinstance,
+            nullptr);
+
+        SetForegroundWindow(hwnd);
+        SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+    }
+
+    bool poll_events() override
+    {
+        MSG msg{};
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) return false;
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+        return true;
+    }
+
+    void post_quit_msg() override
+    {
+        PostQuitMessage(0);
+    }
+
+private:
+    static LRESULT CALLBACK window_proc_(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
+    {
+        auto* shell = reinterpret_cast<Shell_win32*>(GetWindowLongPtr(hwnd, GWLP_USERDATA));
+        if (!shell) return DefWindowProc(hwnd, uMsg, wParam, lParam);
+        return shell->handle_message_(uMsg, wParam, lParam);
+    }
+
+    LRESULT handle_message_(UINT msg, WPARAM wparam, LPARAM lparam)
+    {
+        switch (msg) {
+            case WM_GETMINMAXINFO:
+            {
+                auto p_minmax_info = reinterpret_cast<MINMAXINFO FAR *>(lparam);
+                if (max_width_ > 0) p_minmax_info->ptMaxTrackSize.x = max_width_;
+                if (max_height_ > 0) p_minmax_info->ptMaxTrackSize.y = max_height_;
+            }
+            break;
+            case WM_SIZE:
+            {
+                UINT w = LOWORD(lparam);
+                UINT h = HIWORD(lparam);
+                window_resize_(w, h);
+            }
+            break;
+            case WM_MOUSEWHEEL:
+            {
+                auto zDelta = GET_WHEEL_DELTA_WPARAM(wparam);
+                on_key(zDelta > 0 ? KEY_WHEEL_UP : KEY_WHEEL_DOWN);
+            }
+            break;
+            case WM_KEYDOWN:
+            {
+                Key key;
+                switch (wparam) {
+                    case VK_ESCAPE:key = KEY_ESC; break;
+                    case VK_UP:key = KEY_UP; break;
+                    case VK_DOWN:key = KEY_DOWN; break;
+                    case VK_LEFT:key = KEY_LEFT; break;
+                    case VK_RIGHT:key = KEY_RIGHT; break;
+                    case VK_SPACE:key = KEY_SPACE; break;
+                    case VK_F1:key = KEY_F1; break;
+                    case VK_F2:key = KEY_F2; break;
+                    case VK_F3:key = KEY_F3; break;
+                    case VK_F4:key = KEY_F4; break;
+                    case VK_F5:key = KEY_F5; break;
+                    case VK_F6:key = KEY_F6; break;
+                    case VK_F7:key = KEY_F7; break;
+                    case VK_F8:key = KEY_F8; break;
+                    case VK_F9:key = KEY_F9; break;
+                    case VK_F10:key = KEY_F10; break;
+                    case VK_F11:key = KEY_F11; break;
+                    case VK_F12:key = KEY_F12; break;
+                    case 0x31:key = KEY_NUM_1; break;
+                    case 0x32:key = KEY_NUM_2; break;
+                    case 0x33:key = KEY_NUM_3; break;
+                    case 0x34:key = KEY_NUM_4; break;
+                    case 0x35:key = KEY_NUM_5; break;
+                    case 0x36:key = KEY_NUM_6; break;
+                    case 0x37:key = KEY_NUM_7; break;
+                    case 0x38:key = KEY_NUM_8; break;
+                    case 0x39:key = KEY_NUM_9; break;
+                    case 0x30:key = KEY_NUM_0; break;
+                    case 'A':key = KEY_A; break;
+                    case 'W':key = KEY_W; break;
+                    case 'S':key = KEY_S; break;
+                    case 'D':key = KEY_D; break;
+                    case 'R':key = KEY_R; break;
+                    case 'F':key = KEY_F; break;
+                    default:key = KEY_UNKNOWN; break;
+                }
+                on_key(key);
+            }
+            break;
+            case WM_CLOSE:on_key(KEY_SHUTDOWN); break;
+            case WM_DESTROY:post_quit_msg(); break;
+            default:
+                return DefWindowProc(hwnd, msg, wparam, lparam);
+        }
+        return 0;
+    }
+};
+} // namespace base
@@ -117,7 +117,8 @@ public:
         if (swapchain) p_dev_->dev.destroySwapchainKHR(swapchain);
     }
 
-    void resize(uint32_t width_hint, uint32_t height_hint, bool force = false)
+    // true when the swapchain and its images were recreated
+    virtual bool resize(uint32_t width_hint, uint32_t height_hint, bool force = false)
     {
         vk::SurfaceCapabilitiesKHR caps = p_phy_dev_->phy_dev.getSurfaceCapabilitiesKHR(surface_);
         assert(caps.supportedUsageFlags & vk::ImageUsageFlagBits::eColorAttachment);
@@ -129,7 +130,7 @@ public:
         new_extent.height = std::min(caps.maxImageExtent.height,
                                      std::max(caps.minImageExtent.height, height_hint));
         if (curr_extent_.width == new_extent.width && curr_extent_.height == new_extent.height && ! force)
-            return;
+            return false;
 
         // image count
         assert(image_count_ <= caps.maxImageCount && image_count_ >= caps.minImageCount);
@@ -205,17 +206,12 @@ public:
 
         std::cout << MSG_PREFIX << "swapchain resized to " << curr_extent_.width << " x " << curr_extent_.height
             << std::endl;
+        return true;
     }
 
-    void attach()
+    virtual void attach()
     {
-        // update render area
-        onscreen_viewport = vk::Viewport(0.f, 0.f,
-                                         static_cast<float>(curr_extent_.width),
-                                         static_cast<float>(curr_extent_.height),
-                                         0.f, 1.f);
-        onscreen_scissor = vk::Rect2D({0, 0}, curr_extent_);
-        p_onscreen_rp_->update_render_area(onscreen_scissor);
+        update_render_area_();
 
         // swapchain images
         std::vector<vk::Image> swapchain_images = p_dev_->dev.getSwapchainImagesKHR(swapchain);
@@ -258,6 +254,12 @@ public:
         return image_count_;
     }
 
+    // for framebuffers of other render passes over the same images
+    vk::ImageView color_view(uint32_t idx) const
+    {
+        return p_color_attachments_[idx]->view;
+    }
+
 protected:
     Physical_device * p_phy_dev_;
     Device* p_dev_;
@@ -273,6 +275,16 @@ protected:
     std::vector<Color_attachment*> p_color_attachments_;
     Depth_attachment* p_depth_attachment_ = nullptr;
 
+    void update_render_area_()
+    {
+        onscreen_viewport = vk::Viewport(0.f, 0.f,
+                                         static_cast<float>(curr_extent_.width),
+                                         static_cast<float>(curr_extent_.height),
+                                         0.f, 1.f);
+        onscreen_scissor = vk::Rect2D({0, 0}, curr_extent_);
+        p_onscreen_rp_->update_render_area(onscreen_scissor);
+    }
+
     virtual void create_depth_attachment_()
     {
         p_depth_attachment_ = new Depth_attachment(p_phy_dev_, p_dev_, depth_format_, curr_extent_);
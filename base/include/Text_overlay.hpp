@@ -9,6 +9,7 @@
 #include "Buffer.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "Upload_manager.hpp"
 
 #include <string>
 #include <map>
@@ -90,7 +91,7 @@ public:
         return res;
     }
 
-    void load(base::Physical_device *p_phy_dev, base::Device *p_dev, vk::CommandPool cmd_pool, const std::string &file_path)
+    void load(base::Physical_device *p_phy_dev, base::Device *p_dev, base::Upload_manager &uploads, const std::string &file_path)
     {
         std::string font_path = file_path + ".fnt";
         assert(base::file_exists(font_path));
@@ -213,7 +214,7 @@ public:
         p_tex = new base::Texture2D(p_phy_dev, p_dev);
         auto ktx_path = file_path + ".ktx";
         p_tex->load(ktx_path,
-                    cmd_pool,
+                    uploads,
                     vk::Format::eR8G8B8A8Unorm,
                     vk::ImageUsageFlagBits::eSampled,
                     vk::ImageLayout::eShaderReadOnlyOptimal,
@@ -348,11 +349,11 @@ public:
     Text_overlay(
         base::Physical_device *p_phy_dev,
         base::Device *p_dev,
-        vk::CommandPool cmd_pool,
+        base::Upload_manager *p_uploads,
         const std::string &file_path) :
         p_phy_dev_(p_phy_dev),
         p_dev_(p_dev),
-        cmd_pool_(cmd_pool)
+        p_uploads_(p_uploads)
     {
         prepare_font_(file_path);
         prepare_mesh_();
@@ -405,13 +406,13 @@ public:
 protected:
     base::Physical_device *p_phy_dev_;
     base::Device *p_dev_;
-    vk::CommandPool cmd_pool_;
+    base::Upload_manager *p_uploads_;
 
     void prepare_font_(const std::string &file_path)
     {
-        assert(cmd_pool_);
+        assert(p_uploads_);
         p_font = new Font();
-        p_font->load(p_phy_dev_, p_dev_, cmd_pool_, file_path);
+        p_font->load(p_phy_dev_, p_dev_, *p_uploads_, file_path);
     }
 
     void prepare_shaders_()
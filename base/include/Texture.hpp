@@ -2,6 +2,7 @@
 #include "tools.hpp"
 #include "Physical_device.hpp"
 #include "Device.hpp"
+#include "Upload_manager.hpp"
 #include <gli/gli.hpp>
 #include <iostream>
 #define MSG_PREFIX "-- TEXTURE: "
@@ -58,7 +59,7 @@ public:
     {}
 
     void load(const std::string& full_path,
-              const vk::CommandPool cmd_pool,
+              Upload_manager& uploads,
               const vk::Format format,
               const vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled,
               const vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal,
@@ -85,43 +86,6 @@ public:
             ", height: " << height <<
             ", mip_levels: " << mip_levels << std::endl;
 
-        // blit image from a staging buffer
-
-        // copy_cmd
-        std::vector<vk::CommandBuffer> copy_cmds =
-            p_dev_->dev.allocateCommandBuffers(
-                vk::CommandBufferAllocateInfo(
-                    cmd_pool,
-                    vk::CommandBufferLevel::ePrimary,
-                    1));
-        vk::CommandBuffer copy_cmd_buf = copy_cmds[0];
-        copy_cmd_buf.begin(vk::CommandBufferBeginInfo());
-
-        // staging_buffer
-        vk::Buffer staging_buffer = p_dev_->dev.createBuffer(
-            vk::BufferCreateInfo({},
-                                 tex2D.size(),
-                                 vk::BufferUsageFlagBits::eTransferSrc));
-        vk::MemoryRequirements mem_reqs =
-            p_dev_->dev.getBufferMemoryRequirements(staging_buffer);
-        vk::DeviceMemory staging_mem =
-            p_dev_->dev.allocateMemory(
-                vk::MemoryAllocateInfo(
-                    mem_reqs.size,
-                    p_phy_dev_->get_memory_type_index(
-                        mem_reqs.memoryTypeBits,
-                        vk::MemoryPropertyFlagBits::eHostVisible |
-                        vk::MemoryPropertyFlagBits::eHostCoherent)));
-        p_dev_->dev.bindBufferMemory(staging_buffer, staging_mem, 0);
-        uint8_t* data;
-        p_dev_->dev.mapMemory(staging_mem,
-                              0,
-                              mem_reqs.size,
-                              vk::MemoryMapFlagBits(),
-                              reinterpret_cast<void**>(&data));
-        memcpy(data, tex2D.data(), tex2D.size());
-        p_dev_->dev.unmapMemory(staging_mem);
-
         // setup buffer copy regions for each mip level
         std::vector<vk::BufferImageCopy> buf_image_copies;
         uint32_t offset = 0;
@@ -155,7 +119,7 @@ public:
                 vk::ImageLayout::eUndefined));
 
         // image mem
-        mem_reqs = p_dev_->dev.getImageMemoryRequirements(image);
+        vk::MemoryRequirements mem_reqs = p_dev_->dev.getImageMemoryRequirements(image);
         mem = p_dev_->dev.allocateMemory(
             vk::MemoryAllocateInfo(
                 mem_reqs.size,
@@ -171,56 +135,16 @@ public:
             0,
             1);
 
-        // change image layout
-        vk::ImageMemoryBarrier imb = vk::ImageMemoryBarrier(
-            {},
-            vk::AccessFlagBits::eTransferWrite,
-            vk::ImageLayout::eUndefined,
-            vk::ImageLayout::eTransferDstOptimal,
-            0,
-            0,
-            image,
-            range);
-        copy_cmd_buf.pipelineBarrier(
-            vk::PipelineStageFlagBits::eAllCommands,
-            vk::PipelineStageFlagBits::eAllCommands,
-            {},
-            0, nullptr,
-            0, nullptr,
-            1, &imb);
-
-        // copy staging buffer to image
-        copy_cmd_buf.copyBufferToImage(
-            staging_buffer,
-            image,
-            vk::ImageLayout::eTransferDstOptimal,
-            static_cast<uint32_t>(buf_image_copies.size()),
-            buf_image_copies.data());
-
-        // change image layout
-        imb.oldLayout = vk::ImageLayout::eTransferDstOptimal;
-        imb.newLayout = layout;
-        imb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-        imb.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-        copy_cmd_buf.pipelineBarrier(
-            vk::PipelineStageFlagBits::eAllCommands,
-            vk::PipelineStageFlagBits::eAllCommands,
-            {},
-            0, nullptr,
-            0, nullptr,
-            1, &imb);
-
-        // flush copy command buffer
-        copy_cmd_buf.end();
-        vk::SubmitInfo si(0, nullptr, nullptr, 1, &copy_cmd_buf, 0, nullptr);
-        assert_success(p_dev_->graphics_queue.submit(1, &si, nullptr));
-        p_dev_->graphics_queue.waitIdle();
-        // free copy command buffer
-        p_dev_->dev.freeCommandBuffers(cmd_pool, 1, &copy_cmd_buf);
-
-        // cleanup
-        p_dev_->dev.freeMemory(staging_mem);
-        p_dev_->dev.destroyBuffer(staging_buffer);
+        // the copy is batched with the other uploads, the image is ready
+        // once uploads has completed the submission
+        uploads.upload_image(image,
+                             tex2D.size(),
+                             tex2D.data(),
+                             buf_image_copies,
+                             range,
+                             layout,
+                             vk::PipelineStageFlagBits::eFragmentShader,
+                             vk::AccessFlagBits::eShaderRead);
 
         create_image_view_(format);
 
@@ -1,8 +1,5 @@
 #pragma once
-#ifndef WIN32_LEAN_AND_MEAN
-#define WIN32_LEAN_AND_MEAN
-#endif
-#include <windows.h>
+#include <chrono>
 
 namespace base
 {
@@ -11,23 +8,18 @@ class Timer
 public:
     Timer()
     {
-        LARGE_INTEGER freq;
-        QueryPerformanceFrequency(&freq); // from high resolution counter
-        freq_ = static_cast<double>(freq.QuadPart);
         reset();
     }
     void reset()
     {
-        QueryPerformanceCounter(&start_);
+        start_ = std::chrono::steady_clock::now(); // monotonic
     }
     double get() const
     {
-        LARGE_INTEGER now;
-        QueryPerformanceCounter(&now);
-        return static_cast<double>(now.QuadPart - start_.QuadPart) / freq_;
+        auto now = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(now - start_).count();
     }
 private:
-    double freq_;
-    LARGE_INTEGER start_;
+    std::chrono::steady_clock::time_point start_;
 };
-} // namespace
\ No newline at end of file
+} // namespace base
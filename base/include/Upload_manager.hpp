@@ -0,0 +1,375 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include "Buffer.hpp"
+#include "Physical_device.hpp"
+#include "Device.hpp"
+#include "assert.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <vector>
+#define MSG_PREFIX "-- UPLOAD_MANAGER: "
+
+namespace base
+{
+// copies data to device local buffers and images through a persistent host
+// visible staging ring, the copies of many resources are recorded into one
+// command buffer and submitted together on Device::transfer_queue
+//
+// submissions are numbered from 1 like the values of a timeline, each with a
+// fence, wait(n) blocks until submission n has completed and the ring space
+// of completed submissions is reused, data larger than the ring gets a
+// staging buffer of its own, freed with its submission
+//
+// with a transfer queue family of its own the resources are released to the
+// graphics family and acquired there by a second submission waiting on the
+// first, later graphics submissions see the data without a host wait, other
+// queues wait for the submission on the host
+class Upload_manager
+{
+public:
+    // so far, over all submissions
+    uint64_t upload_count{0};
+    vk::DeviceSize upload_bytes{0};
+
+    Upload_manager(Physical_device *p_phy_dev,
+                   Device *p_dev,
+                   vk::DeviceSize ring_size = 32 * 1024 * 1024) :
+        p_phy_dev_(p_phy_dev),
+        p_dev_(p_dev),
+        ring_size_(ring_size)
+    {
+        transfer_family_ = p_phy_dev_->transfer_queue_family_idx;
+        owner_family_ = p_phy_dev_->graphics_queue_family_idx;
+        release_ = transfer_family_ != owner_family_;
+        // texel blocks and transfer only queues need 16 and 4 bytes
+        alignment_ = std::max<vk::DeviceSize>(16, p_phy_dev_->props.limits.optimalBufferCopyOffsetAlignment);
+
+        p_ring_ = new Buffer(p_dev_,
+                             ring_size_,
+                             vk::BufferUsageFlagBits::eTransferSrc,
+                             vk::MemoryPropertyFlagBits::eHostVisible |
+                             vk::MemoryPropertyFlagBits::eHostCoherent);
+        allocate_and_bind_buffer_memory(p_phy_dev_,
+                                        p_dev_,
+                                        ring_mem_,
+                                        1, &p_ring_);
+
+        transfer_cmd_pool_ = p_dev_->dev.createCommandPool(
+            vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                      transfer_family_));
+        if (release_) {
+            owner_cmd_pool_ = p_dev_->dev.createCommandPool(
+                vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+                                          owner_family_));
+        }
+        std::cout << MSG_PREFIX << ring_size_ << " byte staging ring, " <<
+            (release_ ? "dedicated transfer queue" : "graphics queue") << std::endl;
+    }
+
+    ~Upload_manager()
+    {
+        finish();
+        for (auto &batch : free_batches_) {
+            p_dev_->dev.destroyFence(batch.fence);
+            if (batch.semaphore) p_dev_->dev.destroySemaphore(batch.semaphore);
+        }
+        // the command buffers go with their pools
+        p_dev_->dev.destroyCommandPool(transfer_cmd_pool_);
+        if (owner_cmd_pool_) p_dev_->dev.destroyCommandPool(owner_cmd_pool_);
+        delete p_ring_;
+        p_dev_->dev.freeMemory(ring_mem_);
+    }
+
+    // copies data_size bytes to p_buffer at offset, read by consuming_stages
+    // with new_access once the submission has completed, a range is written
+    // once per submission
+    void upload_buffer(Buffer *p_buffer,
+                       vk::DeviceSize data_size,
+                       const void *data,
+                       vk::DeviceSize offset,
+                       vk::PipelineStageFlags consuming_stages,
+                       vk::AccessFlags new_access)
+    {
+        if (data_size == 0) return;
+        vk::Buffer src;
+        vk::DeviceSize src_offset;
+        stage_(data, data_size, src, src_offset);
+
+        vk::BufferCopy region(src_offset, offset, data_size);
+        batch_.cmd.copyBuffer(src, p_buffer->buf, 1, &region);
+        // concurrent buffers are shared with the transfer family, no ownership to pass
+        bool release = release_ && p_buffer->sharing_mode == vk::SharingMode::eExclusive;
+        batch_.buffer_barriers.emplace_back(vk::AccessFlagBits::eTransferWrite,
+                                            new_access,
+                                            release ? transfer_family_ : VK_QUEUE_FAMILY_IGNORED,
+                                            release ? owner_family_ : VK_QUEUE_FAMILY_IGNORED,
+                                            p_buffer->buf,
+                                            offset, data_size);
+        batch_.consuming_stages |= consuming_stages;
+        upload_count++;
+        upload_bytes += data_size;
+    }
+
+    // copies the regions of data, their buffer offsets relative to data, to
+    // every level and layer of range, which is left in layout, the regions
+    // cover whole levels as transfer only queues may require
+    void upload_image(vk::Image image,
+                      vk::DeviceSize data_size,
+                      const void *data,
+                      const std::vector<vk::BufferImageCopy> &regions,
+                      const vk::ImageSubresourceRange &range,
+                      vk::ImageLayout layout,
+                      vk::PipelineStageFlags consuming_stages,
+                      vk::AccessFlags new_access)
+    {
+        vk::Buffer src;
+        vk::DeviceSize src_offset;
+        stage_(data, data_size, src, src_offset);
+
+        vk::ImageMemoryBarrier imb({},
+                                   vk::AccessFlagBits::eTransferWrite,
+                                   vk::ImageLayout::eUndefined,
+                                   vk::ImageLayout::eTransferDstOptimal,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   VK_QUEUE_FAMILY_IGNORED,
+                                   image,
+                                   range);
+        batch_.cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                                   vk::PipelineStageFlagBits::eTransfer,
+                                   {},
+                                   0, nullptr,
+                                   0, nullptr,
+                                   1, &imb);
+
+        std::vector<vk::BufferImageCopy> copies = regions;
+        for (auto &copy : copies) copy.bufferOffset += src_offset;
+        batch_.cmd.copyBufferToImage(src,
+                                     image,
+                                     vk::ImageLayout::eTransferDstOptimal,
+                                     static_cast<uint32_t>(copies.size()),
+                                     copies.data());
+
+        imb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        imb.dstAccessMask = new_access;
+        imb.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        imb.newLayout = layout;
+        imb.srcQueueFamilyIndex = release_ ? transfer_family_ : VK_QUEUE_FAMILY_IGNORED;
+        imb.dstQueueFamilyIndex = release_ ? owner_family_ : VK_QUEUE_FAMILY_IGNORED;
+        batch_.image_barriers.push_back(imb);
+        batch_.consuming_stages |= consuming_stages;
+        upload_count++;
+        upload_bytes += data_size;
+    }
+
+    // submits the copies recorded since the last flush, returns the number
+    // of the submission, or of the last one when nothing was recorded
+    uint64_t flush()
+    {
+        if (!recording_) return submitted_;
+        auto &cmd = batch_.cmd;
+        const uint32_t buffer_barrier_count = static_cast<uint32_t>(batch_.buffer_barriers.size());
+        const uint32_t image_barrier_count = static_cast<uint32_t>(batch_.image_barriers.size());
+        if (!batch_.consuming_stages) batch_.consuming_stages = vk::PipelineStageFlagBits::eAllCommands;
+
+        if (release_) {
+            // release on the transfer queue, the consuming stages are
+            // not supported there, the accesses are made visible by the acquire
+            std::vector<vk::BufferMemoryBarrier> buffer_barriers = batch_.buffer_barriers;
+            std::vector<vk::ImageMemoryBarrier> image_barriers = batch_.image_barriers;
+            for (auto &barrier : buffer_barriers) barrier.dstAccessMask = vk::AccessFlags();
+            for (auto &barrier : image_barriers) barrier.dstAccessMask = vk::AccessFlags();
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eBottomOfPipe,
+                                {},
+                                0, nullptr,
+                                buffer_barrier_count, buffer_barriers.data(),
+                                image_barrier_count, image_barriers.data());
+
+            for (auto &barrier : batch_.buffer_barriers) barrier.srcAccessMask = vk::AccessFlags();
+            for (auto &barrier : batch_.image_barriers) barrier.srcAccessMask = vk::AccessFlags();
+            batch_.owner_cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            batch_.owner_cmd.pipelineBarrier(batch_.consuming_stages,
+                                             batch_.consuming_stages,
+                                             {},
+                                             0, nullptr,
+                                             buffer_barrier_count, batch_.buffer_barriers.data(),
+                                             image_barrier_count, batch_.image_barriers.data());
+            batch_.owner_cmd.end();
+        } else {
+            cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                batch_.consuming_stages,
+                                {},
+                                0, nullptr,
+                                buffer_barrier_count, batch_.buffer_barriers.data(),
+                                image_barrier_count, batch_.image_barriers.data());
+        }
+        cmd.end();
+
+        if (release_) {
+            vk::SubmitInfo transfer_submit(0, nullptr, nullptr,
+                                           1, &cmd,
+                                           1, &batch_.semaphore);
+            assert_success(p_dev_->transfer_queue.submit(1, &transfer_submit, vk::Fence()));
+            vk::SubmitInfo acquire_submit(1, &batch_.semaphore, &batch_.consuming_stages,
+                                          1, &batch_.owner_cmd,
+                                          0, nullptr);
+            assert_success(p_dev_->graphics_queue.submit(1, &acquire_submit, batch_.fence));
+        } else {
+            vk::SubmitInfo submit(0, nullptr, nullptr,
+                                  1, &cmd,
+                                  0, nullptr);
+            assert_success(p_dev_->transfer_queue.submit(1, &submit, batch_.fence));
+        }
+
+        batch_.submission = ++submitted_;
+        in_flight_.push_back(std::move(batch_));
+        batch_ = Batch();
+        recording_ = false;
+        return submitted_;
+    }
+
+    // blocks until submission has completed
+    void wait(uint64_t submission)
+    {
+        while (!in_flight_.empty() && in_flight_.front().submission <= submission) retire_oldest_();
+    }
+
+    // submits the recorded copies and waits for every submission
+    void finish()
+    {
+        wait(flush());
+    }
+
+    uint64_t submission_count() const
+    {
+        return submitted_;
+    }
+
+private:
+    Physical_device *p_phy_dev_;
+    Device *p_dev_;
+
+    struct Batch
+    {
+        vk::CommandBuffer cmd;
+        vk::CommandBuffer owner_cmd; // acquires on the graphics queue
+        vk::Fence fence;
+        vk::Semaphore semaphore; // between the transfer and the acquire
+        uint64_t submission{0};
+        vk::DeviceSize ring_bytes{0}; // with the end of the ring skipped on wrapping
+        std::vector<Buffer *> staging_bufs; // for data larger than the ring
+        std::vector<vk::DeviceMemory> staging_mems;
+        std::vector<vk::BufferMemoryBarrier> buffer_barriers;
+        std::vector<vk::ImageMemoryBarrier> image_barriers;
+        vk::PipelineStageFlags consuming_stages;
+    };
+
+    uint32_t transfer_family_{0};
+    uint32_t owner_family_{0};
+    bool release_{false};
+    vk::DeviceSize alignment_{16};
+    vk::CommandPool transfer_cmd_pool_;
+    vk::CommandPool owner_cmd_pool_;
+
+    Buffer *p_ring_{nullptr};
+    vk::DeviceMemory ring_mem_;
+    const vk::DeviceSize ring_size_;
+    vk::DeviceSize ring_head_{0};
+    vk::DeviceSize ring_used_{0}; // by the recording and the in flight batches
+
+    Batch batch_;
+    bool recording_{false};
+    std::deque<Batch> in_flight_;
+    std::vector<Batch> free_batches_;
+    uint64_t submitted_{0};
+
+    void begin_batch_()
+    {
+        if (recording_) return;
+        if (!free_batches_.empty()) {
+            batch_ = std::move(free_batches_.back());
+            free_batches_.pop_back();
+        } else {
+            batch_.cmd = p_dev_->dev.allocateCommandBuffers(
+                vk::CommandBufferAllocateInfo(transfer_cmd_pool_, vk::CommandBufferLevel::ePrimary, 1))[0];
+            if (release_) {
+                batch_.owner_cmd = p_dev_->dev.allocateCommandBuffers(
+                    vk::CommandBufferAllocateInfo(owner_cmd_pool_, vk::CommandBufferLevel::ePrimary, 1))[0];
+                batch_.semaphore = p_dev_->dev.createSemaphore(vk::SemaphoreCreateInfo());
+            }
+            batch_.fence = p_dev_->dev.createFence(vk::FenceCreateInfo());
+        }
+        batch_.cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        recording_ = true;
+    }
+
+    // copies data to staging memory of the recording batch
+    void stage_(const void *data,
+                vk::DeviceSize data_size,
+                vk::Buffer &src,
+                vk::DeviceSize &src_offset)
+    {
+        vk::DeviceSize size = data_size;
+        align_size(size, alignment_);
+        if (size > ring_size_) {
+            begin_batch_();
+            auto p_staging_buf = new Buffer(p_dev_,
+                                            data_size,
+                                            vk::BufferUsageFlagBits::eTransferSrc,
+                                            vk::MemoryPropertyFlagBits::eHostVisible |
+                                            vk::MemoryPropertyFlagBits::eHostCoherent);
+            vk::DeviceMemory staging_mem;
+            allocate_and_bind_buffer_memory(p_phy_dev_,
+                                            p_dev_,
+                                            staging_mem,
+                                            1, &p_staging_buf);
+            memcpy(p_staging_buf->mapped, data, data_size);
+            batch_.staging_bufs.push_back(p_staging_buf);
+            batch_.staging_mems.push_back(staging_mem);
+            src = p_staging_buf->buf;
+            src_offset = 0;
+            return;
+        }
+
+        // the ring holds the batches in submission order, the oldest ones
+        // are waited for until there is room
+        vk::DeviceSize skipped = 0;
+        while (true) {
+            if (ring_used_ == 0) ring_head_ = 0;
+            skipped = ring_head_ + size > ring_size_ ? ring_size_ - ring_head_ : 0;
+            if (ring_used_ + skipped + size <= ring_size_) break;
+            if (in_flight_.empty()) flush();
+            if (!in_flight_.empty()) retire_oldest_();
+        }
+        begin_batch_();
+        if (skipped > 0) ring_head_ = 0;
+        src = p_ring_->buf;
+        src_offset = ring_head_;
+        memcpy(reinterpret_cast<uint8_t *>(p_ring_->mapped) + ring_head_, data, data_size);
+        ring_head_ += size;
+        ring_used_ += skipped + size;
+        batch_.ring_bytes += skipped + size;
+    }
+
+    void retire_oldest_()
+    {
+        Batch &batch = in_flight_.front();
+        assert_success(p_dev_->dev.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX));
+        assert_success(p_dev_->dev.resetFences(1, &batch.fence));
+        for (auto p_buf : batch.staging_bufs) delete p_buf;
+        for (auto &mem : batch.staging_mems) p_dev_->dev.freeMemory(mem);
+        batch.staging_bufs.clear();
+        batch.staging_mems.clear();
+        batch.buffer_barriers.clear();
+        batch.image_barriers.clear();
+        batch.consuming_stages = vk::PipelineStageFlags();
+        ring_used_ -= batch.ring_bytes;
+        batch.ring_bytes = 0;
+        free_batches_.push_back(std::move(batch));
+        in_flight_.pop_front();
+    }
+};
+} // namespace base
+#undef MSG_PREFIX
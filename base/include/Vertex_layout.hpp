@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace base
+{
+typedef enum Vertex_component
+{
+    VERT_COMP_VEC4,
+    VERT_COMP_COLOR3,
+    VERT_COMP_POSITION,
+    VERT_COMP_NORMAL,
+    VERT_COMP_TANGENT,
+    VERT_COMP_BITANGENT,
+    VERT_COMP_UV,
+    VERT_COMP_FLOAT,
+    // quantized, see Vertex_packer
+    VERT_COMP_POSITION_UNORM16, // 4 x unorm16, relative to the mesh aabb, w unused
+    VERT_COMP_NORMAL_OCT16, // 2 x snorm16, octahedral
+    VERT_COMP_UV_HALF // 2 x float16
+} Vertex_component;
+
+struct Vertex_layout
+{
+    std::vector<Vertex_component> comps;
+
+    Vertex_layout() = default;
+
+    explicit Vertex_layout(const std::vector<Vertex_component> &comps) :
+        comps(comps)
+    {}
+
+    explicit Vertex_layout(Vertex_component comp) {
+        comps.emplace_back(comp);
+    }
+
+    uint32_t get_stride() const
+    {
+        uint32_t res = 0;
+        for (auto &comp : comps) {
+            switch (comp) {
+                case VERT_COMP_VEC4:res += 4 * sizeof(float);
+                    break;
+                case VERT_COMP_POSITION:
+                case VERT_COMP_NORMAL:
+                case VERT_COMP_TANGENT:
+                case VERT_COMP_BITANGENT:
+                case VERT_COMP_COLOR3:res += 3 * sizeof(float);
+                    break;
+                case VERT_COMP_UV:res += 2 * sizeof(float);
+                    break;
+                case VERT_COMP_FLOAT:res += sizeof(float);
+                    break;
+                case VERT_COMP_POSITION_UNORM16:res += 4 * sizeof(uint16_t);
+                    break;
+                case VERT_COMP_NORMAL_OCT16:
+                case VERT_COMP_UV_HALF:res += 2 * sizeof(uint16_t);
+                    break;
+                default:
+                    break;
+            }
+        }
+        return res;
+    }
+
+    bool has(Vertex_component comp) const
+    {
+        for (auto &c : comps) {
+            if (c == comp) return true;
+        }
+        return false;
+    }
+
+    // the same layout with 32 bit float components in place of the quantized ones
+    Vertex_layout unquantized() const
+    {
+        Vertex_layout res;
+        for (auto &comp : comps) {
+            switch (comp) {
+                case VERT_COMP_POSITION_UNORM16:res.comps.push_back(VERT_COMP_POSITION);
+                    break;
+                case VERT_COMP_NORMAL_OCT16:res.comps.push_back(VERT_COMP_NORMAL);
+                    break;
+                case VERT_COMP_UV_HALF:res.comps.push_back(VERT_COMP_UV);
+                    break;
+                default:res.comps.push_back(comp);
+                    break;
+            }
+        }
+        return res;
+    }
+};
+} // namespace base
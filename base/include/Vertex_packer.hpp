@@ -0,0 +1,396 @@
+#pragma once
+#include "Vertex_layout.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VERTEX_PACKER_SSE
+#include <immintrin.h>
+#endif
+
+// packs the attributes of one mesh into interleaved vertices of a Vertex_layout
+//
+// pack_vertices() writes into a buffer sized for the whole mesh, layouts listed
+// there go through a Vertex_packer specialized at compile time, which copies
+// every component with a fixed size and offset, any other layout through
+// pack_vertices_generic(), which switches over the components per vertex.
+// Both write the same floats.
+//
+// quantized components:
+//   VERT_COMP_POSITION_UNORM16  (position - bounds_min) / bounds_extent, the
+//                               draw folds position_dequantization() into the
+//                               instance transform
+//   VERT_COMP_NORMAL_OCT16      octahedral normal scaled by bounds_extent first,
+//                               which cancels the scale of the dequantization
+//                               in the inverse transpose of the instance transform
+//   VERT_COMP_UV_HALF           half floats
+
+namespace base
+{
+// attribute arrays of a mesh, laid out as aiMesh stores them
+struct Vertex_source
+{
+    uint32_t vert_count{0};
+    const float *positions{nullptr}; // 3 floats per vertex
+    const float *normals{nullptr}; // 3 floats per vertex
+    const float *uvs{nullptr}; // 3 floats per vertex, the first two are used
+    const float *tangents{nullptr}; // 3 floats per vertex
+    const float *bitangents{nullptr}; // 3 floats per vertex
+    const float *colors{nullptr}; // 4 floats per vertex, white when missing
+
+    // quantized positions are relative to these, see quantization_extent()
+    glm::vec3 bounds_min{0.f};
+    glm::vec3 bounds_extent{1.f};
+};
+
+// per axis extent of the aabb the positions are quantized over, 1 for flat axes
+inline glm::vec3 quantization_extent(const glm::vec3 &min, const glm::vec3 &max)
+{
+    glm::vec3 res = max - min;
+    for (int i = 0; i < 3; i++) {
+        if (!(res[i] > 0.f)) res[i] = 1.f;
+    }
+    return res;
+}
+
+// maps quantized positions back into the mesh
+inline glm::mat4 position_dequantization(const glm::vec3 &min, const glm::vec3 &max)
+{
+    glm::vec3 extent = quantization_extent(min, max);
+    glm::mat4 res(1.f);
+    res[0][0] = extent.x;
+    res[1][1] = extent.y;
+    res[2][2] = extent.z;
+    res[3] = glm::vec4(min, 1.f);
+    return res;
+}
+
+inline uint16_t quantize_unorm16(float v)
+{
+    v = std::min(std::max(v, 0.f), 1.f);
+    return static_cast<uint16_t>(v * 65535.f + .5f);
+}
+
+inline int16_t quantize_snorm16(float v)
+{
+    v = std::min(std::max(v, -1.f), 1.f) * 32767.f;
+    return static_cast<int16_t>(v >= 0.f ? v + .5f : v - .5f);
+}
+
+// round to nearest even, overflows to infinity
+inline uint16_t quantize_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t abs = x & 0x7fffffffu;
+    if (abs >= 0x7f800000u) {
+        // inf, nan
+        return static_cast<uint16_t>(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+    }
+    if (abs >= 0x477ff000u) return static_cast<uint16_t>(sign | 0x7c00u);
+    if (abs < 0x38800000u) {
+        // subnormal, multiples of 2^-24
+        float a;
+        memcpy(&a, &abs, sizeof(a));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(a * 16777216.f + .5f));
+    }
+    uint32_t h = abs - 0x38000000u; // rebias the exponent
+    h += 0xfffu + ((h >> 13) & 1u);
+    return static_cast<uint16_t>(sign | (h >> 13));
+}
+
+// octahedral mapping of the direction of n
+inline void quantize_oct16(const glm::vec3 &n, int16_t *p_dst)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    float x = l1 > 0.f ? n.x / l1 : 0.f;
+    float y = l1 > 0.f ? n.y / l1 : 0.f;
+    if (n.z < 0.f) {
+        float fx = x;
+        x = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+        y = (1.f - std::abs(fx)) * (y >= 0.f ? 1.f : -1.f);
+    }
+    p_dst[0] = quantize_snorm16(x);
+    p_dst[1] = quantize_snorm16(y);
+}
+
+template<Vertex_component C>
+struct Vertex_comp_writer;
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_POSITION>
+{
+    static const uint32_t floats = 3;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        memcpy(p_dst, src.positions + 3 * v, 3 * sizeof(float));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_NORMAL>
+{
+    static const uint32_t floats = 3;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        memcpy(p_dst, src.normals + 3 * v, 3 * sizeof(float));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_UV>
+{
+    static const uint32_t floats = 2;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        memcpy(p_dst, src.uvs + 3 * v, 2 * sizeof(float));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_TANGENT>
+{
+    static const uint32_t floats = 3;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        memcpy(p_dst, src.tangents + 3 * v, 3 * sizeof(float));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_BITANGENT>
+{
+    static const uint32_t floats = 3;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        memcpy(p_dst, src.bitangents + 3 * v, 3 * sizeof(float));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_POSITION_UNORM16>
+{
+    static const uint32_t floats = 2;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        uint16_t q[4];
+        for (int i = 0; i < 3; i++) {
+            q[i] = quantize_unorm16((src.positions[3 * v + i] - src.bounds_min[i]) / src.bounds_extent[i]);
+        }
+        q[3] = 0;
+        memcpy(p_dst, q, sizeof(q));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_NORMAL_OCT16>
+{
+    static const uint32_t floats = 1;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        const float *p_n = src.normals + 3 * v;
+        int16_t q[2];
+        quantize_oct16(glm::vec3(p_n[0], p_n[1], p_n[2]) * src.bounds_extent, q);
+        memcpy(p_dst, q, sizeof(q));
+    }
+};
+
+template<>
+struct Vertex_comp_writer<VERT_COMP_UV_HALF>
+{
+    static const uint32_t floats = 1;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        uint16_t q[2] = {quantize_half(src.uvs[3 * v]), quantize_half(src.uvs[3 * v + 1])};
+        memcpy(p_dst, q, sizeof(q));
+    }
+};
+
+template<Vertex_component... Comps>
+struct Vertex_comp_writers;
+
+template<>
+struct Vertex_comp_writers<>
+{
+    static const uint32_t floats = 0;
+    static void write(const Vertex_source &, uint32_t, float *) {}
+    static bool matches(const Vertex_component *) { return true; }
+};
+
+template<Vertex_component C, Vertex_component... Rest>
+struct Vertex_comp_writers<C, Rest...>
+{
+    static const uint32_t floats = Vertex_comp_writer<C>::floats + Vertex_comp_writers<Rest...>::floats;
+    static void write(const Vertex_source &src, uint32_t v, float *p_dst)
+    {
+        Vertex_comp_writer<C>::write(src, v, p_dst);
+        Vertex_comp_writers<Rest...>::write(src, v, p_dst + Vertex_comp_writer<C>::floats);
+    }
+    static bool matches(const Vertex_component *p_comps)
+    {
+        return p_comps[0] == C && Vertex_comp_writers<Rest...>::matches(p_comps + 1);
+    }
+};
+
+template<Vertex_component... Comps>
+class Vertex_packer
+{
+public:
+    typedef Vertex_comp_writers<Comps...> Writers;
+
+    static bool matches(const Vertex_layout &layout)
+    {
+        return layout.comps.size() == sizeof...(Comps) && Writers::matches(layout.comps.data());
+    }
+
+    static void pack(const Vertex_source &src, float *p_dst)
+    {
+        for (uint32_t v = 0; v < src.vert_count; v++) {
+            Writers::write(src, v, p_dst + v * Writers::floats);
+        }
+    }
+};
+
+inline void pack_vertices_generic(const Vertex_layout &layout,
+                                  const Vertex_source &src,
+                                  float *p_dst)
+{
+    for (uint32_t v = 0; v < src.vert_count; v++) {
+        for (auto &comp : layout.comps) {
+            switch (comp) {
+                case VERT_COMP_POSITION:
+                    for (int i = 0; i < 3; i++) *p_dst++ = src.positions[3 * v + i];
+                    break;
+                case VERT_COMP_NORMAL:
+                    assert(src.normals);
+                    for (int i = 0; i < 3; i++) *p_dst++ = src.normals[3 * v + i];
+                    break;
+                case VERT_COMP_UV:
+                    assert(src.uvs);
+                    for (int i = 0; i < 2; i++) *p_dst++ = src.uvs[3 * v + i];
+                    break;
+                case VERT_COMP_COLOR3:
+                    for (int i = 0; i < 3; i++) *p_dst++ = src.colors ? src.colors[4 * v + i] : 1.f;
+                    break;
+                case VERT_COMP_TANGENT:
+                    assert(src.tangents);
+                    for (int i = 0; i < 3; i++) *p_dst++ = src.tangents[3 * v + i];
+                    break;
+                case VERT_COMP_BITANGENT:
+                    assert(src.bitangents);
+                    for (int i = 0; i < 3; i++) *p_dst++ = src.bitangents[3 * v + i];
+                    break;
+                case VERT_COMP_VEC4:
+                    // to be implemented in child class
+                    for (int i = 0; i < 4; i++) *p_dst++ = 0.f;
+                    break;
+                case VERT_COMP_FLOAT:
+                    // to be implemented in child class
+                    *p_dst++ = 0.f;
+                    break;
+                case VERT_COMP_POSITION_UNORM16:
+                    Vertex_comp_writer<VERT_COMP_POSITION_UNORM16>::write(src, v, p_dst);
+                    p_dst += Vertex_comp_writer<VERT_COMP_POSITION_UNORM16>::floats;
+                    break;
+                case VERT_COMP_NORMAL_OCT16:
+                    assert(src.normals);
+                    Vertex_comp_writer<VERT_COMP_NORMAL_OCT16>::write(src, v, p_dst);
+                    p_dst += Vertex_comp_writer<VERT_COMP_NORMAL_OCT16>::floats;
+                    break;
+                case VERT_COMP_UV_HALF:
+                    assert(src.uvs);
+                    Vertex_comp_writer<VERT_COMP_UV_HALF>::write(src, v, p_dst);
+                    p_dst += Vertex_comp_writer<VERT_COMP_UV_HALF>::floats;
+                    break;
+                default:throw std::runtime_error("Invalid vertex component.");
+            } // switch component
+        } // loop components
+    } // loop vertices
+}
+
+// p_dst holds vert_count * layout stride bytes
+inline void pack_vertices(const Vertex_layout &layout,
+                          const Vertex_source &src,
+                          float *p_dst)
+{
+    typedef Vertex_packer<VERT_COMP_POSITION, VERT_COMP_NORMAL, VERT_COMP_UV> Packer_pnu;
+    typedef Vertex_packer<VERT_COMP_POSITION, VERT_COMP_NORMAL> Packer_pn;
+    typedef Vertex_packer<VERT_COMP_POSITION> Packer_p;
+    typedef Vertex_packer<VERT_COMP_POSITION, VERT_COMP_NORMAL, VERT_COMP_UV,
+                          VERT_COMP_TANGENT, VERT_COMP_BITANGENT> Packer_pnutb;
+    typedef Vertex_packer<VERT_COMP_POSITION_UNORM16, VERT_COMP_NORMAL_OCT16, VERT_COMP_UV_HALF> Packer_pnu_quantized;
+
+    if (src.vert_count == 0) return;
+    if (Packer_pnu::matches(layout)) {
+        assert(src.normals && src.uvs);
+        Packer_pnu::pack(src, p_dst);
+    } else if (Packer_pn::matches(layout)) {
+        assert(src.normals);
+        Packer_pn::pack(src, p_dst);
+    } else if (Packer_p::matches(layout)) {
+        Packer_p::pack(src, p_dst);
+    } else if (Packer_pnutb::matches(layout)) {
+        assert(src.normals && src.uvs && src.tangents && src.bitangents);
+        Packer_pnutb::pack(src, p_dst);
+    } else if (Packer_pnu_quantized::matches(layout)) {
+        assert(src.normals && src.uvs);
+        Packer_pnu_quantized::pack(src, p_dst);
+    } else {
+        pack_vertices_generic(layout, src, p_dst);
+    }
+}
+
+inline void position_bounds_scalar(const float *p_positions,
+                                   uint32_t vert_count,
+                                   glm::vec3 &min,
+                                   glm::vec3 &max)
+{
+    min = glm::vec3(FLT_MAX);
+    max = glm::vec3(-FLT_MAX);
+    for (uint32_t v = 0; v < vert_count; v++) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(p_positions[3 * v + i], min[i]);
+            max[i] = std::max(p_positions[3 * v + i], max[i]);
+        }
+    }
+}
+
+// aabb of the positions, FLT_MAX and -FLT_MAX for no vertices
+inline void position_bounds(const float *p_positions,
+                            uint32_t vert_count,
+                            glm::vec3 &min,
+                            glm::vec3 &max)
+{
+#ifdef VERTEX_PACKER_SSE
+    if (vert_count == 0) {
+        position_bounds_scalar(p_positions, vert_count, min, max);
+        return;
+    }
+    // one vertex per load, the 4th lane holds the next x and is ignored,
+    // the last vertex is loaded on its own to stay inside the array
+    __m128 vmin = _mm_set1_ps(FLT_MAX);
+    __m128 vmax = _mm_set1_ps(-FLT_MAX);
+    for (uint32_t v = 0; v + 1 < vert_count; v++) {
+        __m128 p = _mm_loadu_ps(p_positions + 3 * v);
+        vmin = _mm_min_ps(vmin, p);
+        vmax = _mm_max_ps(vmax, p);
+    }
+    const float *p_last = p_positions + 3 * (vert_count - 1);
+    __m128 p = _mm_set_ps(0.f, p_last[2], p_last[1], p_last[0]);
+    vmin = _mm_min_ps(vmin, p);
+    vmax = _mm_max_ps(vmax, p);
+
+    float res_min[4], res_max[4];
+    _mm_storeu_ps(res_min, vmin);
+    _mm_storeu_ps(res_max, vmax);
+    min = glm::vec3(res_min[0], res_min[1], res_min[2]);
+    max = glm::vec3(res_max[0], res_max[1], res_max[2]);
+#else
+    position_bounds_scalar(p_positions, vert_count, min, max);
+#endif
+}
+} // namespace base
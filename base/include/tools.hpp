@@ -3,6 +3,9 @@
 #include <string>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
 
 namespace base
 {
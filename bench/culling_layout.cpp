@@ -0,0 +1,103 @@
+#include "Instance_data.hpp"
+#include "Timer.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+// instances per second of a host version of the frustum stage of
+// visibility.comp, reading Instance_properties and writing the visibility
+// into the commands and the occluder commands, in the layout the build
+// selects, built as culling_layout and culling_layout_compact
+// usage: culling_layout [instance_count] [iterations]
+
+namespace
+{
+uint32_t frustum_visible(const glm::mat4 &view_proj,
+                         const Instance_properties &prop)
+{
+    const glm::mat4 mvp = view_proj * prop.get_transform();
+    uint32_t outside[6] = {};
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 corner(i & 1 ? prop.max.x : prop.min.x,
+                         i & 2 ? prop.max.y : prop.min.y,
+                         i & 4 ? prop.max.z : prop.min.z,
+                         1.f);
+        glm::vec4 clip = mvp * corner;
+        outside[0] += clip.x < -clip.w;
+        outside[1] += clip.x > clip.w;
+        outside[2] += clip.y < -clip.w;
+        outside[3] += clip.y > clip.w;
+        outside[4] += clip.z < 0.f;
+        outside[5] += clip.z > clip.w;
+    }
+    uint32_t res = 1;
+    for (int p = 0; p < 6; p++) res &= outside[p] != 8;
+    return res;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    uint32_t inst_count = argc > 1 ? std::stoul(argv[1]) : 1u << 20;
+    uint32_t iterations = argc > 2 ? std::stoul(argv[2]) : 20;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> pos_dist(-500.f, 500.f);
+    std::uniform_real_distribution<float> size_dist(.5f, 10.f);
+    std::vector<Instance_properties> props;
+    std::vector<Mdi_cmd> cmds, occluder_cmds;
+    props.reserve(inst_count);
+    cmds.reserve(inst_count);
+    for (uint32_t i = 0; i < inst_count; i++) {
+        glm::mat4 transform(1.f);
+        transform[3] = glm::vec4(pos_dist(rng), pos_dist(rng), pos_dist(rng), 1.f);
+        glm::vec3 extent(size_dist(rng), size_dist(rng), size_dist(rng));
+        props.push_back(make_instance_properties(transform, -extent, i % 64, extent, 0.f));
+        cmds.emplace_back(36, 1, 0, 0, i);
+    }
+    occluder_cmds = cmds;
+
+    // looking down -z from the center, the default depth range of the program
+    const float near = .1f, far = 1000.f, f = 1.f / std::tan(.5f);
+    glm::mat4 view_proj(0.f);
+    view_proj[0][0] = f;
+    view_proj[1][1] = -f;
+    view_proj[2][2] = far / (near - far);
+    view_proj[2][3] = -1.f;
+    view_proj[3][2] = near * far / (near - far);
+
+    uint32_t visible = 0;
+    auto run = [&]() {
+        visible = 0;
+        for (uint32_t i = 0; i < inst_count; i++) {
+            uint32_t res = frustum_visible(view_proj, props[i]);
+            Mdi_cmd occluder = cmds[i];
+            occluder.inst_count = res;
+            occluder_cmds[i] = occluder;
+            cmds[i].inst_count = res;
+            visible += res;
+        }
+    };
+    run(); // warm up
+    base::Timer timer;
+    for (uint32_t i = 0; i < iterations; i++) run();
+    double seconds = timer.get() / iterations;
+
+#ifdef COMPACT_LAYOUT
+    const char *layout = "compact";
+#else
+    const char *layout = "full";
+#endif
+    printf("%u instances, %u iterations, %s layout\n", inst_count, iterations, layout);
+    printf("%-22s %8zu bytes\n", "instance", sizeof(Instance_properties));
+    printf("%-22s %8zu bytes\n", "command", sizeof(Mdi_cmd));
+    printf("%-22s %8.1f MB\n", "read and written",
+           static_cast<double>(inst_count) * (sizeof(Instance_properties) + 3 * sizeof(Mdi_cmd)) * 1e-6);
+    printf("%-22s %8.2f ms\n", "frustum pass", seconds * 1000.);
+    printf("%-22s %8.1f Minst/s\n", "rate", inst_count / seconds * 1e-6);
+    printf("%-22s %8u\n", "visible", visible);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+#include "Scene_import.hpp"
+#include "Timer.hpp"
+#include <assimp/Importer.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// load time of model files on the host, the assimp import or the glTF
+// loader, then the mesh packing and the instances as the program runs them,
+// e.g. occlusion_scene.fbx against occlusion_scene.glb
+// usage: scene_load model_file... [--iterations=N] [--load-threads=N] [--quantize-vertices]
+
+namespace
+{
+struct Load_times
+{
+    double import;
+    double pack;
+    double instances;
+};
+
+bool load(const std::string &path,
+          const base::Vertex_layout &layout,
+          base::Job_system &jobs,
+          Load_times &res,
+          size_t &inst_count)
+{
+    base::Timer timer;
+    base::Packed_meshes packed;
+    std::vector<Instance_properties> props;
+    if (base::Gltf_scene::is_gltf_path(path)) {
+        base::Gltf_scene scene;
+        if (!scene.load(path, &jobs)) {
+            fprintf(stderr, "cannot load %s: %s\n", path.c_str(), scene.error.c_str());
+            return false;
+        }
+        res.import = timer.get();
+        base::pack_meshes(scene.mesh_sources(), layout, false, 0, &jobs, packed);
+        res.pack = timer.get() - res.import;
+        props = scene_instances(scene, packed.meshes, packed.mesh_remap);
+    } else {
+        Assimp::Importer importer;
+        const aiScene *p_scene = importer.ReadFile(path.c_str(), SCENE_AI_BASE_FLAGS | SCENE_AI_FLAGS);
+        if (!p_scene) {
+            fprintf(stderr, "cannot import %s: %s\n", path.c_str(), importer.GetErrorString());
+            return false;
+        }
+        res.import = timer.get();
+        base::pack_meshes(p_scene, layout, false, 0, &jobs, packed);
+        res.pack = timer.get() - res.import;
+        props = scene_instances(p_scene, packed.meshes, packed.mesh_remap);
+    }
+    res.instances = timer.get() - res.import - res.pack;
+    inst_count = props.size();
+    return true;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> paths;
+    uint32_t iterations = 5;
+    uint32_t load_threads = 0;
+    bool quantize = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            paths.push_back(arg);
+            continue;
+        }
+        auto eq = arg.find('=');
+        std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "iterations") iterations = std::max(1ul, std::stoul(value));
+        else if (key == "load-threads") load_threads = std::stoul(value);
+        else if (key == "quantize-vertices") quantize = true;
+    }
+    if (paths.empty()) {
+        fprintf(stderr, "usage: scene_load model_file... [--iterations=N] [--load-threads=N] [--quantize-vertices]\n");
+        return EXIT_FAILURE;
+    }
+
+    base::Vertex_layout layout(quantize ?
+                               std::vector<base::Vertex_component>{base::VERT_COMP_POSITION_UNORM16,
+                                                                   base::VERT_COMP_NORMAL_OCT16,
+                                                                   base::VERT_COMP_UV_HALF} :
+                               std::vector<base::Vertex_component>{base::VERT_COMP_POSITION,
+                                                                   base::VERT_COMP_NORMAL,
+                                                                   base::VERT_COMP_UV});
+    base::Job_system jobs(load_threads);
+    printf("%u iterations, %u threads, best of each\n", iterations, jobs.thread_count());
+    printf("%-32s %10s %10s %10s %10s %10s\n", "file", "import ms", "pack ms", "inst ms", "total ms", "instances");
+    for (auto &path : paths) {
+        Load_times best{1e30, 1e30, 1e30};
+        size_t inst_count = 0;
+        for (uint32_t i = 0; i < iterations; i++) {
+            Load_times times;
+            if (!load(path, layout, jobs, times, inst_count)) return EXIT_FAILURE;
+            best.import = std::min(best.import, times.import);
+            best.pack = std::min(best.pack, times.pack);
+            best.instances = std::min(best.instances, times.instances);
+        }
+        auto slash = path.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        printf("%-32s %10.1f %10.1f %10.1f %10.1f %10zu\n", name.c_str(),
+               best.import * 1000., best.pack * 1000., best.instances * 1000.,
+               (best.import + best.pack + best.instances) * 1000., inst_count);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+#include "Vertex_packer.hpp"
+#include "Timer.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// vertices per second of the specialized and the generic vertex packing of
+// the float and the quantized layout, and of the sse and the scalar mesh
+// bounds, on a synthetic mesh
+// usage: vertex_packing [vertex_count] [iterations]
+
+namespace
+{
+template<typename F>
+double vertices_per_second(uint32_t vert_count, uint32_t iterations, F run)
+{
+    run(); // warm up
+    base::Timer timer;
+    for (uint32_t i = 0; i < iterations; i++) run();
+    return static_cast<double>(vert_count) * iterations / timer.get();
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    uint32_t vert_count = argc > 1 ? std::stoul(argv[1]) : 1u << 20;
+    uint32_t iterations = argc > 2 ? std::stoul(argv[2]) : 20;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-100.f, 100.f);
+    std::vector<float> positions(3 * vert_count), normals(3 * vert_count), uvs(3 * vert_count);
+    for (auto &f : positions) f = dist(rng);
+    for (auto &f : normals) f = dist(rng);
+    for (auto &f : uvs) f = dist(rng);
+
+    base::Vertex_source src;
+    src.vert_count = vert_count;
+    src.positions = positions.data();
+    src.normals = normals.data();
+    src.uvs = uvs.data();
+
+    glm::vec3 min, max, scalar_min, scalar_max;
+    base::position_bounds(src.positions, vert_count, min, max);
+    src.bounds_min = min;
+    src.bounds_extent = base::quantization_extent(min, max);
+
+    struct Rates
+    {
+        double specialized;
+        double generic;
+    };
+    bool same_vertices = true;
+    auto pack_rates = [&](const base::Vertex_layout &layout) {
+        const size_t vert_floats = layout.get_stride() / sizeof(float);
+        std::vector<float> specialized(vert_floats * vert_count), generic(vert_floats * vert_count);
+        Rates res;
+        res.specialized = vertices_per_second(vert_count, iterations, [&]() {
+            base::pack_vertices(layout, src, specialized.data());
+        });
+        res.generic = vertices_per_second(vert_count, iterations, [&]() {
+            base::pack_vertices_generic(layout, src, generic.data());
+        });
+        same_vertices &= memcmp(specialized.data(), generic.data(), specialized.size() * sizeof(float)) == 0;
+        return res;
+    };
+    Rates rates = pack_rates(base::Vertex_layout({base::VERT_COMP_POSITION,
+                                                  base::VERT_COMP_NORMAL,
+                                                  base::VERT_COMP_UV}));
+    Rates quantized_rates = pack_rates(base::Vertex_layout({base::VERT_COMP_POSITION_UNORM16,
+                                                            base::VERT_COMP_NORMAL_OCT16,
+                                                            base::VERT_COMP_UV_HALF}));
+
+    double bounds_rate = vertices_per_second(vert_count, iterations, [&]() {
+        base::position_bounds(src.positions, vert_count, min, max);
+    });
+    double scalar_bounds_rate = vertices_per_second(vert_count, iterations, [&]() {
+        base::position_bounds_scalar(src.positions, vert_count, scalar_min, scalar_max);
+    });
+    bool same_bounds = min == scalar_min && max == scalar_max;
+
+    printf("%u vertices, %u iterations, position normal uv, float and quantized\n", vert_count, iterations);
+    printf("%-22s %8.1f Mverts/s\n", "pack specialized", rates.specialized * 1e-6);
+    printf("%-22s %8.1f Mverts/s\n", "pack generic", rates.generic * 1e-6);
+    printf("%-22s %8.1f Mverts/s\n", "quantized specialized", quantized_rates.specialized * 1e-6);
+    printf("%-22s %8.1f Mverts/s\n", "quantized generic", quantized_rates.generic * 1e-6);
+    printf("%-22s %8.1f Mverts/s\n", "bounds", bounds_rate * 1e-6);
+    printf("%-22s %8.1f Mverts/s\n", "bounds scalar", scalar_bounds_rate * 1e-6);
+    if (!same_vertices || !same_bounds) {
+        printf("results differ:%s%s\n", same_vertices ? "" : " vertices", same_bounds ? "" : " bounds");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,702 @@
+#pragma once
+#include "Instance_data.hpp"
+#include "Timer.hpp"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_CULLING_SSE
+#include <immintrin.h>
+#endif
+#if defined(CPU_CULLING_SSE) && defined(__AVX__)
+#define CPU_CULLING_AVX
+#endif
+#define MSG_PREFIX "-- CPU_CULLING: "
+
+// host side implementation of data/shaders/visibility.comp
+//
+// cull_reference() is a per-instance transliteration of the shader and serves
+// as the oracle, cull() runs the corner transform, near/far and lrtb plane tests
+// for 4 (SSE) or 8 (AVX) instances per iteration on an SoA copy of
+// Instance_properties and shares the HiZ stage with the reference.
+// Both paths evaluate the same float operations in the same order,
+// build without fp contraction (no implicit fma) to keep them bit identical.
+//
+// glsl semantics reproduced:
+//   step(edge, x) = x < edge ? 0 : 1
+//   min(x, y)     = y < x ? y : x
+//   max(x, y)     = x < y ? y : x
+// levels the shader leaves undefined (negative shifts for sub-pixel rects,
+// lods outside the sampler range) are clamped to the valid range.
+
+struct Cpu_culling_params
+{
+    glm::mat4 model{1.f};
+    glm::mat4 view{1.f};
+    glm::mat4 projection_clip{1.f};
+    float cam_near{0.1f};
+    float cam_far{1000.f};
+    glm::vec2 resolution{1024.f, 700.f};
+    bool use_occlusion_culling{false};
+};
+
+struct Cpu_culling_stats
+{
+    uint32_t instance_count{0};
+    uint32_t visible_count{0};
+    double seconds{0.};
+    double instances_per_second{0.};
+};
+
+// emulates copy.comp and mipmap.comp writing into the r32f staging atlas
+// and the per level blit into depth_dst, see Program::update_push_constants_
+// the atlas and the pyramid persist between builds as the device images do,
+// both start cleared to 0
+class Cpu_depth_pyramid
+{
+public:
+    Cpu_depth_pyramid(uint32_t size = 1024,
+                      uint32_t staging_width = 1536,
+                      uint32_t staging_height = 1024) :
+        size_(size),
+        staging_width_(staging_width),
+        staging_height_(staging_height)
+    {
+        level_count_ = static_cast<uint32_t>(floor(log2(size_))) + 1;
+        staging_.assign(staging_width_ * staging_height_, 0.f);
+        levels_.resize(level_count_);
+        for (uint32_t i = 0; i < level_count_; i++) {
+            uint32_t s = level_size(i);
+            levels_[i].assign(s * s, 0.f);
+        }
+    }
+
+    uint32_t level_count() const
+    {
+        return level_count_;
+    }
+
+    uint32_t level_size(uint32_t level) const
+    {
+        return std::max(1u, size_ >> level);
+    }
+
+    float fetch(uint32_t level, uint32_t x, uint32_t y) const
+    {
+        return levels_[level][y * level_size(level) + x];
+    }
+
+    // depth_src: level 0 depth image of size x size texels (row major)
+    // width, height: viewport extent rendered into depth_src
+    void build(const float *depth_src, uint32_t width, uint32_t height)
+    {
+        int w = static_cast<int>(width);
+        int h = static_cast<int>(height);
+
+        // copy.comp
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                staging_[y * staging_width_ + x] = depth_src[y * size_ + x];
+            }
+        }
+
+        // mipmap.comp
+        glm::ivec2 src_start{0, 0};
+        glm::ivec2 dst_start{0, 0};
+        glm::ivec2 dst_size{w, h};
+        std::vector<glm::ivec2> starts{dst_start};
+        std::vector<glm::ivec2> sizes{dst_size};
+        std::vector<float> level;
+        for (uint32_t i = 1; i < level_count_; i++) {
+            src_start = dst_start;
+            if (i % 2 == 0) dst_start.y += dst_size.y;
+            else dst_start.x += dst_size.x;
+            dst_size.x = std::max(1, dst_size.x / 2);
+            dst_size.y = std::max(1, dst_size.y / 2);
+
+            // all invocations read before any of them writes
+            level.resize(dst_size.x * dst_size.y);
+            for (int y = 0; y < dst_size.y; y++) {
+                for (int x = 0; x < dst_size.x; x++) {
+                    float res = 0.f;
+                    for (int j = 0; j < 2; j++) {
+                        for (int k = 0; k < 2; k++) {
+                            float d = load_staging_(src_start.x + x * 2 + j, src_start.y + y * 2 + k);
+                            res = glsl_max_(res, d);
+                        }
+                    }
+                    level[y * dst_size.x + x] = res;
+                }
+            }
+            for (int y = 0; y < dst_size.y; y++) {
+                for (int x = 0; x < dst_size.x; x++) {
+                    store_staging_(dst_start.x + x, dst_start.y + y, level[y * dst_size.x + x]);
+                }
+            }
+            starts.push_back(dst_start);
+            sizes.push_back(dst_size);
+        }
+
+        // blit staging to depth_dst
+        for (uint32_t i = 0; i < level_count_; i++) {
+            uint32_t s = level_size(i);
+            for (int y = 0; y < sizes[i].y; y++) {
+                for (int x = 0; x < sizes[i].x; x++) {
+                    levels_[i][y * s + x] = load_staging_(starts[i].x + x, starts[i].y + y);
+                }
+            }
+        }
+    }
+
+    static float glsl_max_(float x, float y)
+    {
+        return x < y ? y : x;
+    }
+
+private:
+    uint32_t size_;
+    uint32_t staging_width_;
+    uint32_t staging_height_;
+    uint32_t level_count_{0};
+    std::vector<float> staging_;
+    std::vector<std::vector<float>> levels_;
+
+    float load_staging_(int x, int y) const
+    {
+        if (x < 0 || y < 0 || x >= static_cast<int>(staging_width_) || y >= static_cast<int>(staging_height_))
+            return 0.f;
+        return staging_[y * staging_width_ + x];
+    }
+
+    void store_staging_(int x, int y, float d)
+    {
+        if (x < 0 || y < 0 || x >= static_cast<int>(staging_width_) || y >= static_cast<int>(staging_height_))
+            return;
+        staging_[y * staging_width_ + x] = d;
+    }
+};
+
+#ifdef CPU_CULLING_SSE
+namespace cpu_culling_simd
+{
+struct F4
+{
+    static const uint32_t width = 4;
+    __m128 v;
+
+    static F4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static F4 set1(float f) { return {_mm_set1_ps(f)}; }
+    static F4 zero() { return {_mm_setzero_ps()}; }
+    static F4 all_true() { return {_mm_castsi128_ps(_mm_set1_epi32(-1))}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+    int mask() const { return _mm_movemask_ps(v); }
+};
+inline F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F4 operator/(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F4 operator&(F4 a, F4 b) { return {_mm_and_ps(a.v, b.v)}; }
+inline F4 operator|(F4 a, F4 b) { return {_mm_or_ps(a.v, b.v)}; }
+inline F4 and_not(F4 a, F4 b) { return {_mm_andnot_ps(a.v, b.v)}; } // ~a & b
+inline F4 less(F4 a, F4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline F4 glsl_min(F4 x, F4 y) { return {_mm_min_ps(y.v, x.v)}; } // y < x ? y : x
+inline F4 glsl_max(F4 x, F4 y) { return {_mm_max_ps(y.v, x.v)}; } // y > x ? y : x
+
+#ifdef CPU_CULLING_AVX
+struct F8
+{
+    static const uint32_t width = 8;
+    __m256 v;
+
+    static F8 load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static F8 set1(float f) { return {_mm256_set1_ps(f)}; }
+    static F8 zero() { return {_mm256_setzero_ps()}; }
+    static F8 all_true() { return {_mm256_castsi256_ps(_mm256_set1_epi32(-1))}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+    int mask() const { return _mm256_movemask_ps(v); }
+};
+inline F8 operator+(F8 a, F8 b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline F8 operator-(F8 a, F8 b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline F8 operator*(F8 a, F8 b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline F8 operator/(F8 a, F8 b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline F8 operator&(F8 a, F8 b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline F8 operator|(F8 a, F8 b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline F8 and_not(F8 a, F8 b) { return {_mm256_andnot_ps(a.v, b.v)}; }
+inline F8 less(F8 a, F8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline F8 glsl_min(F8 x, F8 y) { return {_mm256_min_ps(y.v, x.v)}; }
+inline F8 glsl_max(F8 x, F8 y) { return {_mm256_max_ps(y.v, x.v)}; }
+#endif
+} // namespace cpu_culling_simd
+#endif
+
+class Cpu_culling
+{
+public:
+    static const uint32_t MAX_DEPTH_IMAGE_SIZE = 1024;
+
+    explicit Cpu_culling(const std::vector<Instance_properties> &props) :
+        props_(props)
+    {
+        // SoA copy, padded to a multiple of the widest batch
+        inst_count_ = static_cast<uint32_t>(props_.size());
+        padded_count_ = (inst_count_ + 7) / 8 * 8;
+        for (auto &comp : soa_) comp.assign(padded_count_, 0.f);
+        for (uint32_t i = 0; i < inst_count_; i++) {
+            const auto &p = props_[i];
+            const glm::mat4 transform = p.get_transform();
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    soa_[c * 4 + r][i] = transform[c][r];
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                soa_[SOA_MIN + k][i] = p.min[k];
+                soa_[SOA_MAX + k][i] = p.max[k];
+            }
+        }
+        std::cout << MSG_PREFIX << "instances: " << inst_count_ <<
+            ", batch width: " << batch_width() << std::endl;
+    }
+
+    uint32_t instance_count() const
+    {
+        return inst_count_;
+    }
+
+    static uint32_t batch_width()
+    {
+#if defined(CPU_CULLING_AVX)
+        return 8;
+#elif defined(CPU_CULLING_SSE)
+        return 4;
+#else
+        return 1;
+#endif
+    }
+
+    const Cpu_culling_stats &last_stats() const
+    {
+        return stats_;
+    }
+
+    // scalar oracle, visibility[i] receives what visibility.comp writes to cmds[i].inst_count
+    void cull_reference(const Cpu_culling_params &params,
+                        const Cpu_depth_pyramid *p_pyramid,
+                        uint32_t *visibility)
+    {
+        base::Timer timer;
+        float vm[16];
+        mat_mul_(params.view, params.model, vm);
+        uint32_t visible = 0;
+        for (uint32_t i = 0; i < inst_count_; i++) {
+            visibility[i] = cull_reference_(i, params, vm, p_pyramid);
+            visible += visibility[i];
+        }
+        update_stats_(visible, timer.get());
+    }
+
+    // batched path, 4/8 instances per iteration
+    void cull(const Cpu_culling_params &params,
+              const Cpu_depth_pyramid *p_pyramid,
+              uint32_t *visibility)
+    {
+        base::Timer timer;
+        float vm[16];
+        mat_mul_(params.view, params.model, vm);
+        uint32_t visible = 0;
+#if defined(CPU_CULLING_AVX)
+        for (uint32_t i = 0; i < inst_count_; i += 8) {
+            visible += cull_batch_<cpu_culling_simd::F8>(i, params, vm, p_pyramid, visibility);
+        }
+#elif defined(CPU_CULLING_SSE)
+        for (uint32_t i = 0; i < inst_count_; i += 4) {
+            visible += cull_batch_<cpu_culling_simd::F4>(i, params, vm, p_pyramid, visibility);
+        }
+#else
+        for (uint32_t i = 0; i < inst_count_; i++) {
+            visibility[i] = cull_reference_(i, params, vm, p_pyramid);
+            visible += visibility[i];
+        }
+#endif
+        update_stats_(visible, timer.get());
+    }
+
+    // runs both paths, returns the number of instances they disagree on
+    uint32_t verify(const Cpu_culling_params &params,
+                    const Cpu_depth_pyramid *p_pyramid)
+    {
+        std::vector<uint32_t> ref(inst_count_), res(inst_count_);
+        cull_reference(params, p_pyramid, ref.data());
+        cull(params, p_pyramid, res.data());
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < inst_count_; i++) {
+            if (ref[i] != res[i]) mismatches++;
+        }
+        return mismatches;
+    }
+
+    // averaged throughput of the batched path
+    Cpu_culling_stats benchmark(const Cpu_culling_params &params,
+                                const Cpu_depth_pyramid *p_pyramid,
+                                uint32_t iterations = 100)
+    {
+        std::vector<uint32_t> res(inst_count_);
+        Cpu_culling_stats total{};
+        for (uint32_t i = 0; i < iterations; i++) {
+            cull(params, p_pyramid, res.data());
+            total.seconds += stats_.seconds;
+        }
+        total.instance_count = inst_count_;
+        total.visible_count = stats_.visible_count;
+        total.instances_per_second = total.seconds > 0. ?
+            static_cast<double>(inst_count_) * iterations / total.seconds : 0.;
+        total.seconds /= iterations;
+        std::cout << MSG_PREFIX << "visible " << total.visible_count << " / " << total.instance_count <<
+            ", " << total.seconds * 1000. << " ms, " <<
+            static_cast<uint64_t>(total.instances_per_second) << " instances/s" << std::endl;
+        return total;
+    }
+
+private:
+    enum
+    {
+        SOA_MIN = 16,
+        SOA_MAX = 19,
+        SOA_COUNT = 22
+    };
+
+    const std::vector<Instance_properties> &props_;
+    uint32_t inst_count_{0};
+    uint32_t padded_count_{0};
+    std::vector<float> soa_[SOA_COUNT];
+    Cpu_culling_stats stats_{};
+
+    void update_stats_(uint32_t visible, double seconds)
+    {
+        stats_.instance_count = inst_count_;
+        stats_.visible_count = visible;
+        stats_.seconds = seconds;
+        stats_.instances_per_second = seconds > 0. ? inst_count_ / seconds : 0.;
+    }
+
+    static float step_(float edge, float x)
+    {
+        return x < edge ? 0.f : 1.f;
+    }
+
+    static float glsl_min_(float x, float y)
+    {
+        return y < x ? y : x;
+    }
+
+    static float glsl_max_(float x, float y)
+    {
+        return x < y ? y : x;
+    }
+
+    // res[c * 4 + r] = (a * b)[c][r]
+    static void mat_mul_(const float *a, const float *b, float *res)
+    {
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                res[c * 4 + r] = a[0 * 4 + r] * b[c * 4 + 0] +
+                    a[1 * 4 + r] * b[c * 4 + 1] +
+                    a[2 * 4 + r] * b[c * 4 + 2] +
+                    a[3 * 4 + r] * b[c * 4 + 3];
+            }
+        }
+    }
+
+    static void mat_mul_(const glm::mat4 &a, const glm::mat4 &b, float *res)
+    {
+        float fa[16], fb[16];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                fa[c * 4 + r] = a[c][r];
+                fb[c * 4 + r] = b[c][r];
+            }
+        }
+        mat_mul_(fa, fb, res);
+    }
+
+    // hiz part of the shader, from the projected rect onward
+    static uint32_t cull_occluder_(const Cpu_culling_params &params,
+                                   const Cpu_depth_pyramid *p_pyramid,
+                                   const float ndc_min[2],
+                                   const float ndc_max[2],
+                                   float z_min)
+    {
+        const float viewport[2] = {params.resolution.x, params.resolution.y};
+        float scr_pos_min[2], scr_pos_max[2], scr_rect[2];
+        for (int k = 0; k < 2; k++) {
+            scr_pos_min[k] = (ndc_min[k] * .5f + .5f) * viewport[k];
+            scr_pos_max[k] = (ndc_max[k] * .5f + .5f) * viewport[k];
+            scr_rect[k] = (ndc_max[k] - ndc_min[k]) * .5f * viewport[k];
+        }
+        float scr_size = glsl_max_(scr_rect[0], scr_rect[1]);
+
+        // int(ceil(log2(scr_size))) evaluated exactly
+        int mip = 0;
+        if (scr_size > 0.f && std::isfinite(scr_size)) {
+            int e;
+            float m = std::frexp(scr_size, &e);
+            mip = m > .5f ? e : e - 1;
+        }
+        int shift = std::max(0, std::min(31, mip));
+        uint32_t dim[2];
+        for (int k = 0; k < 2; k++) {
+            dim[k] = (static_cast<uint32_t>(scr_pos_max[k]) >> shift) -
+                (static_cast<uint32_t>(scr_pos_min[k]) >> shift);
+        }
+        int use_lower = static_cast<int>(step_(static_cast<float>(dim[0]), 2.f) *
+                                         step_(static_cast<float>(dim[1]), 2.f));
+        mip = use_lower * std::max(0, mip - 1) + (1 - use_lower) * mip;
+        mip = std::max(0, std::min(static_cast<int>(p_pyramid->level_count()) - 1, mip));
+
+        float uv_min[2], uv_max[2];
+        for (int k = 0; k < 2; k++) {
+            float uv_scale = static_cast<float>(static_cast<uint32_t>(viewport[k]) >> mip) /
+                viewport[k] / static_cast<float>(MAX_DEPTH_IMAGE_SIZE >> mip);
+            uv_min[k] = scr_pos_min[k] * uv_scale;
+            uv_max[k] = scr_pos_max[k] * uv_scale;
+        }
+        const float coords[4][2] = {
+            {uv_min[0], uv_min[1]},
+            {uv_min[0], uv_max[1]},
+            {uv_max[0], uv_min[1]},
+            {uv_max[0], uv_max[1]}
+        };
+
+        // textureLod with nearest filtering and clamp to edge
+        const int s = static_cast<int>(p_pyramid->level_size(mip));
+        float scene_z = 0.f;
+        for (int i = 0; i < 4; i++) {
+            int x = std::max(0, std::min(s - 1, static_cast<int>(std::floor(coords[i][0] * s))));
+            int y = std::max(0, std::min(s - 1, static_cast<int>(std::floor(coords[i][1] * s))));
+            scene_z = glsl_max_(scene_z, p_pyramid->fetch(mip, x, y));
+        }
+
+        return 1 - static_cast<uint32_t>(step_(scene_z, z_min));
+    }
+
+    uint32_t cull_reference_(uint32_t idx,
+                             const Cpu_culling_params &params,
+                             const float *vm,
+                             const Cpu_depth_pyramid *p_pyramid) const
+    {
+        static const float a[4][3] = {{1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f}, {0.f, -1.f, 0.f}, {0.f, 1.f, 0.f}};
+        static const float n[4][3] = {{-1.f, 0.f, 0.f}, {1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, -1.f, 0.f}};
+
+        const auto &prop = props_[idx];
+        const glm::mat4 transform = prop.get_transform();
+        float t[16], mv[16], p[16];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[c * 4 + r] = transform[c][r];
+                p[c * 4 + r] = params.projection_clip[c][r];
+            }
+        }
+        mat_mul_(vm, t, mv);
+
+        const float *bbmin = &prop.min[0];
+        const float *bbmax = &prop.max[0];
+        float bbsize[3] = {bbmax[0] - bbmin[0], bbmax[1] - bbmin[1], bbmax[2] - bbmin[2]};
+        const float corners[8][3] = {
+            {bbmin[0], bbmin[1], bbmin[2]},
+            {bbmin[0] + bbsize[0], bbmin[1] + 0.f, bbmin[2] + 0.f},
+            {bbmin[0] + 0.f, bbmin[1] + bbsize[1], bbmin[2] + 0.f},
+            {bbmin[0] + 0.f, bbmin[1] + 0.f, bbmin[2] + bbsize[2]},
+            {bbmin[0] + bbsize[0], bbmin[1] + bbsize[1], bbmin[2] + 0.f},
+            {bbmin[0] + 0.f, bbmin[1] + bbsize[1], bbmin[2] + bbsize[2]},
+            {bbmin[0] + bbsize[0], bbmin[1] + 0.f, bbmin[2] + bbsize[2]},
+            {bbmax[0], bbmax[1], bbmax[2]}
+        };
+
+        float ndc_min[2] = {1.f, 1.f};
+        float ndc_max[2] = {-1.f, -1.f};
+        float z_min = 1.f;
+
+        uint32_t res = 0;
+        for (int i = 0; i < 8; i++) {
+            // cull near far
+            float view_pos[4];
+            for (int r = 0; r < 4; r++) {
+                view_pos[r] = mv[0 * 4 + r] * corners[i][0] +
+                    mv[1 * 4 + r] * corners[i][1] +
+                    mv[2 * 4 + r] * corners[i][2] +
+                    mv[3 * 4 + r];
+            }
+            uint32_t nf_res = static_cast<uint32_t>(step_(view_pos[2], -params.cam_near) *
+                                                    step_(-view_pos[2], params.cam_far));
+
+            // cull left right top bottom
+            float clip_pos[4];
+            for (int r = 0; r < 4; r++) {
+                clip_pos[r] = p[0 * 4 + r] * view_pos[0] +
+                    p[1 * 4 + r] * view_pos[1] +
+                    p[2 * 4 + r] * view_pos[2] +
+                    p[3 * 4 + r] * view_pos[3];
+            }
+            float ndc_pos[3] = {clip_pos[0] / clip_pos[3], clip_pos[1] / clip_pos[3], clip_pos[2] / clip_pos[3]};
+
+            // clip objects behind near plane
+            ndc_pos[2] *= step_(view_pos[2], params.cam_near);
+
+            uint32_t lrtb_res = 1;
+            for (int k = 0; k < 4; k++) {
+                float B = -((ndc_pos[0] - a[k][0]) * n[k][0] +
+                            (ndc_pos[1] - a[k][1]) * n[k][1] +
+                            (ndc_pos[2] - a[k][2]) * n[k][2]);
+                lrtb_res &= static_cast<uint32_t>(step_(B, 0.f));
+            }
+
+            for (int k = 0; k < 2; k++) {
+                ndc_pos[k] = glsl_max_(-1.f, glsl_min_(1.f, ndc_pos[k]));
+                ndc_min[k] = glsl_min_(ndc_min[k], ndc_pos[k]);
+                ndc_max[k] = glsl_max_(ndc_max[k], ndc_pos[k]);
+            }
+            ndc_pos[2] = glsl_max_(0.f, glsl_min_(1.f, ndc_pos[2]));
+            z_min = glsl_min_(z_min, ndc_pos[2]);
+
+            res = std::max(res, nf_res * lrtb_res);
+        }
+        // is_skybox
+        res = std::max(res, static_cast<uint32_t>(step_(ndc_min[0] * ndc_max[0] + ndc_min[1] * ndc_max[1], 0.f)));
+
+        if (!params.use_occlusion_culling || !p_pyramid) return res;
+        return res * cull_occluder_(params, p_pyramid, ndc_min, ndc_max, z_min);
+    }
+
+#ifdef CPU_CULLING_SSE
+    template<typename V>
+    uint32_t cull_batch_(uint32_t first,
+                         const Cpu_culling_params &params,
+                         const float *vm,
+                         const Cpu_depth_pyramid *p_pyramid,
+                         uint32_t *visibility) const
+    {
+        using namespace cpu_culling_simd;
+        static const float a[4][3] = {{1.f, 0.f, 0.f}, {-1.f, 0.f, 0.f}, {0.f, -1.f, 0.f}, {0.f, 1.f, 0.f}};
+        static const float n[4][3] = {{-1.f, 0.f, 0.f}, {1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, -1.f, 0.f}};
+        const V zero = V::zero();
+        const V one = V::set1(1.f);
+        const V all_true = V::all_true();
+
+        // model view per lane
+        V t[16], mv[16];
+        for (int k = 0; k < 16; k++) {
+            t[k] = V::load(&soa_[k][first]);
+        }
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                mv[c * 4 + r] = V::set1(vm[0 * 4 + r]) * t[c * 4 + 0] +
+                    V::set1(vm[1 * 4 + r]) * t[c * 4 + 1] +
+                    V::set1(vm[2 * 4 + r]) * t[c * 4 + 2] +
+                    V::set1(vm[3 * 4 + r]) * t[c * 4 + 3];
+            }
+        }
+        V p[16];
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                p[c * 4 + r] = V::set1(params.projection_clip[c][r]);
+            }
+        }
+
+        V bbmin[3], bbmax[3], bbsize[3];
+        for (int k = 0; k < 3; k++) {
+            bbmin[k] = V::load(&soa_[SOA_MIN + k][first]);
+            bbmax[k] = V::load(&soa_[SOA_MAX + k][first]);
+            bbsize[k] = bbmax[k] - bbmin[k];
+        }
+        // corner i takes bbmin + bbsize on the axes flagged in CORNER_AXES[i]
+        static const int CORNER_AXES[8] = {0, 1, 2, 4, 3, 6, 5, 7};
+
+        V ndc_min[2] = {one, one};
+        V ndc_max[2] = {V::set1(-1.f), V::set1(-1.f)};
+        V z_min = one;
+        V res = zero; // all bits set when visible
+
+        const V neg_near = V::set1(-params.cam_near);
+        const V near_v = V::set1(params.cam_near);
+        const V far_v = V::set1(params.cam_far);
+
+        for (int i = 0; i < 8; i++) {
+            V corner[3];
+            for (int k = 0; k < 3; k++) {
+                if (i == 7) corner[k] = bbmax[k];
+                else if (i == 0) corner[k] = bbmin[k];
+                else corner[k] = bbmin[k] + ((CORNER_AXES[i] >> k) & 1 ? bbsize[k] : zero);
+            }
+
+            V view_pos[4];
+            for (int r = 0; r < 4; r++) {
+                view_pos[r] = mv[0 * 4 + r] * corner[0] +
+                    mv[1 * 4 + r] * corner[1] +
+                    mv[2 * 4 + r] * corner[2] +
+                    mv[3 * 4 + r];
+            }
+            // step(view_z, -near) * step(-view_z, far)
+            V nf_res = and_not(less(neg_near, view_pos[2]), and_not(less(far_v, zero - view_pos[2]), all_true));
+
+            V clip_pos[4];
+            for (int r = 0; r < 4; r++) {
+                clip_pos[r] = p[0 * 4 + r] * view_pos[0] +
+                    p[1 * 4 + r] * view_pos[1] +
+                    p[2 * 4 + r] * view_pos[2] +
+                    p[3 * 4 + r] * view_pos[3];
+            }
+            V ndc_pos[3] = {clip_pos[0] / clip_pos[3], clip_pos[1] / clip_pos[3], clip_pos[2] / clip_pos[3]};
+            ndc_pos[2] = ndc_pos[2] * and_not(less(near_v, view_pos[2]), one);
+
+            V lrtb_res = all_true;
+            for (int k = 0; k < 4; k++) {
+                V B = zero - ((ndc_pos[0] - V::set1(a[k][0])) * V::set1(n[k][0]) +
+                              (ndc_pos[1] - V::set1(a[k][1])) * V::set1(n[k][1]) +
+                              (ndc_pos[2] - V::set1(a[k][2])) * V::set1(n[k][2]));
+                lrtb_res = and_not(less(zero, B), lrtb_res);
+            }
+
+            for (int k = 0; k < 2; k++) {
+                ndc_pos[k] = glsl_max(V::set1(-1.f), glsl_min(one, ndc_pos[k]));
+                ndc_min[k] = glsl_min(ndc_min[k], ndc_pos[k]);
+                ndc_max[k] = glsl_max(ndc_max[k], ndc_pos[k]);
+            }
+            ndc_pos[2] = glsl_max(zero, glsl_min(one, ndc_pos[2]));
+            z_min = glsl_min(z_min, ndc_pos[2]);
+
+            res = res | (nf_res & lrtb_res);
+        }
+        // is_skybox
+        res = res | and_not(less(zero, ndc_min[0] * ndc_max[0] + ndc_min[1] * ndc_max[1]), all_true);
+
+        const uint32_t w = V::width;
+        const int mask = res.mask();
+        float lane_ndc_min[2][w], lane_ndc_max[2][w], lane_z_min[w];
+        if (params.use_occlusion_culling && p_pyramid && mask) {
+            for (int k = 0; k < 2; k++) {
+                ndc_min[k].store(lane_ndc_min[k]);
+                ndc_max[k].store(lane_ndc_max[k]);
+            }
+            z_min.store(lane_z_min);
+        }
+
+        uint32_t visible = 0;
+        const uint32_t count = std::min(w, inst_count_ - first);
+        for (uint32_t l = 0; l < count; l++) {
+            uint32_t lane_res = (mask >> l) & 1;
+            if (lane_res && params.use_occlusion_culling && p_pyramid) {
+                const float mn[2] = {lane_ndc_min[0][l], lane_ndc_min[1][l]};
+                const float mx[2] = {lane_ndc_max[0][l], lane_ndc_max[1][l]};
+                lane_res = cull_occluder_(params, p_pyramid, mn, mx, lane_z_min[l]);
+            }
+            visibility[first + l] = lane_res;
+            visible += lane_res;
+        }
+        return visible;
+    }
+#endif
+};
+#undef MSG_PREFIX
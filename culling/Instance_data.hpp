@@ -0,0 +1,105 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+
+// per-instance and material data shared between the host and the shaders,
+// layouts must match simple.vert, depth.vert, simple.frag, visibility.comp and rebatch.comp
+//
+// COMPACT_LAYOUT, defined for the host and the shaders alike, stores the
+// instance transforms as 3x4 affine rows, 80 instead of 96 bytes per
+// instance, and drops the padding of the commands, 20 instead of 48 bytes
+
+struct Instance
+{
+    glm::mat4 transform;
+    uint32_t mesh_idx;
+};
+
+// the inverse transpose of the upper 3x3 of an instance transform,
+// a std430 mat3 with vec4 aligned columns
+struct Instance_normal
+{
+    glm::vec4 cols[3];
+};
+
+struct Instance_properties
+{
+#ifdef COMPACT_LAYOUT
+    glm::vec4 rows[3]; // the transform without its last row
+#else
+    glm::mat4 transform;
+#endif
+    glm::vec3 min;
+    uint32_t mesh_idx;
+    glm::vec3 max;
+    float material_idx;
+
+    glm::mat4 get_transform() const
+    {
+#ifdef COMPACT_LAYOUT
+        return glm::mat4(rows[0].x, rows[1].x, rows[2].x, 0.f,
+                         rows[0].y, rows[1].y, rows[2].y, 0.f,
+                         rows[0].z, rows[1].z, rows[2].z, 0.f,
+                         rows[0].w, rows[1].w, rows[2].w, 1.f);
+#else
+        return transform;
+#endif
+    }
+
+    void set_transform(const glm::mat4 &t)
+    {
+#ifdef COMPACT_LAYOUT
+        for (int r = 0; r < 3; r++) rows[r] = glm::vec4(t[0][r], t[1][r], t[2][r], t[3][r]);
+#else
+        transform = t;
+#endif
+    }
+};
+
+inline Instance_properties make_instance_properties(const glm::mat4 &transform,
+                                                    const glm::vec3 &min,
+                                                    uint32_t mesh_idx,
+                                                    const glm::vec3 &max,
+                                                    float material_idx)
+{
+    Instance_properties res;
+    res.set_transform(transform);
+    res.min = min;
+    res.mesh_idx = mesh_idx;
+    res.max = max;
+    res.material_idx = material_idx;
+    return res;
+}
+
+struct Mdi_cmd
+{
+    uint32_t idx_count;
+    uint32_t inst_count;
+    uint32_t idx_base;
+    int vert_offset;
+    uint32_t inst_start;
+#ifndef COMPACT_LAYOUT
+    float paddings[7];
+#endif
+    Mdi_cmd(uint32_t idx_c, uint32_t inst_c, uint32_t idx_b, int vert_o, uint32_t inst_s) :
+        idx_count(idx_c),
+        inst_count(inst_c),
+        idx_base(idx_b),
+        vert_offset(vert_o),
+        inst_start(inst_s)
+    {}
+};
+
+struct Material_properties
+{
+    glm::vec4 tex_indices{-1.f};
+
+    glm::vec3 diffuse{1.f};
+    float alpha{1.f};
+
+    glm::vec3 specular{0.f};
+    float specular_exponent{0.f};
+
+    glm::vec3 emissive{0.f};
+    float padding{0.f};
+};
@@ -1,5 +1,8 @@
 #pragma once
 #include  "stdafx.h"
+#include "Instance_data.hpp"
+#include "Scene_cache.hpp"
+#include "Scene_import.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #define MSG_PREFIX "-- MODEL: "
 #define DUMMY_TEX_PATH "dummy/dummy_rgba_unorm.ktx" 
@@ -13,12 +16,12 @@ public:
     Material_texture2D(base::Physical_device *p_phy_dev,
                        base::Device *p_dev,
                        const std::string file_path,
-                       vk::CommandPool &graphics_cmd_pool,
+                       base::Upload_manager &uploads,
                        vk::Format format) :
         base::Texture2D(p_phy_dev, p_dev)
     {
         load(file_path,
-             graphics_cmd_pool,
+             uploads,
              format,
              vk::ImageUsageFlagBits::eSampled,
              vk::ImageLayout::eShaderReadOnlyOptimal,
@@ -35,44 +38,6 @@ public:
     }
 };
 
-struct Instance
-{
-    glm::mat4 transform;
-    uint32_t mesh_idx;
-};
-
-struct Instance_attributes 
-{
-    glm::mat4 transform;
-    float material_idx;
-};
-
-struct Instance_properties
-{
-    glm::mat4 transform;
-    glm::vec3 min;
-    float padding;
-    glm::vec3 max;
-    float material_idx;
-};
-
-struct Mdi_cmd
-{
-    uint32_t idx_count;
-    uint32_t inst_count;
-    uint32_t idx_base;
-    int vert_offset;
-    uint32_t inst_start;
-    float paddings[7];
-    Mdi_cmd(uint32_t idx_c, uint32_t inst_c, uint32_t idx_b, int vert_o, uint32_t inst_s) :
-        idx_count(idx_c),
-        inst_count(inst_c),
-        idx_base(idx_b),
-        vert_offset(vert_o),
-        inst_start(inst_s)
-    {}
-};
-
 struct Cmd_draw_info
 {
     vk::Buffer indirect_cmd_buffer{};
@@ -81,50 +46,86 @@ struct Cmd_draw_info
     uint32_t stride{0};
 };
 
-struct Material_properties
-{
-    glm::vec4 tex_indices{-1.f};
-
-    glm::vec3 diffuse{1.f};
-    float alpha{1.f};
-
-    glm::vec3 specular{0.f};
-    float specular_exponent{0.f};
-
-    glm::vec3 emissive{0.f};
-    float padding{0.f};
-};
-
 class Model : public base::Model_base
 {
 public:
-    base::Buffer *p_inst_attribs_buffer{nullptr};
+    // instance indices, the per instance vertex stream of the unculled draws,
+    // the vertex shaders fetch the instance streams by them
+    base::Buffer *p_inst_ids_buffer{nullptr};
+    // transforms, normal matrices and material indices, one array each
+    base::Buffer *p_inst_streams_buffer{nullptr};
     base::Buffer *p_inst_data_buffer{nullptr};
     base::Buffer *p_mdi_cmd_buffer{nullptr};
     base::Buffer *p_mdi_no_batching_cmd_buffer{nullptr};
+    base::Buffer *p_mesh_cmd_buffer{nullptr};
+    // base::MAX_MESH_LODS index ranges per mesh, visibility.comp picks one
+    // per instance by its size on screen
+    base::Buffer *p_mesh_lod_buffer{nullptr};
+    // some mesh has simplified levels
+    bool has_lods{false};
+    // base::Mesh_cluster of all meshes and the first cluster of every mesh
+    // with one more, cluster_cull.comp tests those of the visible instances
+    base::Buffer *p_cluster_buffer{nullptr};
+    base::Buffer *p_cluster_offset_buffer{nullptr};
+    // clusters over all instances, at most one cmd each
+    uint32_t inst_cluster_total{0};
+    // indices of the full meshes over all instances
+    uint64_t inst_index_total{0};
+
+    // host copy of the culling input, see Cpu_culling
+    std::vector<Instance_properties> inst_props{};
+    // world space aabbs of the instances, without the model matrix
+    std::vector<base::Aabb> inst_world_bounds{};
 
     Cmd_draw_info mdi_cmd_draw_info{};
     Cmd_draw_info mdi_no_batching_cmd_draw_info{};
+    // one cmd per mesh without instances, the source of the rebatched cmds
+    Cmd_draw_info mesh_cmd_draw_info{};
 
     uint32_t inst_vi_bind_id{1};
     std::vector<vk::VertexInputBindingDescription> vi_bindings{};
     std::vector<vk::VertexInputAttributeDescription> vi_attribs{};
+    // positions of the position stream and instance indices,
+    // empty without the position stream
+    std::vector<vk::VertexInputBindingDescription> depth_vi_bindings{};
+    std::vector<vk::VertexInputAttributeDescription> depth_vi_attribs{};
 
     vk::DeviceSize mtl_buffer_aligned_size{0};
 
+    // loads the scene cache next to the model file when it is current,
+    // and writes it after importing the model file otherwise
+    bool use_scene_cache{false};
+    // loads the package baked by culling_bake next to the model file,
+    // before the scene cache and the import
+    bool use_package{false};
+
     vk::DescriptorSet desc_set{};
     vk::DescriptorSetLayout desc_set_layout{};
 
+    // the vertex positions are quantized over the mesh aabbs, the instance
+    // transforms carry the dequantization
+    bool quantized_positions() const
+    {
+        return p_geometries->vertex_layout.has(base::VERT_COMP_POSITION_UNORM16);
+    }
+
+    // the instance transforms of the vertex shaders, with the dequantization
+    // of quantized positions
+    const vk::DescriptorBufferInfo &inst_transform_info() const
+    {
+        return inst_stream_infos_[0];
+    }
+
     Model(base::Physical_device *p_phy_dev,
           base::Device *p_dev,
-          vk::CommandPool graphics_cmd_pool,
+          base::Upload_manager *p_uploads,
           bool has_diffuse_map = false,
           bool has_opacity_map = false,
           bool has_specular_map = false,
           bool has_normal_map = false) :
         base::Model_base(p_phy_dev,
                          p_dev,
-                         graphics_cmd_pool),
+                         p_uploads),
         has_diffuse_map_(has_diffuse_map),
         has_opacity_map_(has_opacity_map),
         has_specular_map_(has_specular_map),
@@ -136,14 +137,23 @@ public:
         p_dev_->dev.destroyDescriptorPool(desc_pool_);
         p_dev_->dev.destroyDescriptorSetLayout(desc_set_layout);
         p_dev_->dev.freeMemory(inst_data_buffer_mem_);
-        p_dev_->dev.freeMemory(inst_attribs_buffer_mem_);
+        p_dev_->dev.freeMemory(inst_ids_buffer_mem_);
+        p_dev_->dev.freeMemory(inst_streams_buffer_mem_);
         p_dev_->dev.freeMemory(mtl_buffer_mem_);
         p_dev_->dev.freeMemory(mdi_cmd_buffer_mem_);
-        delete p_inst_attribs_buffer;
+        p_dev_->dev.freeMemory(mesh_cmd_buffer_mem_);
+        p_dev_->dev.freeMemory(mesh_lod_buffer_mem_);
+        p_dev_->dev.freeMemory(cluster_buffer_mem_);
+        delete p_inst_ids_buffer;
+        delete p_inst_streams_buffer;
         delete p_inst_data_buffer;
         delete p_mtl_buffer_;
         delete p_mdi_cmd_buffer;
         delete p_mdi_no_batching_cmd_buffer;
+        delete p_mesh_cmd_buffer;
+        delete p_mesh_lod_buffer;
+        delete p_cluster_buffer;
+        delete p_cluster_offset_buffer;
         for (auto p_tex : p_mtl_textures_) {
             delete p_tex;
         }
@@ -159,6 +169,7 @@ public:
         }
 
         // load meshes and run post processing
+        keep_host_geometry_ = use_scene_cache;
         base::Model_base::load(model_path, layout, ai_flags);
     }
 
@@ -166,8 +177,14 @@ private:
     vk::DescriptorPool desc_pool_{};
 
     vk::DeviceMemory inst_data_buffer_mem_{};
-    vk::DeviceMemory inst_attribs_buffer_mem_{};
+    vk::DeviceMemory inst_ids_buffer_mem_{};
+    vk::DeviceMemory inst_streams_buffer_mem_{};
+    // transforms, normal matrices and material indices in p_inst_streams_buffer
+    vk::DescriptorBufferInfo inst_stream_infos_[3]{};
     vk::DeviceMemory mdi_cmd_buffer_mem_{};
+    vk::DeviceMemory mesh_cmd_buffer_mem_{};
+    vk::DeviceMemory mesh_lod_buffer_mem_{};
+    vk::DeviceMemory cluster_buffer_mem_{};
     vk::DeviceMemory mtl_buffer_mem_{};
     base::Buffer *p_mtl_buffer_{nullptr};
 
@@ -179,70 +196,163 @@ private:
     bool has_specular_map_;
     bool has_normal_map_;
 
-    void post_process_(const aiScene *p_scene,
-                       vk::CommandBuffer cmd_buffer)
+    void post_process_(const aiScene *p_scene)
         override
     {
-        init_indirect_draw_(p_scene, cmd_buffer);
-        init_materials_(p_scene, cmd_buffer);
+        init_scene_(scene_instances(p_scene, p_geometries->meshes, p_geometries->mesh_remap),
+                    read_materials(p_scene));
     }
 
-    void traverse_instances_(aiNode *p_node,
-                             glm::mat4 transform,
-                             std::vector<Instance> &instances)
+    void post_process_(const base::Gltf_scene &scene)
+        override
     {
-        transform *= base::convert_mat(p_node->mTransformation);
-        if (p_node->mNumChildren > 0) {
-            for (uint32_t i = 0; i < p_node->mNumChildren; i++) {
-                traverse_instances_(p_node->mChildren[i], transform, instances);
-            }
-        } else if (p_node->mNumMeshes > 0) {
+        init_scene_(scene_instances(scene, p_geometries->meshes, p_geometries->mesh_remap),
+                    read_materials(scene));
+    }
+
+    void init_scene_(const std::vector<Instance_properties> &props,
+                     const std::vector<Scene_material> &materials)
+    {
+        inst_world_bounds = instance_world_bounds(props);
+
+        if (use_scene_cache) {
+            auto cache_path = Scene_cache::path_of(model_path_);
+            if (Scene_cache::write(cache_path,
+                                   cache_key_(),
+                                   p_geometries->vertex_layout,
+                                   optimize_meshes ? Scene_cache::FLAG_OPTIMIZED_MESHES : 0,
+                                   p_geometries->host_vertices,
+                                   p_geometries->host_indices,
+                                   p_geometries->meshes,
+                                   p_geometries->mesh_remap,
+                                   p_geometries->mesh_lods,
+                                   lod_count,
+                                   p_geometries->clusters,
+                                   p_geometries->cluster_offsets,
+                                   props,
+                                   inst_world_bounds,
+                                   materials))
+                std::cout << MSG_PREFIX << "wrote scene cache " << cache_path << std::endl;
+            else
+                std::cout << MSG_PREFIX << "cannot write scene cache " << cache_path << std::endl;
+            std::vector<float>().swap(p_geometries->host_vertices);
+            std::vector<uint32_t>().swap(p_geometries->host_indices);
+        }
+
+        print_world_bounds_();
+        init_indirect_draw_(props);
+        init_materials_(materials);
+    }
+
+    Scene_cache_key cache_key_() const
+    {
+        return Scene_cache_key(model_path_, p_geometries->vertex_layout, ai_flags_, optimize_meshes, lod_count);
+    }
 
-            // only process single mesh leaf nodes
-            assert(p_node->mNumMeshes == 1);
-            instances.push_back({transform, p_node->mMeshes[0]});
+    // the package is used whatever the mesh optimization and lod options, it
+    // was baked with its own, the vertex layout is the one of the package
+    bool load_cached_()
+        override
+    {
+        if (use_package) {
+            auto package_path = Scene_cache::package_path_of(model_path_);
+            Scene_cache package(package_path);
+            if (package.valid()) {
+                const bool optimized = (package.flags() & Scene_cache::FLAG_OPTIMIZED_MESHES) != 0;
+                if (package.import_hash() == Scene_cache_key::import_hash_of(p_geometries->vertex_layout, ai_flags_, optimized,
+                                                                            package.lod_count())) {
+                    std::cout << MSG_PREFIX << "loading package " << package_path << std::endl;
+                    load_from_(package);
+                    return true;
+                }
+                std::cout << MSG_PREFIX << "package " << package_path << " was baked for another build" << std::endl;
+            }
         }
+
+        if (!use_scene_cache) return false;
+        Scene_cache cache(Scene_cache::path_of(model_path_), cache_key_());
+        if (!cache.valid()) return false;
+        load_from_(cache);
+        return true;
     }
 
-    void init_indirect_draw_(const aiScene *p_scene,
-                             vk::CommandBuffer cmd_buffer)
+    // the same uploads as the import, straight from the mapped file
+    void load_from_(const Scene_cache &cache)
     {
-        std::vector<Instance> instances;
-        traverse_instances_(p_scene->mRootNode, glm::mat4(1.f), instances);
+        base::Timer timer;
+        p_geometries->meshes.assign(cache.meshes(), cache.meshes() + cache.mesh_count());
+        p_geometries->mesh_remap.assign(cache.mesh_remap(), cache.mesh_remap() + cache.scene_mesh_count());
+        p_geometries->mesh_lods.assign(cache.mesh_lods(), cache.mesh_lods() + cache.mesh_count() * base::MAX_MESH_LODS);
+        p_geometries->clusters.assign(cache.clusters(), cache.clusters() + cache.cluster_count());
+        p_geometries->cluster_offsets.assign(cache.cluster_offsets(), cache.cluster_offsets() + cache.mesh_count() + 1);
+        p_geometries->init_packed(cache.vertices(), cache.vertex_bytes(),
+                                  cache.indices(), cache.index_count(),
+                                  *p_uploads_);
+        double geometries_time = timer.get();
+
+        std::vector<Instance_properties> props(cache.instances(), cache.instances() + cache.instance_count());
+        inst_world_bounds.assign(cache.world_bounds(), cache.world_bounds() + cache.instance_count());
+        print_world_bounds_();
+        init_indirect_draw_(props);
+        double instances_time = timer.get();
+
+        init_materials_(cache.materials());
+        double materials_time = timer.get();
+
+        std::cout << MSG_PREFIX << "cached geometries " << geometries_time * 1000. << " ms, instances " <<
+            (instances_time - geometries_time) * 1000. << " ms, materials " <<
+            (materials_time - instances_time) * 1000. << " ms" << std::endl;
+    }
 
-        std::vector<Instance_attributes> inst_attribs;
-        std::vector<Instance_properties> inst_data;
+    void print_world_bounds_() const
+    {
+        if (inst_world_bounds.empty()) return;
+        base::Aabb bounds = inst_world_bounds[0];
+        for (auto &aabb : inst_world_bounds) {
+            bounds.min = glm::min(bounds.min, aabb.min);
+            bounds.max = glm::max(bounds.max, aabb.max);
+        }
+        std::cout << MSG_PREFIX << "scene bounds (" << bounds.min.x << ", " << bounds.min.y << ", " << bounds.min.z <<
+            ") to (" << bounds.max.x << ", " << bounds.max.y << ", " << bounds.max.z << ")" << std::endl;
+    }
+
+    void init_indirect_draw_(const std::vector<Instance_properties> &inst_data)
+    {
+        const size_t inst_count = inst_data.size();
+        std::vector<uint32_t> inst_ids(inst_count);
+        std::vector<glm::mat4> inst_transforms(inst_count);
+        std::vector<Instance_normal> inst_normals(inst_count);
+        std::vector<uint32_t> inst_mtls(inst_count);
+        uint32_t uniform_scale_count = 0;
         std::vector<vk::DrawIndexedIndirectCommand> mdi_cmds;
         std::vector<Mdi_cmd> mdi_no_batching_cmds;
         std::vector<base::Mesh> &meshes = p_geometries->meshes;
+        std::vector<uint32_t> mesh_inst_counts(meshes.size(), 0);
+        const bool dequantize = quantized_positions();
         uint32_t inst_idx = 0;
-        for (auto &inst : instances) {
+        inst_index_total = 0;
+        for (auto &inst : inst_data) {
             auto p_mesh = &meshes[inst.mesh_idx];
+            inst_index_total += p_mesh->idx_count;
 
-            // can pack inst_attribs and inst_data into one,
-            // separated just for clarity purpose
-
-            // inst attribs for vertex shader
-            inst_attribs.push_back({inst.transform,
-                                   static_cast<float>(p_mesh->material_idx)
-                                   });
-            // inst data for compute shader
-            inst_data.push_back({inst.transform,
-                                p_mesh->min,
-                                0.f,
-                                p_mesh->max,
-                                static_cast<float>(p_mesh->material_idx)});
+            // inst streams for the vertex shaders, fetched by instance index
+            inst_ids[inst_idx] = inst_idx;
+            inst_transforms[inst_idx] = dequantize ?
+                inst.get_transform() * base::position_dequantization(glm::vec3(p_mesh->min), glm::vec3(p_mesh->max)) :
+                inst.get_transform();
+            if (normal_matrix_(inst_transforms[inst_idx], inst_normals[inst_idx])) uniform_scale_count++;
+            inst_mtls[inst_idx] = static_cast<uint32_t>(inst.material_idx);
 
             // mdi cmd
-            // draw all instances of the same mesh per cmd 
-            if (mdi_cmds.size() <= inst.mesh_idx) {
+            // draw all instances of the same mesh per cmd, they are consecutive
+            if (inst_idx == 0 || inst.mesh_idx != inst_data[inst_idx - 1].mesh_idx) {
                 mdi_cmds.emplace_back(p_mesh->idx_count,
                                       1,
                                       p_mesh->idx_base,
                                       p_mesh->vert_offset,
                                       inst_idx);
             } else {
-                mdi_cmds[inst.mesh_idx].instanceCount++;
+                mdi_cmds.back().instanceCount++;
             }
 
             // mdi no batching cmd
@@ -252,9 +362,24 @@ private:
                                               p_mesh->idx_base,
                                               p_mesh->vert_offset,
                                               inst_idx);
+            mesh_inst_counts[inst.mesh_idx]++;
             inst_idx++;
         }
 
+        // mesh cmds
+        // one cmd per mesh, each mesh owns a range of the rebatched instances
+        // in which rebatch.comp packs and counts the visible ones
+        std::vector<vk::DrawIndexedIndirectCommand> mesh_cmds;
+        uint32_t inst_start = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            mesh_cmds.emplace_back(meshes[i].idx_count,
+                                   0,
+                                   meshes[i].idx_base,
+                                   meshes[i].vert_offset,
+                                   inst_start);
+            inst_start += mesh_inst_counts[i];
+        }
+
         // device local buffers
 
         // inst data buffer
@@ -274,51 +399,95 @@ private:
                                                   1,
                                                   &p_inst_data_buffer);
 
-            base::update_device_local_buffer_memory(p_phy_dev_,
-                                                    p_dev_,
-                                                    p_inst_data_buffer,
-                                                    inst_data_buffer_mem_,
-                                                    inst_buf_size,
-                                                    inst_data.data(),
-                                                    0,
-                                                    vk::PipelineStageFlagBits::eTopOfPipe,
-                                                    vk::PipelineStageFlagBits::eComputeShader,
-                                                    vk::AccessFlags(),
-                                                    vk::AccessFlagBits::eShaderRead,
-                                                    cmd_buffer);
+            p_uploads_->upload_buffer(p_inst_data_buffer,
+                                      inst_buf_size,
+                                      inst_data.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                      vk::AccessFlagBits::eShaderRead);
+            inst_props = inst_data;
         }
 
-        // inst attribs buffer
+        // inst ids buffer
         {
-            const vk::DeviceSize inst_buf_size = inst_attribs.size() * sizeof(inst_attribs[0]);
-            p_inst_attribs_buffer = new base::Buffer(p_dev_,
-                                                  inst_buf_size,
-                                                  vk::BufferUsageFlagBits::eVertexBuffer |
-                                                  vk::BufferUsageFlagBits::eTransferDst,
-                                                  vk::MemoryPropertyFlagBits::eDeviceLocal,
-                                                  vk::SharingMode::eExclusive);
-            p_inst_attribs_buffer->update_descriptor();
+            const vk::DeviceSize inst_buf_size = inst_ids.size() * sizeof(inst_ids[0]);
+            p_inst_ids_buffer = new base::Buffer(p_dev_,
+                                                 inst_buf_size,
+                                                 vk::BufferUsageFlagBits::eVertexBuffer |
+                                                 vk::BufferUsageFlagBits::eTransferDst,
+                                                 vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                 vk::SharingMode::eExclusive);
+            p_inst_ids_buffer->update_descriptor();
+
+            base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                                  p_dev_,
+                                                  inst_ids_buffer_mem_,
+                                                  1,
+                                                  &p_inst_ids_buffer);
+
+            p_uploads_->upload_buffer(p_inst_ids_buffer,
+                                      inst_buf_size,
+                                      inst_ids.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eVertexInput,
+                                      vk::AccessFlagBits::eVertexAttributeRead);
+        }
+
+        // inst streams buffer
+        // the arrays start at storage buffer offset alignment, one descriptor each
+        {
+            const vk::DeviceSize alignment = p_phy_dev_->props.limits.minStorageBufferOffsetAlignment;
+            const vk::DeviceSize stream_sizes[3] = {
+                inst_count * sizeof(inst_transforms[0]),
+                inst_count * sizeof(inst_normals[0]),
+                inst_count * sizeof(inst_mtls[0])
+            };
+            const void *stream_data[3] = {inst_transforms.data(), inst_normals.data(), inst_mtls.data()};
+            vk::DeviceSize inst_buf_size = 0;
+            for (int i = 0; i < 3; i++) {
+                inst_stream_infos_[i].offset = inst_buf_size;
+                inst_stream_infos_[i].range = stream_sizes[i];
+                inst_buf_size += stream_sizes[i];
+                base::align_size(inst_buf_size, alignment);
+            }
+            std::vector<uint8_t> streams(inst_buf_size, 0);
+            for (int i = 0; i < 3; i++) {
+                memcpy(streams.data() + inst_stream_infos_[i].offset, stream_data[i], stream_sizes[i]);
+            }
+
+            p_inst_streams_buffer = new base::Buffer(p_dev_,
+                                                     inst_buf_size,
+                                                     vk::BufferUsageFlagBits::eStorageBuffer |
+                                                     vk::BufferUsageFlagBits::eTransferDst,
+                                                     vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                     vk::SharingMode::eExclusive);
 
             base::allocate_and_bind_buffer_memory(p_phy_dev_,
                                                   p_dev_,
-                                                  inst_attribs_buffer_mem_,
+                                                  inst_streams_buffer_mem_,
                                                   1,
-                                                  &p_inst_attribs_buffer);
-
-            base::update_device_local_buffer_memory(p_phy_dev_,
-                                                    p_dev_,
-                                                    p_inst_attribs_buffer,
-                                                    inst_attribs_buffer_mem_,
-                                                    inst_buf_size,
-                                                    inst_attribs.data(),
-                                                    0,
-                                                    vk::PipelineStageFlagBits::eTopOfPipe,
-                                                    vk::PipelineStageFlagBits::eVertexInput,
-                                                    vk::AccessFlags(),
-                                                    vk::AccessFlagBits::eVertexAttributeRead,
-                                                    cmd_buffer);
+                                                  &p_inst_streams_buffer);
+
+            p_uploads_->upload_buffer(p_inst_streams_buffer,
+                                      inst_buf_size,
+                                      streams.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eVertexShader,
+                                      vk::AccessFlagBits::eShaderRead);
+            for (int i = 0; i < 3; i++) inst_stream_infos_[i].buffer = p_inst_streams_buffer->buf;
+
+            std::cout << MSG_PREFIX << "instance streams " << inst_buf_size << " bytes, " <<
+                uniform_scale_count << " of " << inst_count << " normal matrices without inverse" << std::endl;
         }
 
+        std::cout << MSG_PREFIX <<
+#ifdef COMPACT_LAYOUT
+            "compact instance layout, " <<
+#else
+            "instance layout, " <<
+#endif
+            sizeof(Instance_properties) << " bytes per instance, " << sizeof(Mdi_cmd) << " bytes per command" << std::endl;
+
         // mdi cmd buffers
         {
             const vk::DeviceSize mdi_cmd_buf_size = mdi_cmds.size() * sizeof(mdi_cmds[0]);
@@ -342,36 +511,135 @@ private:
                                                   2,
                                                   cmd_buffers);
 
-            base::update_device_local_buffer_memory(p_phy_dev_,
-                                                    p_dev_,
-                                                    p_mdi_cmd_buffer,
-                                                    mdi_cmd_buffer_mem_,
-                                                    mdi_cmd_buf_size,
-                                                    mdi_cmds.data(),
-                                                    0,
-                                                    vk::PipelineStageFlagBits::eTopOfPipe,
-                                                    vk::PipelineStageFlagBits::eDrawIndirect,
-                                                    vk::AccessFlags(),
-                                                    vk::AccessFlagBits::eIndirectCommandRead,
-                                                    cmd_buffer);
-            base::update_device_local_buffer_memory(p_phy_dev_,
-                                                    p_dev_,
-                                                    p_mdi_no_batching_cmd_buffer,
-                                                    mdi_cmd_buffer_mem_,
-                                                    mdi_no_batching_cmd_buf_size,
-                                                    mdi_no_batching_cmds.data(),
-                                                    0,
-                                                    vk::PipelineStageFlagBits::eTopOfPipe,
-                                                    vk::PipelineStageFlagBits::eDrawIndirect,
-                                                    vk::AccessFlags(),
-                                                    vk::AccessFlagBits::eIndirectCommandRead,
-                                                    cmd_buffer);
+            p_uploads_->upload_buffer(p_mdi_cmd_buffer,
+                                      mdi_cmd_buf_size,
+                                      mdi_cmds.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eDrawIndirect,
+                                      vk::AccessFlagBits::eIndirectCommandRead);
+            p_uploads_->upload_buffer(p_mdi_no_batching_cmd_buffer,
+                                      mdi_no_batching_cmd_buf_size,
+                                      mdi_no_batching_cmds.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eDrawIndirect,
+                                      vk::AccessFlagBits::eIndirectCommandRead);
             p_mdi_no_batching_cmd_buffer->update_descriptor(
                 0,
                 p_mdi_no_batching_cmd_buffer->size
             );
         }
 
+        // mesh cmd buffer, uploaded on the transfer queue and copied to the
+        // rebatched cmds on the compute queue, shared by the distinct families
+        {
+            std::vector<uint32_t> queue_families{p_phy_dev_->graphics_queue_family_idx};
+            for (uint32_t family : {p_phy_dev_->compute_queue_family_idx, p_phy_dev_->transfer_queue_family_idx}) {
+                if (std::find(queue_families.begin(), queue_families.end(), family) == queue_families.end()) {
+                    queue_families.push_back(family);
+                }
+            }
+            bool concurrent = queue_families.size() > 1;
+
+            const vk::DeviceSize mesh_cmd_buf_size = mesh_cmds.size() * sizeof(mesh_cmds[0]);
+            p_mesh_cmd_buffer = new base::Buffer(p_dev_,
+                                                 mesh_cmd_buf_size,
+                                                 vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+                                                 vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                 concurrent ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+                                                 concurrent ? static_cast<uint32_t>(queue_families.size()) : 0,
+                                                 queue_families.data());
+
+            base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                                  p_dev_,
+                                                  mesh_cmd_buffer_mem_,
+                                                  1,
+                                                  &p_mesh_cmd_buffer);
+
+            p_uploads_->upload_buffer(p_mesh_cmd_buffer,
+                                      mesh_cmd_buf_size,
+                                      mesh_cmds.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eTransfer,
+                                      vk::AccessFlagBits::eTransferRead);
+        }
+
+        // mesh lod buffer
+        {
+            const std::vector<base::Mesh_lod> &mesh_lods = p_geometries->mesh_lods;
+            for (size_t i = 1; i < mesh_lods.size(); i += base::MAX_MESH_LODS) {
+                if (mesh_lods[i].idx_base != mesh_lods[i - 1].idx_base) has_lods = true;
+            }
+            const vk::DeviceSize mesh_lod_buf_size = mesh_lods.size() * sizeof(mesh_lods[0]);
+            p_mesh_lod_buffer = new base::Buffer(p_dev_,
+                                                 mesh_lod_buf_size,
+                                                 vk::BufferUsageFlagBits::eTransferDst |
+                                                 vk::BufferUsageFlagBits::eStorageBuffer,
+                                                 vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                 vk::SharingMode::eExclusive);
+            p_mesh_lod_buffer->update_descriptor();
+
+            base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                                  p_dev_,
+                                                  mesh_lod_buffer_mem_,
+                                                  1,
+                                                  &p_mesh_lod_buffer);
+
+            p_uploads_->upload_buffer(p_mesh_lod_buffer,
+                                      mesh_lod_buf_size,
+                                      mesh_lods.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                      vk::AccessFlagBits::eShaderRead);
+        }
+
+        // cluster buffers
+        {
+            const std::vector<base::Mesh_cluster> &clusters = p_geometries->clusters;
+            const std::vector<uint32_t> &cluster_offsets = p_geometries->cluster_offsets;
+            inst_cluster_total = 0;
+            for (auto &inst : inst_data) {
+                inst_cluster_total += cluster_offsets[inst.mesh_idx + 1] - cluster_offsets[inst.mesh_idx];
+            }
+            const vk::DeviceSize cluster_buf_size = std::max<size_t>(1, clusters.size()) * sizeof(base::Mesh_cluster);
+            const vk::DeviceSize cluster_offset_buf_size = cluster_offsets.size() * sizeof(uint32_t);
+            p_cluster_buffer = new base::Buffer(p_dev_,
+                                                cluster_buf_size,
+                                                vk::BufferUsageFlagBits::eTransferDst |
+                                                vk::BufferUsageFlagBits::eStorageBuffer,
+                                                vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                vk::SharingMode::eExclusive);
+            p_cluster_buffer->update_descriptor();
+            p_cluster_offset_buffer = new base::Buffer(p_dev_,
+                                                       cluster_offset_buf_size,
+                                                       vk::BufferUsageFlagBits::eTransferDst |
+                                                       vk::BufferUsageFlagBits::eStorageBuffer,
+                                                       vk::MemoryPropertyFlagBits::eDeviceLocal,
+                                                       vk::SharingMode::eExclusive);
+            p_cluster_offset_buffer->update_descriptor();
+
+            base::Buffer *p_buffers[2] = {p_cluster_buffer, p_cluster_offset_buffer};
+            base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                                  p_dev_,
+                                                  cluster_buffer_mem_,
+                                                  2,
+                                                  p_buffers);
+
+            if (!clusters.empty()) {
+                p_uploads_->upload_buffer(p_cluster_buffer,
+                                          cluster_buf_size,
+                                          clusters.data(),
+                                          0,
+                                          vk::PipelineStageFlagBits::eComputeShader,
+                                          vk::AccessFlagBits::eShaderRead);
+            }
+            p_uploads_->upload_buffer(p_cluster_offset_buffer,
+                                      cluster_offset_buf_size,
+                                      cluster_offsets.data(),
+                                      0,
+                                      vk::PipelineStageFlagBits::eComputeShader,
+                                      vk::AccessFlagBits::eShaderRead);
+        }
+
         // mdi cmd draw info
         {
             mdi_cmd_draw_info = {
@@ -387,42 +655,60 @@ private:
                 mdi_no_batching_cmds.size(),
                 sizeof(mdi_no_batching_cmds[0])
             };
+
+            mesh_cmd_draw_info = {
+                p_mesh_cmd_buffer->buf,
+                0,
+                mesh_cmds.size(),
+                sizeof(mesh_cmds[0])
+            };
         }
 
         // vertex input
+        // the instance index follows the vertex attributes
         {
-            std::vector<base::Vertex_component> comps = {
-                // transform
-                base::Vertex_component::VERT_COMP_VEC4,
-                base::Vertex_component::VERT_COMP_VEC4,
-                base::Vertex_component::VERT_COMP_VEC4,
-                base::Vertex_component::VERT_COMP_VEC4,
-                // mtl idx
-                base::Vertex_component::VERT_COMP_FLOAT
-            };
-            base::Vertex_layout layout(comps);
             vi_bindings.push_back(p_geometries->vi_binding);
             vi_bindings.emplace_back(inst_vi_bind_id,
-                                     layout.get_stride(),
+                                     sizeof(uint32_t),
                                      vk::VertexInputRate::eInstance);
             vi_attribs = p_geometries->vi_attribs;
-            uint32_t offset = 0;
-            for (uint32_t i = 0; i < 4; i++) {
-                vi_attribs.emplace_back(vi_attribs.size(),
-                                        inst_vi_bind_id,
-                                        vk::Format::eR32G32B32A32Sfloat,
-                                        offset);
-                offset += sizeof(float) * 4;
-            }
             vi_attribs.emplace_back(vi_attribs.size(),
                                     inst_vi_bind_id,
-                                    vk::Format::eR32Sfloat,
-                                    offset);
+                                    vk::Format::eR32Uint,
+                                    0);
+
+            if (p_geometries->p_pos_buffer) {
+                depth_vi_bindings.push_back(p_geometries->pos_vi_binding);
+                depth_vi_bindings.push_back(vi_bindings[1]);
+                depth_vi_attribs = p_geometries->pos_vi_attribs;
+                depth_vi_attribs.emplace_back(depth_vi_attribs.size(),
+                                              inst_vi_bind_id,
+                                              vk::Format::eR32Uint,
+                                              0);
+            }
         }
     }
 
-    void init_materials_(const aiScene *p_scene,
-                         vk::CommandBuffer cmd_buffer)
+    // inverse transpose of the upper 3x3 of transform, returns true when the
+    // transform is a rotation with uniform scale and the 3x3 itself is used,
+    // the shaders normalize the transformed normals
+    static bool normal_matrix_(const glm::mat4 &transform,
+                               Instance_normal &res)
+    {
+        glm::mat3 m(transform);
+        const float len0 = glm::dot(m[0], m[0]);
+        const float eps = 1e-4f * len0;
+        bool uniform = std::abs(glm::dot(m[1], m[1]) - len0) <= eps &&
+            std::abs(glm::dot(m[2], m[2]) - len0) <= eps &&
+            std::abs(glm::dot(m[0], m[1])) <= eps &&
+            std::abs(glm::dot(m[0], m[2])) <= eps &&
+            std::abs(glm::dot(m[1], m[2])) <= eps;
+        if (!uniform) m = glm::transpose(glm::inverse(m));
+        for (int c = 0; c < 3; c++) res.cols[c] = glm::vec4(m[c], 0.f);
+        return uniform;
+    }
+
+    void init_materials_(const std::vector<Scene_material> &scene_mtls)
     {
         vk::Format tex_format{vk::Format::eR8G8B8A8Unorm};
         vk::Format dummy_tex_format{vk::Format::eR8G8B8A8Unorm};
@@ -448,28 +734,13 @@ private:
         std::vector<std::string> textures;
         std::vector<vk::DescriptorImageInfo> image_info;
 
-        for (size_t i = 0; i < p_scene->mNumMaterials; i++) {
-            auto p_m = p_scene->mMaterials[i];
-            Material_properties mtl;
-
-            aiColor4D color;
-            p_m->Get(AI_MATKEY_COLOR_DIFFUSE, color);
-            mtl.diffuse = {color.r, color.g, color.b};
-
-            p_m->Get(AI_MATKEY_COLOR_SPECULAR, color); 
-            mtl.specular = {color.r, color.g, color.b};
-
-            p_m->Get(AI_MATKEY_COLOR_EMISSIVE, color); 
-            mtl.emissive = {color.r, color.g, color.b};
-
-            p_m->Get(AI_MATKEY_OPACITY, mtl.alpha);
-            p_m->Get(AI_MATKEY_SHININESS, mtl.specular_exponent);
+        for (auto &scene_mtl : scene_mtls) {
+            Material_properties mtl = scene_mtl.props;
 
             if (has_diffuse_map_) {
                 setup_material_texture_(&mtl.tex_indices[0],
                                         textures,
-                                        p_m,
-                                        aiTextureType_DIFFUSE,
+                                        scene_mtl.textures[0],
                                         has_compression,
                                         tex_filename_suffix,
                                         tex_format,
@@ -480,8 +751,7 @@ private:
             if (has_opacity_map_) {
                 setup_material_texture_(&mtl.tex_indices[1],
                                         textures,
-                                        p_m,
-                                        aiTextureType_OPACITY,
+                                        scene_mtl.textures[1],
                                         has_compression,
                                         tex_filename_suffix,
                                         tex_format,
@@ -492,8 +762,7 @@ private:
             if (has_specular_map_) {
                 setup_material_texture_(&mtl.tex_indices[2],
                                         textures,
-                                        p_m,
-                                        aiTextureType_SPECULAR,
+                                        scene_mtl.textures[2],
                                         has_compression,
                                         tex_filename_suffix,
                                         tex_format,
@@ -504,8 +773,7 @@ private:
             if (has_normal_map_) {
                 setup_material_texture_(&mtl.tex_indices[3],
                                         textures,
-                                        p_m,
-                                        aiTextureType_NORMALS,
+                                        scene_mtl.textures[3],
                                         has_compression,
                                         tex_filename_suffix,
                                         tex_format,
@@ -526,7 +794,7 @@ private:
         const VkDeviceSize &alignment = p_phy_dev_->props.limits.minStorageBufferOffsetAlignment;
         base::align_size(mtl_buffer_aligned_size, alignment);
 
-        vk::DeviceSize buffer_size = p_scene->mNumMaterials * mtl_buffer_aligned_size;
+        vk::DeviceSize buffer_size = mtls.size() * mtl_buffer_aligned_size;
         void *p_mtl_data = malloc(buffer_size);
 
         int ptr_offset = 0;
@@ -548,24 +816,19 @@ private:
                                         mtl_buffer_mem_,
                                         1,
                                         &p_mtl_buffer_);
-        update_device_local_buffer_memory(p_phy_dev_,
-                                          p_dev_,
-                                          p_mtl_buffer_,
-                                          mtl_buffer_mem_,
-                                          buffer_size,
-                                          p_mtl_data,
-                                          0,
-                                          vk::PipelineStageFlagBits::eTopOfPipe,
-                                          vk::PipelineStageFlagBits::eFragmentShader,
-                                          {}, vk::AccessFlagBits::eShaderRead,
-                                          cmd_buffer);
+        p_uploads_->upload_buffer(p_mtl_buffer_,
+                                  buffer_size,
+                                  p_mtl_data,
+                                  0,
+                                  vk::PipelineStageFlagBits::eFragmentShader,
+                                  vk::AccessFlagBits::eShaderRead);
         vk::DescriptorBufferInfo buffer_info{p_mtl_buffer_->buf, 0, VK_WHOLE_SIZE};
         free(p_mtl_data);
 
         // desc set
 
         std::vector<vk::DescriptorPoolSize> pool_sizes;
-        pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 1);
+        pool_sizes.emplace_back(vk::DescriptorType::eStorageBuffer, 4);
         if (num_textures > 0)
             pool_sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler, num_textures);
 
@@ -580,6 +843,10 @@ private:
         if (num_textures > 0) {
             bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler, num_textures, vk::ShaderStageFlagBits::eFragment);
         }
+        // inst streams
+        for (uint32_t i = 0; i < 3; i++) {
+            bindings.emplace_back(2 + i, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex);
+        }
         desc_set_layout = p_dev_->dev.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo({},
                                                                                                   bindings.size(),
                                                                                                   bindings.data()));
@@ -607,6 +874,16 @@ private:
                                 nullptr, // buffer info
                                 nullptr); // texel buffer view
         }
+        for (uint32_t i = 0; i < 3; i++) {
+            writes.emplace_back(desc_set,
+                                2 + i,
+                                0,
+                                1,
+                                vk::DescriptorType::eStorageBuffer,
+                                nullptr,
+                                &inst_stream_infos_[i],
+                                nullptr);
+        }
         p_dev_->dev.updateDescriptorSets(
             static_cast<uint32_t>(writes.size()),
             writes.data(),
@@ -615,8 +892,7 @@ private:
 
     void setup_material_texture_(float *p_tex_idx,
                                  std::vector<std::string> &textures,
-                                 aiMaterial *p_m,
-                                 aiTextureType ai_tex_type,
+                                 std::string filename, // empty when the material has none
                                  bool has_compression,
                                  const std::string &tex_format_suffix,
                                  vk::Format tex_format,
@@ -624,10 +900,7 @@ private:
                                  vk::Format dummy_tex_format,
                                  std::vector<vk::DescriptorImageInfo> &image_info)
     {
-        aiString ai_tex_filename;
-        p_m->GetTexture(ai_tex_type, 0, &ai_tex_filename);
-        std::string filename = std::string{ai_tex_filename.C_Str()};
-        if (p_m->GetTextureCount(ai_tex_type) > 0 && filename.size() > 0) {
+        if (filename.size() > 0) {
             assert(base::ends_with(filename, ".ktx"));
             auto it = std::find(textures.begin(), textures.end(), filename);
             if (it != textures.end()) {
@@ -650,7 +923,7 @@ private:
 
                 p_mtl_textures_.push_back(new Material_texture2D(p_phy_dev_, p_dev_,
                                                                  full_path,
-                                                                 graphics_cmd_pool_,
+                                                                 *p_uploads_,
                                                                  tex_format));
                 auto p_tex = p_mtl_textures_.back();
                 image_info.emplace_back(p_tex->sampler,
@@ -670,7 +943,7 @@ private:
 
                 p_mtl_textures_.push_back(new Material_texture2D(p_phy_dev_, p_dev_,
                                                                  full_path,
-                                                                 graphics_cmd_pool_,
+                                                                 *p_uploads_,
                                                                  dummy_tex_format));
                 auto p_tex = p_mtl_textures_.back();
                 image_info.emplace_back(p_tex->sampler,
@@ -0,0 +1,124 @@
+#pragma once
+#include "stdafx.h"
+#include "Instance_data.hpp"
+#include "Cpu_culling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// picks the occluders drawn by the depth prepass on the host
+//
+// instances are ranked by the viewport fraction covered by the screen rect
+// of their projected bounding box, or by the world volume of the box, and
+// the commands of the highest ranked ones are written largest first.
+// instances outside the view are never selected, boxes crossing the near
+// plane cover the whole viewport.
+
+enum class Occluder_rank
+{
+    SCREEN_AREA,
+    VOLUME
+};
+
+class Occluder_selection
+{
+public:
+    Occluder_selection(const std::vector<Instance_properties> &props,
+                       const std::vector<base::Mesh> &meshes) :
+        props_(props)
+    {
+        auto inst_count = static_cast<uint32_t>(props_.size());
+        cmds_.reserve(inst_count);
+        volumes_.reserve(inst_count);
+        for (uint32_t i = 0; i < inst_count; i++) {
+            const auto &prop = props_[i];
+            const auto &mesh = meshes[prop.mesh_idx];
+            cmds_.emplace_back(mesh.idx_count, 1, mesh.idx_base, mesh.vert_offset, i);
+
+            // the model matrix scales every volume alike and is left out
+            glm::vec3 size = prop.max - prop.min;
+            volumes_.push_back(std::abs(glm::determinant(glm::mat3(prop.get_transform()))) * size.x * size.y * size.z);
+        }
+        scores_.resize(inst_count);
+        order_.resize(inst_count);
+    }
+
+    uint32_t instance_count() const
+    {
+        return static_cast<uint32_t>(props_.size());
+    }
+
+    // seconds taken by the last select()
+    double last_seconds() const
+    {
+        return seconds_;
+    }
+
+    // writes at most budget commands to cmds, returns the count written
+    uint32_t select(const Cpu_culling_params &params,
+                    Occluder_rank rank,
+                    uint32_t budget,
+                    Mdi_cmd *cmds)
+    {
+        base::Timer timer;
+        const glm::mat4 vm = params.view * params.model;
+        uint32_t candidates = 0;
+        for (uint32_t i = 0; i < instance_count(); i++) {
+            float area = screen_area_(params, vm, props_[i]);
+            if (area <= 0.f) continue;
+            scores_[i] = rank == Occluder_rank::SCREEN_AREA ? area : volumes_[i];
+            order_[candidates++] = i;
+        }
+
+        uint32_t count = std::min(budget, candidates);
+        std::partial_sort(order_.begin(), order_.begin() + count, order_.begin() + candidates,
+                          [this](uint32_t a, uint32_t b) { return scores_[a] > scores_[b]; });
+        for (uint32_t i = 0; i < count; i++) {
+            cmds[i] = cmds_[order_[i]];
+        }
+        seconds_ = timer.get();
+        return count;
+    }
+
+private:
+    const std::vector<Instance_properties> &props_;
+    std::vector<Mdi_cmd> cmds_; // one instance each
+    std::vector<float> volumes_;
+    std::vector<float> scores_;
+    std::vector<uint32_t> order_;
+    double seconds_{0.};
+
+    // viewport fraction of the screen rect of the box, 0 when outside the view
+    static float screen_area_(const Cpu_culling_params &params,
+                              const glm::mat4 &vm,
+                              const Instance_properties &prop)
+    {
+        const glm::mat4 mv = vm * prop.get_transform();
+        glm::vec2 ndc_min(1.f);
+        glm::vec2 ndc_max(-1.f);
+        uint32_t in_front = 0;
+        uint32_t in_range = 0;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner(i & 1 ? prop.max.x : prop.min.x,
+                             i & 2 ? prop.max.y : prop.min.y,
+                             i & 4 ? prop.max.z : prop.min.z);
+            glm::vec4 view_pos = mv * glm::vec4(corner, 1.f);
+            if (view_pos.z > -params.cam_near) continue;
+            in_front++;
+            if (-view_pos.z <= params.cam_far) in_range++;
+
+            glm::vec4 clip_pos = params.projection_clip * view_pos;
+            glm::vec2 ndc = glm::vec2(clip_pos) / clip_pos.w;
+            ndc_min = glm::min(ndc_min, ndc);
+            ndc_max = glm::max(ndc_max, ndc);
+        }
+        if (in_range == 0) return 0.f;
+        if (in_front < 8) return 1.f;
+
+        ndc_min = glm::max(ndc_min, glm::vec2(-1.f));
+        ndc_max = glm::min(ndc_max, glm::vec2(1.f));
+        glm::vec2 size = ndc_max - ndc_min;
+        if (size.x <= 0.f || size.y <= 0.f) return 0.f;
+        return size.x * size.y * .25f;
+    }
+};
@@ -13,6 +13,9 @@ public:
     // same as the max depth image height
     const uint32_t MAX_DEPTH_STAGING_IMAGE_HEIGHT = 1024; 
 
+    // F1 - F6
+    static const uint32_t MODE_COUNT = 6;
+
     Prog_info() = default;
 
     uint32_t width() const override
@@ -43,7 +46,9 @@ public:
         // mode 2 frustum culling
         // mode 3 frustum + occlusion culling 
         // mode 4 frustum + occlusion culling (blending enabled)
-        if (mode < 5 && mode > 0)
+        // mode 5 frustum + occlusion culling, visible instances rebatched per mesh
+        // mode 6 two-phase frustum + occlusion culling against the current frame
+        if (mode <= MODE_COUNT && mode > 0)
             mode_ = mode;
     }
 
@@ -51,9 +56,87 @@ public:
         return mode_;
     }
 
+    // headless runs render frame_count frames offscreen and exit
+    void set_headless(uint32_t frame_count)
+    {
+        headless_frame_count_ = frame_count;
+    }
+
+    bool headless() const
+    {
+        return headless_frame_count_ > 0;
+    }
+
+    uint32_t headless_frame_count() const
+    {
+        return headless_frame_count_;
+    }
+
+    // per frame timestamp results are written as csv when set
+    std::string stats_path{};
+    // keyframe file for headless runs, an orbit is used when empty
+    std::string camera_path{};
+    // builds the depth mipchain in one dispatch of hiz_spd.comp
+    // instead of one mipmap.comp dispatch per level
+    bool single_pass_mipchain{false};
+    // startup only, the compute passes write the mip levels of the depth
+    // pyramid directly instead of the staging atlas blitted by the graphics queue
+    bool direct_depth_pyramid{false};
+    // visible commands are compacted on the gpu and drawn with
+    // vkCmdDrawIndexedIndirectCountKHR when the device supports it
+    bool compact_draws{false};
+    // the depth prepass of F3 - F5 draws the instances visible in
+    // the last occluder_history frames instead of every instance
+    bool temporal_occluders{false};
+    uint32_t occluder_history{1};
+    // the depth prepass of F3 - F5 draws the occluder_budget instances with the
+    // largest screen area, or world volume, picked on the host every frame
+    bool select_occluders{false};
+    uint32_t occluder_budget{256};
+    bool rank_occluders_by_volume{false};
+    // startup only, the imported scene is cached next to the model file
+    // and later runs map the cache instead of importing the model
+    bool scene_cache{true};
+    // startup only, a package baked by culling_bake next to the model file
+    // is loaded with its own vertex layout, without the model file
+    bool package{true};
+    // startup only, threads packing the meshes of an imported model,
+    // 0 for one per hardware thread
+    uint32_t load_threads{0};
+    // startup only, imported meshes are reordered for the vertex cache,
+    // overdraw and vertex fetch, the scene cache keeps the result
+    bool optimize_meshes{false};
+    // startup only, 16 bit positions relative to the mesh aabbs, octahedral
+    // normals and half float uvs
+    bool quantize_vertices{false};
+    // startup only, the depth prepass reads a separate stream of positions
+    // with depth.vert instead of the interleaved vertices
+    bool position_stream{false};
+    // startup only, simplified levels added to every imported mesh
+    uint32_t lod_count{0};
+    // the visibility pass of F2 - F4 and F6 draws the coarsest level of each
+    // instance whose simplification error on screen is at most lod_error pixels
+    bool select_lods{true};
+    float lod_error{1.f};
+    // the visible instances of F2 - F4 are drawn as their clusters that pass
+    // the frustum, normal cone and occlusion tests of cluster_cull.comp, with
+    // vkCmdDrawIndexedIndirectCountKHR when the device supports it
+    bool cluster_culling{false};
+    // the visible instances of F2 - F4 are drawn from an index buffer with
+    // the triangles that pass the backface, small primitive, frustum and
+    // occlusion tests of triangle_cull.comp, ahead of the cluster culling
+    bool triangle_culling{false};
+    // startup only, millions of indices in that buffer, instances past
+    // them are drawn whole
+    uint32_t triangle_index_budget{16};
+    // startup only, reports the instances per second of Cpu_culling
+    // from the initial camera
+    bool cpu_culling_bench{false};
+
 private:
     uint32_t width_{1024};
     uint32_t height_{700};
     std::string prog_name_{"occlusion culling vk"};
     uint32_t mode_{1};
+    uint32_t headless_frame_count_{0};
 };
@@ -3,18 +3,25 @@
 #include "stdafx.h"
 #include "Shell.hpp"
 #include "Model.hpp"
+#include "Cpu_culling.hpp"
+#include "Occluder_selection.hpp"
 #include "Prog_info.hpp"
+#include <deque>
+#include <array>
+#include <sstream>
+#include <fstream>
 
 #define BACK_BUFFER_COUNT 3
 #define FONT_FILENAME "RobotoMonoMedium"
 #define MODEL_FILENAME "occlusion_scene.fbx"
+#define MSG_PREFIX "-- PROGRAM: "
 
 class Program : public base::Program_base
 {
 public:
     Program(const bool enable_validation,
             Prog_info *p_info,
-            Shell *p_shell,
+            base::Shell_base *p_shell,
             base::Camera *p_camera,
             std::string &model_filename) :
         Program_base(enable_validation, p_info, p_shell),
@@ -23,6 +30,7 @@ public:
         p_camera_(p_camera)
     {
         p_camera_->update_aspect(p_info->width(), p_info->height());
+        headless_ = p_shell->headless();
 
         // to read a different scene, 
         // image descriptor count needs to be modified accordingly in this program
@@ -30,20 +38,38 @@ public:
         else model_filename_ = model_filename;
 
         req_phy_dev_features_.multiDrawIndirect = VK_TRUE;
+        opt_device_extensions_.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+        if (p_info_->direct_depth_pyramid) {
+            direct_pyramid_ = true;
+            // hiz_spd_direct.comp indexes the level views with the level,
+            // checked against the device in init
+            opt_phy_dev_features_.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+        }
     }
 
     ~Program() override
     {
         p_dev_->dev.waitIdle();
+        read_back_all_();
         destroy_pipelines_();
         destroy_shaders_();
         destroy_descriptors_();
+        destroy_occluder_selection_();
+        destroy_visibility_history_();
+        destroy_two_phase_();
+        destroy_triangle_culling_();
+        destroy_cluster_culling_();
+        destroy_rebatching_();
+        destroy_compaction_();
         destroy_depth_resources_();
         destroy_swapchain_();
         destroy_render_passes_();
         destroy_frame_data_();
         destroy_text_overlay_();
+        destroy_cpu_culling_();
         destroy_model_();
+        destroy_uploads_();
         destroy_command_pools_();
         destroy_back_buffers_();
     }
@@ -51,24 +77,42 @@ public:
     void init()
     {
         init_base();
+        if (direct_pyramid_ && !p_phy_dev_->req_features.shaderStorageImageArrayDynamicIndexing) {
+            std::cout << MSG_PREFIX << "shaderStorageImageArrayDynamicIndexing not supported, "
+                "falling back to the staging copy pyramid" << std::endl;
+            direct_pyramid_ = false;
+        }
         init_back_buffers_();
         init_command_pools_();
+        init_uploads_();
         init_model_();
+        init_cpu_culling_();
         init_text_overlay_();
+        finish_uploads_();
         init_frame_data_();
         init_render_passes_();
         init_swapchain_();
         init_depth_resources_();
+        init_compaction_();
+        init_rebatching_();
+        init_cluster_culling_();
+        init_triangle_culling_();
+        init_two_phase_();
+        init_visibility_history_();
+        init_occluder_selection_();
         init_descriptors_();
         init_shaders_();
         init_pipelines_();
+        init_stats_();
     }
 
 private:
     Prog_info * p_info_{nullptr};
-    Shell *p_shell_{nullptr};
+    base::Shell_base *p_shell_{nullptr};
     base::Camera *p_camera_{nullptr};
     std::string model_filename_;
+    bool headless_{false};
+    bool direct_pyramid_{false};
 
     /* ---------------------------------------------------------- */
 
@@ -130,11 +174,38 @@ private:
 
     /* ---------------------------------------------------------- */
 
+    // the copies of the model and the font, batched into few submissions
+    base::Upload_manager *p_uploads_{nullptr};
+
+    void init_uploads_()
+    {
+        p_uploads_ = new base::Upload_manager(p_phy_dev_, p_dev_);
+    }
+
+    // the compute queue reads the model buffers too, everything is complete
+    // before the first frame
+    void finish_uploads_()
+    {
+        base::Timer timer;
+        p_uploads_->finish();
+        std::cout << MSG_PREFIX << "uploaded " << p_uploads_->upload_count << " resources, " <<
+            p_uploads_->upload_bytes << " bytes in " << p_uploads_->submission_count() << " submissions, waited " <<
+            timer.get() * 1000. << " ms" << std::endl;
+    }
+
+    void destroy_uploads_()
+    {
+        delete p_uploads_;
+    }
+
+    /* ---------------------------------------------------------- */
+
     Model *p_model_{nullptr};
+    base::Camera_path camera_path_;
 
     void init_model_()
     {
-        p_model_ = new Model(p_phy_dev_, p_dev_, graphics_cmd_pool_, true);
+        p_model_ = new Model(p_phy_dev_, p_dev_, p_uploads_, true);
 
         auto model_path = base::data_dir() + "models/" + model_filename_;
         auto components = std::vector<base::Vertex_component>
@@ -143,14 +214,44 @@ private:
             base::VERT_COMP_NORMAL,
             base::VERT_COMP_UV
         };
+        if (p_info_->quantize_vertices) {
+            components = {
+                base::VERT_COMP_POSITION_UNORM16,
+                base::VERT_COMP_NORMAL_OCT16,
+                base::VERT_COMP_UV_HALF
+            };
+        }
         base::Vertex_layout layout(components);
 
+        bool use_package = false;
+        if (p_info_->package) {
+            Scene_cache package(Scene_cache::package_path_of(model_path));
+            if (package.valid()) {
+                layout = package.layout();
+                use_package = true;
+            }
+        }
+
+        p_model_->position_stream = p_info_->position_stream;
+
         auto tex_dir = base::data_dir() + "models/";
-        p_model_->load(model_path, layout, aiProcess_GenNormals | aiProcess_GenUVCoords, tex_dir);
+        p_model_->use_scene_cache = p_info_->scene_cache;
+        p_model_->use_package = use_package;
+        p_model_->load_thread_count = p_info_->load_threads;
+        p_model_->optimize_meshes = p_info_->optimize_meshes;
+        p_model_->lod_count = p_info_->lod_count;
+        p_model_->load(model_path, layout, SCENE_AI_FLAGS, tex_dir);
 
         p_camera_->eye_pos = {20.f, 2.f, 0.f};
         p_camera_->cam_far = 1000.f;
         p_camera_->update();
+
+        if (headless_) {
+            if (p_info_->camera_path.empty() ||
+                !camera_path_.load(p_info_->camera_path)) {
+                camera_path_.make_orbit(p_camera_->eye_pos, p_camera_->target, 10.f);
+            }
+        }
     }
 
     void destroy_model_()
@@ -160,6 +261,33 @@ private:
 
     /* ---------------------------------------------------------- */
 
+    Cpu_culling *p_cpu_culling_{nullptr};
+
+    // with --cpu-culling-bench, the throughput of the frustum stage of the
+    // host culling from the initial camera, there is no depth on the host,
+    // bench/cpu_culling checks both stages against the scalar reference
+    void init_cpu_culling_()
+    {
+        if (!p_info_->cpu_culling_bench) return;
+        p_cpu_culling_ = new Cpu_culling(p_model_->inst_props);
+
+        Cpu_culling_params params;
+        params.model = p_model_->model_matrix;
+        params.view = p_camera_->view;
+        params.projection_clip = p_camera_->clip * p_camera_->projection;
+        params.cam_near = p_camera_->cam_near;
+        params.cam_far = p_camera_->cam_far;
+        params.resolution = glm::vec2(p_info_->width(), p_info_->height());
+        p_cpu_culling_->benchmark(params, nullptr);
+    }
+
+    void destroy_cpu_culling_()
+    {
+        delete p_cpu_culling_;
+    }
+
+    /* ---------------------------------------------------------- */
+
     base::Text_overlay *p_text_overlay_{nullptr};
 
     void init_text_overlay_()
@@ -167,7 +295,7 @@ private:
         std::string font_path = base::data_dir();
         font_path.append("fonts/");
         font_path.append(FONT_FILENAME);
-        p_text_overlay_ = new base::Text_overlay(p_phy_dev_, p_dev_, graphics_cmd_pool_, font_path);
+        p_text_overlay_ = new base::Text_overlay(p_phy_dev_, p_dev_, p_uploads_, font_path);
     }
 
     void destroy_text_overlay_()
@@ -177,7 +305,7 @@ private:
 
     /* ---------------------------------------------------------- */
 
-    static const uint32_t max_query_count_{10};
+    static const uint32_t max_query_count_{20};
     struct Query_data
     {
         uint32_t data[max_query_count_];
@@ -193,7 +321,17 @@ private:
         QUERY_COMPUTE_MIPCHAIN_START,
         QUERY_COMPUTE_MIPCHAIN_STOP,
         QUERY_COMPUTE_VISIBILITY_START,
-        QUERY_COMPUTE_VISIBILITY_STOP
+        QUERY_COMPUTE_VISIBILITY_STOP,
+        QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START,
+        QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_STOP,
+        QUERY_COMPUTE_REBATCH_START,
+        QUERY_COMPUTE_REBATCH_STOP,
+        QUERY_SECOND_PHASE_START,
+        QUERY_SECOND_PHASE_STOP,
+        QUERY_COMPUTE_CLUSTERS_START,
+        QUERY_COMPUTE_CLUSTERS_STOP,
+        QUERY_COMPUTE_TRIANGLES_START,
+        QUERY_COMPUTE_TRIANGLES_STOP
     };
 
     struct UBO
@@ -221,6 +359,39 @@ private:
 
         vk::QueryPool query_pool;
         Query_data query_data;
+        uint32_t queries_written{0}; // bit per query slot written this frame
+        uint32_t mode{0};
+        bool read_back_pending{false}; // submitted, see read_back_
+
+        // signaled when this frame compacted, rebatched, cluster or triangle
+        // culled the visible commands, waited by the next graphics submit
+        // before drawing them
+        vk::Semaphore compaction_semaphore;
+        bool compacted{false};
+        bool rebatched{false};
+        bool clusters_culled{false};
+        bool triangles_culled{false};
+
+        // two-phase frames draw the first phase with graphics_cmd_buffer,
+        // the second phase waits the compute submit on second_phase_semaphore
+        vk::CommandBuffer second_phase_cmd_buffer;
+        vk::Semaphore second_phase_semaphore;
+        bool two_phase{false};
+        uint32_t false_negatives{0}; // drawn by the second phase only
+
+        // read back when the frame data comes round again
+        uint32_t became_visible{0};
+        uint32_t became_hidden{0};
+        uint32_t visible_clusters{0}; // drawn, a simplified level counts as one
+        uint32_t tested_clusters{0};
+        uint32_t visible_triangles{0};
+        uint32_t tested_triangles{0};
+        uint32_t whole_draws{0}; // of the geometry indices, small or past the budget
+
+        // written on the host before the graphics submit
+        bool occluders_selected{false};
+        uint32_t selected_occluder_count{0};
+        double occluder_selection_seconds{0.};
     };
 
     std::vector<Frame_data> frame_data_vector_;
@@ -256,7 +427,7 @@ private:
                                               1, &p_global_uniforms_,
                                               aligned_size * frame_data_count_);
 
-        std::vector<vk::CommandBuffer> graphics_cmd_buffers(frame_data_count_);
+        std::vector<vk::CommandBuffer> graphics_cmd_buffers(frame_data_count_ * 2);
         std::vector<vk::CommandBuffer> compute_cmd_buffers(frame_data_count_);
         graphics_cmd_buffers = p_dev_->dev.allocateCommandBuffers(
             vk::CommandBufferAllocateInfo(graphics_cmd_pool_,
@@ -272,6 +443,7 @@ private:
             data.dynamic_offset = idx * aligned_size;
             data.mapped = base + idx * aligned_size;
             data.graphics_cmd_buffer = graphics_cmd_buffers[idx];
+            data.second_phase_cmd_buffer = graphics_cmd_buffers[frame_data_count_ + idx];
             data.compute_cmd_buffer = compute_cmd_buffers[idx];
             data.graphics_submit_fence = p_dev_->dev.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
             data.compute_submit_fence = p_dev_->dev.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
@@ -279,6 +451,8 @@ private:
                                                                                   vk::QueryType::eTimestamp,
                                                                                   max_query_count_,
                                                                                   {}));
+            data.compaction_semaphore = p_dev_->dev.createSemaphore(vk::SemaphoreCreateInfo());
+            data.second_phase_semaphore = p_dev_->dev.createSemaphore(vk::SemaphoreCreateInfo());
             idx++;
         }
     }
@@ -291,6 +465,8 @@ private:
             p_dev_->dev.destroyFence(data.graphics_submit_fence);
             p_dev_->dev.destroyFence(data.compute_submit_fence);
             p_dev_->dev.destroyQueryPool(data.query_pool);
+            p_dev_->dev.destroySemaphore(data.compaction_semaphore);
+            p_dev_->dev.destroySemaphore(data.second_phase_semaphore);
         }
     }
 
@@ -298,6 +474,8 @@ private:
 
     base::Render_pass *p_rp_simple_{nullptr};
     base::Render_pass *p_rp_depth_{nullptr};
+    base::Render_pass *p_rp_first_phase_{nullptr};
+    base::Render_pass *p_rp_second_phase_{nullptr};
 
     vk::Format depth_format_{vk::Format::eD32Sfloat};
 
@@ -310,6 +488,8 @@ private:
     {
         p_rp_simple_ = new base::Render_pass(p_dev_, 2, clear_values_.data());
         p_rp_depth_ = new base::Render_pass(p_dev_, 1, &clear_values_[1]);
+        p_rp_first_phase_ = new base::Render_pass(p_dev_, 2, clear_values_.data());
+        p_rp_second_phase_ = new base::Render_pass(p_dev_, 2, clear_values_.data());
 
         // simple
         {
@@ -324,7 +504,7 @@ private:
                     vk::AttachmentLoadOp::eDontCare,
                     vk::AttachmentStoreOp::eDontCare,
                     vk::ImageLayout::eUndefined,
-                    vk::ImageLayout::ePresentSrcKHR),
+                    headless_ ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR),
                 // depth
                 vk::AttachmentDescription(
                     {},
@@ -429,12 +609,111 @@ private:
                                 1, &subpass,
                                 2, dependencies);
         }
+
+        // two-phase, compatible with simple
+        // the first phase keeps color and depth_src for the hiz and the second phase
+        {
+            vk::AttachmentDescription attachments[2] = {
+                // color
+                vk::AttachmentDescription(
+                    {},
+                    surface_format_.format,
+                    vk::SampleCountFlagBits::e1,
+                    vk::AttachmentLoadOp::eClear,
+                    vk::AttachmentStoreOp::eStore,
+                    vk::AttachmentLoadOp::eDontCare,
+                    vk::AttachmentStoreOp::eDontCare,
+                    vk::ImageLayout::eUndefined,
+                    vk::ImageLayout::eColorAttachmentOptimal),
+                // depth
+                vk::AttachmentDescription(
+                    {},
+                    depth_format_,
+                    vk::SampleCountFlagBits::e1,
+                    vk::AttachmentLoadOp::eClear,
+                    vk::AttachmentStoreOp::eStore,
+                    vk::AttachmentLoadOp::eDontCare,
+                    vk::AttachmentStoreOp::eDontCare,
+                    vk::ImageLayout::eUndefined,
+                    vk::ImageLayout::eDepthStencilReadOnlyOptimal),
+            };
+
+            vk::AttachmentReference references[2] = {
+                // color
+                vk::AttachmentReference(
+                    0,
+                    vk::ImageLayout::eColorAttachmentOptimal),
+                // depth
+                vk::AttachmentReference(
+                    1,
+                    vk::ImageLayout::eDepthStencilAttachmentOptimal),
+            };
+
+            vk::SubpassDescription subpass = vk::SubpassDescription({},
+                                                                    vk::PipelineBindPoint::eGraphics,
+                                                                    0, nullptr,
+                                                                    1, &references[0],
+                                                                    nullptr,
+                                                                    &references[1],
+                                                                    0, nullptr);
+            vk::SubpassDependency dependencies[3] = {
+                // the last hiz pass is done reading depth_src
+                vk::SubpassDependency(
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    vk::PipelineStageFlagBits::eComputeShader,
+                    vk::PipelineStageFlagBits::eEarlyFragmentTests,
+                    vk::AccessFlagBits::eShaderRead,
+                    vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::DependencyFlagBits::eByRegion),
+                vk::SubpassDependency(
+                    VK_SUBPASS_EXTERNAL,
+                    0,
+                    vk::PipelineStageFlagBits::eBottomOfPipe,
+                    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                    vk::AccessFlagBits::eHostWrite,
+                    vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                    vk::DependencyFlagBits::eByRegion),
+                vk::SubpassDependency(
+                    0,
+                    VK_SUBPASS_EXTERNAL,
+                    vk::PipelineStageFlagBits::eLateFragmentTests,
+                    vk::PipelineStageFlagBits::eComputeShader,
+                    vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                    vk::AccessFlagBits::eShaderRead,
+                    vk::DependencyFlagBits::eByRegion)
+            };
+            p_rp_first_phase_->create(2, attachments,
+                                      1, &subpass,
+                                      3, dependencies);
+
+            // the second phase loads both and presents
+            attachments[0].loadOp = vk::AttachmentLoadOp::eLoad;
+            attachments[0].initialLayout = vk::ImageLayout::eColorAttachmentOptimal;
+            attachments[0].finalLayout = headless_ ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+            attachments[1].loadOp = vk::AttachmentLoadOp::eLoad;
+            attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+            attachments[1].initialLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+            dependencies[2] = vk::SubpassDependency(
+                0,
+                VK_SUBPASS_EXTERNAL,
+                vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                vk::AccessFlagBits::eHostWrite,
+                vk::DependencyFlagBits::eByRegion);
+            p_rp_second_phase_->create(2, attachments,
+                                       1, &subpass,
+                                       3, dependencies);
+        }
     }
 
     void destroy_render_passes_()
     {
         delete p_rp_simple_;
         delete p_rp_depth_;
+        delete p_rp_first_phase_;
+        delete p_rp_second_phase_;
     }
 
     /* ---------------------------------------------------------- */
@@ -443,13 +722,22 @@ private:
 
     void init_swapchain_()
     {
-        p_swapchain_ = new base::Swapchain(p_phy_dev_,
-                                           p_dev_,
-                                           surface_,
-                                           surface_format_,
-                                           depth_format_,
-                                           BACK_BUFFER_COUNT,
-                                           p_rp_simple_);
+        if (headless_) {
+            p_swapchain_ = new base::Offscreen_target(p_phy_dev_,
+                                                      p_dev_,
+                                                      surface_format_,
+                                                      depth_format_,
+                                                      BACK_BUFFER_COUNT,
+                                                      p_rp_simple_);
+        } else {
+            p_swapchain_ = new base::Swapchain(p_phy_dev_,
+                                               p_dev_,
+                                               surface_,
+                                               surface_format_,
+                                               depth_format_,
+                                               BACK_BUFFER_COUNT,
+                                               p_rp_simple_);
+        }
         p_swapchain_->resize(p_info_->width(), p_info_->height());
         auto extent = p_swapchain_->curr_extent();
         if (extent.width != p_info_->width() || extent.height != p_info_->height()) {
@@ -473,17 +761,55 @@ private:
         glm::ivec2 src_image_size;
     } level_info_;
 
+    // hiz_spd.comp derives the atlas layout from the level 0 extent
+    struct Spd_consts
+    {
+        glm::ivec2 extent;
+        int32_t level_count;
+    } spd_consts_;
+
     struct Visibility_consts
     {
         uint32_t inst_total;
         uint32_t use_occluder_culling;
+        uint32_t draw_count_idx;
+        uint32_t occluder_history_mask;
+        float lod_error; // pixels, 0 draws the full meshes
     } visibility_consts_;
 
+    struct Rebatch_consts
+    {
+        uint32_t inst_total;
+    } rebatch_consts_;
+
+    struct Cluster_consts
+    {
+        uint32_t inst_total;
+        uint32_t use_occluder_culling;
+        uint32_t count_idx;
+    } cluster_consts_;
+
+    struct Triangle_consts
+    {
+        uint32_t inst_total;
+        uint32_t use_occluder_culling;
+        uint32_t count_idx;
+        uint32_t idx_budget;
+        uint32_t vert_stride; // words
+        uint32_t pos_offset; // words
+        uint32_t quantized_positions;
+        uint32_t min_triangles;
+    } triangle_consts_;
+
     vk::Framebuffer depth_prepass_framebuffer_;
     base::Render_target *p_depth_src_{nullptr};
     base::Render_target *p_depth_staging_{nullptr};
     base::Render_target *p_depth_dst_{nullptr};
     vk::Sampler depth_src_sampler_;
+    base::Buffer *p_spd_counter_{nullptr};
+    vk::DeviceMemory spd_counter_mem_;
+    std::vector<vk::ImageView> depth_dst_level_views_;
+    std::vector<vk::DescriptorImageInfo> depth_dst_level_infos_;
 
     void init_depth_resources_()
     {
@@ -526,17 +852,31 @@ private:
                                                                     p_info_->MAX_DEPTH_IMAGE_HEIGHT,
                                                                     1));
 
-        // staging
-        p_depth_staging_ = new base::Render_target(p_phy_dev_,
-                                                   p_dev_,
-                                                   vk::Format::eR32Sfloat,
-                                                   {p_info_->MAX_DEPTH_STAGING_IMAGE_WIDTH, p_info_->MAX_DEPTH_STAGING_IMAGE_HEIGHT},
-                                                   vk::ImageUsageFlagBits::eStorage |
-                                                   vk::ImageUsageFlagBits::eTransferSrc,
-                                                   vk::ImageAspectFlagBits::eColor,
-                                                   vk::SampleCountFlagBits::e1,
-                                                   false);
-        p_depth_staging_->desc_image_info = {{}, p_depth_staging_->view, vk::ImageLayout::eGeneral};
+        // staging, not needed when the pyramid is written directly
+        if (!direct_pyramid_) {
+            p_depth_staging_ = new base::Render_target(p_phy_dev_,
+                                                       p_dev_,
+                                                       vk::Format::eR32Sfloat,
+                                                       {p_info_->MAX_DEPTH_STAGING_IMAGE_WIDTH, p_info_->MAX_DEPTH_STAGING_IMAGE_HEIGHT},
+                                                       vk::ImageUsageFlagBits::eStorage |
+                                                       vk::ImageUsageFlagBits::eTransferSrc,
+                                                       vk::ImageAspectFlagBits::eColor,
+                                                       vk::SampleCountFlagBits::e1,
+                                                       false);
+            p_depth_staging_->desc_image_info = {{}, p_depth_staging_->view, vk::ImageLayout::eGeneral};
+        }
+
+        // finished workgroup count of hiz_spd.comp, cleared before every dispatch
+        p_spd_counter_ = new base::Buffer(p_dev_,
+                                          sizeof(uint32_t),
+                                          vk::BufferUsageFlagBits::eStorageBuffer |
+                                          vk::BufferUsageFlagBits::eTransferDst,
+                                          vk::MemoryPropertyFlagBits::eDeviceLocal);
+        p_spd_counter_->update_descriptor();
+        base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                              p_dev_,
+                                              spd_counter_mem_,
+                                              1, &p_spd_counter_);
 
         // dst
         auto depth_dst_sampler_info = vk::SamplerCreateInfo{{},
@@ -554,26 +894,740 @@ private:
             0.f,
             float(base::get_mip_levels(p_info_->MAX_DEPTH_IMAGE_WIDTH,
                                        p_info_->MAX_DEPTH_IMAGE_HEIGHT)) - 1.f};
+        // the direct pyramid keeps depth_dst in general layout on the compute queue
         p_depth_dst_ = new base::Render_target(p_phy_dev_, p_dev_,
                                                vk::Format::eR32Sfloat,
                                                {p_info_->MAX_DEPTH_IMAGE_WIDTH, p_info_->MAX_DEPTH_IMAGE_HEIGHT},
-                                               vk::ImageUsageFlagBits::eTransferDst |
+                                               (direct_pyramid_ ? vk::ImageUsageFlagBits::eStorage : vk::ImageUsageFlagBits::eTransferDst) |
                                                vk::ImageUsageFlagBits::eSampled,
                                                vk::ImageAspectFlagBits::eColor,
                                                vk::SampleCountFlagBits::e1,
                                                true,
                                                depth_dst_sampler_info,
-                                               vk::ImageLayout::eShaderReadOnlyOptimal,
+                                               direct_pyramid_ ? vk::ImageLayout::eGeneral : vk::ImageLayout::eShaderReadOnlyOptimal,
                                                true);
+        if (direct_pyramid_) {
+            for (uint32_t i = 0; i < p_depth_dst_->mip_levels; i++) {
+                depth_dst_level_views_.push_back(p_dev_->dev.createImageView(
+                    vk::ImageViewCreateInfo({},
+                                            p_depth_dst_->image,
+                                            vk::ImageViewType::e2D,
+                                            vk::Format::eR32Sfloat,
+                                            vk::ComponentMapping(),
+                                            vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, i, 1, 0, 1})));
+                depth_dst_level_infos_.emplace_back(vk::Sampler(),
+                                                    depth_dst_level_views_.back(),
+                                                    vk::ImageLayout::eGeneral);
+            }
+        }
     }
 
     void destroy_depth_resources_()
     {
+        for (auto view : depth_dst_level_views_) {
+            p_dev_->dev.destroyImageView(view);
+        }
         p_dev_->dev.destroyFramebuffer(depth_prepass_framebuffer_);
         p_dev_->dev.destroySampler(depth_src_sampler_);
         delete p_depth_dst_;
         delete p_depth_staging_;
         delete p_depth_src_;
+        delete p_spd_counter_;
+        p_dev_->dev.freeMemory(spd_counter_mem_);
+    }
+
+    /* ---------------------------------------------------------- */
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR p_draw_indexed_indirect_count_{nullptr};
+    base::Buffer *p_compacted_cmd_buffer_{nullptr};
+    base::Buffer *p_draw_count_buffer_{nullptr};
+    vk::DeviceMemory compacted_cmd_mem_;
+    vk::DeviceMemory draw_count_mem_;
+    uint32_t *p_draw_counts_{nullptr}; // mapped, one per frame data
+    int32_t compacted_frame_data_idx_{-1}; // waited and drawn by the next graphics submit
+    uint32_t visible_draw_count_{0};
+
+    // visibility_compact.comp appends the visible commands,
+    // the buffers are created without the extension to keep the descriptor set complete
+    void init_compaction_()
+    {
+        if (p_phy_dev_->extension_enabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+            p_draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                p_dev_->dev.getProcAddr("vkCmdDrawIndexedIndirectCountKHR"));
+        }
+
+        // written on the compute queue, read by indirect draws on the graphics queue
+        p_compacted_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                             p_dev_,
+                                                             compacted_cmd_mem_,
+                                                             p_model_->mdi_no_batching_cmd_draw_info.draw_count * sizeof(Mdi_cmd),
+                                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                                             vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                             vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        // host visible for the visible count readback
+        p_draw_count_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                          p_dev_,
+                                                          draw_count_mem_,
+                                                          frame_data_count_ * sizeof(uint32_t),
+                                                          vk::BufferUsageFlagBits::eStorageBuffer |
+                                                          vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                          vk::BufferUsageFlagBits::eTransferDst,
+                                                          vk::MemoryPropertyFlagBits::eHostVisible |
+                                                          vk::MemoryPropertyFlagBits::eHostCoherent);
+        p_draw_counts_ = reinterpret_cast<uint32_t *>(p_draw_count_buffer_->mapped);
+    }
+
+    void destroy_compaction_()
+    {
+        delete p_compacted_cmd_buffer_;
+        delete p_draw_count_buffer_;
+        p_dev_->dev.freeMemory(compacted_cmd_mem_);
+        p_dev_->dev.freeMemory(draw_count_mem_);
+    }
+
+    bool compaction_active_() const
+    {
+        return p_info_->compact_draws && p_info_->mode() >= 2 && p_info_->mode() <= 4 &&
+            p_draw_indexed_indirect_count_ && pipelines_.visibility_compact_compute;
+    }
+
+    /* ---------------------------------------------------------- */
+
+    base::Buffer *p_rebatched_cmd_buffer_{nullptr};
+    base::Buffer *p_rebatched_ids_buffer_{nullptr};
+    vk::DeviceMemory rebatched_cmd_mem_;
+    vk::DeviceMemory rebatched_ids_mem_;
+
+    // mode 5, rebatch.comp groups the visible instances per mesh,
+    // the rebatched instance indices replace the instance vertex buffer
+    // and one cmd per mesh draws the visible instances of it
+    void init_rebatching_()
+    {
+        // written on the compute queue, read by indirect draws on the graphics queue
+        p_rebatched_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                             p_dev_,
+                                                             rebatched_cmd_mem_,
+                                                             p_model_->p_mesh_cmd_buffer->size,
+                                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                                             vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                             vk::BufferUsageFlagBits::eTransferDst,
+                                                             vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        p_rebatched_ids_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                             p_dev_,
+                                                             rebatched_ids_mem_,
+                                                             p_model_->mdi_no_batching_cmd_draw_info.draw_count * sizeof(uint32_t),
+                                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                                             vk::BufferUsageFlagBits::eVertexBuffer,
+                                                             vk::MemoryPropertyFlagBits::eDeviceLocal);
+    }
+
+    void destroy_rebatching_()
+    {
+        delete p_rebatched_cmd_buffer_;
+        delete p_rebatched_ids_buffer_;
+        p_dev_->dev.freeMemory(rebatched_cmd_mem_);
+        p_dev_->dev.freeMemory(rebatched_ids_mem_);
+    }
+
+    bool rebatching_active_() const
+    {
+        return p_info_->mode() == 5 && pipelines_.rebatch_compute;
+    }
+
+    // clears the visible counts, then packs the visible instances of
+    // the visibility pass recorded before
+    void record_rebatch_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_REBATCH_START, 2);
+        data.queries_written |= 3u << QUERY_COMPUTE_REBATCH_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_REBATCH_START);
+
+        // the rebatched cmds of the last frame were drawn by the
+        // graphics submit this compute submit waits on
+        vk::BufferCopy region{0, 0, p_model_->p_mesh_cmd_buffer->size};
+        cmd_buf.copyBuffer(p_model_->p_mesh_cmd_buffer->buf, p_rebatched_cmd_buffer_->buf, 1, &region);
+
+        vk::MemoryBarrier barriers[2] = {
+            // cleared counts
+            {vk::AccessFlagBits::eTransferWrite,
+             vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite},
+            // inst_count written by the visibility pass
+            {vk::AccessFlagBits::eShaderWrite,
+             vk::AccessFlagBits::eShaderRead}
+        };
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[0],
+                                0, nullptr,
+                                0, nullptr);
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[1],
+                                0, nullptr,
+                                0, nullptr);
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.rebatch_compute);
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                   pipeline_layouts_.rebatch_compute,
+                                   0, 1, &desc_set_rebatch_,
+                                   0, nullptr);
+        rebatch_consts_.inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+        cmd_buf.pushConstants(pipeline_layouts_.rebatch_compute,
+                              vk::ShaderStageFlagBits::eCompute,
+                              0, sizeof(Rebatch_consts), &rebatch_consts_);
+        cmd_buf.dispatch((rebatch_consts_.inst_total - 1) / 64 + 1, 1, 1);
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_REBATCH_STOP);
+        data.rebatched = true;
+    }
+
+    /* ---------------------------------------------------------- */
+
+    base::Buffer *p_cluster_cmd_buffer_{nullptr};
+    base::Buffer *p_cluster_count_buffer_{nullptr};
+    vk::DeviceMemory cluster_cmd_mem_;
+    vk::DeviceMemory cluster_count_mem_;
+    uint32_t *p_cluster_counts_{nullptr}; // mapped, draws and tested clusters per frame data
+
+    // cluster_cull.comp appends one cmd per visible cluster of the instances
+    // visible to the visibility pass, drawn with an indirect count as the
+    // compacted cmds
+    void init_cluster_culling_()
+    {
+        // written on the compute queue, read by indirect draws on the graphics queue
+        p_cluster_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                           p_dev_,
+                                                           cluster_cmd_mem_,
+                                                           std::max(p_model_->inst_cluster_total, 1u) * sizeof(vk::DrawIndexedIndirectCommand),
+                                                           vk::BufferUsageFlagBits::eStorageBuffer |
+                                                           vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                           vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        // host visible for the cluster count readback
+        p_cluster_count_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                             p_dev_,
+                                                             cluster_count_mem_,
+                                                             frame_data_count_ * 2 * sizeof(uint32_t),
+                                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                                             vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                             vk::BufferUsageFlagBits::eTransferDst,
+                                                             vk::MemoryPropertyFlagBits::eHostVisible |
+                                                             vk::MemoryPropertyFlagBits::eHostCoherent);
+        p_cluster_counts_ = reinterpret_cast<uint32_t *>(p_cluster_count_buffer_->mapped);
+        std::cout << MSG_PREFIX << p_model_->inst_cluster_total << " clusters over all instances" << std::endl;
+    }
+
+    void destroy_cluster_culling_()
+    {
+        delete p_cluster_cmd_buffer_;
+        delete p_cluster_count_buffer_;
+        p_dev_->dev.freeMemory(cluster_cmd_mem_);
+        p_dev_->dev.freeMemory(cluster_count_mem_);
+    }
+
+    // in place of the compaction, the visibility pass then writes
+    // the per instance commands only
+    bool cluster_culling_active_() const
+    {
+        return p_info_->cluster_culling && p_info_->mode() >= 2 && p_info_->mode() <= 4 &&
+            p_draw_indexed_indirect_count_ && pipelines_.cluster_cull_compute;
+    }
+
+    // clears the counts of this frame data, then tests the clusters of
+    // the instances visible to the visibility pass recorded before
+    void record_cluster_cull_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_CLUSTERS_START, 2);
+        data.queries_written |= 3u << QUERY_COMPUTE_CLUSTERS_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_CLUSTERS_START);
+
+        // last read three frames ago
+        cmd_buf.fillBuffer(p_cluster_count_buffer_->buf, frame_data_idx_ * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t), 0);
+
+        vk::MemoryBarrier barriers[2] = {
+            // cleared counts
+            {vk::AccessFlagBits::eTransferWrite,
+             vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite},
+            // lods and inst_count written by the visibility pass
+            {vk::AccessFlagBits::eShaderWrite,
+             vk::AccessFlagBits::eShaderRead}
+        };
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[0],
+                                0, nullptr,
+                                0, nullptr);
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[1],
+                                0, nullptr,
+                                0, nullptr);
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.cluster_cull_compute);
+        vk::DescriptorSet desc_sets[2] = {
+            desc_set_cluster_cull_,
+            data.desc_set
+        };
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                   pipeline_layouts_.cluster_cull_compute,
+                                   0, 2, desc_sets,
+                                   1, &data.dynamic_offset);
+        cluster_consts_.inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+        cluster_consts_.use_occluder_culling = static_cast<uint32_t>(p_info_->mode() >= 3);
+        cluster_consts_.count_idx = frame_data_idx_;
+        cmd_buf.pushConstants(pipeline_layouts_.cluster_cull_compute,
+                              vk::ShaderStageFlagBits::eCompute,
+                              0, sizeof(Cluster_consts), &cluster_consts_);
+        // one workgroup per instance, wrapped into y past the group count limit
+        const uint32_t x = std::min(std::max(cluster_consts_.inst_total, 1u), 65535u);
+        cmd_buf.dispatch(x, (cluster_consts_.inst_total + x - 1) / x, 1);
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_CLUSTERS_STOP);
+    }
+
+    /* ---------------------------------------------------------- */
+
+    base::Buffer *p_triangle_idx_buffer_{nullptr};
+    base::Buffer *p_triangle_cmd_buffer_{nullptr};
+    base::Buffer *p_triangle_count_buffer_{nullptr};
+    vk::DeviceMemory triangle_idx_mem_;
+    vk::DeviceMemory triangle_cmd_mem_;
+    vk::DeviceMemory triangle_count_mem_;
+    // mapped, triangle_count_stride_ per frame data: draws of the culled
+    // indices, whole draws, allocated indices, tested and kept triangles
+    uint32_t *p_triangle_counts_{nullptr};
+    uint32_t triangle_idx_budget_{0};
+    static const uint32_t triangle_count_stride_{8};
+    // instances with fewer triangles are drawn whole without a test
+    static const uint32_t triangle_cull_min_triangles_{64};
+
+    // triangle_cull.comp writes the triangles of the instances visible to the
+    // visibility pass that pass its tests to p_triangle_idx_buffer_, with one
+    // cmd per instance, instances it does not test keep their own indices and
+    // are drawn by a second indirect count draw
+    void init_triangle_culling_()
+    {
+        // written on the compute queue, read by indirect draws on the graphics queue,
+        // every index of every instance at most, in the largest storage buffer
+        uint64_t budget = std::min<uint64_t>(p_model_->inst_index_total,
+                                             static_cast<uint64_t>(p_info_->triangle_index_budget) * 1000000);
+        budget = std::min<uint64_t>(budget, p_phy_dev_->props.limits.maxStorageBufferRange / sizeof(uint32_t));
+        triangle_idx_budget_ = static_cast<uint32_t>(budget);
+        p_triangle_idx_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                            p_dev_,
+                                                            triangle_idx_mem_,
+                                                            std::max(triangle_idx_budget_, 1u) * sizeof(uint32_t),
+                                                            vk::BufferUsageFlagBits::eStorageBuffer |
+                                                            vk::BufferUsageFlagBits::eIndexBuffer,
+                                                            vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        // the cmds of the culled indices, then those of the whole instances
+        const uint32_t inst_total = std::max(p_model_->mdi_no_batching_cmd_draw_info.draw_count, 1u);
+        p_triangle_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                            p_dev_,
+                                                            triangle_cmd_mem_,
+                                                            2 * inst_total * sizeof(vk::DrawIndexedIndirectCommand),
+                                                            vk::BufferUsageFlagBits::eStorageBuffer |
+                                                            vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                            vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        // host visible for the triangle count readback
+        p_triangle_count_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                              p_dev_,
+                                                              triangle_count_mem_,
+                                                              frame_data_count_ * triangle_count_stride_ * sizeof(uint32_t),
+                                                              vk::BufferUsageFlagBits::eStorageBuffer |
+                                                              vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                              vk::BufferUsageFlagBits::eTransferDst,
+                                                              vk::MemoryPropertyFlagBits::eHostVisible |
+                                                              vk::MemoryPropertyFlagBits::eHostCoherent);
+        p_triangle_counts_ = reinterpret_cast<uint32_t *>(p_triangle_count_buffer_->mapped);
+        std::cout << MSG_PREFIX << "culled index buffer of " << triangle_idx_budget_ << " of " <<
+            p_model_->inst_index_total << " instance indices" << std::endl;
+    }
+
+    void destroy_triangle_culling_()
+    {
+        delete p_triangle_idx_buffer_;
+        delete p_triangle_cmd_buffer_;
+        delete p_triangle_count_buffer_;
+        p_dev_->dev.freeMemory(triangle_idx_mem_);
+        p_dev_->dev.freeMemory(triangle_cmd_mem_);
+        p_dev_->dev.freeMemory(triangle_count_mem_);
+    }
+
+    // in place of the cluster culling and the compaction, the visibility
+    // pass then writes the per instance commands only
+    bool triangle_culling_active_() const
+    {
+        return p_info_->triangle_culling && p_info_->mode() >= 2 && p_info_->mode() <= 4 &&
+            p_draw_indexed_indirect_count_ && pipelines_.triangle_cull_compute;
+    }
+
+    // clears the counts of this frame data, then tests the triangles of
+    // the instances visible to the visibility pass recorded before
+    void record_triangle_cull_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_TRIANGLES_START, 2);
+        data.queries_written |= 3u << QUERY_COMPUTE_TRIANGLES_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_TRIANGLES_START);
+
+        // last read three frames ago
+        cmd_buf.fillBuffer(p_triangle_count_buffer_->buf,
+                           frame_data_idx_ * triangle_count_stride_ * sizeof(uint32_t),
+                           triangle_count_stride_ * sizeof(uint32_t),
+                           0);
+
+        vk::MemoryBarrier barriers[2] = {
+            // cleared counts
+            {vk::AccessFlagBits::eTransferWrite,
+             vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite},
+            // lods and inst_count written by the visibility pass
+            {vk::AccessFlagBits::eShaderWrite,
+             vk::AccessFlagBits::eShaderRead}
+        };
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[0],
+                                0, nullptr,
+                                0, nullptr);
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barriers[1],
+                                0, nullptr,
+                                0, nullptr);
+
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.triangle_cull_compute);
+        vk::DescriptorSet desc_sets[2] = {
+            desc_set_triangle_cull_,
+            data.desc_set
+        };
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                   pipeline_layouts_.triangle_cull_compute,
+                                   0, 2, desc_sets,
+                                   1, &data.dynamic_offset);
+        uint32_t pos_offset = 0;
+        p_model_->p_geometries->position_offset(pos_offset);
+        triangle_consts_.inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+        triangle_consts_.use_occluder_culling = static_cast<uint32_t>(p_info_->mode() >= 3);
+        triangle_consts_.count_idx = frame_data_idx_;
+        triangle_consts_.idx_budget = triangle_idx_budget_;
+        triangle_consts_.vert_stride = p_model_->p_geometries->stride / sizeof(uint32_t);
+        triangle_consts_.pos_offset = pos_offset / sizeof(uint32_t);
+        triangle_consts_.quantized_positions = static_cast<uint32_t>(p_model_->quantized_positions());
+        triangle_consts_.min_triangles = triangle_cull_min_triangles_;
+        cmd_buf.pushConstants(pipeline_layouts_.triangle_cull_compute,
+                              vk::ShaderStageFlagBits::eCompute,
+                              0, sizeof(Triangle_consts), &triangle_consts_);
+        // one workgroup per instance, wrapped into y past the group count limit
+        const uint32_t x = std::min(std::max(triangle_consts_.inst_total, 1u), 65535u);
+        cmd_buf.dispatch(x, (triangle_consts_.inst_total + x - 1) / x, 1);
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_TRIANGLES_STOP);
+    }
+
+    /* ---------------------------------------------------------- */
+
+    base::Buffer *p_second_phase_cmd_buffer_{nullptr};
+    vk::DeviceMemory second_phase_cmd_mem_;
+    std::vector<vk::Framebuffer> two_phase_framebuffers_; // per swapchain image
+
+    // mode 6, the first phase draws last frame's visible instances onscreen
+    // with depth_src as the depth attachment, the compute submit builds the
+    // hiz from it and tests every instance, and the second phase draws the
+    // visible instances the first phase missed, so there is no depth prepass.
+    // needs the direct pyramid to build and test the hiz in one compute submit
+    void init_two_phase_()
+    {
+        p_second_phase_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                                p_dev_,
+                                                                second_phase_cmd_mem_,
+                                                                p_model_->mdi_no_batching_cmd_draw_info.draw_count * sizeof(Mdi_cmd),
+                                                                vk::BufferUsageFlagBits::eStorageBuffer |
+                                                                vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                                vk::MemoryPropertyFlagBits::eDeviceLocal);
+    }
+
+    void destroy_two_phase_()
+    {
+        destroy_two_phase_framebuffers_();
+        delete p_second_phase_cmd_buffer_;
+        p_dev_->dev.freeMemory(second_phase_cmd_mem_);
+    }
+
+    void destroy_two_phase_framebuffers_()
+    {
+        for (auto fb : two_phase_framebuffers_) {
+            p_dev_->dev.destroyFramebuffer(fb);
+        }
+        two_phase_framebuffers_.clear();
+    }
+
+    // color of the swapchain image and depth_src, created on the first
+    // two-phase frame and rebuilt by resize_swapchain_ with the images
+    void create_two_phase_framebuffers_()
+    {
+        destroy_two_phase_framebuffers_();
+        auto extent = p_swapchain_->curr_extent();
+        for (uint32_t i = 0; i < p_swapchain_->image_count(); i++) {
+            vk::ImageView attachments[2] = {p_swapchain_->color_view(i), p_depth_src_->view};
+            two_phase_framebuffers_.push_back(p_dev_->dev.createFramebuffer(
+                vk::FramebufferCreateInfo({},
+                                          p_rp_first_phase_->rp,
+                                          2, attachments,
+                                          extent.width,
+                                          extent.height,
+                                          1)));
+        }
+    }
+
+    bool two_phase_active_() const
+    {
+        return p_info_->mode() == 6 && direct_pyramid_ && pipelines_.visibility_two_phase_compute;
+    }
+
+    // the visible instances the first phase missed, then the text overlay,
+    // submitted after the compute submit of this frame, its timestamps and
+    // the false negatives are read back with the rest of the frame
+    void draw_second_phase_(Frame_data &data)
+    {
+        const vk::DeviceSize vb_offset{0};
+        auto &back = acquired_back_buf_;
+        auto &cmd_buf = data.second_phase_cmd_buffer;
+        cmd_buf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_SECOND_PHASE_START, 2);
+        cmd_buf.setViewport(0, 1, &p_swapchain_->onscreen_viewport);
+        cmd_buf.setScissor(0, 1, &p_swapchain_->onscreen_scissor);
+
+        auto &rp_begin = p_rp_second_phase_->rp_begin;
+        rp_begin.renderArea.extent = p_swapchain_->curr_extent();
+        rp_begin.framebuffer = two_phase_framebuffers_[back.swapchain_image_idx];
+        cmd_buf.beginRenderPass(&rp_begin, vk::SubpassContents::eInline);
+
+        data.queries_written |= 3u << QUERY_SECOND_PHASE_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_SECOND_PHASE_START);
+
+        cmd_buf.bindIndexBuffer(p_model_->p_geometries->p_idx_buffer->buf, 0, vk::IndexType::eUint32);
+        cmd_buf.bindVertexBuffers(0, 1, &p_model_->p_geometries->p_vert_buffer->buf, &vb_offset);
+        cmd_buf.bindVertexBuffers(1, 1, &p_model_->p_inst_ids_buffer->buf, &vb_offset);
+
+        vk::DescriptorSet desc_sets[2] = {
+            data.desc_set,
+            p_model_->desc_set
+        };
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                   pipeline_layouts_.simple,
+                                   0, 2,
+                                   desc_sets,
+                                   1, &data.dynamic_offset);
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines_.simple);
+        cmd_buf.drawIndexedIndirect(p_second_phase_cmd_buffer_->buf,
+                                    p_model_->mdi_no_batching_cmd_draw_info.offset,
+                                    p_model_->mdi_no_batching_cmd_draw_info.draw_count,
+                                    p_model_->mdi_no_batching_cmd_draw_info.stride);
+
+        draw_text_(cmd_buf);
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eColorAttachmentOutput, data.query_pool, QUERY_SECOND_PHASE_STOP);
+
+        cmd_buf.endRenderPass();
+        cmd_buf.end();
+
+        // present waits the second phase instead of the compute submit
+        const vk::PipelineStageFlags wait_stages{vk::PipelineStageFlagBits::eDrawIndirect};
+        auto submit_info = vk::SubmitInfo(1, &data.second_phase_semaphore,
+                                          &wait_stages,
+                                          1, &cmd_buf,
+                                          headless_ ? 0 : 1, &back.compute_complete_semaphore);
+        base::assert_success(p_dev_->graphics_queue.submit(
+            1,
+            &submit_info,
+            data.graphics_submit_fence));
+    }
+
+    /* ---------------------------------------------------------- */
+
+    base::Buffer *p_history_buffer_{nullptr};
+    base::Buffer *p_occluder_cmd_buffer_{nullptr};
+    base::Buffer *p_flip_count_buffer_{nullptr};
+    vk::DeviceMemory history_mem_;
+    vk::DeviceMemory occluder_cmd_mem_;
+    vk::DeviceMemory flip_count_mem_;
+    uint32_t *p_flip_counts_{nullptr}; // mapped, became visible and became hidden per frame data
+    bool first_invocation_history_{true};
+    bool occluders_written_{false};
+
+    // every visibility pass shifts the visibility of an instance into its
+    // history bits and counts the flips, and writes the occluder commands
+    // of the instances visible in the last occluder_history frames.
+    // with temporal occluders the depth prepass draws those instead of
+    // every instance in F3 - F5
+    void init_visibility_history_()
+    {
+        const uint32_t inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+
+        // compute queue only, cleared by the first visibility pass
+        p_history_buffer_ = new base::Buffer(p_dev_,
+                                             inst_total * sizeof(uint32_t),
+                                             vk::BufferUsageFlagBits::eStorageBuffer |
+                                             vk::BufferUsageFlagBits::eTransferDst,
+                                             vk::MemoryPropertyFlagBits::eDeviceLocal);
+        p_history_buffer_->update_descriptor();
+        base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                              p_dev_,
+                                              history_mem_,
+                                              1, &p_history_buffer_);
+
+        // written on the compute queue, read by the depth prepass on the graphics queue
+        p_occluder_cmd_buffer_ = base::create_shared_buffer(p_phy_dev_,
+                                                            p_dev_,
+                                                            occluder_cmd_mem_,
+                                                            inst_total * sizeof(Mdi_cmd),
+                                                            vk::BufferUsageFlagBits::eStorageBuffer |
+                                                            vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                            vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+        // host visible for the flip count readback
+        p_flip_count_buffer_ = new base::Buffer(p_dev_,
+                                                frame_data_count_ * 2 * sizeof(uint32_t),
+                                                vk::BufferUsageFlagBits::eStorageBuffer |
+                                                vk::BufferUsageFlagBits::eTransferDst,
+                                                vk::MemoryPropertyFlagBits::eHostVisible |
+                                                vk::MemoryPropertyFlagBits::eHostCoherent);
+        p_flip_count_buffer_->update_descriptor();
+        base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                              p_dev_,
+                                              flip_count_mem_,
+                                              1, &p_flip_count_buffer_);
+        p_flip_counts_ = reinterpret_cast<uint32_t *>(p_flip_count_buffer_->mapped);
+    }
+
+    void destroy_visibility_history_()
+    {
+        delete p_history_buffer_;
+        delete p_occluder_cmd_buffer_;
+        delete p_flip_count_buffer_;
+        p_dev_->dev.freeMemory(history_mem_);
+        p_dev_->dev.freeMemory(occluder_cmd_mem_);
+        p_dev_->dev.freeMemory(flip_count_mem_);
+    }
+
+    bool temporal_occluders_active_() const
+    {
+        return p_info_->temporal_occluders && p_info_->mode() >= 3 && occluders_written_;
+    }
+
+    uint32_t occluder_history_mask_() const
+    {
+        uint32_t frames = std::min(std::max(p_info_->occluder_history, 1u), 32u);
+        return frames == 32 ? ~0u : (1u << frames) - 1;
+    }
+
+    // the visibility pass writes the level of every instance into its command,
+    // the batched commands of F1 and F5 draw the full meshes
+    bool lods_active_() const
+    {
+        return p_info_->select_lods && p_model_->has_lods;
+    }
+
+    // clears the history once and the flip counts of this frame data
+    void record_history_clear_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+        if (first_invocation_history_) {
+            cmd_buf.fillBuffer(p_history_buffer_->buf, 0, VK_WHOLE_SIZE, 0);
+            first_invocation_history_ = false;
+        }
+        // last read after the compute submit three frames ago
+        cmd_buf.fillBuffer(p_flip_count_buffer_->buf, frame_data_idx_ * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t), 0);
+        // the history written by the last visibility pass as well
+        vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                1, &barrier,
+                                0, nullptr,
+                                0, nullptr);
+    }
+
+    /* ---------------------------------------------------------- */
+
+    Occluder_selection *p_occluder_selection_{nullptr};
+    base::Buffer *p_selected_occluder_buffer_{nullptr};
+    vk::DeviceMemory selected_occluder_mem_;
+
+    // the host picks the occluders of the depth prepass every frame,
+    // one range of commands per frame data in a host visible buffer
+    void init_occluder_selection_()
+    {
+        p_occluder_selection_ = new Occluder_selection(p_model_->inst_props, p_model_->p_geometries->meshes);
+
+        p_selected_occluder_buffer_ = new base::Buffer(p_dev_,
+                                                       frame_data_count_ * occluder_range_size_(),
+                                                       vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                       vk::MemoryPropertyFlagBits::eHostVisible |
+                                                       vk::MemoryPropertyFlagBits::eHostCoherent);
+        base::allocate_and_bind_buffer_memory(p_phy_dev_,
+                                              p_dev_,
+                                              selected_occluder_mem_,
+                                              1, &p_selected_occluder_buffer_);
+    }
+
+    void destroy_occluder_selection_()
+    {
+        delete p_occluder_selection_;
+        delete p_selected_occluder_buffer_;
+        p_dev_->dev.freeMemory(selected_occluder_mem_);
+    }
+
+    vk::DeviceSize occluder_range_size_() const
+    {
+        return p_model_->mdi_no_batching_cmd_draw_info.draw_count * sizeof(Mdi_cmd);
+    }
+
+    bool occluder_selection_active_() const
+    {
+        return p_info_->select_occluders && p_info_->mode() >= 3 && p_info_->mode() <= 5 &&
+            !temporal_occluders_active_();
+    }
+
+    // the range of this frame data was last drawn by the graphics submit waited on
+    void select_occluders_(Frame_data &data)
+    {
+        data.occluders_selected = occluder_selection_active_();
+        if (!data.occluders_selected) return;
+
+        Cpu_culling_params params;
+        params.model = p_model_->model_matrix;
+        params.view = p_camera_->view;
+        params.projection_clip = p_camera_->clip * p_camera_->projection;
+        params.cam_near = p_camera_->cam_near;
+        params.cam_far = p_camera_->cam_far;
+        params.resolution = glm::vec2(p_info_->width(), p_info_->height());
+
+        auto cmds = reinterpret_cast<Mdi_cmd *>(
+            reinterpret_cast<uint8_t *>(p_selected_occluder_buffer_->mapped) + frame_data_idx_ * occluder_range_size_());
+        data.selected_occluder_count = p_occluder_selection_->select(params,
+                                                                     p_info_->rank_occluders_by_volume ? Occluder_rank::VOLUME : Occluder_rank::SCREEN_AREA,
+                                                                     p_info_->occluder_budget,
+                                                                     cmds);
+        data.occluder_selection_seconds = p_occluder_selection_->last_seconds();
     }
 
     /* ---------------------------------------------------------- */
@@ -586,17 +1640,27 @@ private:
         vk::DescriptorSetLayout font_tex;
         vk::DescriptorSetLayout depth_staging;
         vk::DescriptorSetLayout visibility;
+        vk::DescriptorSetLayout depth_direct;
+        vk::DescriptorSetLayout depth_direct_spd;
+        vk::DescriptorSetLayout rebatch;
+        vk::DescriptorSetLayout cluster_cull;
+        vk::DescriptorSetLayout triangle_cull;
     } desc_set_layouts_;
 
     vk::DescriptorSet desc_set_font_tex_;
     vk::DescriptorSet desc_set_depth_staging_;
     vk::DescriptorSet desc_set_visibility_;
+    std::vector<vk::DescriptorSet> desc_sets_depth_direct_; // per level
+    vk::DescriptorSet desc_set_depth_direct_spd_;
+    vk::DescriptorSet desc_set_rebatch_;
+    vk::DescriptorSet desc_set_cluster_cull_;
+    vk::DescriptorSet desc_set_triangle_cull_;
 
     void init_descriptors_()
     {
         // layout
 
-        vk::DescriptorSetLayoutBinding bindings[3];
+        vk::DescriptorSetLayoutBinding bindings[10];
         // frame_data
         bindings[0] = {
             0,
@@ -615,27 +1679,79 @@ private:
         // compute_depth_staging
         bindings[0] = {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute};
         bindings[1] = {1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[2] = {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
         desc_set_layouts_.depth_staging = p_dev_->dev.createDescriptorSetLayout(
-            vk::DescriptorSetLayoutCreateInfo({}, 2, bindings));
+            vk::DescriptorSetLayoutCreateInfo({}, 3, bindings));
 
-        // compute visibility
+        // compute visibility, 3 and 4 are the compacted commands and their counts,
+        // two-phase counts false negatives in 4 and writes the second phase commands to 5,
+        // 6 - 8 are the visibility history, the occluder commands and the flip counts,
+        // 9 the index ranges of the mesh lods
         bindings[0] = {0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute};
         bindings[1] = {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
         bindings[2] = {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[3] = {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[4] = {4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[5] = {5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[6] = {6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[7] = {7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[8] = {8, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[9] = {9, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
         desc_set_layouts_.visibility = p_dev_->dev.createDescriptorSetLayout(
+            vk::DescriptorSetLayoutCreateInfo({}, 10, bindings));
+
+        // compute rebatch
+        bindings[0] = {0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[1] = {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[2] = {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[3] = {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        desc_set_layouts_.rebatch = p_dev_->dev.createDescriptorSetLayout(
+            vk::DescriptorSetLayoutCreateInfo({}, 4, bindings));
+
+        // compute cluster cull, 3 and 4 are the clusters and the first cluster of
+        // every mesh, 5 and 6 the cluster commands and their counts
+        bindings[0] = {0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[1] = {1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[2] = {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[3] = {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[4] = {4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[5] = {5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[6] = {6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        desc_set_layouts_.cluster_cull = p_dev_->dev.createDescriptorSetLayout(
+            vk::DescriptorSetLayoutCreateInfo({}, 7, bindings));
+
+        // compute triangle cull, 1 the instance transforms, 3 and 4 the vertices
+        // and indices, 5 - 7 the culled indices, their cmds and counts
+        bindings[7] = {7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        desc_set_layouts_.triangle_cull = p_dev_->dev.createDescriptorSetLayout(
+            vk::DescriptorSetLayoutCreateInfo({}, 8, bindings));
+
+        // compute_depth_direct, binding 2 is the level above the written one
+        const uint32_t level_count = p_depth_dst_->mip_levels;
+        bindings[0] = {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[1] = {1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute};
+        bindings[2] = {2, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute};
+        desc_set_layouts_.depth_direct = p_dev_->dev.createDescriptorSetLayout(
+            vk::DescriptorSetLayoutCreateInfo({}, 3, bindings));
+
+        // compute_depth_direct_spd, every level at once
+        bindings[0] = {0, vk::DescriptorType::eStorageImage, level_count, vk::ShaderStageFlagBits::eCompute};
+        bindings[2] = {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute};
+        desc_set_layouts_.depth_direct_spd = p_dev_->dev.createDescriptorSetLayout(
             vk::DescriptorSetLayoutCreateInfo({}, 3, bindings));
 
         // pool
+        const uint32_t direct_set_count = direct_pyramid_ ? level_count + 1 : 0;
         std::vector<vk::DescriptorPoolSize> pool_sizes =
         {
             vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, frame_data_count_),
-            vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, 1),
-            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 2),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3)
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, direct_pyramid_ ? level_count * 3 : 1),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, 27),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 5 + direct_set_count)
         };
         desc_pool_ = p_dev_->dev.createDescriptorPool(
             vk::DescriptorPoolCreateInfo({},
-                                         frame_data_count_ + 6,
+                                         frame_data_count_ + 9 + direct_set_count,
                                          static_cast<uint32_t>(pool_sizes.size()),
                                          pool_sizes.data()));
 
@@ -646,8 +1762,18 @@ private:
             set_layouts.push_back(desc_set_layouts_.frame_data);
         }
         set_layouts.push_back(desc_set_layouts_.font_tex);
-        set_layouts.push_back(desc_set_layouts_.depth_staging);
         set_layouts.push_back(desc_set_layouts_.visibility);
+        set_layouts.push_back(desc_set_layouts_.rebatch);
+        set_layouts.push_back(desc_set_layouts_.cluster_cull);
+        set_layouts.push_back(desc_set_layouts_.triangle_cull);
+        if (direct_pyramid_) {
+            for (uint32_t i = 0; i < level_count; i++) {
+                set_layouts.push_back(desc_set_layouts_.depth_direct);
+            }
+            set_layouts.push_back(desc_set_layouts_.depth_direct_spd);
+        } else {
+            set_layouts.push_back(desc_set_layouts_.depth_staging);
+        }
 
         std::vector<vk::DescriptorSet> desc_sets =
             p_dev_->dev.allocateDescriptorSets(vk::DescriptorSetAllocateInfo(desc_pool_,
@@ -667,32 +1793,206 @@ private:
         writes.emplace_back(desc_set_font_tex_,
                             0, 0,
                             1, vk::DescriptorType::eCombinedImageSampler, &p_text_overlay_->p_font->p_tex->desc_image_info);
-        // depth_staging
-        desc_set_depth_staging_ = desc_sets[idx++];
-        writes.emplace_back(desc_set_depth_staging_,
+        // visibility
+        desc_set_visibility_ = desc_sets[idx++];
+        writes.emplace_back(desc_set_visibility_,
+                            0, 0,
+                            1, vk::DescriptorType::eCombinedImageSampler,
+                            &p_depth_dst_->desc_image_info);
+        writes.emplace_back(desc_set_visibility_,
+                            1, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_inst_data_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            2, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_mdi_no_batching_cmd_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            3, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_compacted_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            4, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_draw_count_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            5, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_second_phase_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            6, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_history_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            7, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_occluder_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            8, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_flip_count_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_visibility_,
+                            9, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_mesh_lod_buffer->desc_buf_info);
+        // rebatch
+        desc_set_rebatch_ = desc_sets[idx++];
+        writes.emplace_back(desc_set_rebatch_,
                             0, 0,
-                            1, vk::DescriptorType::eStorageImage,
-                            &p_depth_staging_->desc_image_info);
-        writes.emplace_back(desc_set_depth_staging_,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_inst_data_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_rebatch_,
                             1, 0,
-                            1, vk::DescriptorType::eCombinedImageSampler,
-                            &p_depth_src_->desc_image_info);
-        // visibility
-        desc_set_visibility_ = desc_sets[idx];
-        writes.emplace_back(desc_set_visibility_,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_mdi_no_batching_cmd_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_rebatch_,
+                            2, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_rebatched_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_rebatch_,
+                            3, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_rebatched_ids_buffer_->desc_buf_info);
+        // cluster cull
+        desc_set_cluster_cull_ = desc_sets[idx++];
+        writes.emplace_back(desc_set_cluster_cull_,
                             0, 0,
                             1, vk::DescriptorType::eCombinedImageSampler,
                             &p_depth_dst_->desc_image_info);
-        writes.emplace_back(desc_set_visibility_,
+        writes.emplace_back(desc_set_cluster_cull_,
                             1, 0,
                             1, vk::DescriptorType::eStorageBuffer,
                             nullptr,
                             &p_model_->p_inst_data_buffer->desc_buf_info);
-        writes.emplace_back(desc_set_visibility_,
+        writes.emplace_back(desc_set_cluster_cull_,
+                            2, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_mdi_no_batching_cmd_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_cluster_cull_,
+                            3, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_cluster_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_cluster_cull_,
+                            4, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_cluster_offset_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_cluster_cull_,
+                            5, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_cluster_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_cluster_cull_,
+                            6, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_cluster_count_buffer_->desc_buf_info);
+        // triangle cull
+        desc_set_triangle_cull_ = desc_sets[idx++];
+        writes.emplace_back(desc_set_triangle_cull_,
+                            0, 0,
+                            1, vk::DescriptorType::eCombinedImageSampler,
+                            &p_depth_dst_->desc_image_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            1, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->inst_transform_info());
+        writes.emplace_back(desc_set_triangle_cull_,
                             2, 0,
                             1, vk::DescriptorType::eStorageBuffer,
                             nullptr,
                             &p_model_->p_mdi_no_batching_cmd_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            3, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_geometries->p_vert_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            4, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_model_->p_geometries->p_idx_buffer->desc_buf_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            5, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_triangle_idx_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            6, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_triangle_cmd_buffer_->desc_buf_info);
+        writes.emplace_back(desc_set_triangle_cull_,
+                            7, 0,
+                            1, vk::DescriptorType::eStorageBuffer,
+                            nullptr,
+                            &p_triangle_count_buffer_->desc_buf_info);
+        if (direct_pyramid_) {
+            // depth_direct
+            for (uint32_t i = 0; i < level_count; i++) {
+                desc_sets_depth_direct_.push_back(desc_sets[idx++]);
+                writes.emplace_back(desc_sets_depth_direct_[i],
+                                    0, 0,
+                                    1, vk::DescriptorType::eStorageImage,
+                                    &depth_dst_level_infos_[i]);
+                writes.emplace_back(desc_sets_depth_direct_[i],
+                                    1, 0,
+                                    1, vk::DescriptorType::eCombinedImageSampler,
+                                    &p_depth_src_->desc_image_info);
+                if (i == 0) continue;
+                writes.emplace_back(desc_sets_depth_direct_[i],
+                                    2, 0,
+                                    1, vk::DescriptorType::eStorageImage,
+                                    &depth_dst_level_infos_[i - 1]);
+            }
+            // depth_direct_spd
+            desc_set_depth_direct_spd_ = desc_sets[idx++];
+            writes.emplace_back(desc_set_depth_direct_spd_,
+                                0, 0,
+                                level_count, vk::DescriptorType::eStorageImage,
+                                depth_dst_level_infos_.data());
+            writes.emplace_back(desc_set_depth_direct_spd_,
+                                1, 0,
+                                1, vk::DescriptorType::eCombinedImageSampler,
+                                &p_depth_src_->desc_image_info);
+            writes.emplace_back(desc_set_depth_direct_spd_,
+                                2, 0,
+                                1, vk::DescriptorType::eStorageBuffer,
+                                nullptr,
+                                &p_spd_counter_->desc_buf_info);
+        } else {
+            // depth_staging
+            desc_set_depth_staging_ = desc_sets[idx++];
+            writes.emplace_back(desc_set_depth_staging_,
+                                0, 0,
+                                1, vk::DescriptorType::eStorageImage,
+                                &p_depth_staging_->desc_image_info);
+            writes.emplace_back(desc_set_depth_staging_,
+                                1, 0,
+                                1, vk::DescriptorType::eCombinedImageSampler,
+                                &p_depth_src_->desc_image_info);
+            writes.emplace_back(desc_set_depth_staging_,
+                                2, 0,
+                                1, vk::DescriptorType::eStorageBuffer,
+                                nullptr,
+                                &p_spd_counter_->desc_buf_info);
+        }
         p_dev_->dev.updateDescriptorSets(static_cast<uint32_t>(writes.size()),
                                          writes.data(),
                                          0, nullptr);
@@ -705,6 +2005,11 @@ private:
         p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.font_tex);
         p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.depth_staging);
         p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.visibility);
+        p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.depth_direct);
+        p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.depth_direct_spd);
+        p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.rebatch);
+        p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.cluster_cull);
+        p_dev_->dev.destroyDescriptorSetLayout(desc_set_layouts_.triangle_cull);
     }
 
     /* ---------------------------------------------------------- */
@@ -714,6 +2019,16 @@ private:
     base::Shader *p_copy_comp_{nullptr};
     base::Shader *p_mipmap_comp_{nullptr};
     base::Shader *p_visibility_comp_{nullptr};
+    base::Shader *p_hiz_spd_comp_{nullptr};
+    base::Shader *p_copy_direct_comp_{nullptr};
+    base::Shader *p_mipmap_direct_comp_{nullptr};
+    base::Shader *p_hiz_spd_direct_comp_{nullptr};
+    base::Shader *p_visibility_compact_comp_{nullptr};
+    base::Shader *p_rebatch_comp_{nullptr};
+    base::Shader *p_visibility_two_phase_comp_{nullptr};
+    base::Shader *p_cluster_cull_comp_{nullptr};
+    base::Shader *p_triangle_cull_comp_{nullptr};
+    base::Shader *p_depth_vs_{nullptr};
 
     void init_shaders_()
     {
@@ -724,11 +2039,49 @@ private:
         p_visibility_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
 
         auto dir = base::data_dir() + "shaders/";
-        p_simple_vs_->generate(dir + "simple.vert.spv");
+        p_simple_vs_->generate(dir + (p_model_->quantized_positions() ? "simple_quantized.vert.spv" : "simple.vert.spv"));
         p_simple_fs_->generate(dir + "simple.frag.spv");
         p_copy_comp_->generate(dir + "copy.comp.spv");
         p_mipmap_comp_->generate(dir + "mipmap.comp.spv");
         p_visibility_comp_->generate(dir + "visibility.comp.spv");
+
+        auto p_spd_comp = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+        if (direct_pyramid_) {
+            p_spd_comp->generate(dir + "hiz_spd_direct.comp.spv");
+            p_hiz_spd_direct_comp_ = p_spd_comp;
+        } else {
+            p_spd_comp->generate(dir + "hiz_spd.comp.spv");
+            p_hiz_spd_comp_ = p_spd_comp;
+        }
+        p_visibility_compact_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+        p_visibility_compact_comp_->generate(dir + "visibility_compact.comp.spv");
+        p_rebatch_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+        p_rebatch_comp_->generate(dir + "rebatch.comp.spv");
+        p_cluster_cull_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+        p_cluster_cull_comp_->generate(dir + "cluster_cull.comp.spv");
+        uint32_t pos_offset = 0;
+        if (p_model_->p_geometries->position_offset(pos_offset)) {
+            p_triangle_cull_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+            p_triangle_cull_comp_->generate(dir + "triangle_cull.comp.spv");
+        } else {
+            std::cout << MSG_PREFIX << "no positions, triangle culling disabled" << std::endl;
+        }
+        if (direct_pyramid_) {
+            p_visibility_two_phase_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+            p_visibility_two_phase_comp_->generate(dir + "visibility_two_phase.comp.spv");
+        } else {
+            std::cout << MSG_PREFIX << "two-phase culling needs the direct pyramid, mode 6 culls as mode 3" << std::endl;
+        }
+        if (position_stream_active_()) {
+            p_depth_vs_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eVertex);
+            p_depth_vs_->generate(dir + "depth.vert.spv");
+        }
+        if (direct_pyramid_) {
+            p_copy_direct_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+            p_mipmap_direct_comp_ = new base::Shader(p_dev_, vk::ShaderStageFlagBits::eCompute);
+            p_copy_direct_comp_->generate(dir + "copy_direct.comp.spv");
+            p_mipmap_direct_comp_->generate(dir + "mipmap_direct.comp.spv");
+        }
     }
 
     void destroy_shaders_()
@@ -738,6 +2091,22 @@ private:
         delete p_copy_comp_;
         delete p_mipmap_comp_;
         delete p_visibility_comp_;
+        delete p_hiz_spd_comp_;
+        delete p_copy_direct_comp_;
+        delete p_mipmap_direct_comp_;
+        delete p_hiz_spd_direct_comp_;
+        delete p_visibility_compact_comp_;
+        delete p_rebatch_comp_;
+        delete p_visibility_two_phase_comp_;
+        delete p_cluster_cull_comp_;
+        delete p_triangle_cull_comp_;
+        delete p_depth_vs_;
+    }
+
+    // the depth prepass reads only positions and transforms with depth.vert
+    bool position_stream_active_() const
+    {
+        return !p_model_->depth_vi_bindings.empty();
     }
 
     /* ---------------------------------------------------------- */
@@ -751,6 +2120,15 @@ private:
         vk::Pipeline copy_compute;
         vk::Pipeline mipmap_compute;
         vk::Pipeline visibility_compute;
+        vk::Pipeline spd_compute;
+        vk::Pipeline copy_direct_compute;
+        vk::Pipeline mipmap_direct_compute;
+        vk::Pipeline spd_direct_compute;
+        vk::Pipeline visibility_compact_compute;
+        vk::Pipeline rebatch_compute;
+        vk::Pipeline visibility_two_phase_compute;
+        vk::Pipeline cluster_cull_compute;
+        vk::Pipeline triangle_cull_compute;
     } pipelines_;
 
     struct Pipeline_layouts
@@ -760,6 +2138,11 @@ private:
         vk::PipelineLayout depth;
         vk::PipelineLayout depth_compute;
         vk::PipelineLayout visibility_compute;
+        vk::PipelineLayout depth_direct_compute;
+        vk::PipelineLayout depth_direct_spd_compute;
+        vk::PipelineLayout rebatch_compute;
+        vk::PipelineLayout cluster_cull_compute;
+        vk::PipelineLayout triangle_cull_compute;
     } pipeline_layouts_;
 
     void init_pipelines_()
@@ -780,10 +2163,10 @@ private:
                                          0, nullptr));
         pipeline_layouts_.depth = p_dev_->dev.createPipelineLayout(
             vk::PipelineLayoutCreateInfo({},
-                                         1, &layouts[0],
+                                         2, layouts,
                                          0, nullptr));
 
-        vk::PushConstantRange compute_ranges[2] = {
+        vk::PushConstantRange compute_ranges[5] = {
             vk::PushConstantRange(
                 vk::ShaderStageFlagBits::eCompute,
                 0,
@@ -791,18 +2174,52 @@ private:
             vk::PushConstantRange(
                 vk::ShaderStageFlagBits::eCompute,
                 0,
-                sizeof(Visibility_consts))
+                sizeof(Visibility_consts)),
+            vk::PushConstantRange(
+                vk::ShaderStageFlagBits::eCompute,
+                0,
+                sizeof(Rebatch_consts)),
+            vk::PushConstantRange(
+                vk::ShaderStageFlagBits::eCompute,
+                0,
+                sizeof(Cluster_consts)),
+            vk::PushConstantRange(
+                vk::ShaderStageFlagBits::eCompute,
+                0,
+                sizeof(Triangle_consts))
         };
         pipeline_layouts_.depth_compute = p_dev_->dev.createPipelineLayout(
             vk::PipelineLayoutCreateInfo({},
                                          1, &desc_set_layouts_.depth_staging,
                                          1, &compute_ranges[0]));
+        pipeline_layouts_.depth_direct_compute = p_dev_->dev.createPipelineLayout(
+            vk::PipelineLayoutCreateInfo({},
+                                         1, &desc_set_layouts_.depth_direct,
+                                         1, &compute_ranges[0]));
+        pipeline_layouts_.depth_direct_spd_compute = p_dev_->dev.createPipelineLayout(
+            vk::PipelineLayoutCreateInfo({},
+                                         1, &desc_set_layouts_.depth_direct_spd,
+                                         1, &compute_ranges[0]));
         layouts[0] = desc_set_layouts_.visibility;
         layouts[1] = desc_set_layouts_.frame_data;
         pipeline_layouts_.visibility_compute = p_dev_->dev.createPipelineLayout(
             vk::PipelineLayoutCreateInfo({},
                                          2, layouts,
                                          1, &compute_ranges[1]));
+        pipeline_layouts_.rebatch_compute = p_dev_->dev.createPipelineLayout(
+            vk::PipelineLayoutCreateInfo({},
+                                         1, &desc_set_layouts_.rebatch,
+                                         1, &compute_ranges[2]));
+        layouts[0] = desc_set_layouts_.cluster_cull;
+        pipeline_layouts_.cluster_cull_compute = p_dev_->dev.createPipelineLayout(
+            vk::PipelineLayoutCreateInfo({},
+                                         2, layouts,
+                                         1, &compute_ranges[3]));
+        layouts[0] = desc_set_layouts_.triangle_cull;
+        pipeline_layouts_.triangle_cull_compute = p_dev_->dev.createPipelineLayout(
+            vk::PipelineLayoutCreateInfo({},
+                                         2, layouts,
+                                         1, &compute_ranges[4]));
 
         // pipelines
         vk::PipelineInputAssemblyStateCreateInfo input_assembly_state(
@@ -953,8 +2370,19 @@ private:
 
         // depth
 
-        pipeline_ci.pVertexInputState = &vertex_input_state;
-        pipeline_ci.pStages = shader_stages;
+        vk::PipelineVertexInputStateCreateInfo depth_vertex_input_state{
+            {},
+            p_model_->depth_vi_bindings.size(),
+            p_model_->depth_vi_bindings.data(),
+            p_model_->depth_vi_attribs.size(),
+            p_model_->depth_vi_attribs.data()
+        };
+        vk::PipelineShaderStageCreateInfo depth_shader_stage = p_depth_vs_ ?
+            p_depth_vs_->create_pipeline_stage_info() :
+            shader_stages[0];
+
+        pipeline_ci.pVertexInputState = position_stream_active_() ? &depth_vertex_input_state : &vertex_input_state;
+        pipeline_ci.pStages = &depth_shader_stage;
         pipeline_ci.stageCount = 1;
 
         blend_attachment_state.blendEnable = VK_FALSE;
@@ -986,6 +2414,70 @@ private:
                 {},
                 p_visibility_comp_->create_pipeline_stage_info(),
                 pipeline_layouts_.visibility_compute));
+        if (p_hiz_spd_comp_) {
+            pipelines_.spd_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_hiz_spd_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.depth_compute));
+        }
+        if (direct_pyramid_) {
+            pipelines_.copy_direct_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_copy_direct_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.depth_direct_compute));
+            pipelines_.mipmap_direct_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_mipmap_direct_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.depth_direct_compute));
+        }
+        pipelines_.visibility_compact_compute = p_dev_->dev.createComputePipeline(
+            nullptr,
+            vk::ComputePipelineCreateInfo(
+                {},
+                p_visibility_compact_comp_->create_pipeline_stage_info(),
+                pipeline_layouts_.visibility_compute));
+        if (p_visibility_two_phase_comp_) {
+            pipelines_.visibility_two_phase_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_visibility_two_phase_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.visibility_compute));
+        }
+        pipelines_.rebatch_compute = p_dev_->dev.createComputePipeline(
+            nullptr,
+            vk::ComputePipelineCreateInfo(
+                {},
+                p_rebatch_comp_->create_pipeline_stage_info(),
+                pipeline_layouts_.rebatch_compute));
+        pipelines_.cluster_cull_compute = p_dev_->dev.createComputePipeline(
+            nullptr,
+            vk::ComputePipelineCreateInfo(
+                {},
+                p_cluster_cull_comp_->create_pipeline_stage_info(),
+                pipeline_layouts_.cluster_cull_compute));
+        if (p_triangle_cull_comp_) {
+            pipelines_.triangle_cull_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_triangle_cull_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.triangle_cull_compute));
+        }
+        if (p_hiz_spd_direct_comp_) {
+            pipelines_.spd_direct_compute = p_dev_->dev.createComputePipeline(
+                nullptr,
+                vk::ComputePipelineCreateInfo(
+                    {},
+                    p_hiz_spd_direct_comp_->create_pipeline_stage_info(),
+                    pipeline_layouts_.depth_direct_spd_compute));
+        }
     }
 
     void destroy_pipelines_()
@@ -997,20 +2489,159 @@ private:
         p_dev_->dev.destroyPipeline(pipelines_.copy_compute);
         p_dev_->dev.destroyPipeline(pipelines_.mipmap_compute);
         p_dev_->dev.destroyPipeline(pipelines_.visibility_compute);
+        if (pipelines_.spd_compute) p_dev_->dev.destroyPipeline(pipelines_.spd_compute);
+        if (pipelines_.copy_direct_compute) p_dev_->dev.destroyPipeline(pipelines_.copy_direct_compute);
+        if (pipelines_.mipmap_direct_compute) p_dev_->dev.destroyPipeline(pipelines_.mipmap_direct_compute);
+        if (pipelines_.spd_direct_compute) p_dev_->dev.destroyPipeline(pipelines_.spd_direct_compute);
+        p_dev_->dev.destroyPipeline(pipelines_.visibility_compact_compute);
+        p_dev_->dev.destroyPipeline(pipelines_.rebatch_compute);
+        if (pipelines_.visibility_two_phase_compute) p_dev_->dev.destroyPipeline(pipelines_.visibility_two_phase_compute);
+        p_dev_->dev.destroyPipeline(pipelines_.cluster_cull_compute);
+        if (pipelines_.triangle_cull_compute) p_dev_->dev.destroyPipeline(pipelines_.triangle_cull_compute);
         p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.simple);
         p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.text);
         p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.depth);
         p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.depth_compute);
         p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.visibility_compute);
+        p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.depth_direct_compute);
+        p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.depth_direct_spd_compute);
+        p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.rebatch_compute);
+        p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.cluster_cull_compute);
+        p_dev_->dev.destroyPipelineLayout(pipeline_layouts_.triangle_cull_compute);
+    }
+
+    /* ---------------------------------------------------------- */
+
+    std::ofstream stats_file_;
+    uint32_t stats_frame_idx_{0};
+    uint32_t offscreen_image_idx_{0};
+
+    void init_stats_()
+    {
+        if (p_info_->stats_path.empty()) return;
+        stats_file_.open(p_info_->stats_path);
+        if (!stats_file_.is_open()) {
+            std::string errstr = MSG_PREFIX;
+            errstr.append("cannot open stats file ");
+            errstr.append(p_info_->stats_path);
+            throw std::runtime_error(errstr);
+        }
+        std::cout << MSG_PREFIX << "writing stats to " << p_info_->stats_path << std::endl;
+        stats_file_ << "frame,mode,onscreen_ms,depth_ms,transfer_ms,compute_mipchain_ms,compute_visibility_ms,compute_mipchain_single_pass_ms,compute_rebatch_ms,second_phase_ms,false_negatives,became_visible,became_hidden,selected_occluders,occluder_selection_ms,compute_clusters_ms,visible_clusters,tested_clusters,compute_triangles_ms,visible_triangles,tested_triangles,whole_draws\n";
+    }
+
+    // the timestamps and counts of the last frame of a frame data, read when
+    // it comes round again after its fences, so the host does not wait on
+    // the frames in flight, then its stats row
+    void read_back_(uint32_t idx)
+    {
+        auto &data = frame_data_vector_[idx];
+        if (!data.read_back_pending) return;
+        data.read_back_pending = false;
+
+        // only the pairs written, available since the fences are signaled
+        for (uint32_t q = 0; q < max_query_count_; q += 2) {
+            if ((data.queries_written >> q & 3u) != 3u) continue;
+            base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
+                                                       static_cast<VkQueryPool>(data.query_pool),
+                                                       q, 2,
+                                                       sizeof(uint32_t) * 2,
+                                                       &data.query_data.data[q],
+                                                       sizeof(uint32_t),
+                                                       static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
+        }
+
+        if (data.compacted) visible_draw_count_ = p_draw_counts_[idx];
+        if (data.two_phase) data.false_negatives = p_draw_counts_[idx];
+        // flip counts of the visibility pass, the cluster and triangle counts
+        if ((data.queries_written >> QUERY_COMPUTE_VISIBILITY_START & 3u) == 3u) {
+            data.became_visible = p_flip_counts_[idx * 2];
+            data.became_hidden = p_flip_counts_[idx * 2 + 1];
+            if (data.clusters_culled) {
+                data.visible_clusters = p_cluster_counts_[idx * 2];
+                data.tested_clusters = p_cluster_counts_[idx * 2 + 1];
+            }
+            if (data.triangles_culled) {
+                const uint32_t *p_counts = p_triangle_counts_ + idx * triangle_count_stride_;
+                data.whole_draws = p_counts[1];
+                data.tested_triangles = p_counts[3];
+                data.visible_triangles = p_counts[4];
+            }
+        }
+
+        write_stats_(data);
+    }
+
+    // the frames still in flight at exit, oldest first
+    void read_back_all_()
+    {
+        for (uint32_t i = 0; i < frame_data_count_; i++) {
+            read_back_((frame_data_idx_ + i) % frame_data_count_);
+        }
+    }
+
+    // one csv row per frame, passes that did not run this frame are left empty
+    void write_stats_(const Frame_data &data)
+    {
+        if (!stats_file_.is_open()) return;
+
+        const double period = p_phy_dev_->props.limits.timestampPeriod;
+        auto write_pass = [&](uint32_t start) {
+            stats_file_ << ",";
+            if ((data.queries_written >> start & 3u) != 3u) return;
+            uint32_t ticks = data.query_data.data[start + 1] - data.query_data.data[start];
+            stats_file_ << ticks * period / 1000000.;
+        };
+        stats_file_ << stats_frame_idx_++ << "," << data.mode;
+        write_pass(QUERY_ONSCREEN_START);
+        write_pass(QUERY_DEPTH_START);
+        write_pass(QUERY_TRANSFER_START);
+        write_pass(QUERY_COMPUTE_MIPCHAIN_START);
+        write_pass(QUERY_COMPUTE_VISIBILITY_START);
+        write_pass(QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START);
+        write_pass(QUERY_COMPUTE_REBATCH_START);
+        write_pass(QUERY_SECOND_PHASE_START);
+        stats_file_ << ",";
+        if (data.two_phase) stats_file_ << data.false_negatives;
+        stats_file_ << ",";
+        if ((data.queries_written >> QUERY_COMPUTE_VISIBILITY_START & 3u) == 3u)
+            stats_file_ << data.became_visible << "," << data.became_hidden;
+        else
+            stats_file_ << ",";
+        stats_file_ << ",";
+        if (data.occluders_selected)
+            stats_file_ << data.selected_occluder_count << "," << data.occluder_selection_seconds * 1000.;
+        else
+            stats_file_ << ",";
+        write_pass(QUERY_COMPUTE_CLUSTERS_START);
+        stats_file_ << ",";
+        if ((data.queries_written >> QUERY_COMPUTE_CLUSTERS_START & 3u) == 3u)
+            stats_file_ << data.visible_clusters << "," << data.tested_clusters;
+        else
+            stats_file_ << ",";
+        write_pass(QUERY_COMPUTE_TRIANGLES_START);
+        stats_file_ << ",";
+        if ((data.queries_written >> QUERY_COMPUTE_TRIANGLES_START & 3u) == 3u)
+            stats_file_ << data.visible_triangles << "," << data.tested_triangles << "," << data.whole_draws;
+        else
+            stats_file_ << ",,";
+        stats_file_ << "\n";
     }
 
     /* ---------------------------------------------------------- */
 
-    void detect_window_resize_() const
+    // the swapchain waits idle before it recreates its images
+    void resize_swapchain_(uint32_t width_hint, uint32_t height_hint)
+    {
+        if (!p_swapchain_->resize(width_hint, height_hint)) return;
+        if (!two_phase_framebuffers_.empty()) create_two_phase_framebuffers_();
+    }
+
+    void detect_window_resize_()
     {
         if (p_info_->resize_flag) {
             p_info_->resize_flag = false;
-            p_swapchain_->resize(p_info_->width(), p_info_->height());
+            resize_swapchain_(p_info_->width(), p_info_->height());
         }
     }
 
@@ -1025,6 +2656,14 @@ private:
 
         detect_window_resize_();
 
+        if (headless_) {
+            back.swapchain_image_idx = offscreen_image_idx_;
+            offscreen_image_idx_ = (offscreen_image_idx_ + 1) % p_swapchain_->image_count();
+            acquired_back_buf_ = back;
+            back_buffers_.pop_front();
+            return;
+        }
+
         vk::Result res = vk::Result::eTimeout;
         while (res != vk::Result::eSuccess) {
 
@@ -1035,7 +2674,7 @@ private:
                 vk::Fence(),
                 &back.swapchain_image_idx);
             if (res == vk::Result::eErrorOutOfDateKHR) {
-                p_swapchain_->resize(0, 0);
+                resize_swapchain_(0, 0);
                 p_shell_->post_quit_msg();
             } else {
                 assert(res == vk::Result::eSuccess);
@@ -1048,13 +2687,17 @@ private:
 
     void present_back_buffer_(float elapsed_time, float delta_time) override
     {
+        if (headless_) camera_path_.apply(elapsed_time, p_camera_);
+
         on_frame_(elapsed_time, delta_time);
 
         auto &back = acquired_back_buf_;
-        vk::PresentInfoKHR present_info(1, &back.compute_complete_semaphore,
-                                        1, &p_swapchain_->swapchain,
-                                        &back.swapchain_image_idx);
-        base::assert_success(p_dev_->present_queue.presentKHR(present_info));
+        if (!headless_) {
+            vk::PresentInfoKHR present_info(1, &back.compute_complete_semaphore,
+                                            1, &p_swapchain_->swapchain,
+                                            &back.swapchain_image_idx);
+            base::assert_success(p_dev_->present_queue.presentKHR(present_info));
+        }
         p_dev_->present_queue.submit(0, nullptr, back.present_queue_submit_fence);
 
         back_buffers_.push_back(back);
@@ -1110,9 +2753,185 @@ private:
             level_info_.dst_mipmap_size.x = std::max(1, level_info_.dst_mipmap_size.x / 2);
             level_info_.dst_mipmap_size.y = std::max(1, level_info_.dst_mipmap_size.y / 2);
         }
+    }
+
+    bool single_pass_mipchain_() const
+    {
+        return p_info_->single_pass_mipchain &&
+            (direct_pyramid_ ? pipelines_.spd_direct_compute : pipelines_.spd_compute);
+    }
+
+    // copy.comp and one mipmap.comp dispatch per level
+    void record_mipchain_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_MIPCHAIN_START, 2);
+
+        data.queries_written |= 3u << QUERY_COMPUTE_MIPCHAIN_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_MIPCHAIN_START);
+
+        // copy pipeline
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.copy_compute);
+        update_push_constants_(0);
+        cmd_buf.pushConstants(pipeline_layouts_.depth_compute,
+                              vk::ShaderStageFlagBits::eCompute,
+                              0, sizeof(Mipmap_level_info), &level_info_);
+        auto x = static_cast<uint32_t> ((level_info_.dst_mipmap_size.x - 1) / 32 + 1);
+        auto y = static_cast<uint32_t> ((level_info_.dst_mipmap_size.y - 1) / 32 + 1);
+        cmd_buf.dispatch(x, y, 1);
+
+        // mipmap pipeline
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.mipmap_compute);
+        for (int i = 1; i < p_depth_dst_->mip_levels; i++) {
+            update_push_constants_(i);
+            cmd_buf.pushConstants(pipeline_layouts_.depth_compute,
+                                  vk::ShaderStageFlagBits::eCompute,
+                                  0, sizeof(Mipmap_level_info), &level_info_);
+            x = static_cast<uint32_t> ((level_info_.dst_mipmap_size.x - 1) / 32 + 1);
+            y = static_cast<uint32_t> ((level_info_.dst_mipmap_size.y - 1) / 32 + 1);
+            cmd_buf.dispatch(x, y, 1);
+        }
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_MIPCHAIN_STOP);
+    }
+
+    // all levels in one hiz_spd.comp dispatch, 64 x 64 texels of level 0 per workgroup
+    void record_mipchain_single_pass_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START, 2);
+
+        data.queries_written |= 3u << QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START);
+
+        // clear the workgroup counter after the last frame's dispatch
+        vk::BufferMemoryBarrier barrier{
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eTransferWrite,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            p_spd_counter_->buf,
+            0, VK_WHOLE_SIZE};
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eTransfer,
+                                vk::DependencyFlags(),
+                                0, nullptr,
+                                1, &barrier,
+                                0, nullptr);
+        cmd_buf.fillBuffer(p_spd_counter_->buf, 0, VK_WHOLE_SIZE, 0);
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                0, nullptr,
+                                1, &barrier,
+                                0, nullptr);
+
+        auto extent = p_swapchain_->curr_extent();
+        spd_consts_.extent.x = extent.width;
+        spd_consts_.extent.y = extent.height;
+        spd_consts_.level_count = p_depth_dst_->mip_levels;
+
+        if (direct_pyramid_) {
+            cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                       pipeline_layouts_.depth_direct_spd_compute,
+                                       0, 1, &desc_set_depth_direct_spd_,
+                                       0, nullptr);
+            cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.spd_direct_compute);
+        } else {
+            cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.spd_compute);
+        }
+        cmd_buf.pushConstants(direct_pyramid_ ? pipeline_layouts_.depth_direct_spd_compute : pipeline_layouts_.depth_compute,
+                              vk::ShaderStageFlagBits::eCompute,
+                              0, sizeof(Spd_consts), &spd_consts_);
+        cmd_buf.dispatch((extent.width - 1) / 64 + 1, (extent.height - 1) / 64 + 1, 1);
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_STOP);
+    }
+
+    // copy_direct.comp and one mipmap_direct.comp dispatch per level into the level views
+    void record_direct_mipchain_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+        cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_MIPCHAIN_START, 2);
+
+        data.queries_written |= 3u << QUERY_COMPUTE_MIPCHAIN_START;
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_MIPCHAIN_START);
+
+        auto extent = p_swapchain_->curr_extent();
+        level_info_ = {};
+        level_info_.dst_mipmap_size = glm::ivec2(extent.width, extent.height);
+        for (uint32_t i = 0; i < p_depth_dst_->mip_levels; i++) {
+            if (i == 0) {
+                cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.copy_direct_compute);
+            } else {
+                // the level above is read by this dispatch
+                vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead};
+                cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                        vk::PipelineStageFlagBits::eComputeShader,
+                                        vk::DependencyFlags(),
+                                        1, &barrier,
+                                        0, nullptr,
+                                        0, nullptr);
+                if (i == 1) cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.mipmap_direct_compute);
+                level_info_.src_image_size = level_info_.dst_mipmap_size;
+                level_info_.dst_mipmap_size = glm::max(glm::ivec2(1), level_info_.dst_mipmap_size / 2);
+            }
+            cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                       pipeline_layouts_.depth_direct_compute,
+                                       0, 1, &desc_sets_depth_direct_[i],
+                                       0, nullptr);
+            cmd_buf.pushConstants(pipeline_layouts_.depth_direct_compute,
+                                  vk::ShaderStageFlagBits::eCompute,
+                                  0, sizeof(Mipmap_level_info), &level_info_);
+            auto x = static_cast<uint32_t> ((level_info_.dst_mipmap_size.x - 1) / 32 + 1);
+            auto y = static_cast<uint32_t> ((level_info_.dst_mipmap_size.y - 1) / 32 + 1);
+            cmd_buf.dispatch(x, y, 1);
+        }
+
+        cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_MIPCHAIN_STOP);
+    }
 
-        visibility_consts_.inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
-        visibility_consts_.use_occluder_culling = static_cast<uint32_t>(p_info_->mode() >= 3);
+    // builds the pyramid of this frame's depth in depth_dst on the compute queue,
+    // the visibility pass reads it right after without a transfer
+    void record_direct_pyramid_(Frame_data &data)
+    {
+        auto &cmd_buf = data.compute_cmd_buffer;
+
+        // the last visibility pass is done reading
+        vk::ImageMemoryBarrier barrier{
+            first_invocation_depth_dst_ ? vk::AccessFlags() : vk::AccessFlagBits::eShaderRead,
+            vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+            first_invocation_depth_dst_ ? vk::ImageLayout::eUndefined : vk::ImageLayout::eGeneral,
+            vk::ImageLayout::eGeneral,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            p_depth_dst_->image,
+            vk::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor,
+            0, p_depth_dst_->mip_levels,
+            0, 1}};
+        cmd_buf.pipelineBarrier(first_invocation_depth_dst_ ? vk::PipelineStageFlagBits::eTopOfPipe : vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                0, nullptr,
+                                0, nullptr,
+                                1, &barrier);
+        first_invocation_depth_dst_ = false;
+
+        if (single_pass_mipchain_()) record_mipchain_single_pass_(data);
+        else record_direct_mipchain_(data);
+
+        // the levels are sampled by the visibility pass
+        barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        barrier.oldLayout = vk::ImageLayout::eGeneral;
+        cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                vk::PipelineStageFlagBits::eComputeShader,
+                                vk::DependencyFlags(),
+                                0, nullptr,
+                                0, nullptr,
+                                1, &barrier);
     }
 
     void generate_text_(Frame_data &data, std::string &text)
@@ -1127,24 +2946,82 @@ private:
             case 2: ss << "multi-draw indirect per instance\nw/ frustum culling\n"; break;
             case 3: ss << "multi-draw indirect per instance\nw/ frustum and occlusion culling\n"; break;
             case 4: ss << "multi-draw indirect per instance\nw/ frustum and occlusion culling (blending enabled)\n"; break;
+            case 5: ss << "multi-draw indirect batched per mesh\nw/ frustum and occlusion culling, rebatched\n"; break;
+            case 6: ss << "multi-draw indirect per instance\nw/ two-phase frustum and occlusion culling\n"; break;
             default:break;
         }
         ss << "------------------------------\n";
-        ss << "onscreen: ";
+        ss << (data.two_phase ? "first phase: " : "onscreen: ");
         ss << base::timestamp_str(data.query_data.data[QUERY_ONSCREEN_STOP] - data.query_data.data[QUERY_ONSCREEN_START]) << " ms\n";
+        if (data.two_phase) {
+            ss << "second phase: ";
+            ss << base::timestamp_str(data.query_data.data[QUERY_SECOND_PHASE_STOP] - data.query_data.data[QUERY_SECOND_PHASE_START]) << " ms\n";
+            ss << "false negatives: " << data.false_negatives << "\n";
+        } else if (mode == 6) {
+            ss << "two-phase unavailable, see --direct-pyramid\n";
+        }
         if (mode > 1) {
-            ss << "depth prepass: ";
-            ss << base::timestamp_str(data.query_data.data[QUERY_DEPTH_STOP] - data.query_data.data[QUERY_DEPTH_START]) << " ms\n";
-            ss << "transfer: ";
-            ss << base::timestamp_str(data.query_data.data[QUERY_TRANSFER_STOP] - data.query_data.data[QUERY_TRANSFER_START]) << " ms\n";
-            ss << "compute mipchain: ";
-            ss << base::timestamp_str(data.query_data.data[QUERY_COMPUTE_MIPCHAIN_STOP] - data.query_data.data[QUERY_COMPUTE_MIPCHAIN_START]) << " ms\n";
+            if (!data.two_phase) {
+                ss << "depth prepass";
+                if (temporal_occluders_active_()) ss << " (temporal occluders)";
+                else if (data.occluders_selected) ss << " (" << data.selected_occluder_count << " selected occluders)";
+                ss << ": ";
+                ss << base::timestamp_str(data.query_data.data[QUERY_DEPTH_STOP] - data.query_data.data[QUERY_DEPTH_START]) << " ms\n";
+            }
+            if (!direct_pyramid_) {
+                ss << "transfer: ";
+                ss << base::timestamp_str(data.query_data.data[QUERY_TRANSFER_STOP] - data.query_data.data[QUERY_TRANSFER_START]) << " ms\n";
+            }
+            bool single_pass = single_pass_mipchain_();
+            auto mipchain_start = single_pass ? QUERY_COMPUTE_MIPCHAIN_SINGLE_PASS_START : QUERY_COMPUTE_MIPCHAIN_START;
+            ss << "compute mipchain";
+            if (single_pass) ss << " (single pass)";
+            if (direct_pyramid_) ss << " (direct)";
+            ss << ": ";
+            ss << base::timestamp_str(data.query_data.data[mipchain_start + 1] - data.query_data.data[mipchain_start]) << " ms\n";
             ss << "compute visibility: ";
             ss << base::timestamp_str(data.query_data.data[QUERY_COMPUTE_VISIBILITY_STOP] - data.query_data.data[QUERY_COMPUTE_VISIBILITY_START]) << " ms\n";
+            ss << "visibility flips: +" << data.became_visible << " / -" << data.became_hidden << "\n";
+            if (lods_active_() && mode != 5) ss << "lods: " << p_info_->lod_error << " px error\n";
+            if (triangle_culling_active_()) {
+                ss << "compute triangles: ";
+                ss << base::timestamp_str(data.query_data.data[QUERY_COMPUTE_TRIANGLES_STOP] - data.query_data.data[QUERY_COMPUTE_TRIANGLES_START]) << " ms\n";
+                ss << "visible triangles: " << data.visible_triangles << " / " << data.tested_triangles << ", "
+                    << data.whole_draws << " instances drawn whole\n";
+            } else if (cluster_culling_active_()) {
+                ss << "compute clusters: ";
+                ss << base::timestamp_str(data.query_data.data[QUERY_COMPUTE_CLUSTERS_STOP] - data.query_data.data[QUERY_COMPUTE_CLUSTERS_START]) << " ms\n";
+                ss << "visible clusters: " << data.visible_clusters << " / " << data.tested_clusters << " of "
+                    << p_model_->inst_cluster_total << "\n";
+            } else if (compaction_active_()) {
+                ss << "visible draws (compacted): " << visible_draw_count_ << " / "
+                    << p_model_->mdi_no_batching_cmd_draw_info.draw_count << "\n";
+            }
+            if (rebatching_active_()) {
+                ss << "compute rebatch: ";
+                ss << base::timestamp_str(data.query_data.data[QUERY_COMPUTE_REBATCH_STOP] - data.query_data.data[QUERY_COMPUTE_REBATCH_START]) << " ms\n";
+                ss << "draws (rebatched): " << p_model_->mesh_cmd_draw_info.draw_count << " / "
+                    << p_model_->mdi_no_batching_cmd_draw_info.draw_count << "\n";
+            }
         }
         text = ss.str();
     }
 
+    void draw_text_(vk::CommandBuffer &cmd_buf)
+    {
+        const vk::DeviceSize vb_offset{0};
+        cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                   pipeline_layouts_.text,
+                                   0, 1,
+                                   &desc_set_font_tex_,
+                                   0, nullptr);
+        cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                             pipelines_.simple_text);
+        cmd_buf.bindVertexBuffers(0, 1, &p_text_overlay_->p_vert_buf->buf, &vb_offset);
+        cmd_buf.bindIndexBuffer(p_text_overlay_->p_idx_buf->buf, 0, vk::IndexType::eUint32);
+        cmd_buf.drawIndexed(p_text_overlay_->draw_index_count, 1, 0, 0, 0);
+    }
+
     std::string text_overlay_content_;
     bool first_invocation_depth_staging_ = true;
     bool first_invocation_depth_dst_ = true;
@@ -1155,16 +3032,37 @@ private:
 
         auto &data = frame_data_vector_[frame_data_idx_];
         auto &back = acquired_back_buf_;
+        bool two_phase = false;
+
+        // the last frame of this frame data is done on both queues
+        base::assert_success(p_dev_->dev.waitForFences(1,
+                                                       &data.graphics_submit_fence,
+                                                       VK_TRUE,
+                                                       UINT64_MAX));
+        p_dev_->dev.resetFences(1, &data.graphics_submit_fence);
+        base::assert_success(p_dev_->dev.waitForFences(1,
+                                                       &data.compute_submit_fence,
+                                                       VK_TRUE,
+                                                       UINT64_MAX));
+        p_dev_->dev.resetFences(1, &data.compute_submit_fence);
+        read_back_(frame_data_idx_);
+        data.queries_written = 0;
+        data.mode = p_info_->mode();
+        data.read_back_pending = true;
 
         // graphics
         {
-            int query_count = 0;
-
-            base::assert_success(p_dev_->dev.waitForFences(1,
-                                                           &data.graphics_submit_fence,
-                                                           VK_TRUE,
-                                                           UINT64_MAX));
-            p_dev_->dev.resetFences(1, &data.graphics_submit_fence);
+            // commands compacted or rebatched by the last frame, its semaphore is waited either way
+            int32_t compacted_idx = compacted_frame_data_idx_;
+            compacted_frame_data_idx_ = -1;
+            bool draw_compacted = compacted_idx >= 0 && frame_data_vector_[compacted_idx].compacted;
+            bool draw_rebatched = compacted_idx >= 0 && frame_data_vector_[compacted_idx].rebatched;
+            bool draw_clusters = compacted_idx >= 0 && frame_data_vector_[compacted_idx].clusters_culled;
+            bool draw_triangles = compacted_idx >= 0 && frame_data_vector_[compacted_idx].triangles_culled;
+            two_phase = two_phase_active_();
+
+            if (two_phase && two_phase_framebuffers_.empty()) create_two_phase_framebuffers_();
+            select_occluders_(data);
 
             update_uniforms_(data);
             if (fps_counter_.frame_count() == 0) {
@@ -1177,7 +3075,7 @@ private:
 
             // transfer
 
-            if (!first_invocation_depth_staging_) {
+            if (!direct_pyramid_ && !first_invocation_depth_staging_) {
                 cmd_buf.resetQueryPool(data.query_pool, QUERY_TRANSFER_START, 2);
 
                 // depth_dst layout from shader read to transfer dst
@@ -1202,7 +3100,7 @@ private:
 
                 // copy depth_staging from last frame to depth_dst
 
-                query_count += 2;
+                data.queries_written |= 3u << QUERY_TRANSFER_START;
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eAllCommands, data.query_pool, QUERY_TRANSFER_START);
 
                 auto extent = p_swapchain_->curr_extent();
@@ -1267,8 +3165,8 @@ private:
             cmd_buf.setViewport(0, 1, &p_swapchain_->onscreen_viewport);
             cmd_buf.setScissor(0, 1, &p_swapchain_->onscreen_scissor);
 
-            // depth
-            {
+            // depth, the first phase replaces it in two-phase frames
+            if (!two_phase) {
                 cmd_buf.resetQueryPool(data.query_pool, QUERY_DEPTH_START, 2);
 
                 auto &rp_begin = p_rp_depth_->rp_begin;
@@ -1276,26 +3174,47 @@ private:
                 rp_begin.framebuffer = depth_prepass_framebuffer_;
                 cmd_buf.beginRenderPass(&rp_begin, vk::SubpassContents::eInline);
 
-                query_count += 2;
+                data.queries_written |= 3u << QUERY_DEPTH_START;
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_DEPTH_START);
 
                 cmd_buf.bindIndexBuffer(p_model_->p_geometries->p_idx_buffer->buf, 0, vk::IndexType::eUint32);
-                cmd_buf.bindVertexBuffers(0, 1, &p_model_->p_geometries->p_vert_buffer->buf, &vb_offset);
-                cmd_buf.bindVertexBuffers(1, 1, &p_model_->p_inst_attribs_buffer->buf, &vb_offset);
-
+                cmd_buf.bindVertexBuffers(0, 1,
+                                          position_stream_active_() ?
+                                          &p_model_->p_geometries->p_pos_buffer->buf :
+                                          &p_model_->p_geometries->p_vert_buffer->buf,
+                                          &vb_offset);
+                cmd_buf.bindVertexBuffers(1, 1, &p_model_->p_inst_ids_buffer->buf, &vb_offset);
+
+                vk::DescriptorSet depth_desc_sets[2] = {
+                    data.desc_set,
+                    p_model_->desc_set
+                };
                 cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
                                            pipeline_layouts_.depth,
-                                           0, 1,
-                                           &data.desc_set,
+                                           0, 2,
+                                           depth_desc_sets,
                                            1, &data.dynamic_offset);
 
                 cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
                                      pipelines_.depth);
 
-                cmd_buf.drawIndexedIndirect(p_model_->mdi_cmd_draw_info.indirect_cmd_buffer,
-                                            p_model_->mdi_cmd_draw_info.offset,
-                                            p_model_->mdi_cmd_draw_info.draw_count,
-                                            p_model_->mdi_cmd_draw_info.stride);
+                // the instances visible in the last frames, the selected occluders,
+                // or every instance batched
+                if (temporal_occluders_active_())
+                    cmd_buf.drawIndexedIndirect(p_occluder_cmd_buffer_->buf,
+                                                p_model_->mdi_no_batching_cmd_draw_info.offset,
+                                                p_model_->mdi_no_batching_cmd_draw_info.draw_count,
+                                                p_model_->mdi_no_batching_cmd_draw_info.stride);
+                else if (data.occluders_selected)
+                    cmd_buf.drawIndexedIndirect(p_selected_occluder_buffer_->buf,
+                                                frame_data_idx_ * occluder_range_size_(),
+                                                data.selected_occluder_count,
+                                                p_model_->mdi_no_batching_cmd_draw_info.stride);
+                else
+                    cmd_buf.drawIndexedIndirect(p_model_->mdi_cmd_draw_info.indirect_cmd_buffer,
+                                                p_model_->mdi_cmd_draw_info.offset,
+                                                p_model_->mdi_cmd_draw_info.draw_count,
+                                                p_model_->mdi_cmd_draw_info.stride);
 
                 // write timestamp
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eLateFragmentTests, data.query_pool, QUERY_DEPTH_STOP);
@@ -1303,22 +3222,38 @@ private:
                 cmd_buf.endRenderPass();
             }
 
-            // simple
+            // simple, or the first phase drawing last frame's visible instances
 
             {
                 cmd_buf.resetQueryPool(data.query_pool, QUERY_ONSCREEN_START, 2);
 
-                auto &rp_begin = p_rp_simple_->rp_begin;
+                if (two_phase) {
+                    // the commands were written by the compute submit
+                    // the last second phase waited on
+                    vk::MemoryBarrier barrier{vk::AccessFlagBits::eIndirectCommandRead,
+                        vk::AccessFlagBits::eIndirectCommandRead};
+                    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect,
+                                            vk::PipelineStageFlagBits::eDrawIndirect,
+                                            vk::DependencyFlags(),
+                                            1, &barrier,
+                                            0, nullptr,
+                                            0, nullptr);
+                }
+
+                auto &rp_begin = two_phase ? p_rp_first_phase_->rp_begin : p_rp_simple_->rp_begin;
                 rp_begin.renderArea.extent = p_swapchain_->curr_extent();
-                rp_begin.framebuffer = p_swapchain_->framebuffers[back.swapchain_image_idx];
+                rp_begin.framebuffer = two_phase ? two_phase_framebuffers_[back.swapchain_image_idx] :
+                    p_swapchain_->framebuffers[back.swapchain_image_idx];
                 cmd_buf.beginRenderPass(&rp_begin, vk::SubpassContents::eInline);
 
-                query_count += 2;
+                data.queries_written |= 3u << QUERY_ONSCREEN_START;
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_ONSCREEN_START);
 
                 cmd_buf.bindIndexBuffer(p_model_->p_geometries->p_idx_buffer->buf, 0, vk::IndexType::eUint32);
                 cmd_buf.bindVertexBuffers(0, 1, &p_model_->p_geometries->p_vert_buffer->buf, &vb_offset);
-                cmd_buf.bindVertexBuffers(1, 1, &p_model_->p_inst_attribs_buffer->buf, &vb_offset);
+                cmd_buf.bindVertexBuffers(1, 1,
+                                          draw_rebatched ? &p_rebatched_ids_buffer_->buf : &p_model_->p_inst_ids_buffer->buf,
+                                          &vb_offset);
 
                 vk::DescriptorSet desc_sets[2] = {
                     data.desc_set,
@@ -1330,7 +3265,7 @@ private:
                                            desc_sets,
                                            1, &data.dynamic_offset);
 
-                if (p_info_->mode() < 4)
+                if (p_info_->mode() != 4)
                     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
                                          pipelines_.simple);
                 else
@@ -1338,30 +3273,63 @@ private:
                                          pipelines_.simple_blending);
 
 
-                if (p_info_->mode() == 1) {
+                if (draw_rebatched) {
+                    cmd_buf.drawIndexedIndirect(p_rebatched_cmd_buffer_->buf,
+                                                p_model_->mesh_cmd_draw_info.offset,
+                                                p_model_->mesh_cmd_draw_info.draw_count,
+                                                p_model_->mesh_cmd_draw_info.stride);
+                } else if (p_info_->mode() == 1 || p_info_->mode() == 5) {
+                    // mode 5 until the first rebatched cmds
                     cmd_buf.drawIndexedIndirect(p_model_->mdi_cmd_draw_info.indirect_cmd_buffer,
                                                 p_model_->mdi_cmd_draw_info.offset,
                                                 p_model_->mdi_cmd_draw_info.draw_count,
                                                 p_model_->mdi_cmd_draw_info.stride);
-                } else if (p_info_->mode() >= 2) {
+                } else if (draw_triangles) {
+                    // the culled indices, then the instances drawn whole
+                    const uint32_t inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+                    const vk::DeviceSize count_offset = compacted_idx * triangle_count_stride_ * sizeof(uint32_t);
+                    cmd_buf.bindIndexBuffer(p_triangle_idx_buffer_->buf, 0, vk::IndexType::eUint32);
+                    p_draw_indexed_indirect_count_(static_cast<VkCommandBuffer>(cmd_buf),
+                                                   static_cast<VkBuffer>(p_triangle_cmd_buffer_->buf),
+                                                   0,
+                                                   static_cast<VkBuffer>(p_triangle_count_buffer_->buf),
+                                                   count_offset,
+                                                   inst_total,
+                                                   sizeof(vk::DrawIndexedIndirectCommand));
+                    cmd_buf.bindIndexBuffer(p_model_->p_geometries->p_idx_buffer->buf, 0, vk::IndexType::eUint32);
+                    p_draw_indexed_indirect_count_(static_cast<VkCommandBuffer>(cmd_buf),
+                                                   static_cast<VkBuffer>(p_triangle_cmd_buffer_->buf),
+                                                   inst_total * sizeof(vk::DrawIndexedIndirectCommand),
+                                                   static_cast<VkBuffer>(p_triangle_count_buffer_->buf),
+                                                   count_offset + sizeof(uint32_t),
+                                                   inst_total,
+                                                   sizeof(vk::DrawIndexedIndirectCommand));
+                } else if (draw_clusters) {
+                    p_draw_indexed_indirect_count_(static_cast<VkCommandBuffer>(cmd_buf),
+                                                   static_cast<VkBuffer>(p_cluster_cmd_buffer_->buf),
+                                                   0,
+                                                   static_cast<VkBuffer>(p_cluster_count_buffer_->buf),
+                                                   compacted_idx * 2 * sizeof(uint32_t),
+                                                   std::max(p_model_->inst_cluster_total, 1u),
+                                                   sizeof(vk::DrawIndexedIndirectCommand));
+                } else if (draw_compacted) {
+                    p_draw_indexed_indirect_count_(static_cast<VkCommandBuffer>(cmd_buf),
+                                                   static_cast<VkBuffer>(p_compacted_cmd_buffer_->buf),
+                                                   0,
+                                                   static_cast<VkBuffer>(p_draw_count_buffer_->buf),
+                                                   compacted_idx * sizeof(uint32_t),
+                                                   p_model_->mdi_no_batching_cmd_draw_info.draw_count,
+                                                   p_model_->mdi_no_batching_cmd_draw_info.stride);
+                } else {
                     cmd_buf.drawIndexedIndirect(p_model_->mdi_no_batching_cmd_draw_info.indirect_cmd_buffer,
                                                 p_model_->mdi_no_batching_cmd_draw_info.offset,
                                                 p_model_->mdi_no_batching_cmd_draw_info.draw_count,
                                                 p_model_->mdi_no_batching_cmd_draw_info.stride);
                 }
 
-                // text
+                // text, drawn by the second phase in two-phase frames
 
-                cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                           pipeline_layouts_.text,
-                                           0, 1,
-                                           &desc_set_font_tex_,
-                                           0, nullptr);
-                cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics,
-                                     pipelines_.simple_text);
-                cmd_buf.bindVertexBuffers(0, 1, &p_text_overlay_->p_vert_buf->buf, &vb_offset);
-                cmd_buf.bindIndexBuffer(p_text_overlay_->p_idx_buf->buf, 0, vk::IndexType::eUint32);
-                cmd_buf.drawIndexed(p_text_overlay_->draw_index_count, 1, 0, 0, 0);
+                if (!two_phase) draw_text_(cmd_buf);
 
                 // write timestamp
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eColorAttachmentOutput, data.query_pool, QUERY_ONSCREEN_STOP);
@@ -1371,83 +3339,90 @@ private:
 
             cmd_buf.end();
 
-            const vk::PipelineStageFlags wait_stages{vk::PipelineStageFlagBits::eColorAttachmentOutput};
-            auto submit_info = vk::SubmitInfo(1, &back.swapchain_image_acquire_semaphore,
-                                              &wait_stages,
+            // offscreen images need no acquire
+            std::vector<vk::Semaphore> wait_semaphores;
+            std::vector<vk::PipelineStageFlags> wait_stages;
+            if (!headless_) {
+                wait_semaphores.push_back(back.swapchain_image_acquire_semaphore);
+                wait_stages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            }
+            if (compacted_idx >= 0) {
+                wait_semaphores.push_back(frame_data_vector_[compacted_idx].compaction_semaphore);
+                wait_stages.push_back(vk::PipelineStageFlagBits::eDrawIndirect);
+            }
+            auto submit_info = vk::SubmitInfo(static_cast<uint32_t>(wait_semaphores.size()), wait_semaphores.data(),
+                                              wait_stages.data(),
                                               1, &cmd_buf,
                                               1, &back.onscreen_render_semaphore);
 
+            // the second phase signals the fence in two-phase frames
             base::assert_success(p_dev_->graphics_queue.submit(
                 1,
                 &submit_info,
-                data.graphics_submit_fence));
-
-            // get query results
-            base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
-                                                       static_cast<VkQueryPool>(data.query_pool),
-                                                       0, query_count,
-                                                       sizeof(uint32_t) * query_count,
-                                                       &data.query_data,
-                                                       sizeof(uint32_t),
-                                                       static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
+                two_phase ? vk::Fence() : data.graphics_submit_fence));
         }
 
         // compute
 
         {
-            base::assert_success(p_dev_->dev.waitForFences(1,
-                                                           &data.compute_submit_fence,
-                                                           VK_TRUE,
-                                                           UINT64_MAX));
-            p_dev_->dev.resetFences(1, &data.compute_submit_fence);
+            data.compacted = false;
+            data.rebatched = false;
+            data.clusters_culled = false;
+            data.triangles_culled = false;
+            data.two_phase = two_phase;
 
             auto &cmd_buf = data.compute_cmd_buffer;
             cmd_buf.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
 
-            cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_MIPCHAIN_START, 2);
-
-            int query_count = 2;
-            cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_MIPCHAIN_START);
-
-            cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
-                                       pipeline_layouts_.depth_compute,
-                                       0, 1, &desc_set_depth_staging_,
-                                       0, nullptr);
-            // copy pipeline
-            cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.copy_compute);
-            update_push_constants_(0);
-            cmd_buf.pushConstants(pipeline_layouts_.depth_compute,
-                                  vk::ShaderStageFlagBits::eCompute,
-                                  0, sizeof(Mipmap_level_info), &level_info_);
-            auto x = static_cast<uint32_t> ((level_info_.dst_mipmap_size.x - 1) / 32 + 1);
-            auto y = static_cast<uint32_t> ((level_info_.dst_mipmap_size.y - 1) / 32 + 1);
-            cmd_buf.dispatch(x, y, 1);
-
-            // mipmap pipeline
-            cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.mipmap_compute);
-            for (int i = 1; i < p_depth_dst_->mip_levels; i++) {
-                if (first_invocation_depth_staging_) first_invocation_depth_staging_ = false;
-                update_push_constants_(i);
-                cmd_buf.pushConstants(pipeline_layouts_.depth_compute,
-                                      vk::ShaderStageFlagBits::eCompute,
-                                      0, sizeof(Mipmap_level_info), &level_info_);
-                x = static_cast<uint32_t> ((level_info_.dst_mipmap_size.x - 1) / 32 + 1);
-                y = static_cast<uint32_t> ((level_info_.dst_mipmap_size.y - 1) / 32 + 1);
-                cmd_buf.dispatch(x, y, 1);
+            if (direct_pyramid_) {
+                record_direct_pyramid_(data);
+            } else {
+                cmd_buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                                           pipeline_layouts_.depth_compute,
+                                           0, 1, &desc_set_depth_staging_,
+                                           0, nullptr);
+                first_invocation_depth_staging_ = false;
+                if (single_pass_mipchain_()) record_mipchain_single_pass_(data);
+                else record_mipchain_(data);
             }
 
-            cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, data.query_pool, QUERY_COMPUTE_MIPCHAIN_STOP);
-
             // visibility pipeline
 
             if (!first_invocation_depth_dst_) {
                 cmd_buf.resetQueryPool(data.query_pool, QUERY_COMPUTE_VISIBILITY_START, 2);
 
-                query_count += 2;
+                data.queries_written |= 3u << QUERY_COMPUTE_VISIBILITY_START;
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_VISIBILITY_START);
 
-                // read depth_dst texture from the last tranfer operations
-                cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_.visibility_compute);
+                record_history_clear_(data);
+
+                data.triangles_culled = triangle_culling_active_();
+                data.clusters_culled = cluster_culling_active_() && !data.triangles_culled;
+                data.compacted = compaction_active_() && !data.clusters_culled && !data.triangles_culled;
+                if (data.compacted || data.two_phase) {
+                    // clear the count of this frame data, last read three frames ago
+                    cmd_buf.fillBuffer(p_draw_count_buffer_->buf, frame_data_idx_ * sizeof(uint32_t), sizeof(uint32_t), 0);
+                    vk::BufferMemoryBarrier barrier{
+                        vk::AccessFlagBits::eTransferWrite,
+                        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        VK_QUEUE_FAMILY_IGNORED,
+                        p_draw_count_buffer_->buf,
+                        frame_data_idx_ * sizeof(uint32_t), sizeof(uint32_t)};
+                    cmd_buf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                            vk::PipelineStageFlagBits::eComputeShader,
+                                            vk::DependencyFlags(),
+                                            0, nullptr,
+                                            1, &barrier,
+                                            0, nullptr);
+                }
+
+                // read depth_dst texture from the last tranfer operations,
+                // or from the direct pyramid recorded above
+                auto visibility_pipeline = pipelines_.visibility_compute;
+                if (data.compacted) visibility_pipeline = pipelines_.visibility_compact_compute;
+                if (data.two_phase) visibility_pipeline = pipelines_.visibility_two_phase_compute;
+                cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, visibility_pipeline);
                 vk::DescriptorSet desc_sets[2] = {
                     desc_set_visibility_,
                     data.desc_set
@@ -1456,38 +3431,51 @@ private:
                                            pipeline_layouts_.visibility_compute,
                                            0, 2, desc_sets,
                                            1, &data.dynamic_offset);
+                visibility_consts_.inst_total = p_model_->mdi_no_batching_cmd_draw_info.draw_count;
+                visibility_consts_.use_occluder_culling = static_cast<uint32_t>(p_info_->mode() >= 3);
+                visibility_consts_.draw_count_idx = frame_data_idx_;
+                visibility_consts_.occluder_history_mask = occluder_history_mask_();
+                visibility_consts_.lod_error = lods_active_() ? p_info_->lod_error : 0.f;
                 cmd_buf.pushConstants(pipeline_layouts_.visibility_compute,
                                       vk::ShaderStageFlagBits::eCompute,
                                       0, sizeof(Visibility_consts), &visibility_consts_);
-                x = (p_model_->mdi_no_batching_cmd_draw_info.draw_count - 1) / 64 + 1;
+                auto x = (p_model_->mdi_no_batching_cmd_draw_info.draw_count - 1) / 64 + 1;
                 cmd_buf.dispatch(x, 1, 1);
 
                 cmd_buf.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, data.query_pool, QUERY_COMPUTE_VISIBILITY_STOP);
+                occluders_written_ = true;
+
+                if (rebatching_active_()) record_rebatch_(data);
+                if (data.clusters_culled) record_cluster_cull_(data);
+                if (data.triangles_culled) record_triangle_cull_(data);
             }
 
             cmd_buf.end();
 
+            std::vector<vk::Semaphore> signal_semaphores;
+            if (data.two_phase) signal_semaphores.push_back(data.second_phase_semaphore);
+            else if (!headless_) signal_semaphores.push_back(back.compute_complete_semaphore);
+            if (data.compacted || data.rebatched || data.clusters_culled || data.triangles_culled) {
+                signal_semaphores.push_back(data.compaction_semaphore);
+                compacted_frame_data_idx_ = static_cast<int32_t>(frame_data_idx_);
+            }
             const vk::PipelineStageFlags wait_stages{vk::PipelineStageFlagBits::eComputeShader};
             auto submit_info = vk::SubmitInfo(1, &back.onscreen_render_semaphore,
                                               &wait_stages,
                                               1, &cmd_buf,
-                                              1, &back.compute_complete_semaphore);
+                                              static_cast<uint32_t>(signal_semaphores.size()), signal_semaphores.data());
 
             base::assert_success(p_dev_->compute_queue.submit(
                 1,
                 &submit_info,
                 data.compute_submit_fence));
-
-            // get query results
-            base::assert_success(vkGetQueryPoolResults(static_cast<VkDevice>(p_dev_->dev),
-                                                       static_cast<VkQueryPool>(data.query_pool),
-                                                       QUERY_COMPUTE_MIPCHAIN_START, query_count,
-                                                       sizeof(uint32_t) * query_count,
-                                                       &data.query_data.data[QUERY_COMPUTE_MIPCHAIN_START],
-                                                       sizeof(uint32_t),
-                                                       static_cast<VkQueryResultFlagBits>(vk::QueryResultFlagBits::eWait)));
         }
 
+        // second phase
+
+        if (two_phase) draw_second_phase_(data);
+
         frame_data_idx_ = (frame_data_idx_ + 1) % frame_data_count_;
     }
 };
+#undef MSG_PREFIX
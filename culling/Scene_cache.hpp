@@ -0,0 +1,454 @@
+#pragma once
+#include "Instance_data.hpp"
+#include "Aabb.hpp"
+#include "Mapped_file.hpp"
+#include "Mesh_packer.hpp"
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#define MSG_PREFIX "-- SCENE_CACHE: "
+
+// material of the scene, the texture file names as referenced by the scene,
+// empty when the material has none
+struct Scene_material
+{
+    Material_properties props;
+    std::string textures[4]; // diffuse, opacity, specular, normal
+};
+
+// identifies the import a cache was written from
+struct Scene_cache_key
+{
+    uint64_t source_size{0};
+    int64_t source_mtime{0};
+    uint32_t import_hash{0}; // vertex layout, import flags, mesh optimization, lods and struct sizes
+
+    // an empty source_path leaves the source size and time 0, as for packages
+    Scene_cache_key(const std::string &source_path,
+                    const base::Vertex_layout &layout,
+                    int ai_flags,
+                    bool optimized_meshes,
+                    uint32_t lod_count)
+    {
+        struct stat st;
+        if (!source_path.empty() && stat(source_path.c_str(), &st) == 0) {
+            source_size = static_cast<uint64_t>(st.st_size);
+            source_mtime = static_cast<int64_t>(st.st_mtime);
+        }
+        import_hash = import_hash_of(layout, ai_flags, optimized_meshes, lod_count);
+    }
+
+    static uint32_t import_hash_of(const base::Vertex_layout &layout,
+                                   int ai_flags,
+                                   bool optimized_meshes,
+                                   uint32_t lod_count)
+    {
+        // fnv-1a
+        uint32_t res = 2166136261u;
+        auto mix = [&res](uint32_t v) {
+            res = (res ^ v) * 16777619u;
+        };
+        for (auto comp : layout.comps) mix(static_cast<uint32_t>(comp));
+        mix(static_cast<uint32_t>(ai_flags));
+        mix(optimized_meshes ? 1u : 0u);
+        mix(lod_count);
+        mix(sizeof(base::Mesh));
+        mix(sizeof(base::Mesh_lod));
+        mix(sizeof(base::Mesh_cluster));
+        mix(sizeof(Instance_properties));
+        mix(sizeof(Material_properties));
+        return res;
+    }
+};
+
+// versioned binary cache of an imported scene, written next to the source.
+// the sections are 16 byte aligned and read in place from a read only mapping,
+// the packed vertices and indices are uploaded straight from it
+//   header       with the vertex layout
+//   vertices     packed as the vertex layout
+//   indices      uint32_t
+//   meshes       base::Mesh
+//   mesh remap   uint32_t per scene mesh, the mesh sharing its geometry
+//   mesh lods    base::MAX_MESH_LODS base::Mesh_lod per mesh
+//   clusters     base::Mesh_cluster
+//   cluster offsets uint32_t per mesh and one more, its first cluster
+//   instances    Instance_properties, transforms and mesh aabbs
+//   world bounds base::Aabb per instance, without the model matrix
+//   materials    Material_properties and the offsets of their texture names
+//   strings      null terminated texture names
+//
+// a package is the same file baked offline by culling_bake, it does not
+// depend on the source file and is loaded in place of the import
+class Scene_cache
+{
+public:
+    static const uint32_t VERSION = 6;
+
+    static const uint32_t FLAG_PACKAGE = 1;
+    static const uint32_t FLAG_OPTIMIZED_MESHES = 2;
+
+    static std::string path_of(const std::string &source_path)
+    {
+        return source_path + ".cache";
+    }
+
+    static std::string package_path_of(const std::string &source_path)
+    {
+        return source_path + ".pkg";
+    }
+
+    // maps the cache, invalid when it is missing, stale or of another version
+    Scene_cache(const std::string &path,
+                const Scene_cache_key &key) :
+        file_(path)
+    {
+        auto p_header = map_(path);
+        if (!p_header) return;
+        if (p_header->source_size != key.source_size ||
+            p_header->source_mtime != key.source_mtime ||
+            p_header->import_hash != key.import_hash) {
+            std::cout << MSG_PREFIX << "stale " << path << std::endl;
+            return;
+        }
+        p_header_ = p_header;
+    }
+
+    // maps a package, invalid when it is missing or of another version,
+    // the caller checks import_hash() against its build
+    explicit Scene_cache(const std::string &path) :
+        file_(path)
+    {
+        auto p_header = map_(path);
+        if (!p_header) return;
+        if (!(p_header->flags & FLAG_PACKAGE)) {
+            std::cout << MSG_PREFIX << "not a package " << path << std::endl;
+            return;
+        }
+        p_header_ = p_header;
+    }
+
+    bool valid() const
+    {
+        return p_header_ != nullptr;
+    }
+
+    uint32_t import_hash() const
+    {
+        return p_header_->import_hash;
+    }
+
+    uint32_t flags() const
+    {
+        return p_header_->flags;
+    }
+
+    base::Vertex_layout layout() const
+    {
+        std::vector<base::Vertex_component> comps;
+        for (uint32_t i = 0; i < p_header_->layout_comp_count; i++) {
+            comps.push_back(static_cast<base::Vertex_component>(p_header_->layout_comps[i]));
+        }
+        return base::Vertex_layout(comps);
+    }
+
+    const void *vertices() const
+    {
+        return section_(SECTION_VERTICES);
+    }
+
+    uint64_t vertex_bytes() const
+    {
+        return p_header_->vertex_bytes;
+    }
+
+    const uint32_t *indices() const
+    {
+        return reinterpret_cast<const uint32_t *>(section_(SECTION_INDICES));
+    }
+
+    uint32_t index_count() const
+    {
+        return p_header_->index_count;
+    }
+
+    const base::Mesh *meshes() const
+    {
+        return reinterpret_cast<const base::Mesh *>(section_(SECTION_MESHES));
+    }
+
+    uint32_t mesh_count() const
+    {
+        return p_header_->mesh_count;
+    }
+
+    const uint32_t *mesh_remap() const
+    {
+        return reinterpret_cast<const uint32_t *>(section_(SECTION_MESH_REMAP));
+    }
+
+    uint32_t scene_mesh_count() const
+    {
+        return p_header_->scene_mesh_count;
+    }
+
+    const base::Mesh_lod *mesh_lods() const
+    {
+        return reinterpret_cast<const base::Mesh_lod *>(section_(SECTION_MESH_LODS));
+    }
+
+    const base::Mesh_cluster *clusters() const
+    {
+        return reinterpret_cast<const base::Mesh_cluster *>(section_(SECTION_CLUSTERS));
+    }
+
+    uint32_t cluster_count() const
+    {
+        return p_header_->cluster_count;
+    }
+
+    // mesh_count() + 1 offsets into clusters()
+    const uint32_t *cluster_offsets() const
+    {
+        return reinterpret_cast<const uint32_t *>(section_(SECTION_CLUSTER_OFFSETS));
+    }
+
+    // the simplified levels the meshes were packed with
+    uint32_t lod_count() const
+    {
+        return p_header_->lod_count;
+    }
+
+    const Instance_properties *instances() const
+    {
+        return reinterpret_cast<const Instance_properties *>(section_(SECTION_INSTANCES));
+    }
+
+    uint32_t instance_count() const
+    {
+        return p_header_->instance_count;
+    }
+
+    const base::Aabb *world_bounds() const
+    {
+        return reinterpret_cast<const base::Aabb *>(section_(SECTION_WORLD_BOUNDS));
+    }
+
+    std::vector<Scene_material> materials() const
+    {
+        auto p_cached = reinterpret_cast<const Cached_material *>(section_(SECTION_MATERIALS));
+        auto p_strings = reinterpret_cast<const char *>(section_(SECTION_STRINGS));
+        std::vector<Scene_material> res(p_header_->material_count);
+        for (uint32_t i = 0; i < p_header_->material_count; i++) {
+            res[i].props = p_cached[i].props;
+            for (int t = 0; t < 4; t++) {
+                uint32_t offset = p_cached[i].textures[t];
+                if (offset < p_header_->string_bytes) res[i].textures[t] = p_strings + offset;
+            }
+        }
+        return res;
+    }
+
+    // writes through a temporary file, returns false when the cache cannot be written
+    static bool write(const std::string &path,
+                      const Scene_cache_key &key,
+                      const base::Vertex_layout &layout,
+                      uint32_t flags,
+                      const std::vector<float> &vertices,
+                      const std::vector<uint32_t> &indices,
+                      const std::vector<base::Mesh> &meshes,
+                      const std::vector<uint32_t> &mesh_remap,
+                      const std::vector<base::Mesh_lod> &mesh_lods,
+                      uint32_t lod_count,
+                      const std::vector<base::Mesh_cluster> &clusters,
+                      const std::vector<uint32_t> &cluster_offsets,
+                      const std::vector<Instance_properties> &instances,
+                      const std::vector<base::Aabb> &world_bounds,
+                      const std::vector<Scene_material> &materials)
+    {
+        if (layout.comps.size() > MAX_LAYOUT_COMPS || world_bounds.size() != instances.size() ||
+            mesh_lods.size() != meshes.size() * base::MAX_MESH_LODS ||
+            cluster_offsets.size() != meshes.size() + 1) return false;
+
+        std::string strings;
+        std::vector<Cached_material> cached(materials.size());
+        for (size_t i = 0; i < materials.size(); i++) {
+            cached[i].props = materials[i].props;
+            for (int t = 0; t < 4; t++) {
+                cached[i].textures[t] = NO_TEXTURE;
+                if (materials[i].textures[t].empty()) continue;
+                cached[i].textures[t] = static_cast<uint32_t>(strings.size());
+                strings.append(materials[i].textures[t]);
+                strings.push_back('\0');
+            }
+        }
+
+        Header header{};
+        memcpy(header.magic, magic_(), sizeof(header.magic));
+        header.version = VERSION;
+        header.import_hash = key.import_hash;
+        header.source_size = key.source_size;
+        header.source_mtime = key.source_mtime;
+        header.flags = flags;
+        header.layout_comp_count = static_cast<uint32_t>(layout.comps.size());
+        for (size_t i = 0; i < layout.comps.size(); i++) {
+            header.layout_comps[i] = static_cast<uint32_t>(layout.comps[i]);
+        }
+        header.vertex_bytes = vertices.size() * sizeof(float);
+        header.index_count = static_cast<uint32_t>(indices.size());
+        header.mesh_count = static_cast<uint32_t>(meshes.size());
+        header.scene_mesh_count = static_cast<uint32_t>(mesh_remap.size());
+        header.lod_count = lod_count;
+        header.cluster_count = static_cast<uint32_t>(clusters.size());
+        header.instance_count = static_cast<uint32_t>(instances.size());
+        header.material_count = static_cast<uint32_t>(materials.size());
+        header.string_bytes = strings.size();
+
+        const void *data[SECTION_COUNT] = {
+            vertices.data(), indices.data(), meshes.data(), mesh_remap.data(), mesh_lods.data(),
+            clusters.data(), cluster_offsets.data(),
+            instances.data(), world_bounds.data(), cached.data(), strings.data()
+        };
+        uint64_t sizes[SECTION_COUNT];
+        section_sizes_(header, sizes);
+        uint64_t offset = align_(sizeof(Header));
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            header.offsets[i] = offset;
+            offset = align_(offset + sizes[i]);
+        }
+
+        std::string tmp_path = path + ".tmp";
+        {
+            std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) return false;
+            const char padding[ALIGNMENT] = {};
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            uint64_t written = sizeof(header);
+            for (int i = 0; i < SECTION_COUNT; i++) {
+                out.write(padding, header.offsets[i] - written);
+                out.write(reinterpret_cast<const char *>(data[i]), sizes[i]);
+                written = header.offsets[i] + sizes[i];
+            }
+            if (!out.good()) {
+                out.close();
+                std::remove(tmp_path.c_str());
+                return false;
+            }
+        }
+        std::remove(path.c_str());
+        return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static const uint64_t ALIGNMENT = 16;
+    static const uint32_t NO_TEXTURE = ~0u;
+    static const uint32_t MAX_LAYOUT_COMPS = 8;
+
+    enum
+    {
+        SECTION_VERTICES,
+        SECTION_INDICES,
+        SECTION_MESHES,
+        SECTION_MESH_REMAP,
+        SECTION_MESH_LODS,
+        SECTION_CLUSTERS,
+        SECTION_CLUSTER_OFFSETS,
+        SECTION_INSTANCES,
+        SECTION_WORLD_BOUNDS,
+        SECTION_MATERIALS,
+        SECTION_STRINGS,
+        SECTION_COUNT
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t import_hash;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint32_t flags;
+        uint32_t layout_comp_count;
+        uint32_t layout_comps[MAX_LAYOUT_COMPS];
+        uint64_t vertex_bytes;
+        uint32_t index_count;
+        uint32_t mesh_count;
+        uint32_t scene_mesh_count;
+        uint32_t lod_count;
+        uint32_t cluster_count;
+        uint32_t instance_count;
+        uint32_t material_count;
+        uint64_t string_bytes;
+        uint64_t offsets[SECTION_COUNT];
+    };
+
+    struct Cached_material
+    {
+        Material_properties props;
+        uint32_t textures[4]; // offsets into the strings
+    };
+
+    base::Mapped_file file_;
+    const Header *p_header_{nullptr};
+
+    static const char *magic_()
+    {
+        return "OCSCACHE";
+    }
+
+    // the header when the file is of this format and version and holds its sections
+    const Header *map_(const std::string &path) const
+    {
+        if (!file_.valid()) return nullptr;
+        if (file_.size() < sizeof(Header)) {
+            std::cout << MSG_PREFIX << "truncated " << path << std::endl;
+            return nullptr;
+        }
+        auto p_header = reinterpret_cast<const Header *>(file_.data());
+        if (memcmp(p_header->magic, magic_(), sizeof(p_header->magic)) != 0 ||
+            p_header->version != VERSION ||
+            p_header->layout_comp_count > MAX_LAYOUT_COMPS) {
+            std::cout << MSG_PREFIX << "unknown format or version " << path << std::endl;
+            return nullptr;
+        }
+        uint64_t sizes[SECTION_COUNT];
+        section_sizes_(*p_header, sizes);
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            if (p_header->offsets[i] % ALIGNMENT != 0 ||
+                p_header->offsets[i] + sizes[i] > file_.size()) {
+                std::cout << MSG_PREFIX << "truncated " << path << std::endl;
+                return nullptr;
+            }
+        }
+        return p_header;
+    }
+
+    static uint64_t align_(uint64_t offset)
+    {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    static void section_sizes_(const Header &header, uint64_t *sizes)
+    {
+        sizes[SECTION_VERTICES] = header.vertex_bytes;
+        sizes[SECTION_INDICES] = header.index_count * sizeof(uint32_t);
+        sizes[SECTION_MESHES] = header.mesh_count * sizeof(base::Mesh);
+        sizes[SECTION_MESH_REMAP] = header.scene_mesh_count * sizeof(uint32_t);
+        sizes[SECTION_MESH_LODS] = header.mesh_count * base::MAX_MESH_LODS * sizeof(base::Mesh_lod);
+        sizes[SECTION_CLUSTERS] = header.cluster_count * sizeof(base::Mesh_cluster);
+        sizes[SECTION_CLUSTER_OFFSETS] = (header.mesh_count + 1ull) * sizeof(uint32_t);
+        sizes[SECTION_INSTANCES] = header.instance_count * sizeof(Instance_properties);
+        sizes[SECTION_WORLD_BOUNDS] = header.instance_count * sizeof(base::Aabb);
+        sizes[SECTION_MATERIALS] = header.material_count * sizeof(Cached_material);
+        sizes[SECTION_STRINGS] = header.string_bytes;
+    }
+
+    const uint8_t *section_(int section) const
+    {
+        return file_.data() + p_header_->offsets[section];
+    }
+};
+#undef MSG_PREFIX
@@ -0,0 +1,171 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "math.hpp"
+#include "Aabb.hpp"
+#include "Instance_data.hpp"
+#include "Scene_cache.hpp"
+#include "Gltf_loader.hpp"
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// instances, bounds and materials of an imported or loaded scene, on the
+// host and without a device, shared by Model and culling_bake
+
+// import flags of the program, Model_base adds SCENE_AI_BASE_FLAGS
+const int SCENE_AI_FLAGS = aiProcess_GenNormals | aiProcess_GenUVCoords;
+const int SCENE_AI_BASE_FLAGS = aiProcess_Triangulate | aiProcess_RemoveRedundantMaterials;
+
+inline void traverse_instances(const aiNode *p_node,
+                               glm::mat4 transform,
+                               std::vector<Instance> &instances)
+{
+    transform *= base::convert_mat(p_node->mTransformation);
+    for (uint32_t i = 0; i < p_node->mNumMeshes; i++) {
+        instances.push_back({transform, p_node->mMeshes[i]});
+    }
+    for (uint32_t i = 0; i < p_node->mNumChildren; i++) {
+        traverse_instances(p_node->mChildren[i], transform, instances);
+    }
+}
+
+// the instances of a mesh are consecutive for the batched cmds,
+// scene meshes sharing their geometry draw as one mesh, every instance
+// keeps the material of its scene mesh
+inline std::vector<Instance_properties> scene_instances(const std::vector<Instance> &instances,
+                                                        const std::vector<uint32_t> &scene_mesh_materials,
+                                                        const std::vector<base::Mesh> &meshes,
+                                                        const std::vector<uint32_t> &mesh_remap)
+{
+    std::vector<Instance_properties> res;
+    res.reserve(instances.size());
+    for (auto &inst : instances) {
+        uint32_t mesh_idx = mesh_remap[inst.mesh_idx];
+        auto &mesh = meshes[mesh_idx];
+        res.push_back(make_instance_properties(inst.transform,
+                                               mesh.min,
+                                               mesh_idx,
+                                               mesh.max,
+                                               static_cast<float>(scene_mesh_materials[inst.mesh_idx])));
+    }
+    std::stable_sort(res.begin(), res.end(), [](const Instance_properties &a, const Instance_properties &b) {
+        return a.mesh_idx < b.mesh_idx;
+    });
+    return res;
+}
+
+inline std::vector<Instance_properties> scene_instances(const aiScene *p_scene,
+                                                        const std::vector<base::Mesh> &meshes,
+                                                        const std::vector<uint32_t> &mesh_remap)
+{
+    std::vector<Instance> instances;
+    traverse_instances(p_scene->mRootNode, glm::mat4(1.f), instances);
+    std::vector<uint32_t> scene_mesh_materials(p_scene->mNumMeshes);
+    for (uint32_t m = 0; m < p_scene->mNumMeshes; m++) {
+        scene_mesh_materials[m] = p_scene->mMeshes[m]->mMaterialIndex;
+    }
+    return scene_instances(instances, scene_mesh_materials, meshes, mesh_remap);
+}
+
+inline std::vector<Instance_properties> scene_instances(const base::Gltf_scene &scene,
+                                                        const std::vector<base::Mesh> &meshes,
+                                                        const std::vector<uint32_t> &mesh_remap)
+{
+    std::vector<Instance> instances;
+    instances.reserve(scene.instances.size());
+    for (auto &inst : scene.instances) {
+        instances.push_back({inst.transform, inst.mesh_idx});
+    }
+    std::vector<uint32_t> scene_mesh_materials;
+    for (auto &mesh : scene.meshes) {
+        scene_mesh_materials.push_back(mesh.material_idx);
+    }
+    return scene_instances(instances, scene_mesh_materials, meshes, mesh_remap);
+}
+
+// aabbs of the transformed mesh aabbs
+inline std::vector<base::Aabb> instance_world_bounds(const std::vector<Instance_properties> &props)
+{
+    std::vector<base::Aabb> res;
+    res.reserve(props.size());
+    for (auto &prop : props) {
+        const glm::mat4 transform = prop.get_transform();
+        glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 corner(i & 1 ? prop.max.x : prop.min.x,
+                             i & 2 ? prop.max.y : prop.min.y,
+                             i & 4 ? prop.max.z : prop.min.z,
+                             1.f);
+            glm::vec3 p(transform * corner);
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        res.emplace_back(min, max);
+    }
+    return res;
+}
+
+// material properties and texture names of the scene
+inline std::vector<Scene_material> read_materials(const aiScene *p_scene)
+{
+    const aiTextureType tex_types[4] = {
+        aiTextureType_DIFFUSE,
+        aiTextureType_OPACITY,
+        aiTextureType_SPECULAR,
+        aiTextureType_NORMALS
+    };
+    std::vector<Scene_material> res(p_scene->mNumMaterials);
+    for (size_t i = 0; i < p_scene->mNumMaterials; i++) {
+        auto p_m = p_scene->mMaterials[i];
+        Material_properties &mtl = res[i].props;
+
+        aiColor4D color;
+        p_m->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+        mtl.diffuse = {color.r, color.g, color.b};
+
+        p_m->Get(AI_MATKEY_COLOR_SPECULAR, color);
+        mtl.specular = {color.r, color.g, color.b};
+
+        p_m->Get(AI_MATKEY_COLOR_EMISSIVE, color);
+        mtl.emissive = {color.r, color.g, color.b};
+
+        p_m->Get(AI_MATKEY_OPACITY, mtl.alpha);
+        p_m->Get(AI_MATKEY_SHININESS, mtl.specular_exponent);
+
+        for (int t = 0; t < 4; t++) {
+            if (p_m->GetTextureCount(tex_types[t]) == 0) continue;
+            aiString ai_tex_filename;
+            p_m->GetTexture(tex_types[t], 0, &ai_tex_filename);
+            res[i].textures[t] = ai_tex_filename.C_Str();
+        }
+    }
+    return res;
+}
+
+// the metallic roughness materials in the blinn phong terms of the program,
+// textures are referenced by the ktx file of the same name the program loads
+inline std::vector<Scene_material> read_materials(const base::Gltf_scene &scene)
+{
+    auto ktx_name = [](const std::string &uri) {
+        if (uri.empty()) return uri;
+        auto dot = uri.find_last_of('.');
+        return (dot == std::string::npos ? uri : uri.substr(0, dot)) + ".ktx";
+    };
+    std::vector<Scene_material> res(scene.materials.size());
+    for (size_t i = 0; i < scene.materials.size(); i++) {
+        const base::Gltf_material &gltf_mtl = scene.materials[i];
+        Material_properties &mtl = res[i].props;
+        mtl.diffuse = glm::vec3(gltf_mtl.base_color);
+        mtl.alpha = gltf_mtl.opaque ? 1.f : gltf_mtl.base_color.w;
+        mtl.emissive = gltf_mtl.emissive;
+        // dielectric reflectance, the base color for metals
+        mtl.specular = glm::mix(glm::vec3(.04f), mtl.diffuse, gltf_mtl.metallic);
+        float r4 = gltf_mtl.roughness * gltf_mtl.roughness * gltf_mtl.roughness * gltf_mtl.roughness;
+        mtl.specular_exponent = glm::clamp(2.f / std::max(r4, 1e-4f) - 2.f, 1.f, 1024.f);
+        res[i].textures[0] = ktx_name(gltf_mtl.base_color_image);
+        res[i].textures[3] = ktx_name(gltf_mtl.normal_image);
+    }
+    return res;
+}
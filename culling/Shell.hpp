@@ -1,7 +1,7 @@
 #pragma once
 #include "Prog_info.hpp"
 
-class Shell : public base::Shell_base
+class Shell : public base::Shell_platform
 {
 public:
     float orbit_speed = 0.01f;
@@ -10,10 +10,12 @@ public:
 
     Shell(Prog_info* p_info,
           base::Camera* p_camera) :
-        Shell_base(p_info),
+        Shell_platform(p_info),
         p_camera_(p_camera),
         p_info_(p_info)
-    {}
+    {
+        set_max_window_size(p_info_->MAX_DEPTH_IMAGE_WIDTH, p_info_->MAX_DEPTH_IMAGE_HEIGHT);
+    }
 
     void on_key(base::Key key) override
     {
@@ -53,8 +55,26 @@ public:
                 break;
             case::base::KEY_F4:p_info_->select_mode(4);
                 break;
+            case::base::KEY_F5:p_info_->select_mode(5);
+                break;
+            case::base::KEY_F6:p_info_->select_mode(6);
+                break;
+            case::base::KEY_NUM_1:p_info_->single_pass_mipchain = !p_info_->single_pass_mipchain;
+                break;
+            case::base::KEY_NUM_2:p_info_->compact_draws = !p_info_->compact_draws;
+                break;
+            case::base::KEY_NUM_3:p_info_->temporal_occluders = !p_info_->temporal_occluders;
+                break;
+            case::base::KEY_NUM_4:p_info_->select_occluders = !p_info_->select_occluders;
+                break;
+            case::base::KEY_NUM_5:p_info_->select_lods = !p_info_->select_lods;
+                break;
+            case::base::KEY_NUM_6:p_info_->cluster_culling = !p_info_->cluster_culling;
+                break;
+            case::base::KEY_NUM_7:p_info_->triangle_culling = !p_info_->triangle_culling;
+                break;
 
-            default:base::Shell_base::on_key(key);
+            default:base::Shell_platform::on_key(key);
                 break;
         }
     }
@@ -68,10 +88,4 @@ private:
         p_info_base_->on_resize(width, height);
         p_camera_->update_aspect(width, height);
     }
-
-    void on_get_minmax_info_(LPARAM lparam) override {
-       p_minmax_info_ = reinterpret_cast<MINMAXINFO FAR *>(lparam);
-       p_minmax_info_->ptMaxTrackSize.x = p_info_->MAX_DEPTH_IMAGE_WIDTH;
-       p_minmax_info_->ptMaxTrackSize.y = p_info_->MAX_DEPTH_IMAGE_HEIGHT;
-    }
 };
@@ -2,24 +2,158 @@
 #include "Prog_info.hpp"
 #include "Shell.hpp"
 #include "Program.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+// false unless value is a whole number that fits in 32 bits
+bool parse_uint(const std::string &value, uint32_t &res)
+{
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) return false;
+    unsigned long long v = strtoull(value.c_str(), nullptr, 10);
+    if (v > UINT32_MAX) return false;
+    res = static_cast<uint32_t>(v);
+    return true;
+}
+
+bool parse_float(const std::string &value, float &res)
+{
+    char *p_end = nullptr;
+    res = strtof(value.c_str(), &p_end);
+    return !value.empty() && *p_end == '\0' && std::isfinite(res);
+}
+} // namespace
+
+// usage: culling [enable_validation] [model_filename] [options]
+//   --headless=N       render N frames offscreen along a camera path and exit
+//   --camera-path=FILE keyframes for the headless camera, see base::Camera_path
+//   --stats=FILE       write per frame pass timings as csv
+//   --mode=M           initial mode, same as F1 - F6
+//   --single-pass-mipchain  build the depth mipchain with hiz_spd.comp, same as key 1
+//   --direct-pyramid   write the depth pyramid without the staging atlas and transfer
+//   --compact-draws    draw the compacted visible commands with an indirect count, same as key 2
+//   --temporal-occluders[=N]  the depth prepass draws the instances visible in the last N frames, same as key 3
+//   --occluder-budget[=N]     the depth prepass draws the N largest instances on screen, same as key 4
+//   --occluder-rank=R  rank the occluders by screen area, the default, or world volume
+//   --no-scene-cache   import the model file without reading or writing its scene cache
+//   --no-package       ignore the package baked by culling_bake next to the model file
+//   --load-threads=N   threads packing the meshes of an imported model, all hardware threads by default
+//   --optimize-meshes  reorder the imported meshes for the vertex cache, overdraw and vertex fetch
+//   --quantize-vertices  16 bit positions and normals and half float uvs, 16 instead of 32 bytes per vertex
+//   --position-stream  the depth prepass reads a tightly packed position stream
+//   --lods[=N]         N simplified levels per imported mesh, 3 by default, picked per instance, same as key 5
+//   --lod-error=P      the largest simplification error on screen in pixels, 1 by default
+//   --cluster-culling  draw the visible clusters of the visible instances, same as key 6
+//   --triangle-culling[=N]  draw the visible triangles of the visible instances from up to N million culled indices, 16 by default, same as key 7
+//   --cpu-culling-bench  report the instances per second of the host culling at startup
 
 int main(int argc, char *argv[])
 {
+    bool headless = false;
     {
         bool enable_validation = true;
-        if (argc > 1) enable_validation = strcmp(argv[1], "false");
         std::string filename = "";
-        if (argc > 2) filename = argv[2];
-
         Prog_info prog_info{};
+
+        int positional = 0;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.compare(0, 2, "--") != 0) {
+                if (positional == 0) enable_validation = strcmp(argv[i], "false");
+                else if (positional == 1) filename = arg;
+                positional++;
+                continue;
+            }
+            auto eq = arg.find('=');
+            std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+            std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+            uint32_t u = 0;
+            float f = 0.f;
+            bool valid = true;
+            if (key == "headless") {
+                valid = value.empty() || (parse_uint(value, u) && u > 0);
+                if (valid) prog_info.set_headless(value.empty() ? 300 : u);
+            }
+            else if (key == "camera-path") prog_info.camera_path = value;
+            else if (key == "stats") prog_info.stats_path = value;
+            else if (key == "mode") {
+                valid = parse_uint(value, u) && u >= 1 && u <= Prog_info::MODE_COUNT;
+                if (valid) prog_info.select_mode(u);
+            }
+            else if (key == "single-pass-mipchain") prog_info.single_pass_mipchain = true;
+            else if (key == "direct-pyramid") prog_info.direct_depth_pyramid = true;
+            else if (key == "compact-draws") prog_info.compact_draws = true;
+            else if (key == "temporal-occluders") {
+                prog_info.temporal_occluders = true;
+                if (!value.empty()) valid = parse_uint(value, prog_info.occluder_history);
+            }
+            else if (key == "occluder-budget") {
+                prog_info.select_occluders = true;
+                if (!value.empty()) valid = parse_uint(value, prog_info.occluder_budget);
+            }
+            else if (key == "occluder-rank") {
+                valid = value == "volume" || value == "area";
+                prog_info.rank_occluders_by_volume = value == "volume";
+            }
+            else if (key == "no-scene-cache") prog_info.scene_cache = false;
+            else if (key == "no-package") prog_info.package = false;
+            else if (key == "load-threads") valid = parse_uint(value, prog_info.load_threads);
+            else if (key == "optimize-meshes") prog_info.optimize_meshes = true;
+            else if (key == "quantize-vertices") prog_info.quantize_vertices = true;
+            else if (key == "position-stream") prog_info.position_stream = true;
+            else if (key == "lods") {
+                prog_info.lod_count = 3;
+                if (!value.empty()) valid = parse_uint(value, prog_info.lod_count);
+            }
+            else if (key == "lod-error") {
+                valid = parse_float(value, f) && f >= 0.f;
+                if (valid) prog_info.lod_error = f;
+            }
+            else if (key == "cluster-culling") prog_info.cluster_culling = true;
+            else if (key == "triangle-culling") {
+                prog_info.triangle_culling = true;
+                if (!value.empty()) valid = parse_uint(value, prog_info.triangle_index_budget);
+            }
+            else if (key == "cpu-culling-bench") prog_info.cpu_culling_bench = true;
+            else std::cout << "unknown option " << arg << std::endl;
+            if (!valid) {
+                std::cout << "invalid value of " << arg << "\n"
+                    "usage: culling [enable_validation] [model_filename] [--option[=value]...]"
+                    << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
         base::Camera camera{};
-        Shell shell{&prog_info, &camera};
+        std::unique_ptr<base::Shell_base> p_shell;
+        if (prog_info.headless()) {
+            p_shell.reset(new base::Shell_null(&prog_info));
+        } else {
+            // the window shell throws without a display, e.g. when glfwInit fails
+            try {
+                p_shell.reset(new Shell(&prog_info, &camera));
+            } catch (const std::runtime_error &e) {
+                std::cout << e.what() << std::endl;
+                p_shell.reset(new base::Shell_null(&prog_info));
+            }
+        }
+        if (p_shell->headless() && !prog_info.headless()) {
+            std::cout << "no window system available, running headless" << std::endl;
+            prog_info.set_headless(300);
+        }
+        headless = prog_info.headless();
 
-        Program program{enable_validation, &prog_info, &shell, &camera, filename};
+        Program program{enable_validation, &prog_info, p_shell.get(), &camera, filename};
         program.init();
-        program.run();
+        if (headless) program.run_headless(prog_info.headless_frame_count());
+        else program.run();
+    }
+    if (!headless) {
+        printf("press any key...");
+        getchar();
     }
-    printf("press any key...");
-    getchar();
     return 0;
 }
\ No newline at end of file
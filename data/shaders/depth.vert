@@ -0,0 +1,34 @@
+#version 450 core
+
+// depth prepass reading the position stream of base::Geometries and the
+// instance transforms, same transform as simple.vert
+layout (location= 0) in vec3 pos_in;
+layout (location= 1) in uint inst_id;
+
+layout(set = 0, binding = 0) uniform UBO
+{
+    mat4 model;
+    mat4 normal;
+    mat4 view;
+    mat4 projection_clip;
+    float cam_near;
+    float cam_far;
+    vec2 resolution;
+} ubo_in;
+
+// instance streams of Model, by instance index
+layout(set = 1, binding = 2) readonly buffer Inst_transform_buffer
+{
+    mat4 inst_transforms[];
+};
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main(void)
+{
+    mat4 inst_transform = inst_transforms[inst_id];
+    gl_Position = ubo_in.projection_clip * ubo_in.view * ubo_in.model * inst_transform * vec4(pos_in, 1.f);
+}
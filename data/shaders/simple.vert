@@ -1,14 +1,16 @@
 #version 450 core
 
+// QUANTIZED reads base::VERT_COMP_POSITION_UNORM16, VERT_COMP_NORMAL_OCT16 and
+// VERT_COMP_UV_HALF, the instance transform dequantizes the positions
 layout (location= 0) in vec3 pos_in;
+#ifdef QUANTIZED
+layout (location= 1) in vec2 normal_in;
+#else
 layout (location= 1) in vec3 normal_in;
+#endif
 layout (location= 2) in vec2 uv_in;
 
-layout (location= 3) in vec4 tc0;
-layout (location= 4) in vec4 tc1;
-layout (location= 5) in vec4 tc2;
-layout (location= 6) in vec4 tc3;
-layout (location= 7) in float mtl_idx;
+layout (location= 3) in uint inst_id;
 
 layout(set = 0, binding = 0) uniform UBO
 {
@@ -21,6 +23,20 @@ layout(set = 0, binding = 0) uniform UBO
     vec2 resolution;
 } ubo_in;
 
+// instance streams of Model, by instance index
+layout(set = 1, binding = 2) readonly buffer Inst_transform_buffer
+{
+    mat4 inst_transforms[];
+};
+layout(set = 1, binding = 3) readonly buffer Inst_normal_buffer
+{
+    mat3 inst_normals[];
+};
+layout(set = 1, binding = 4) readonly buffer Inst_material_buffer
+{
+    uint inst_mtls[];
+};
+
 out gl_PerVertex
 {
     vec4 gl_Position;
@@ -30,12 +46,27 @@ layout (location = 0) out vec3 normal_out;
 layout (location = 1) out vec2 uv_out;
 layout (location = 2) out int mtl_idx_out;
 
+#ifdef QUANTIZED
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+#endif
+
 void main(void)
 {
-    mat4 inst_transform = mat4(tc0, tc1, tc2, tc3);
-    mat4 inst_normal = transpose(inverse(inst_transform));
+#ifdef QUANTIZED
+    vec3 normal = oct_decode(normal_in);
+#else
+    vec3 normal = normal_in;
+#endif
+    mat4 inst_transform = inst_transforms[inst_id];
     gl_Position = ubo_in.projection_clip * ubo_in.view * ubo_in.model * inst_transform * vec4(pos_in, 1.f);
-    normal_out = normalize((ubo_in.normal * inst_normal * vec4(normal_in, 1.f)).xyz);
+    normal_out = normalize(mat3(ubo_in.normal) * (inst_normals[inst_id] * normal));
     uv_out = uv_in;
-    mtl_idx_out = int(mtl_idx);
+    mtl_idx_out = int(inst_mtls[inst_id]);
 }
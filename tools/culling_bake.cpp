@@ -0,0 +1,150 @@
+#include "Scene_import.hpp"
+#include "Timer.hpp"
+#include <assimp/Importer.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// bakes a model file, imported with assimp, or a glTF file into the package
+// the program loads in place of the import, see Scene_cache, the packed
+// vertices, the reordered indices, the shared meshes, the instances with
+// their world aabbs and the materials, without a device
+// usage: culling_bake model_file [--float-vertices] [--no-optimize] [--lods=N] [--load-threads=N] [--out=path]
+//   --float-vertices  32 bit float vertices, quantized by default
+//   --no-optimize     keep the imported triangle and vertex orders
+//   --lods=N          simplified levels per mesh, 0 - 3, 3 by default
+//   --load-threads=N  threads packing the meshes, all hardware threads by default
+//   --out=path        model_file.pkg by default, the program reads it next to the model file
+
+int main(int argc, char *argv[])
+{
+    std::string model_path, out_path;
+    bool quantize = true;
+    bool optimize = true;
+    uint32_t lod_count = base::MAX_MESH_LODS - 1;
+    uint32_t load_threads = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            model_path = arg;
+            continue;
+        }
+        auto eq = arg.find('=');
+        std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "float-vertices") quantize = false;
+        else if (key == "no-optimize") optimize = false;
+        else if (key == "lods") lod_count = std::min<uint32_t>(std::stoul(value), base::MAX_MESH_LODS - 1);
+        else if (key == "load-threads") load_threads = std::stoul(value);
+        else if (key == "out") out_path = value;
+        else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    if (model_path.empty()) {
+        fprintf(stderr, "usage: culling_bake model_file [--float-vertices] [--no-optimize] [--lods=N] [--load-threads=N] [--out=path]\n");
+        return EXIT_FAILURE;
+    }
+    if (out_path.empty()) out_path = Scene_cache::package_path_of(model_path);
+
+    // the layouts of Program::init_model_
+    base::Vertex_layout layout(quantize ?
+                               std::vector<base::Vertex_component>{base::VERT_COMP_POSITION_UNORM16,
+                                                                   base::VERT_COMP_NORMAL_OCT16,
+                                                                   base::VERT_COMP_UV_HALF} :
+                               std::vector<base::Vertex_component>{base::VERT_COMP_POSITION,
+                                                                   base::VERT_COMP_NORMAL,
+                                                                   base::VERT_COMP_UV});
+
+    base::Timer timer;
+    base::Job_system jobs(load_threads);
+    base::Packed_meshes packed;
+    std::vector<Instance_properties> props;
+    std::vector<Scene_material> materials;
+    uint32_t scene_mesh_count;
+    double import_time, pack_time;
+    if (base::Gltf_scene::is_gltf_path(model_path)) {
+        base::Gltf_scene scene;
+        if (!scene.load(model_path, &jobs)) {
+            fprintf(stderr, "cannot load %s: %s\n", model_path.c_str(), scene.error.c_str());
+            return EXIT_FAILURE;
+        }
+        import_time = timer.get();
+        base::pack_meshes(scene.mesh_sources(), layout, optimize, lod_count, &jobs, packed);
+        pack_time = timer.get();
+        props = scene_instances(scene, packed.meshes, packed.mesh_remap);
+        materials = read_materials(scene);
+        scene_mesh_count = static_cast<uint32_t>(scene.meshes.size());
+    } else {
+        Assimp::Importer importer;
+        const aiScene *p_scene = importer.ReadFile(model_path.c_str(), SCENE_AI_BASE_FLAGS | SCENE_AI_FLAGS);
+        if (!p_scene) {
+            fprintf(stderr, "cannot import %s: %s\n", model_path.c_str(), importer.GetErrorString());
+            return EXIT_FAILURE;
+        }
+        import_time = timer.get();
+        base::pack_meshes(p_scene, layout, optimize, lod_count, &jobs, packed);
+        pack_time = timer.get();
+        props = scene_instances(p_scene, packed.meshes, packed.mesh_remap);
+        materials = read_materials(p_scene);
+        scene_mesh_count = p_scene->mNumMeshes;
+    }
+    std::vector<base::Aabb> world_bounds = instance_world_bounds(props);
+    double instances_time = timer.get();
+
+    uint32_t flags = Scene_cache::FLAG_PACKAGE | (optimize ? Scene_cache::FLAG_OPTIMIZED_MESHES : 0);
+    if (!Scene_cache::write(out_path,
+                            Scene_cache_key("", layout, SCENE_AI_FLAGS, optimize, lod_count),
+                            layout,
+                            flags,
+                            packed.vertices,
+                            packed.indices,
+                            packed.meshes,
+                            packed.mesh_remap,
+                            packed.lods,
+                            lod_count,
+                            packed.clusters,
+                            packed.cluster_offsets,
+                            props,
+                            world_bounds,
+                            materials)) {
+        fprintf(stderr, "cannot write %s\n", out_path.c_str());
+        return EXIT_FAILURE;
+    }
+    double write_time = timer.get();
+
+    // misses per triangle over all meshes
+    double misses_before = 0., misses_after = 0., tri_count = 0.;
+    for (auto &stats : packed.cache_stats) {
+        misses_before += stats.before.misses;
+        misses_after += stats.after.misses;
+        tri_count += stats.after.tri_count;
+    }
+    // triangles of every level over all meshes
+    size_t lod_tri_counts[base::MAX_MESH_LODS] = {};
+    for (size_t i = 0; i < packed.lods.size(); i++) {
+        lod_tri_counts[i % base::MAX_MESH_LODS] += packed.lods[i].idx_count / 3;
+    }
+    printf("%s -> %s\n", model_path.c_str(), out_path.c_str());
+    printf("%-22s %s, %u bytes per vertex\n", "vertices", quantize ? "quantized" : "float", layout.get_stride());
+    printf("%-22s %10zu\n", "vertex count", packed.vertices.size() * sizeof(float) / layout.get_stride());
+    printf("%-22s %10zu\n", "triangle count", lod_tri_counts[0]);
+    for (uint32_t level = 1; level <= lod_count; level++) {
+        printf("lod %-18u %10zu\n", level, lod_tri_counts[level]);
+    }
+    printf("%-22s %10zu of %u\n", "unique meshes", packed.meshes.size(), scene_mesh_count);
+    printf("%-22s %10zu\n", "clusters", packed.clusters.size());
+    printf("%-22s %10zu\n", "instances", props.size());
+    printf("%-22s %10zu\n", "materials", materials.size());
+    if (tri_count > 0.) {
+        printf("%-22s %10.3f -> %.3f\n", "acmr", misses_before / tri_count, misses_after / tri_count);
+    }
+    printf("%-22s %10.1f ms\n", "import", import_time * 1000.);
+    printf("%-22s %10.1f ms, %u threads\n", "pack", (pack_time - import_time) * 1000., jobs.thread_count());
+    printf("%-22s %10.1f ms\n", "instances", (instances_time - pack_time) * 1000.);
+    printf("%-22s %10.1f ms\n", "write", (write_time - instances_time) * 1000.);
+    return EXIT_SUCCESS;
+}